@@ -2,7 +2,7 @@ export class BleDataTransfer {
     // Constants for binary record sizes
     static MAC_ADDR_SIZE = 6;
     static SSID_SIZE = 32;
-    static TYPE_SIZE = 16;
+    static TYPE_SIZE = 1;
     static NAME_SIZE = 32;
     static TIMESTAMP_SIZE = 8;
     static COUNTER_SIZE = 4;
@@ -10,6 +10,9 @@ export class BleDataTransfer {
     static CHANNEL_SIZE = 1;
     static IS_PUBLIC_SIZE = 1;
 
+    // FrameKind values sent by the firmware in WiFi network records
+    static FRAME_KINDS = ['probe', 'beacon', 'assoc', 'control', 'data', 'other'];
+
     static WIFI_NETWORK_RECORD_SIZE = this.MAC_ADDR_SIZE + this.SSID_SIZE + this.RSSI_SIZE + 
                                     this.CHANNEL_SIZE + this.TYPE_SIZE + this.TIMESTAMP_SIZE + 
                                     this.COUNTER_SIZE;
@@ -18,6 +21,12 @@ export class BleDataTransfer {
     static BLE_DEVICE_RECORD_SIZE = this.MAC_ADDR_SIZE + this.NAME_SIZE + this.RSSI_SIZE + 
                                    this.TIMESTAMP_SIZE + this.IS_PUBLIC_SIZE + this.COUNTER_SIZE;
 
+    // RSSI series records ('rssi_list'), RSSI_RING_SAMPLES of the firmware
+    static RSSI_RING_SAMPLES = 16;
+    static RSSI_KINDS = ['wifi_device', 'ble_device', 'wifi_network'];
+    static RSSI_RECORD_SIZE = 1 + this.MAC_ADDR_SIZE + 4 + 2 + 3 * this.RSSI_SIZE + this.COUNTER_SIZE + 1 +
+                             this.RSSI_RING_SAMPLES * 2;
+
     constructor(bleCore) {
         this.core = bleCore;
         this.dataTransferCallback = null;
@@ -166,7 +175,7 @@ export class BleDataTransfer {
             const channel = BleDataTransfer.readUint8(dataView, offset);
             offset += BleDataTransfer.CHANNEL_SIZE;
 
-            const type = BleDataTransfer.readFixedString(dataView, offset, BleDataTransfer.TYPE_SIZE);
+            const type = BleDataTransfer.FRAME_KINDS[BleDataTransfer.readUint8(dataView, offset)] || 'other';
             offset += BleDataTransfer.TYPE_SIZE;
 
             const lastSeen = BleDataTransfer.readUint64(dataView, offset);
@@ -263,6 +272,52 @@ export class BleDataTransfer {
         return { ble_devices: devices, timestamp: this.transferTimestamp };
     }
 
+    parseBinaryRssiSeries(binaryData) {
+        const series = [];
+        const dataView = new DataView(binaryData.buffer);
+        let offset = 0;
+
+        while (offset + BleDataTransfer.RSSI_RECORD_SIZE <= binaryData.length) {
+            const kind = BleDataTransfer.RSSI_KINDS[BleDataTransfer.readUint8(dataView, offset)] || 'unknown';
+            const mac = BleDataTransfer.readMacAddress(dataView, offset + 1);
+            const ssidHash = BleDataTransfer.readUint32(dataView, offset + 7);
+            const ewma = dataView.getInt16(offset + 11, false) / 256;
+            const last = BleDataTransfer.readInt8(dataView, offset + 13);
+            const min = BleDataTransfer.readInt8(dataView, offset + 14);
+            const max = BleDataTransfer.readInt8(dataView, offset + 15);
+            const ageMs = BleDataTransfer.readUint32(dataView, offset + 16);
+            const count = BleDataTransfer.readUint8(dataView, offset + 20);
+
+            // Samples carry the seconds since the previous one, rebuild their age from the newest
+            const samples = [];
+            let age = ageMs / 1000;
+            for (let i = count - 1; i >= 0; i--) {
+                const sampleOffset = offset + 21 + i * 2;
+                samples.unshift({ age, rssi: BleDataTransfer.readInt8(dataView, sampleOffset + 1) });
+                age += BleDataTransfer.readUint8(dataView, sampleOffset);
+            }
+
+            series.push({ kind, mac, ssid_hash: ssidHash, ewma, last, min, max, samples });
+            offset += BleDataTransfer.RSSI_RECORD_SIZE;
+        }
+
+        return { rssi_series: series, timestamp: this.transferTimestamp };
+    }
+
+    async requestRssiSeries() {
+        try {
+            console.log('📥 Requesting RSSI series...');
+            const dataPromise = this.receivePackets();
+            await this.core.characteristics.dataTransfer.writeValue(
+                new TextEncoder().encode('rssi_list')
+            );
+            const data = await dataPromise;
+            return this.parseBinaryRssiSeries(data);
+        } catch (error) {
+            throw new Error(`Error requesting RSSI series: ${error.message}`);
+        }
+    }
+
     async requestWifiNetworks() {
         try {
             console.log('📥 Requesting WiFi networks...');
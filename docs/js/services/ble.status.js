@@ -9,7 +9,7 @@ export class BleStatus {
         return this.core.queue.enqueue(async () => {
             try {
                 const value = await this.core.characteristics.deviceStatus.readValue();
-                return this.parseDeviceStatus(new TextDecoder().decode(value));
+                return this.parseDeviceStatus(value);
             } catch (error) {
                 throw new Error(`Error reading status: ${error.message}`);
             }
@@ -25,13 +25,31 @@ export class BleStatus {
     }
 
     handleStatusNotification(event) {
-        const value = event.target.value;
-        const decoder = new TextDecoder();
-        const status = this.parseDeviceStatus(decoder.decode(value));
+        const status = this.parseDeviceStatus(event.target.value);
         this.core.dispatchEvent('device-status-update', { status });
     }
 
-    parseDeviceStatus(statusString) {
+    parseDeviceStatus(value) {
+        // Binary status (version 2), older firmware sends colon separated text
+        if (value.byteLength >= 40 && value.getUint8(0) === 2) {
+            return {
+                generation: value.getUint32(4, true),
+                uptime: value.getUint32(8, true),
+                freeHeap: value.getUint32(12, true),
+                wifiNetworks: value.getUint16(16, true),
+                wifiDevices: value.getUint16(18, true),
+                bleDevices: value.getUint16(20, true),
+                wifiDetectedNetworks: value.getUint16(22, true),
+                wifiDetectedDevices: value.getUint16(24, true),
+                bleDetectedDevices: value.getUint16(26, true),
+                alarm: (value.getUint8(1) & 0x01) !== 0,
+                frames: value.getUint32(28, true),
+                fcsFailures: value.getUint32(32, true),
+                queueDropped: value.getUint32(36, true)
+            };
+        }
+
+        const statusString = new TextDecoder().decode(value);
         console.log('📊 Parsing device status:', statusString);
         const parts = statusString.split(':');
         return { 
@@ -0,0 +1,131 @@
+"""
+Generates src/OuiTable.generated.h from an IEEE MA-L style CSV
+(Registry,Assignment,Organization Name,...).
+
+scripts/oui_vendors.csv holds the vendors shipped by default. The full IEEE
+registry (https://standards-oui.ieee.org/oui/oui.csv) can be used instead:
+
+    python scripts/generate_oui_table.py path/to/oui.csv
+
+As a PlatformIO pre script it regenerates the header when the default CSV is
+newer than it.
+"""
+import csv
+import os
+import re
+import sys
+
+SUFFIXES = re.compile(
+    r"[\s,.]+(inc|incorporated|corp|corporation|corporate|co|ltd|limited|llc|gmbh|ag|sa|bv|plc|"
+    r"co\.?,?\s*ltd|company)\.?$", re.IGNORECASE)
+MAX_NAME = 31
+
+
+def vendor_name(organization):
+    """Display name: organization without legal suffixes, at most MAX_NAME chars."""
+    name = " ".join(organization.split())
+    while True:
+        shorter = SUFFIXES.sub("", name).strip(" ,.")
+        if shorter == name or not shorter:
+            break
+        name = shorter
+    return name[:MAX_NAME].strip()
+
+
+def read_registry(path):
+    table = {}
+    with open(path, newline="", encoding="utf-8") as source:
+        for row in csv.DictReader(source):
+            assignment = row.get("Assignment", "").strip().upper()
+            name = vendor_name(row.get("Organization Name", ""))
+            if len(assignment) != 6 or not name:
+                continue
+            prefix = int(assignment, 16)
+            if (prefix >> 16) & 0x03:
+                continue  # Multicast or locally administered, never a vendor prefix
+            table[prefix] = name
+    return table
+
+
+def eytzinger(values):
+    """Reorders a sorted list into the breadth-first layout of a complete binary search tree."""
+    result = [None] * len(values)
+    position = iter(values)
+
+    def fill(k):
+        if k <= len(values):
+            fill(2 * k)
+            result[k - 1] = next(position)
+            fill(2 * k + 1)
+
+    fill(1)
+    return result
+
+
+def c_string(text):
+    return '"' + text.replace("\\", "\\\\").replace('"', '\\"') + '\\0"'
+
+
+def render(table, source_name):
+    names = sorted(set(table.values()), key=lambda name: (name.lower(), name))
+    ids = {name: index + 1 for index, name in enumerate(names)}
+    offsets = [0]
+    pool = [c_string("")]
+    size = 1
+    for name in names:
+        offsets.append(size)
+        pool.append(c_string(name))
+        size += len(name.encode("utf-8")) + 1
+    entries = eytzinger(sorted(table.items()))
+
+    lines = [
+        "// Generated by scripts/generate_oui_table.py from %s, do not edit" % source_name,
+        "#pragma once",
+        "",
+        "#include <stdint.h>",
+        "",
+        "#define OUI_TABLE_VENDORS %d" % len(names),
+        "#define OUI_TABLE_SIZE %d" % len(entries),
+        "",
+        "// Vendor names, id 0 is the empty name of unknown vendors",
+        "static constexpr char OUI_VENDOR_NAMES[] =",
+    ]
+    lines += ["  %s" % text for text in pool[:-1]]
+    lines.append("  %s;" % pool[-1])
+    lines += ["", "static constexpr uint32_t OUI_VENDOR_OFFSETS[OUI_TABLE_VENDORS + 1] = {"]
+    lines += wrap(["%d" % offset for offset in offsets])
+    lines += ["};", "", "// 24-bit prefixes in Eytzinger order, entry k - 1 is node k of the search tree",
+              "static constexpr uint32_t OUI_TABLE_PREFIXES[OUI_TABLE_SIZE] = {"]
+    lines += wrap(["0x%06X" % prefix for prefix, _ in entries])
+    lines += ["};", "", "static constexpr uint16_t OUI_TABLE_VENDOR_IDS[OUI_TABLE_SIZE] = {"]
+    lines += wrap(["%d" % ids[name] for _, name in entries])
+    lines += ["};", ""]
+    return "\n".join(lines)
+
+
+def wrap(items, width=10):
+    return ["  " + ", ".join(items[i:i + width]) + "," for i in range(0, len(items), width)]
+
+
+def generate(project_dir, source=None, force=False):
+    source = source or os.path.join(project_dir, "scripts", "oui_vendors.csv")
+    target = os.path.join(project_dir, "src", "OuiTable.generated.h")
+    if not force and os.path.exists(target) and os.path.getmtime(target) >= os.path.getmtime(source):
+        return
+    content = render(read_registry(source), os.path.basename(source))
+    if os.path.exists(target):
+        with open(target, encoding="utf-8") as current:
+            if current.read() == content:
+                return
+    with open(target, "w", encoding="utf-8") as output:
+        output.write(content)
+    print("Generated %s" % target)
+
+
+try:
+    Import("env")  # noqa: F821 - defined when run by PlatformIO
+    generate(env.subst("$PROJECT_DIR"))  # noqa: F821
+except NameError:
+    if __name__ == "__main__":
+        generate(os.path.dirname(os.path.dirname(os.path.abspath(__file__))),
+                 sys.argv[1] if len(sys.argv) > 1 else None, force=True)
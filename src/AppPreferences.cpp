@@ -1,4 +1,5 @@
 #include "AppPreferences.h"
+#include "Console.h"
 #include <Arduino.h>
 
 // For TX Power Default Values
@@ -18,30 +19,32 @@ void printPreferences() {
         case 2: operationModeName = "DETECTION"; break;
     }
 
-    Serial.printf(" - device_name: %s\n", appPrefs.device_name);
-    Serial.printf(" - operation_mode: %s\n", operationModeName.c_str());
-    Serial.printf(" - autosave_interval: %u min\n", appPrefs.autosave_interval);
-    Serial.printf(" - minimal_rssi: %d dBm\n", appPrefs.minimal_rssi);
-    Serial.printf(" - passive_scan: %s\n", appPrefs.passive_scan ? "true" : "false");
-    Serial.printf(" - stealth_mode: %s\n", appPrefs.stealth_mode ? "true" : "false");
-    Serial.printf(" - authorized_address: %s\n", appPrefs.authorized_address);
-    Serial.printf(" - cpu_speed: %u\n", appPrefs.cpu_speed);
-    Serial.printf(" - led_mode: %u\n", appPrefs.led_mode);
-
-    Serial.printf(" - wifi_channel_dwell_time: %u ms\n", appPrefs.wifi_channel_dwell_time);
-    Serial.printf(" - only_mgmt: %s\n", appPrefs.only_management_frames ? "true" : "false");
-    Serial.printf(" - wifi_tx_power: %u\n", appPrefs.wifiTxPower);
-    Serial.printf(" - ignore_local_wifi_addresses: %s\n", appPrefs.ignore_local_wifi_addresses ? "true" : "false");
-
-    Serial.printf(" - ble_tx_power: %u\n", appPrefs.bleTxPower);
-    Serial.printf(" - ble_scan_delay: %u s\n", appPrefs.ble_scan_delay);
-    Serial.printf(" - ble_scan_duration: %u s\n", appPrefs.ble_scan_duration);
-    Serial.printf(" - ignore_random_ble: %s\n", appPrefs.ignore_random_ble_addresses ? "true" : "false");
-    Serial.printf(" - ble_mtu: %u\n", appPrefs.bleMTU);
+    Console.printf(" - device_name: %s\n", appPrefs.device_name);
+    Console.printf(" - operation_mode: %s\n", operationModeName.c_str());
+    Console.printf(" - autosave_interval: %u min\n", appPrefs.autosave_interval);
+    Console.printf(" - minimal_rssi: %d dBm\n", appPrefs.minimal_rssi);
+    Console.printf(" - passive_scan: %s\n", appPrefs.passive_scan ? "true" : "false");
+    Console.printf(" - stealth_mode: %s\n", appPrefs.stealth_mode ? "true" : "false");
+    Console.printf(" - authorized_address: %s\n", appPrefs.authorized_address);
+    Console.printf(" - cpu_speed: %u\n", appPrefs.cpu_speed);
+    Console.printf(" - led_mode: %u\n", appPrefs.led_mode);
+
+    Console.printf(" - wifi_channel_dwell_time: %u ms\n", appPrefs.wifi_channel_dwell_time);
+    Console.printf(" - only_mgmt: %s\n", appPrefs.only_management_frames ? "true" : "false");
+    Console.printf(" - wifi_tx_power: %u\n", appPrefs.wifiTxPower);
+    Console.printf(" - ignore_local_wifi_addresses: %s\n", appPrefs.ignore_local_wifi_addresses ? "true" : "false");
+
+    Console.printf(" - ble_tx_power: %u\n", appPrefs.bleTxPower);
+    Console.printf(" - ble_scan_delay: %u s\n", appPrefs.ble_scan_delay);
+    Console.printf(" - ble_scan_duration: %u s\n", appPrefs.ble_scan_duration);
+    Console.printf(" - ignore_random_ble: %s\n", appPrefs.ignore_random_ble_addresses ? "true" : "false");
+    Console.printf(" - ble_mtu: %u\n", appPrefs.bleMTU);
+    Console.printf(" - watch_vendors: %s\n", appPrefs.watch_vendors);
+    Console.printf(" - detect_rssi: %d dBm\n", appPrefs.detect_rssi);
 }
 
 void loadAppPreferences() {
-    Serial.println("Loading App Preferences");
+    Console.println("Loading App Preferences");
     preferences.begin(Keys::NAMESPACE, false);
 
     // Generate default device name
@@ -84,15 +87,21 @@ void loadAppPreferences() {
     appPrefs.bleTxPower = preferences.getInt(Keys::BLE_TX_POWER, ESP_PWR_LVL_P9);
 
     appPrefs.bleMTU = preferences.getUInt(Keys::BLE_MTU, 256);
+
+    String watchVendors = preferences.getString(Keys::WATCH_VENDORS, "");
+    strncpy(appPrefs.watch_vendors, watchVendors.c_str(), sizeof(appPrefs.watch_vendors) - 1);
+    appPrefs.watch_vendors[sizeof(appPrefs.watch_vendors) - 1] = '\0';
+
+    appPrefs.detect_rssi = preferences.getInt(Keys::DETECT_RSSI, -85);
     
     preferences.end();
 
-    Serial.println("App Preferences loaded");
+    Console.println("App Preferences loaded");
     printPreferences();
 }
 
 void saveAppPreferences() {
-    Serial.println("Saving App Preferences");
+    Console.println("Saving App Preferences");
     preferences.begin(Keys::NAMESPACE, false);
     preferences.putString(Keys::DEVICE_NAME, appPrefs.device_name);
     preferences.putInt(Keys::OP_MODE, appPrefs.operation_mode);
@@ -112,8 +121,10 @@ void saveAppPreferences() {
     preferences.putInt(Keys::WIFI_TX_POWER, appPrefs.wifiTxPower);
     preferences.putInt(Keys::BLE_TX_POWER, appPrefs.bleTxPower);
     preferences.putUInt(Keys::BLE_MTU, appPrefs.bleMTU);
+    preferences.putString(Keys::WATCH_VENDORS, appPrefs.watch_vendors);
+    preferences.putInt(Keys::DETECT_RSSI, appPrefs.detect_rssi);
     preferences.end();
 
-    Serial.println("App Preferences saved");
+    Console.println("App Preferences saved");
     printPreferences();
 }
@@ -31,6 +31,10 @@ struct AppPreferencesData {
     uint8_t led_mode;
 
     uint16_t bleMTU;
+
+    // Detection
+    char watch_vendors[64];            // Comma separated OUI vendor names detected like watched devices
+    int8_t detect_rssi;                // Watched devices are detected once their recent signal (EWMA) reaches it
 };
 
 const int8_t OPERATION_MODE_OFF = 0;
@@ -58,6 +62,8 @@ namespace Keys {
     const char* const WIFI_TX_POWER = "wifi_tx_power";
     const char* const BLE_TX_POWER = "ble_tx_power";
     const char* const BLE_MTU = "ble_mtu";
+    const char* const WATCH_VENDORS = "watch_vendors";
+    const char* const DETECT_RSSI = "detect_rssi";
 }
 
 // Declaraciones de funciones
@@ -8,8 +8,9 @@
 #include "BLE.h"
 #include "WifiDeviceList.h"
 #include "WifiNetworkList.h"
+#include "BLEDeviceList.h"
 #include "AppPreferences.h"
-#include "MACAddress.h"
+#include "MacAddress.h"
 #include "WifiScan.h"
 #include "WifiDetect.h"
 #include "BLEScan.h"
@@ -25,6 +26,7 @@
 #include "FirmwareInfo.h"
 
 #include "BLEStatusUpdater.h"
+#include "Console.h"
 
 // External variables
 extern BLEDeviceList bleDeviceList;
@@ -63,47 +65,47 @@ public:
             if (!savedAddress.isEmpty())
             {
                 authorizedClientAddress = new BLEAddress(savedAddress.c_str());
-                Serial.printf("Loaded authorized address in MySecurity: %s\n", savedAddress.c_str());
+                Console.printf("Loaded authorized address in MySecurity: %s\n", savedAddress.c_str());
             }
             else
             {
-                Serial.println("No authorized address found in preferences");
+                Console.println("No authorized address found in preferences");
             }
             preferences.end();
         }
         else
         {
-            Serial.println("Failed to open preferences namespace in MySecurity");
+            Console.println("Failed to open preferences namespace in MySecurity");
         }
     }
 
     uint32_t onPassKeyRequest() override
     {
-        Serial.println("Passkey Request");
+        Console.println("Passkey Request");
         // Generar una passkey aleatoria de 6 dígitos
         uint32_t passKey = random(100000, 999999);
-        Serial.print("Generated Passkey: ");
-        Serial.println(passKey);
+        Console.print("Generated Passkey: ");
+        Console.println(passKey);
         return passKey;
     }
 
     void onPassKeyNotify(uint32_t pass_key) override
     {
-        Serial.print("Passkey to be entered: ");
-        Serial.println(pass_key);
+        Console.print("Passkey to be entered: ");
+        Console.println(pass_key);
     }
 
     bool onConfirmPIN(uint32_t pass_key) override
     {
-        Serial.print("Confirm Passkey: ");
-        Serial.println(pass_key);
+        Console.print("Confirm Passkey: ");
+        Console.println(pass_key);
         // Considera implementar una forma más robusta de confirmación
         return true;
     }
 
     bool onSecurityRequest() override
     {
-        Serial.println("Security Request Received");
+        Console.println("Security Request Received");
         return true;
     }
 
@@ -111,9 +113,9 @@ public:
     {
         if (auth_cmpl.success)
         {
-            Serial.println("Pairing Successful");
+            Console.println("Pairing Successful");
             BLEAddress clientAddress = BLEAddress(auth_cmpl.bd_addr);
-            Serial.printf("Paired Client MAC: %s\n", clientAddress.toString().c_str());
+            Console.printf("Paired Client MAC: %s\n", clientAddress.toString().c_str());
 
             strncpy(appPrefs.authorized_address, clientAddress.toString().c_str(), sizeof(appPrefs.authorized_address));
 
@@ -123,17 +125,17 @@ public:
             { // Modo lectura y escritura
                 if (preferences.putString(PREF_AUTH_KEY, clientAddress.toString().c_str()))
                 {
-                    Serial.println("Authorized address saved successfully");
+                    Console.println("Authorized address saved successfully");
                 }
                 else
                 {
-                    Serial.println("Failed to save authorized address");
+                    Console.println("Failed to save authorized address");
                 }
                 preferences.end();
             }
             else
             {
-                Serial.println("Failed to open preferences namespace in onAuthenticationComplete");
+                Console.println("Failed to open preferences namespace in onAuthenticationComplete");
             }
 
             // Actualizar la dirección autorizada en memoria
@@ -147,8 +149,8 @@ public:
         }
         else
         {
-            Serial.println("Pairing Failed");
-            Serial.printf("Failure Reason: %d\n", auth_cmpl.fail_reason);
+            Console.println("Pairing Failed");
+            Console.printf("Failure Reason: %d\n", auth_cmpl.fail_reason);
         }
     }
 };
@@ -158,7 +160,7 @@ class MyServerCallbacks : public BLEServerCallbacks
     void onConnect(BLEServer *pServer) override
     {
         deviceConnected = true;
-        Serial.println("Device connected");
+        Console.println("Device connected");
 
         // Asegurarse de que authorizedClientAddress está cargado
         if (authorizedClientAddress == nullptr)
@@ -170,69 +172,69 @@ class MyServerCallbacks : public BLEServerCallbacks
                 if (!savedAddress.isEmpty())
                 {
                     authorizedClientAddress = new BLEAddress(savedAddress.c_str());
-                    Serial.printf("Loaded authorized address: %s\n", savedAddress.c_str());
+                    Console.printf("Loaded authorized address: %s\n", savedAddress.c_str());
                 }
                 else
                 {
-                    Serial.println("No authorized address found in preferences");
+                    Console.println("No authorized address found in preferences");
                 }
                 preferences.end();
             }
             else
             {
-                Serial.println("Failed to open preferences namespace in onConnect");
+                Console.println("Failed to open preferences namespace in onConnect");
             }
         }
 
         try
         {
             auto peerDevices = pServer->getPeerDevices(true);
-            Serial.printf("Number of peer devices: %d\n", peerDevices.size());
+            Console.printf("Number of peer devices: %d\n", peerDevices.size());
 
             for (auto &peerDevice : peerDevices)
             {
                 uint16_t id = peerDevice.first;
                 conn_status_t status = peerDevice.second;
-                Serial.printf("Peer device ID: %d, Connected: %d\n", id, status.connected);
+                Console.printf("Peer device ID: %d, Connected: %d\n", id, status.connected);
 
                 if (status.peer_device != nullptr)
                 {
                     BLEClient *client = (BLEClient *)status.peer_device;
                     BLEAddress clientAddress = client->getPeerAddress();
-                    Serial.printf("Connected client address: %s\n", clientAddress.toString().c_str());
+                    Console.printf("Connected client address: %s\n", clientAddress.toString().c_str());
 
                     // Verificar si el dispositivo está autorizado
                     if (authorizedClientAddress != nullptr && *authorizedClientAddress == clientAddress)
                     {
-                        Serial.println("Authorized client reconnected - skipping security");
+                        Console.println("Authorized client reconnected - skipping security");
                         // No iniciar emparejamiento
                         return;
                     }
 
-                    Serial.println("New client connected. Pairing will be handled by the BLE stack.");
+                    Console.println("New client connected. Pairing will be handled by the BLE stack.");
                     // La pila BLE manejará el emparejamiento automáticamente
                 }
                 else
                 {
-                    Serial.println("Failed to get valid client address");
+                    Console.println("Failed to get valid client address");
                 }
             }
         }
 
         catch (std::exception &e)
         {
-            Serial.printf("Exception in onConnect: %s\n", e.what());
+            Console.printf("Exception in onConnect: %s\n", e.what());
         }
         catch (...)
         {
-            Serial.println("Unknown exception in onConnect");
+            Console.println("Unknown exception in onConnect");
         }
     }
 
     void onDisconnect(BLEServer *pServer) override
     {
         deviceConnected = false;
-        Serial.println("Device disconnected");
+        Console.println("Device disconnected");
 
         // Reiniciar el Advertising
         BLEAdvertisingManager::start();
@@ -243,14 +245,23 @@ class ListSizesCallbacks : public BLECharacteristicCallbacks
 {
     void onRead(BLECharacteristic *pCharacteristic) override
     {
-        BLEStatusUpdater.update();
+        BLEStatusUpdater.refresh();
+    }
+};
+
+class CaptureStatsCallbacks : public BLECharacteristicCallbacks
+{
+    void onRead(BLECharacteristic *pCharacteristic) override
+    {
+        CaptureStatsSnapshot stats = WifiScanner.getCaptureStats().snapshot();
+        pCharacteristic->setValue((uint8_t *)&stats, sizeof(stats));
     }
 };
 
 // Implementación de funciones
 void setupBLE()
 {
-    Serial.println("Initializing BLE");
+    Console.println("Initializing BLE");
     BLEDevice::init(appPrefs.device_name);
 
     BLEDevice::setEncryptionLevel(ESP_BLE_SEC_ENCRYPT);
@@ -289,8 +300,8 @@ void setupBLE()
     pSecurity->setCapability(ESP_IO_CAP_NONE);
     pSecurity->setInitEncryptionKey(ESP_BLE_ENC_KEY_MASK | ESP_BLE_ID_KEY_MASK);
 
-    Serial.println("Creating Scanner BLE service and characteristics");
-    BLEService *pScannerService = pServer->createService(SNEAK32_SERVICE_UUID);
+    Console.println("Creating Scanner BLE service and characteristics");
+    BLEService *pScannerService = pServer->createService(BLEUUID(SNEAK32_SERVICE_UUID), SNEAK32_SERVICE_HANDLES);
 
     pStatusCharacteristic = pScannerService->createCharacteristic(
         BLEUUID((uint16_t)STATUS_UUID),
@@ -323,14 +334,19 @@ void setupBLE()
         BLECharacteristic::PROPERTY_READ);
     pFirmwareInfoCharacteristic->setValue(getFirmwareInfoString().c_str());
 
-    Serial.println("Starting BLE service");
+    BLECharacteristic *pCaptureStatsCharacteristic = pScannerService->createCharacteristic(
+        BLEUUID((uint16_t)CAPTURE_STATS_UUID),
+        BLECharacteristic::PROPERTY_READ);
+    pCaptureStatsCharacteristic->setCallbacks(new CaptureStatsCallbacks());
+
+    Console.println("Starting BLE service");
     pScannerService->start();
 
-    Serial.println("Configuring BLE advertising");
+    Console.println("Configuring BLE advertising");
     BLEAdvertisingManager::setup();
 
-    Serial.println("Starting BLE advertising");
+    Console.println("Starting BLE advertising");
     BLEAdvertisingManager::start();
 
-    Serial.println("BLE Initialized");
+    Console.println("BLE Initialized");
 }
@@ -15,6 +15,10 @@
 #define SETTINGS_UUID 0xFFE2
 #define FIRMWARE_INFO_UUID 0xFFE3
 #define COMMANDS_UUID 0xFFE4
+#define CAPTURE_STATS_UUID 0xFFE5
+
+// Attribute handles reserved for the scanner service, each characteristic takes up to 3
+#define SNEAK32_SERVICE_HANDLES 40
 
 #define DEVICE_APPEARANCE 192 // SmartWatch
 
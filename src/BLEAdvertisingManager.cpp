@@ -1,13 +1,14 @@
 #include "BLEAdvertisingManager.h"
 #include "AppPreferences.h"
 #include "BLE.h"
+#include "Console.h"
 #include <string>
 
 BLEAdvertising* BLEAdvertisingManager::pAdvertising = BLEDevice::getAdvertising();
 uint8_t BLEAdvertisingManager::advertisingMode = 0xFF;
 
 void BLEAdvertisingManager::setup() {
-    Serial.println(">> BLEAdvertisingManager::setup");
+    Console.println(">> BLEAdvertisingManager::setup");
     pAdvertising = BLEDevice::getAdvertising();
 
     pAdvertising->addServiceUUID(SNEAK32_SERVICE_UUID);
@@ -20,7 +21,7 @@ void BLEAdvertisingManager::setup() {
         // Clear the whitelist, only one device is allowed
         esp_ble_gap_clear_whitelist();
         BLEDevice::whiteListAdd(authorizedAddress);
-        Serial.printf("Added authorized address to whitelist: %s\n", appPrefs.authorized_address);
+        Console.printf("Added authorized address to whitelist: %s\n", appPrefs.authorized_address);
     }
 
     if (appPrefs.stealth_mode && strlen(appPrefs.authorized_address) == 17) {
@@ -31,17 +32,17 @@ void BLEAdvertisingManager::setup() {
 }
 
 void BLEAdvertisingManager::start() {
-    Serial.println(">> BLEAdvertisingManager::start");
+    Console.println(">> BLEAdvertisingManager::start");
     pAdvertising->start();
 }
 
 void BLEAdvertisingManager::stop() {
-    Serial.println(">> BLEAdvertisingManager::stop");
+    Console.println(">> BLEAdvertisingManager::stop");
     pAdvertising->stop();
 }
 
 void BLEAdvertisingManager::updateAdvertisingData() {
-    Serial.println(">> BLEAdvertisingManager::updateAdvertisingData");
+    Console.println(">> BLEAdvertisingManager::updateAdvertisingData");
     pAdvertising->stop();
     setup();
     pAdvertising->start();
@@ -49,7 +50,7 @@ void BLEAdvertisingManager::updateAdvertisingData() {
 
 void BLEAdvertisingManager::configureStealthMode() {
     if (advertisingMode != ADV_TYPE_DIRECT_IND_LOW) {
-        Serial.println(">> BLEAdvertisingManager::configureStealthMode");
+        Console.println(">> BLEAdvertisingManager::configureStealthMode");
     }
     advertisingMode = ADV_TYPE_DIRECT_IND_LOW;
 
@@ -63,7 +64,7 @@ void BLEAdvertisingManager::configureStealthMode() {
 
 void BLEAdvertisingManager::configureNormalMode() {
     if (advertisingMode != ADV_TYPE_IND) {
-        Serial.println(">> BLEAdvertisingManager::configureNormalMode");
+        Console.println(">> BLEAdvertisingManager::configureNormalMode");
     }
     advertisingMode = ADV_TYPE_IND;
 
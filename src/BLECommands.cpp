@@ -3,17 +3,35 @@
 #include "WifiNetworkList.h"
 #include "BLEDeviceList.h"
 #include "FlashStorage.h"
+#include "WifiScan.h"
 #include "WifiDetect.h"
 #include "BLEDetect.h"
 #include "BLEStatusUpdater.h"
+#include "DetectionWatchlist.h"
+#include "PcapCapture.h"
+#include "Log.h"
+#include "FrameQuarantine.h"
+#include "HistoryStore.h"
+#include "WarmRestart.h"
+#include "OuiVendor.h"
 #include <Arduino.h>
 #include <SimpleCLI.h>
 #include "FirmwareInfo.h"
+#include "Console.h"
+
+// Sightings listed by the history command by default, and at most (a response fits in 512 bytes)
+#ifndef HISTORY_PAGE_SIZE
+#define HISTORY_PAGE_SIZE 5
+#endif
+#ifndef HISTORY_PAGE_MAX
+#define HISTORY_PAGE_MAX 6
+#endif
 
 // External variables
 extern WifiDeviceList stationsList;
 extern WifiNetworkList ssidList;
 extern BLEDeviceList bleDeviceList;
+extern time_t base_time;
 
 // Callback functions declarations
 void helpCallback(cmd* cmdPtr);
@@ -27,6 +45,21 @@ void errorCallback(cmd_error* errorPtr);
 void saveWifiNetworksCallback(cmd* cmdPtr);
 void saveWifiDevicesCallback(cmd* cmdPtr);
 void saveBleDevicesCallback(cmd* cmdPtr);
+void pcapStartCallback(cmd* cmdPtr);
+void pcapStopCallback(cmd* cmdPtr);
+void pcapStatusCallback(cmd* cmdPtr);
+void pcapDumpCallback(cmd* cmdPtr);
+void storageStatsCallback(cmd* cmdPtr);
+void historyCallback(cmd* cmdPtr);
+void historyStatsCallback(cmd* cmdPtr);
+void captureStatsCallback(cmd* cmdPtr);
+void captureStatsResetCallback(cmd* cmdPtr);
+void quarantineCallback(cmd* cmdPtr);
+void quarantineGetCallback(cmd* cmdPtr);
+void quarantineClearCallback(cmd* cmdPtr);
+void vendorCallback(cmd* cmdPtr);
+void watchVendorsCallback(cmd* cmdPtr);
+void detectRssiCallback(cmd* cmdPtr);
 
 BLECharacteristic* BLECommands::pCharacteristic = nullptr;
 SimpleCLI* BLECommands::pCli = nullptr;
@@ -63,6 +96,57 @@ void BLECommands::onWrite(BLECharacteristic* characteristic) {
     Command saveBleDevices = pCli->addCommand("save_ble_devices", saveBleDevicesCallback);
     saveBleDevices.setDescription("Save BLE devices to FlashStorage");
 
+    Command storageStats = pCli->addCommand("storage_stats", storageStatsCallback);
+    storageStats.setDescription("Show FlashStorage save counters and durations");
+
+    Command history = pCli->addCommand("history", historyCallback);
+    history.addArgument("mac", "*");
+    history.addArgument("hours", "24");
+    history.addArgument("offset", "0");
+    history.addArgument("limit", String(HISTORY_PAGE_SIZE));
+    history.setDescription("Query the sighting history by MAC (* for all) and age, lists limit records from offset");
+
+    Command historyStats = pCli->addCommand("history_stats", historyStatsCallback);
+    historyStats.setDescription("Show the sighting history usage and wear");
+
+    Command pcapStart = pCli->addCommand("pcap_start", pcapStartCallback);
+    pcapStart.addArgument("sink", "serial");
+    pcapStart.addArgument("snaplen", String(PCAP_DEFAULT_SNAPLEN));
+    pcapStart.setDescription("Capture raw frames in pcap format to serial or flash");
+
+    Command pcapStop = pCli->addCommand("pcap_stop", pcapStopCallback);
+    pcapStop.setDescription("Stop the pcap capture");
+
+    Command pcapStatus = pCli->addCommand("pcap_status", pcapStatusCallback);
+    pcapStatus.setDescription("Show pcap capture counters");
+
+    Command pcapDump = pCli->addCommand("pcap_dump", pcapDumpCallback);
+    pcapDump.setDescription("Stream the pcap capture stored in flash to serial");
+
+    Command captureStats = pCli->addCommand("capture_stats", captureStatsCallback);
+    captureStats.setDescription("Print capture counters by frame type and channel to serial");
+
+    Command captureStatsReset = pCli->addCommand("capture_stats_reset", captureStatsResetCallback);
+    captureStatsReset.setDescription("Reset the capture counters");
+
+    Command quarantine = pCli->addCommand("quarantine", quarantineCallback);
+    quarantine.setDescription("Show quarantined frame counters, hexdumps on serial");
+
+    Command quarantineGet = pCli->addSingleArgCmd("quarantine_get", quarantineGetCallback);
+    quarantineGet.setDescription("Get a quarantined frame in hex, 0 is the newest");
+
+    Command quarantineClear = pCli->addCommand("quarantine_clear", quarantineClearCallback);
+    quarantineClear.setDescription("Clear the quarantined frames and counters");
+
+    Command vendor = pCli->addSingleArgCmd("vendor", vendorCallback);
+    vendor.setDescription("Look up the vendor of a MAC address (XX:XX:XX:XX:XX:XX)");
+
+    Command watchVendors = pCli->addSingleArgCmd("watch_vendors", watchVendorsCallback);
+    watchVendors.setDescription("Show or set the vendors to detect (comma separated names, none to clear)");
+
+    Command detectRssi = pCli->addSingleArgCmd("detect_rssi", detectRssiCallback);
+    detectRssi.setDescription("Show or set the recent signal (dBm) a watched device needs to be detected");
+
     Command restart = pCli->addCommand("restart", restartCallback);
     restart.setDescription("Restart the device");
        
@@ -71,25 +155,25 @@ void BLECommands::onWrite(BLECharacteristic* characteristic) {
 
     // Parse command
     String value = String(characteristic->getValue().c_str());
-    Serial.println("BLE Command received: " + value);
+    Console.println("BLE Command received: " + value);
     pCli->parse(value.c_str());
 }
 
 void BLECommands::respond(String text) {
     if (pCharacteristic != nullptr) {
         pCharacteristic->setValue(text.c_str());
-        Serial.println("BLE Response: " + text);
+        Console.println("BLE Response: " + text);
     } else {
-        Serial.println("ERROR: Cannot send BLE response, characteristic is null");
+        Console.println("ERROR: Cannot send BLE response, characteristic is null");
     }
 }
 
 void BLECommands::respond(uint8_t *value, size_t length) {
     if (pCharacteristic != nullptr) {
         pCharacteristic->setValue(value, length);
-        Serial.println("BLE Response: " + String(value, length));
+        Console.println("BLE Response: " + String(value, length));
     } else {
-        Serial.println("ERROR: Cannot send BLE response, characteristic is null");
+        Console.println("ERROR: Cannot send BLE response, characteristic is null");
     }
 }
 
@@ -101,39 +185,326 @@ void helpCallback(cmd* cmdPtr) {
 
 void restartCallback(cmd* cmdPtr) {
     BLECommands::respond("Restarting...");
+    warmRestart.update(true);
+    logger.flush();
     ESP.restart();
 }
 
 void clearDataCallback(cmd* cmdPtr) {
     FlashStorage::clearAll();
+    historyStore.clear();
+    warmRestart.invalidate();
+    if (appPrefs.operation_mode == OPERATION_MODE_DETECTION) {
+        detectionWatchlist.rebuild();
+    }
     BLECommands::respond("Data cleared");
     BLEStatusUpdater.update();
 }
 
 void saveDataCallback(cmd* cmdPtr) {
-    Serial.println("Save data command received");
+    Console.println("Save data command received");
     FlashStorage::saveAll();
     BLECommands::respond("Data saved");
 }
 
 void saveWifiNetworksCallback(cmd* cmdPtr) {
-    Serial.println("Save WiFi networks command received");
+    Console.println("Save WiFi networks command received");
     FlashStorage::saveWifiNetworks();
     BLECommands::respond("WiFi networks saved");
 }   
 
 void saveWifiDevicesCallback(cmd* cmdPtr) {
-    Serial.println("Save WiFi devices command received");
+    Console.println("Save WiFi devices command received");
     FlashStorage::saveWifiDevices();
     BLECommands::respond("WiFi devices saved");
 }
 
 void saveBleDevicesCallback(cmd* cmdPtr) {
-    Serial.println("Save BLE devices command received");
+    Console.println("Save BLE devices command received");
     FlashStorage::saveBLEDevices();
     BLECommands::respond("BLE devices saved");
 }
 
+void storageStatsCallback(cmd* cmdPtr) {
+    FlashSaveStats stats = FlashStorage::getSaveStats();
+    String status = "Saves " + String(stats.saves) +
+                    ", failures " + String(stats.failures) +
+                    ", snapshots " + String(stats.snapshots) +
+                    ", journal segments " + String(stats.journal_segments) +
+                    ", bytes " + String(stats.bytes_written) +
+                    ", last " + String(stats.last_duration_ms) + " ms" +
+                    ", max " + String(stats.max_duration_ms) + " ms";
+    if (stats.last_save_ms > 0) {
+        status += ", " + String((millis() - stats.last_save_ms) / 1000) + "s ago";
+    }
+    BLECommands::respond(status);
+}
+
+namespace {
+    struct HistorySummary {
+        uint32_t first;
+        uint32_t last;
+        int8_t best_rssi;
+        uint32_t offset;   // Page of sightings listed in the response
+        uint32_t limit;
+        uint32_t seen;
+        String page;
+    };
+
+    bool addSighting(const HistoryRecord &record, void *context) {
+        HistorySummary *summary = static_cast<HistorySummary *>(context);
+        if (summary->first == 0) {
+            summary->first = record.timestamp;
+        }
+        summary->last = record.timestamp;
+        if (record.rssi > summary->best_rssi) {
+            summary->best_rssi = record.rssi;
+        }
+        if (summary->seen >= summary->offset && summary->seen - summary->offset < summary->limit) {
+            char line[80];
+            snprintf(line, sizeof(line), "\n%u %s %02X:%02X:%02X:%02X:%02X:%02X rssi %d ch %u seen %u", record.timestamp,
+                     historyKindName(record.kind), record.address[0], record.address[1], record.address[2],
+                     record.address[3], record.address[4], record.address[5], record.rssi, record.channel,
+                     record.times_seen);
+            summary->page += line;
+        }
+        summary->seen++;
+        return true;
+    }
+}
+
+void historyCallback(cmd* cmdPtr) {
+    Command cmd(cmdPtr);
+    String mac = cmd.getArgument("mac").getValue();
+    long hours = cmd.getArgument("hours").getValue().toInt();
+    long offset = cmd.getArgument("offset").getValue().toInt();
+    long limit = cmd.getArgument("limit").getValue().toInt();
+
+    if (offset < 0 || limit < 1 || limit > HISTORY_PAGE_MAX) {
+        BLECommands::respond("Error: offset must be 0 or more and limit between 1 and " + String(HISTORY_PAGE_MAX));
+        return;
+    }
+
+    HistoryQuery query;
+    memset(&query, 0, sizeof(query));
+    query.any_address = mac == "*";
+    if (!query.any_address) {
+        unsigned int bytes[6];
+        if (sscanf(mac.c_str(), "%x:%x:%x:%x:%x:%x", &bytes[0], &bytes[1], &bytes[2], &bytes[3], &bytes[4], &bytes[5]) != 6) {
+            BLECommands::respond("Error: mac must be XX:XX:XX:XX:XX:XX or *");
+            return;
+        }
+        for (int i = 0; i < 6; i++) {
+            query.address[i] = bytes[i];
+        }
+    }
+    uint32_t now = millis() / 1000 + base_time;
+    query.to = now;
+    // Clamped first, hours * 3600 must not wrap
+    query.from = hours > 0 && static_cast<uint32_t>(hours) < now / 3600 ? now - static_cast<uint32_t>(hours) * 3600 : 0;
+
+    HistorySummary summary = {0, 0, INT8_MIN, static_cast<uint32_t>(offset), static_cast<uint32_t>(limit), 0, String()};
+    size_t matches = historyStore.query(query, addSighting, &summary);
+    if (matches == 0) {
+        BLECommands::respond("No sightings of " + mac + " in the last " + String(hours) + " h");
+        return;
+    }
+    BLECommands::respond(String(matches) + " sightings of " + mac +
+                         ", first " + String((now - summary.first) / 60) + " min ago" +
+                         ", last " + String((now - summary.last) / 60) + " min ago" +
+                         ", best rssi " + String(summary.best_rssi) + summary.page);
+}
+
+void historyStatsCallback(cmd* cmdPtr) {
+    HistoryStats stats = historyStore.getStats();
+    if (!stats.mounted) {
+        BLECommands::respond("Error: no history partition");
+        return;
+    }
+    BLECommands::respond("Records " + String(stats.records) + "/" + String(stats.capacity) +
+                         ", appended " + String(stats.appended) +
+                         ", time " + String(stats.oldest) + "-" + String(stats.newest) +
+                         ", erase count " + String(stats.min_erase_count) + "-" + String(stats.max_erase_count) +
+                         ", write errors " + String(stats.write_errors));
+}
+
+void pcapStartCallback(cmd* cmdPtr) {
+    Command cmd(cmdPtr);
+    String sinkName = cmd.getArgument("sink").getValue();
+    int snaplen = cmd.getArgument("snaplen").getValue().toInt();
+
+    PcapSink sink;
+    if (sinkName == "serial") {
+        sink = PcapSink::Serial;
+    } else if (sinkName == "flash") {
+        sink = PcapSink::Flash;
+    } else {
+        BLECommands::respond("Error: sink must be serial or flash");
+        return;
+    }
+
+    if (snaplen < 24 || snaplen > PCAP_MAX_SNAPLEN) {
+        BLECommands::respond("Error: snaplen must be between 24 and " + String(PCAP_MAX_SNAPLEN));
+        return;
+    }
+
+    if (pcapCapture.start(sink, snaplen)) {
+        BLECommands::respond("PCAP capture started (" + sinkName + ", snaplen " + String(snaplen) + ")");
+    } else {
+        BLECommands::respond("Error: PCAP capture could not be started");
+    }
+}
+
+void pcapStopCallback(cmd* cmdPtr) {
+    pcapCapture.stop();
+    BLECommands::respond("PCAP capture stopped");
+}
+
+void pcapStatusCallback(cmd* cmdPtr) {
+    PcapCaptureStats stats = pcapCapture.getStats();
+    String status = String(stats.active ? "active" : "stopped") +
+                    ", sink " + (stats.sink == PcapSink::Flash ? "flash" : "serial") +
+                    ", snaplen " + String(stats.snaplen) +
+                    ", frames " + String(stats.captured) +
+                    ", dropped " + String(stats.dropped) +
+                    ", sink dropped " + String(stats.sink_dropped) +
+                    ", bytes " + String(stats.bytes_written) +
+                    "/" + String(stats.flash_size);
+    BLECommands::respond(status);
+}
+
+void pcapDumpCallback(cmd* cmdPtr) {
+    if (pcapCapture.requestFlashDump()) {
+        BLECommands::respond("Dumping PCAP capture to serial");
+    } else {
+        BLECommands::respond("Error: stop the capture first or no pcap partition");
+    }
+}
+
+void captureStatsCallback(cmd* cmdPtr) {
+    CaptureStatsSnapshot stats = WifiScanner.getCaptureStats().snapshot();
+    Console.print(WifiScanner.getCaptureStats().toString());
+    BLECommands::respond("Too short " + String(stats.too_short) +
+                         ", FCS failures " + String(stats.fcs_failures) +
+                         ", below RSSI " + String(stats.below_rssi) +
+                         " in " + String(stats.seconds) + "s (full table on serial)");
+}
+
+void captureStatsResetCallback(cmd* cmdPtr) {
+    WifiScanner.getCaptureStats().reset();
+    BLECommands::respond("Capture stats reset");
+}
+
+void quarantineCallback(cmd* cmdPtr) {
+    String summary = frameQuarantine.getSummary();
+    Console.println(summary);
+    QuarantineEntry entry;
+    for (uint32_t age = frameQuarantine.size(); age-- > 0;) {
+        if (frameQuarantine.getEntry(age, entry)) {
+            Console.printf("[%u] %s\n", age, frameQuarantine.describeEntry(entry).c_str());
+            printHexDump(entry.data, entry.cap_len);
+        }
+    }
+    BLECommands::respond(summary + ", " + String(frameQuarantine.size()) + " stored");
+}
+
+void quarantineGetCallback(cmd* cmdPtr) {
+    Command cmd(cmdPtr);
+    uint32_t age = cmd.getArgument(0).getValue().toInt();
+    QuarantineEntry entry;
+    if (!frameQuarantine.getEntry(age, entry)) {
+        BLECommands::respond("Error: no quarantined frame " + String(age));
+        return;
+    }
+    String text = frameQuarantine.describeEntry(entry) + ": ";
+    for (uint16_t i = 0; i < entry.cap_len; i++) {
+        char hex[3];
+        snprintf(hex, sizeof(hex), "%02x", entry.data[i]);
+        text += hex;
+    }
+    BLECommands::respond(text);
+}
+
+void quarantineClearCallback(cmd* cmdPtr) {
+    frameQuarantine.clear();
+    BLECommands::respond("Quarantine cleared");
+}
+
+void vendorCallback(cmd* cmdPtr) {
+    Command cmd(cmdPtr);
+    String mac = cmd.getArgument(0).getValue();
+    unsigned int bytes[6];
+    if (sscanf(mac.c_str(), "%x:%x:%x:%x:%x:%x", &bytes[0], &bytes[1], &bytes[2], &bytes[3], &bytes[4], &bytes[5]) != 6) {
+        BLECommands::respond("Error: mac must be XX:XX:XX:XX:XX:XX");
+        return;
+    }
+    uint8_t address[6];
+    for (int i = 0; i < 6; i++) {
+        address[i] = bytes[i];
+    }
+    uint16_t id = ouiVendorId(address);
+    if (id == OUI_VENDOR_UNKNOWN) {
+        BLECommands::respond(String(address[0] & 0x02 ? "Locally administered address" : "Unknown vendor"));
+        return;
+    }
+    BLECommands::respond(String(ouiVendorName(id)) + " (" + String(id) + ")");
+}
+
+void watchVendorsCallback(cmd* cmdPtr) {
+    Command cmd(cmdPtr);
+    String names = cmd.getArgument(0).getValue();
+    names.trim();
+    if (names.isEmpty()) {
+        BLECommands::respond("Watched vendors: " + String(appPrefs.watch_vendors[0] ? appPrefs.watch_vendors : "none"));
+        return;
+    }
+    if (names == "none") {
+        names = "";
+    }
+    if (names.length() >= sizeof(appPrefs.watch_vendors)) {
+        BLECommands::respond("Error: at most " + String(sizeof(appPrefs.watch_vendors) - 1) + " characters");
+        return;
+    }
+    int start = 0;
+    while (start < (int)names.length()) {
+        int end = names.indexOf(',', start);
+        if (end < 0) {
+            end = names.length();
+        }
+        if (ouiVendorByName(names.c_str() + start, end - start) == OUI_VENDOR_UNKNOWN) {
+            BLECommands::respond("Error: unknown vendor " + names.substring(start, end));
+            return;
+        }
+        start = end + 1;
+    }
+
+    strncpy(appPrefs.watch_vendors, names.c_str(), sizeof(appPrefs.watch_vendors) - 1);
+    appPrefs.watch_vendors[sizeof(appPrefs.watch_vendors) - 1] = '\0';
+    saveAppPreferences();
+    if (appPrefs.operation_mode == OPERATION_MODE_DETECTION) {
+        detectionWatchlist.rebuild();
+    }
+    BLECommands::respond("Watched vendors: " + String(names.isEmpty() ? "none" : names.c_str()));
+}
+
+void detectRssiCallback(cmd* cmdPtr) {
+    Command cmd(cmdPtr);
+    String value = cmd.getArgument(0).getValue();
+    value.trim();
+    if (value.isEmpty()) {
+        BLECommands::respond("Detect RSSI: " + String(appPrefs.detect_rssi) + " dBm");
+        return;
+    }
+    int rssi = value.toInt();
+    if (rssi < -120 || rssi > 0) {
+        BLECommands::respond("Error: detect_rssi must be between -120 and 0");
+        return;
+    }
+    appPrefs.detect_rssi = rssi;
+    saveAppPreferences();
+    BLECommands::respond("Detect RSSI: " + String(rssi) + " dBm");
+}
+
 void testMtuCallback(cmd* cmdPtr) {
     Command cmd(cmdPtr);
     int mtuSize = cmd.getArgument(0).getValue().toInt();
@@ -143,7 +514,7 @@ void testMtuCallback(cmd* cmdPtr) {
         return;
     }
 
-    Serial.println("Test MTU command received, sent " + String(mtuSize) + " bytes");
+    Console.println("Test MTU command received, sent " + String(mtuSize) + " bytes");
     uint8_t *mtuBuffer = (uint8_t *)malloc(mtuSize);
     memset(mtuBuffer, 'A', mtuSize);    
     BLECommands::respond(mtuBuffer, mtuSize);
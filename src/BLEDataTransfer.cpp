@@ -3,10 +3,19 @@
 #include <cmath>
 #include <arpa/inet.h>
 #include <algorithm>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <esp_gap_ble_api.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "WifiDeviceList.h"
 #include "WifiNetworkList.h"
 #include "BLEDeviceList.h"
 #include "AppPreferences.h"
+#include "CompactCodec.h"
+#include "HistoryStore.h"
+#include "Console.h"
 
 // External variables
 extern BLEDeviceList bleDeviceList;
@@ -16,6 +25,7 @@ extern AppPreferencesData appPrefs;
 extern time_t base_time;
 
 // Global variables
+extern BLEServer *pServer;
 extern BLECharacteristic *pTxCharacteristic;
 extern bool deviceConnected;
 
@@ -32,6 +42,37 @@ uint16_t totalPackets = 0;
 unsigned long lastPacketRequestTime = 0;
 String currentRequestType;
 
+// Guards the transfer state, used from the BLE stack, the main loop and the stream task
+std::mutex transferMutex;
+
+// Streaming transfer in progress
+struct StreamStats {
+    unsigned long start_ms;
+    uint32_t sent;
+    uint32_t retransmitted;
+    uint32_t link_waits;    // Times the controller had no room for a notification
+};
+bool streaming = false;
+bool streamEndSent = false;
+uint16_t streamNextPacket = 0;    // Next packet of the first pass
+uint32_t streamCredits = 0;       // Packets the client still accepts
+std::deque<uint16_t> retransmitQueue;
+StreamStats streamStats = {};
+TaskHandle_t streamTask = nullptr;
+std::atomic<bool> notifyFailed(false);
+
+// Snapshot of the transfer in progress: the entries are serialized once when
+// the request arrives and every packet is a slice of them
+std::vector<uint8_t> snapshotEntries;
+size_t snapshotEntrySize = 0;
+bool deltaTransfer = false;
+bool deltaReset = false;
+SyncCursor deltaCursor = {0, 0};
+// Compact transfers hold one CompactCodec block per packet, packet n is
+// snapshotEntries[packetOffsets[n - 1], packetOffsets[n])
+bool compactTransfer = false;
+std::vector<uint32_t> packetOffsets;
+
 // Replace the static MTU definition with a dynamic one
 #define MAX_PACKET_SIZE (appPrefs.bleMTU - PACKET_HEADER_SIZE)
 
@@ -59,11 +100,13 @@ void writeInt8(uint8_t* buffer, int8_t value, size_t& offset) {
     buffer[offset++] = value;
 }
 
-void writeFixedString(uint8_t* buffer, const String& str, size_t maxLength, size_t& offset) {
-    size_t strLen = str.length();
+// Copies an interned string into a zero padded field
+void writeFixedString(uint8_t* buffer, uint16_t handle, size_t maxLength, size_t& offset) {
+    char text[STRING_ARENA_MAX_LEN + 1];
+    size_t strLen = stringArena.copy(handle, text, sizeof(text));
     memset(buffer + offset, 0, maxLength); // Fill with zeros
     if (strLen > 0) {
-        memcpy(buffer + offset, str.c_str(), std::min(strLen, maxLength));
+        memcpy(buffer + offset, text, std::min(strLen, maxLength));
     }
     offset += maxLength;
 }
@@ -73,208 +116,612 @@ void writeMacAddress(uint8_t* buffer, const MacAddress& addr, size_t& offset) {
     offset += MAC_ADDR_SIZE;
 }
 
+void writeWifiNetworkRecord(uint8_t* buffer, const WifiNetwork& network, size_t& offset) {
+    writeMacAddress(buffer, network.address, offset);
+    writeFixedString(buffer, network.ssid, SSID_SIZE, offset);
+    writeInt8(buffer, network.rssi, offset);
+    writeInt8(buffer, network.channel, offset);
+    writeInt8(buffer, static_cast<uint8_t>(network.type), offset);
+    writeUint64(buffer, network.last_seen, offset);
+    writeUint32(buffer, network.times_seen, offset);
+}
+
+void writeWifiDeviceRecord(uint8_t* buffer, const WifiDevice& device, size_t& offset) {
+    writeMacAddress(buffer, device.address, offset);
+    writeMacAddress(buffer, device.bssid, offset);
+    writeInt8(buffer, device.rssi, offset);
+    writeInt8(buffer, device.channel, offset);
+    writeUint64(buffer, device.last_seen, offset);
+    writeUint32(buffer, device.times_seen, offset);
+}
+
+void writeBLEDeviceRecord(uint8_t* buffer, const BLEFoundDevice& device, size_t& offset) {
+    writeMacAddress(buffer, device.address, offset);
+    writeFixedString(buffer, device.name, NAME_SIZE, offset);
+    writeInt8(buffer, device.rssi, offset);
+    writeUint64(buffer, device.last_seen, offset);
+    writeInt8(buffer, device.isPublic ? 1 : 0, offset);
+    writeUint32(buffer, device.times_seen, offset);
+}
+
+void writeRssiRecord(uint8_t* buffer, uint8_t kind, const MacAddress& address, uint32_t nameHash,
+                     const RssiTrack& track, size_t& offset) {
+    RssiSeries series;
+    rssiPool.read(track, series);
+    buffer[offset++] = kind;
+    writeMacAddress(buffer, address, offset);
+    writeUint32(buffer, nameHash, offset);
+    writeUint16(buffer, static_cast<uint16_t>(track.ewma), offset);
+    writeInt8(buffer, track.last, offset);
+    writeInt8(buffer, track.min, offset);
+    writeInt8(buffer, track.max, offset);
+    writeUint32(buffer, series.age_ms, offset);
+    buffer[offset++] = series.count;
+    for (uint8_t i = 0; i < RSSI_RING_SAMPLES; i++) {
+        uint16_t sample = i < series.count ? series.samples[i] : 0;
+        buffer[offset++] = rssiSampleDelta(sample);
+        writeInt8(buffer, rssiSampleValue(sample), offset);
+    }
+}
+
+// Serializes the RssiTrack of every list entry that has readings
+void serializeRssiSeries()
+{
+    std::vector<WifiNetwork> networks = ssidList.getClonedList();
+    std::vector<WifiDevice> devices = stationsList.getClonedList();
+    std::vector<BLEFoundDevice> bleDevices = bleDeviceList.getClonedList();
+
+    snapshotEntrySize = RSSI_RECORD_SIZE;
+    snapshotEntries.resize((networks.size() + devices.size() + bleDevices.size()) * RSSI_RECORD_SIZE);
+    size_t offset = 0;
+    for (const WifiNetwork& network : networks) {
+        if (!network.rssi_track.empty()) {
+            // Same hash as HistoryRecord::name_hash
+            writeRssiRecord(snapshotEntries.data(), static_cast<uint8_t>(HistoryKind::WifiNetwork), network.address,
+                            static_cast<uint32_t>(stringArena.hash(network.ssid)), network.rssi_track, offset);
+        }
+    }
+    for (const WifiDevice& device : devices) {
+        if (!device.rssi_track.empty()) {
+            writeRssiRecord(snapshotEntries.data(), static_cast<uint8_t>(HistoryKind::WifiDevice), device.address, 0,
+                            device.rssi_track, offset);
+        }
+    }
+    for (const BLEFoundDevice& device : bleDevices) {
+        if (!device.rssi_track.empty()) {
+            writeRssiRecord(snapshotEntries.data(), static_cast<uint8_t>(HistoryKind::BleDevice), device.address, 0,
+                            device.rssi_track, offset);
+        }
+    }
+    snapshotEntries.resize(offset);
+    snapshotEntries.shrink_to_fit();
+}
+
+// Serializes a copy of the whole list
+template <typename T>
+void serializeSnapshot(const std::vector<T>& list, size_t recordSize, void (*writeRecord)(uint8_t*, const T&, size_t&))
+{
+    snapshotEntrySize = recordSize;
+    snapshotEntries.resize(list.size() * recordSize);
+    snapshotEntries.shrink_to_fit();
+
+    size_t offset = 0;
+    for (const T& record : list) {
+        writeRecord(snapshotEntries.data(), record, offset);
+    }
+}
+
+// Serializes tombstones then changed records, each behind its op byte
+template <typename T>
+void serializeDelta(const SyncDelta<T>& delta, size_t recordSize, void (*writeRecord)(uint8_t*, const T&, size_t&))
+{
+    snapshotEntrySize = DELTA_OP_SIZE + recordSize;
+    snapshotEntries.resize((delta.removed.size() + delta.changed.size()) * snapshotEntrySize);
+    snapshotEntries.shrink_to_fit();
+
+    size_t offset = 0;
+    for (const T& record : delta.removed) {
+        snapshotEntries[offset++] = DELTA_OP_REMOVE;
+        writeRecord(snapshotEntries.data(), record, offset);
+    }
+    for (const T& record : delta.changed) {
+        snapshotEntries[offset++] = DELTA_OP_UPSERT;
+        writeRecord(snapshotEntries.data(), record, offset);
+    }
+}
+
+/**
+ * @brief Packs the removed then the changed records into compact blocks of one packet each.
+ *
+ * Every block carries the timestamp base, so the client decodes each packet on
+ * its own. Records are only split between packets, never inside one.
+ */
+template <typename Record, typename T>
+void serializeCompact(const std::vector<T>& removed, const std::vector<T>& changed, bool withOps)
+{
+    std::vector<Record> records(removed.size() + changed.size());
+    for (size_t i = 0; i < records.size(); i++) {
+        toRecord(i < removed.size() ? removed[i] : changed[i - removed.size()], records[i]);
+    }
+    uint64_t base = compactBase(records.data(), records.size());
+    int payloadSize = MAX_PACKET_SIZE - PACKET_HEADER_SIZE;
+    size_t budget = payloadSize > COMPACT_BLOCK_HEADER_MAX ? payloadSize - COMPACT_BLOCK_HEADER_MAX : 0;
+
+    snapshotEntries.clear();
+    packetOffsets.assign(1, 0);
+    std::vector<uint8_t> block;
+    std::vector<uint8_t> encoded;
+    uint32_t count = 0;
+    for (size_t i = 0; i <= records.size(); i++) {
+        bool last = i == records.size();
+        if (!last) {
+            encoded.clear();
+            if (withOps) {
+                encoded.push_back(i < removed.size() ? DELTA_OP_REMOVE : DELTA_OP_UPSERT);
+            }
+            encodeCompactRecord(encoded, records[i], base);
+        }
+        if (count > 0 && (last || block.size() + encoded.size() > budget)) {
+            writeCompactBlock(snapshotEntries, base, count, withOps, block.data(), block.size(), true);
+            packetOffsets.push_back(snapshotEntries.size());
+            block.clear();
+            count = 0;
+        }
+        if (!last) {
+            block.insert(block.end(), encoded.begin(), encoded.end());
+            count++;
+        }
+    }
+    snapshotEntries.shrink_to_fit();
+}
+
+// Serializes a list in the format of the transfer: whole or delta, fixed records or compact
+template <typename Record, typename List, typename T>
+void serializeList(const List& list, bool delta, const SyncCursor& since, size_t recordSize,
+                   void (*writeRecord)(uint8_t*, const T&, size_t&))
+{
+    if (!delta) {
+        if (compactTransfer) {
+            serializeCompact<Record>(std::vector<T>(), list.getClonedList(), false);
+        } else {
+            serializeSnapshot(list.getClonedList(), recordSize, writeRecord);
+        }
+        return;
+    }
+
+    SyncDelta<T> changes = list.getChangesSince(since);
+    deltaReset = changes.reset;
+    deltaCursor = changes.cursor;
+    if (compactTransfer) {
+        serializeCompact<Record>(changes.removed, changes.changed, true);
+    } else {
+        serializeDelta(changes, recordSize, writeRecord);
+    }
+    Console.printf("Delta of %u changed and %u removed records%s\n", (unsigned)changes.changed.size(),
+                  (unsigned)changes.removed.size(), changes.reset ? " (reset)" : "");
+}
+
+// Parses "<epoch><sequence>" in hex, "0" is the cursor of a client without data
+bool parseCursor(const String& text, SyncCursor& cursor)
+{
+    if (text == "0") {
+        cursor = SyncCursor{0, 0};
+        return true;
+    }
+    if (text.length() != DELTA_CURSOR_SIZE || !std::all_of(text.c_str(), text.c_str() + text.length(), ::isxdigit)) {
+        return false;
+    }
+    cursor.epoch = strtoul(text.substring(0, 8).c_str(), NULL, 16);
+    cursor.sequence = strtoul(text.substring(8).c_str(), NULL, 16);
+    return true;
+}
+
+// Pins the data of a transfer: the whole list, or its changes after since when delta is set
+void prepareSnapshot(const String& requestType, bool delta, const SyncCursor& since)
+{
+    if (requestType == REQUEST_SSID_LIST) {
+        serializeList<WifiNetworkStruct>(ssidList, delta, since, WIFI_NETWORK_RECORD_SIZE, writeWifiNetworkRecord);
+    } else if (requestType == REQUEST_CLIENT_LIST) {
+        serializeList<WifiDeviceStruct>(stationsList, delta, since, WIFI_DEVICE_RECORD_SIZE, writeWifiDeviceRecord);
+    } else if (requestType == REQUEST_RSSI_LIST) {
+        serializeRssiSeries();
+    } else {
+        serializeList<BLEDeviceStruct>(bleDeviceList, delta, since, BLE_DEVICE_RECORD_SIZE, writeBLEDeviceRecord);
+    }
+}
+
+// Drops the snapshot and ends the transfer
+void releaseSnapshot()
+{
+    currentRequestType = "";
+    deltaTransfer = false;
+    compactTransfer = false;
+    streaming = false;
+    retransmitQueue.clear();
+    snapshotEntries.clear();
+    snapshotEntries.shrink_to_fit();
+    packetOffsets.clear();
+    packetOffsets.shrink_to_fit();
+}
+
+// Parses "<request type>[:<cursor>][@1]" and prepares the transfer
+bool startTransfer(BLECharacteristic *pCharacteristic, String requestType)
+{
+    bool compact = requestType.endsWith(COMPACT_REQUEST_SUFFIX);
+    if (compact)
+    {
+        requestType = requestType.substring(0, requestType.length() - strlen(COMPACT_REQUEST_SUFFIX));
+    }
+    String cursorText;
+    int separator = requestType.indexOf(':');
+    if (separator >= 0)
+    {
+        cursorText = requestType.substring(separator + 1);
+        requestType = requestType.substring(0, separator);
+    }
+    SyncCursor since;
+    if (separator >= 0 && !parseCursor(cursorText, since))
+    {
+        pCharacteristic->setValue("Error: Invalid cursor");
+        Console.println("Invalid delta cursor: " + cursorText);
+        return false;
+    }
+    if (requestType != REQUEST_SSID_LIST &&
+        requestType != REQUEST_CLIENT_LIST &&
+        requestType != REQUEST_BLE_LIST &&
+        requestType != REQUEST_RSSI_LIST)
+    {
+        pCharacteristic->setValue("Error: Invalid request type");
+        Console.println("Invalid request type: " + requestType);
+        return false;
+    }
+    if (requestType == REQUEST_RSSI_LIST && (separator >= 0 || compact))
+    {
+        pCharacteristic->setValue("Error: rssi_list has no delta or compact form");
+        Console.println("Unsupported form of " + requestType);
+        return false;
+    }
+    currentRequestType = requestType;
+    deltaTransfer = separator >= 0;
+    compactTransfer = compact;
+    streaming = false;
+    prepareSnapshot(requestType, deltaTransfer, since);
+    return true;
+}
+
+// Queues the packet numbers of "<hex>,<hex>,..." for retransmission
+void queueRetransmits(const String& list)
+{
+    int start = 0;
+    while (start < (int)list.length())
+    {
+        int end = list.indexOf(',', start);
+        if (end < 0)
+        {
+            end = list.length();
+        }
+        uint16_t packetNumber = strtoul(list.substring(start, end).c_str(), NULL, 16);
+        if (packetNumber >= 1 && packetNumber <= totalPackets &&
+            std::find(retransmitQueue.begin(), retransmitQueue.end(), packetNumber) == retransmitQueue.end())
+        {
+            retransmitQueue.push_back(packetNumber);
+        }
+        start = end + 1;
+    }
+}
+
 void SendDataOverBLECallbacks::onWrite(BLECharacteristic *pCharacteristic)
 {
     std::string value = pCharacteristic->getValue();
     
     if (value.length() > 0)
     {
-        Serial.printf("Received BLE value: %s (length: %d)\n", value.c_str(), value.length());
+        Console.printf("Received BLE value: %s (length: %d)\n", value.c_str(), value.length());
+        std::lock_guard<std::mutex> lock(transferMutex);
+        String command = String(value.c_str());
 
         if (value.length() == 4 && std::all_of(value.begin(), value.end(), ::isxdigit)) 
         {
             uint16_t requestedPacket = strtoul(value.substr(0, 4).c_str(), NULL, 16);
-            Serial.printf("Parsed packet number: %d, Current request type: %s\n", 
+            Console.printf("Parsed packet number: %d, Current request type: %s\n", 
                           requestedPacket, currentRequestType.c_str());
 
-            if (!currentRequestType.isEmpty())
+            if (streaming)
+            {
+                queueRetransmits(command);
+                lastPacketRequestTime = millis();
+                wakeStreamTask();
+            }
+            else if (!currentRequestType.isEmpty())
             {
                 sendPacket(requestedPacket, currentRequestType);
                 lastPacketRequestTime = millis();
             }
             else 
             {
-                Serial.printf("ERROR: No valid current request type for packet %d\n", requestedPacket);
+                Console.printf("ERROR: No valid current request type for packet %d\n", requestedPacket);
                 pCharacteristic->setValue("Error: No active request");
             }
         }
-        else 
+        else if (command.startsWith(STREAM_CREDIT_PREFIX) || command.startsWith(STREAM_NACK_PREFIX))
         {
-            String requestType = String(value.c_str());
-            if (requestType == REQUEST_SSID_LIST || 
-                requestType == REQUEST_CLIENT_LIST || 
-                requestType == REQUEST_BLE_LIST)
+            if (!streaming)
             {
-                currentRequestType = requestType;
-                sendPacket(0, requestType);
-                lastPacketRequestTime = millis();
+                pCharacteristic->setValue("Error: No active stream");
+                return;
+            }
+            if (command.startsWith(STREAM_CREDIT_PREFIX))
+            {
+                uint32_t granted = strtoul(command.substring(strlen(STREAM_CREDIT_PREFIX)).c_str(), NULL, 16);
+                streamCredits = std::min<uint32_t>(streamCredits + granted, STREAM_MAX_CREDITS);
             }
             else
             {
-                pCharacteristic->setValue("Error: Invalid request type");
-                Serial.println("Invalid request type: " + requestType);
+                queueRetransmits(command.substring(strlen(STREAM_NACK_PREFIX)));
+            }
+            lastPacketRequestTime = millis();
+            wakeStreamTask();
+        }
+        else if (command.startsWith(STREAM_REQUEST_PREFIX))
+        {
+            if (startTransfer(pCharacteristic, command.substring(strlen(STREAM_REQUEST_PREFIX))))
+            {
+                streaming = true;
+                streamNextPacket = 1;
+                streamCredits = STREAM_INITIAL_CREDITS;
+                streamEndSent = false;
+                retransmitQueue.clear();
+                streamStats = StreamStats{millis(), 0, 0, 0};
+                sendPacket(0, currentRequestType);
+                lastPacketRequestTime = millis();
+                beginStreamTask();
+                wakeStreamTask();
             }
         }
+        else if (startTransfer(pCharacteristic, command))
+        {
+            sendPacket(0, currentRequestType);
+            lastPacketRequestTime = millis();
+        }
+    }
+}
+
+void SendDataOverBLECallbacks::onStatus(BLECharacteristic *pCharacteristic, Status s, uint32_t code)
+{
+    if (s == Status::ERROR_GATT)
+    {
+        // The stack had no buffer for the notification, it was not sent
+        notifyFailed.store(true);
     }
 }
 
 void checkTransmissionTimeout()
 {
     unsigned long currentTime = millis();
+    std::lock_guard<std::mutex> lock(transferMutex);
     if ((currentTime - lastPacketRequestTime > TRANSMISSION_TIMEOUT) || !deviceConnected)
     {
-        currentRequestType = "";
-        Serial.println("Transmission timeout: Resetting current request type");
+        releaseSnapshot();
+        Console.println("Transmission timeout: Resetting current request type");
     }
 }
 
-size_t getItemsPerPacket(const String& requestType)
+size_t getItemsPerPacket()
 {
-    size_t recordSize;
-    
-    if (requestType == REQUEST_BLE_LIST) {
-        recordSize = BLE_DEVICE_RECORD_SIZE;
-    } else if (requestType == REQUEST_CLIENT_LIST) {
-        recordSize = WIFI_DEVICE_RECORD_SIZE;
-    } else {
-        recordSize = WIFI_NETWORK_RECORD_SIZE;
+    return std::max<size_t>(1, (MAX_PACKET_SIZE - PACKET_HEADER_SIZE) / snapshotEntrySize);
+}
+
+uint16_t calculateTotalPackets()
+{
+    if (compactTransfer)
+    {
+        return packetOffsets.empty() ? 0 : packetOffsets.size() - 1;
     }
-    
-    return std::max<size_t>(1, (MAX_PACKET_SIZE - PACKET_HEADER_SIZE) / recordSize);
+    size_t itemsPerPacket = getItemsPerPacket();
+    size_t totalItems = snapshotEntries.size() / snapshotEntrySize;
+    return (totalItems + itemsPerPacket - 1) / itemsPerPacket;
 }
 
-uint16_t calculateTotalPackets(const String& requestType)
+void sendEndMarker()
 {
-    size_t itemsPerPacket = getItemsPerPacket(requestType);
-    size_t totalItems;
-
-    if (requestType == REQUEST_CLIENT_LIST) {
-        totalItems = stationsList.getClonedList().size();
-    } else if (requestType == REQUEST_SSID_LIST) {
-        totalItems = ssidList.getClonedList().size();
-    } else if (requestType == REQUEST_BLE_LIST) {
-        totalItems = bleDeviceList.getClonedList().size();
-    } else {
-        return 0;
+    time_t now = millis() / 1000 + base_time;
+    String endMarker = String(PACKET_END_MARKER) + ":" + String(now);
+    if (deltaTransfer) {
+        char cursor[DELTA_CURSOR_SIZE + 1];
+        snprintf(cursor, sizeof(cursor), "%08X%08X", deltaCursor.epoch, deltaCursor.sequence);
+        endMarker += ":" + String(cursor);
     }
+    pTxCharacteristic->setValue(endMarker.c_str());
+    pTxCharacteristic->notify();
+    Console.println("Sent end marker with timestamp: " + endMarker);
+}
 
-    return (totalItems + itemsPerPacket - 1) / itemsPerPacket;
+void buildPacket(uint16_t packetNumber, std::vector<uint8_t>& packet)
+{
+    size_t start;
+    size_t length;
+    if (compactTransfer)
+    {
+        start = packetOffsets[packetNumber - 1];
+        length = packetOffsets[packetNumber] - start;
+    }
+    else
+    {
+        size_t itemsPerPacket = getItemsPerPacket();
+        size_t totalItems = snapshotEntries.size() / snapshotEntrySize;
+        size_t startIndex = std::min(totalItems, (packetNumber - 1) * itemsPerPacket);
+        size_t endIndex = std::min(startIndex + itemsPerPacket, totalItems);
+        start = startIndex * snapshotEntrySize;
+        length = (endIndex - startIndex) * snapshotEntrySize;
+    }
+
+    char header[PACKET_HEADER_SIZE + 1];
+    snprintf(header, sizeof(header), "%04X", packetNumber);
+    packet.resize(PACKET_HEADER_SIZE + length);
+    memcpy(packet.data(), header, PACKET_HEADER_SIZE);
+    memcpy(packet.data() + PACKET_HEADER_SIZE, snapshotEntries.data() + start, length);
 }
 
 void sendPacket(uint16_t packetNumber, const String& requestType)
 {
     if (pTxCharacteristic == nullptr || !deviceConnected) {
-        Serial.println("ERROR: Cannot send packet - invalid state");
+        Console.println("ERROR: Cannot send packet - invalid state");
         return;
     }
 
     try {
         if (packetNumber == 0)
         {
-            totalPackets = calculateTotalPackets(requestType);
+            totalPackets = calculateTotalPackets();
             char packetsHeader[5];
             snprintf(packetsHeader, sizeof(packetsHeader), "%04X", totalPackets);
             String startMarker = String(PACKET_START_MARKER) + String(packetsHeader);
+            if (deltaTransfer) {
+                startMarker += deltaReset ? ":RESET" : ":DELTA";
+            }
+            if (streaming) {
+                startMarker += ":STREAM";
+            }
+            if (compactTransfer) {
+                startMarker += ":V" + String(COMPACT_CODEC_VERSION);
+            }
             pTxCharacteristic->setValue(startMarker.c_str());
             pTxCharacteristic->notify();
-            Serial.println("Sent start marker: " + startMarker);
+            Console.println("Sent start marker: " + startMarker);
+            if (deltaTransfer && totalPackets == 0 && !streaming) {
+                // Nothing changed, the client still needs the new cursor
+                delay(PACKET_DELAY);
+                sendEndMarker();
+                releaseSnapshot();
+            }
         }
         else if (packetNumber <= totalPackets)
         {
-            size_t itemsPerPacket = getItemsPerPacket(requestType);
-            size_t startIndex = (packetNumber - 1) * itemsPerPacket;
-            size_t length;
-            uint8_t* buffer = nullptr;
-            
-            if (requestType == REQUEST_SSID_LIST)
-            {
-                std::vector<WifiNetwork> networks = ssidList.getClonedList();
-                size_t endIndex = std::min(startIndex + itemsPerPacket, networks.size());
-                length = (endIndex - startIndex) * WIFI_NETWORK_RECORD_SIZE;
-                buffer = new uint8_t[length];
-                size_t offset = 0;
-                
-                for (size_t i = startIndex; i < endIndex; i++) {
-                    writeMacAddress(buffer, networks[i].address, offset);
-                    writeFixedString(buffer, networks[i].ssid, SSID_SIZE, offset);
-                    writeInt8(buffer, networks[i].rssi, offset);
-                    writeInt8(buffer, networks[i].channel, offset);
-                    writeFixedString(buffer, networks[i].type, TYPE_SIZE, offset);
-                    writeUint64(buffer, networks[i].last_seen, offset);
-                    writeUint32(buffer, networks[i].times_seen, offset);
-                }
-            }
-            else if (requestType == REQUEST_CLIENT_LIST)
-            {
-                std::vector<WifiDevice> devices = stationsList.getClonedList();
-                size_t endIndex = std::min(startIndex + itemsPerPacket, devices.size());
-                length = (endIndex - startIndex) * WIFI_DEVICE_RECORD_SIZE;
-                buffer = new uint8_t[length];
-                size_t offset = 0;
-                
-                for (size_t i = startIndex; i < endIndex; i++) {
-                    writeMacAddress(buffer, devices[i].address, offset);
-                    writeMacAddress(buffer, devices[i].bssid, offset);
-                    writeInt8(buffer, devices[i].rssi, offset);
-                    writeInt8(buffer, devices[i].channel, offset);
-                    writeUint64(buffer, devices[i].last_seen, offset);
-                    writeUint32(buffer, devices[i].times_seen, offset);
-                }
-            }
-            else if (requestType == REQUEST_BLE_LIST)
+            std::vector<uint8_t> packet(PACKET_HEADER_SIZE);
+            buildPacket(packetNumber, packet);
+            pTxCharacteristic->setValue(packet.data(), packet.size());
+            pTxCharacteristic->notify();
+            Console.printf("Sent packet %d\n", packetNumber);
+
+            if (packetNumber == totalPackets)
             {
-                std::vector<BLEFoundDevice> devices = bleDeviceList.getClonedList();
-                size_t endIndex = std::min(startIndex + itemsPerPacket, devices.size());
-                length = (endIndex - startIndex) * BLE_DEVICE_RECORD_SIZE;
-                buffer = new uint8_t[length];
-                size_t offset = 0;
-                
-                for (size_t i = startIndex; i < endIndex; i++) {
-                    writeMacAddress(buffer, devices[i].address, offset);
-                    writeFixedString(buffer, devices[i].name, NAME_SIZE, offset);
-                    writeInt8(buffer, devices[i].rssi, offset);
-                    writeUint64(buffer, devices[i].last_seen, offset);
-                    writeInt8(buffer, devices[i].isPublic ? 1 : 0, offset);
-                    writeUint32(buffer, devices[i].times_seen, offset);
-                }
-            }
-            
-            if (buffer != nullptr) {
-                // Add packet number header
-                uint8_t header[PACKET_HEADER_SIZE];
-                snprintf((char*)header, PACKET_HEADER_SIZE + 1, "%04X", packetNumber);
-                
-                // Combine header and data
-                uint8_t* fullPacket = new uint8_t[PACKET_HEADER_SIZE + length];
-                memcpy(fullPacket, header, PACKET_HEADER_SIZE);
-                memcpy(fullPacket + PACKET_HEADER_SIZE, buffer, length);
-                
-                pTxCharacteristic->setValue(fullPacket, PACKET_HEADER_SIZE + length);
-                pTxCharacteristic->notify();
-                
-                delete[] fullPacket;
-                delete[] buffer;
-                
-                Serial.printf("Sent packet %d\n", packetNumber);
-
-                if (packetNumber == totalPackets)
-                {
-                    delay(PACKET_DELAY);
-                    time_t now = millis() / 1000 + base_time;
-                    String endMarker = String(PACKET_END_MARKER) + ":" + String(now);
-                    pTxCharacteristic->setValue(endMarker.c_str());
-                    pTxCharacteristic->notify();
-                    Serial.println("Sent end marker with timestamp: " + endMarker);
-                }
+                delay(PACKET_DELAY);
+                sendEndMarker();
+                releaseSnapshot();
             }
         }
     }
     catch (const std::exception& e) 
     {
-        Serial.printf("EXCEPTION in sendPacket: %s\n", e.what());
+        Console.printf("EXCEPTION in sendPacket: %s\n", e.what());
     }
     catch (...) 
     {
-        Serial.println("UNKNOWN EXCEPTION in sendPacket");
+        Console.println("UNKNOWN EXCEPTION in sendPacket");
+    }
+}
+
+void beginStreamTask()
+{
+    if (streamTask != nullptr)
+    {
+        return;
+    }
+    xTaskCreatePinnedToCore(
+        [](void *parameter)
+        { stream_loop(); },
+        "BLE_Stream_Task", STREAM_TASK_STACK_SIZE, nullptr, STREAM_TASK_PRIORITY, &streamTask, tskNO_AFFINITY);
+}
+
+void wakeStreamTask()
+{
+    if (streamTask != nullptr)
+    {
+        xTaskNotifyGive(streamTask);
+    }
+}
+
+// True while the controller has room for another notification on the link
+static bool linkHasRoom()
+{
+    return esp_ble_get_cur_sendable_packets_num(pServer->getConnId()) > 0;
+}
+
+/**
+ * @brief Sends the next packet of the stream, retransmissions first.
+ *
+ * @return true to be called again right away, false to wait for the client
+ *         (credits or retransmission requests) or the end of the stream.
+ */
+static bool streamStep()
+{
+    std::unique_lock<std::mutex> lock(transferMutex);
+    if (!streaming || !deviceConnected || pTxCharacteristic == nullptr)
+    {
+        return false;
+    }
+
+    bool retransmit = !retransmitQueue.empty();
+    uint16_t packetNumber = retransmit ? retransmitQueue.front() : streamNextPacket;
+    if (!retransmit && packetNumber > totalPackets)
+    {
+        if (!streamEndSent)
+        {
+            sendEndMarker();
+            streamEndSent = true;
+            Console.printf("Stream of %u packets sent in %lu ms: %u retransmitted, %u waits for the link\n",
+                          totalPackets, millis() - streamStats.start_ms, streamStats.retransmitted, streamStats.link_waits);
+        }
+        return false;
+    }
+    if (streamCredits == 0)
+    {
+        return false;
+    }
+    if (!linkHasRoom())
+    {
+        // Paced by the controller: wait until it drains a buffer
+        streamStats.link_waits++;
+        lock.unlock();
+        vTaskDelay(STREAM_LINK_WAIT_TICKS);
+        return true;
+    }
+
+    std::vector<uint8_t> packet(PACKET_HEADER_SIZE);
+    buildPacket(packetNumber, packet);
+    notifyFailed.store(false);
+    pTxCharacteristic->setValue(packet.data(), packet.size());
+    pTxCharacteristic->notify();
+    if (notifyFailed.load())
+    {
+        // Congested: try the same packet again later
+        streamStats.link_waits++;
+        lock.unlock();
+        vTaskDelay(STREAM_LINK_WAIT_TICKS);
+        return true;
+    }
+
+    if (retransmit)
+    {
+        retransmitQueue.pop_front();
+        streamStats.retransmitted++;
+    }
+    else
+    {
+        streamNextPacket++;
+    }
+    streamStats.sent++;
+    streamCredits--;
+    return true;
+}
+
+void stream_loop()
+{
+    while (true)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        while (streamStep())
+        {
+        }
     }
 }
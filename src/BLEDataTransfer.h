@@ -10,7 +10,7 @@
 // Fixed sizes for binary records
 #define MAC_ADDR_SIZE 6
 #define SSID_SIZE 32
-#define TYPE_SIZE 16
+#define TYPE_SIZE 1
 #define NAME_SIZE 32
 #define TIMESTAMP_SIZE 8
 #define COUNTER_SIZE 4
@@ -27,24 +27,87 @@
 #define REQUEST_SSID_LIST "ssid_list"
 #define REQUEST_CLIENT_LIST "client_list"
 #define REQUEST_BLE_LIST "ble_list"
+#define REQUEST_RSSI_LIST "rssi_list"
+
+// RSSI series: "rssi_list" (plain or streamed, no delta or compact form) sends
+// one record per list entry with signal readings: HistoryKind, address, SSID
+// hash of networks (0 otherwise), EWMA (int16, Q8.8 dBm), last, min, max, age
+// of the newest sample in ms, sample count and RSSI_RING_SAMPLES samples of
+// (seconds since the previous sample, dBm), oldest first.
+#define KIND_SIZE 1
+#define NAME_HASH_SIZE 4
+#define EWMA_SIZE 2
+#define SAMPLE_COUNT_SIZE 1
+#define RSSI_RECORD_SIZE (KIND_SIZE + MAC_ADDR_SIZE + NAME_HASH_SIZE + EWMA_SIZE + 3 * RSSI_SIZE + COUNTER_SIZE + \
+                          SAMPLE_COUNT_SIZE + RSSI_RING_SAMPLES * 2)
+
+// Delta sync: "<request type>:<cursor>" returns the records changed after the
+// cursor, "0" as cursor asks for everything. Each entry is an op byte and a
+// record; tombstones come first. The start marker ends in ":DELTA", or in
+// ":RESET" when the client must drop its copy, and the end marker carries the
+// cursor for the next request: "END:<timestamp>:<cursor>".
+#define DELTA_CURSOR_SIZE 16  // Hex digits: epoch and sequence, 8 each
+#define DELTA_OP_SIZE 1
+#define DELTA_OP_UPSERT 0x00
+#define DELTA_OP_REMOVE 0x01
+
+// Streaming: "STREAM:<request>" (plain or delta) makes the firmware push every
+// packet without waiting for packet requests; the start marker ends in
+// ":STREAM". The client grants a window of packets with "CREDIT:<hex count>",
+// the request itself grants STREAM_INITIAL_CREDITS. Missing packets are asked
+// again with "NACK:<hex>,<hex>,..." (or the usual 4-digit request) until the
+// transfer times out; retransmissions also use credits. Notifications are sent
+// as fast as the controller has buffers for them.
+#define STREAM_REQUEST_PREFIX "STREAM:"
+#define STREAM_CREDIT_PREFIX "CREDIT:"
+#define STREAM_NACK_PREFIX "NACK:"
+#define STREAM_INITIAL_CREDITS 8
+#define STREAM_MAX_CREDITS 0xFFFF
+#define STREAM_LINK_WAIT_TICKS 1
+#define STREAM_TASK_STACK_SIZE 4096
+#define STREAM_TASK_PRIORITY 2
+
+// Compact records: "<request>@1" (plain, delta or streamed) sends every packet
+// as one CompactCodec block instead of fixed size records, the start marker
+// ends in ":V1". Blocks of a delta carry the op byte of each record.
+#define COMPACT_REQUEST_SUFFIX "@1"
 
 class SendDataOverBLECallbacks : public BLECharacteristicCallbacks
 {
 public:
     void onWrite(BLECharacteristic *pCharacteristic) override;
+    void onStatus(BLECharacteristic *pCharacteristic, Status s, uint32_t code) override;
 };
 
 void sendPacket(uint16_t packetNumber, const String& requestType);
+void sendEndMarker();
+// Transfer data pinned when the request arrives, released at the end marker or on timeout
+void prepareSnapshot(const String& requestType, bool delta, const SyncCursor& since);
+void releaseSnapshot();
+void buildPacket(uint16_t packetNumber, std::vector<uint8_t>& packet);
+
+// Streaming task
+void beginStreamTask();
+void wakeStreamTask();
+void stream_loop();
 void checkTransmissionTimeout();
-uint16_t calculateTotalPackets(const String& requestType);
-size_t getItemsPerPacket(const String& requestType);
+uint16_t calculateTotalPackets();
+size_t getItemsPerPacket();
+
+// Record encoders shared by full and delta transfers
+void writeWifiNetworkRecord(uint8_t* buffer, const WifiNetwork& network, size_t& offset);
+void writeWifiDeviceRecord(uint8_t* buffer, const WifiDevice& device, size_t& offset);
+void writeBLEDeviceRecord(uint8_t* buffer, const BLEFoundDevice& device, size_t& offset);
+void writeRssiRecord(uint8_t* buffer, uint8_t kind, const MacAddress& address, uint32_t nameHash,
+                     const RssiTrack& track, size_t& offset);
 
 // Helper functions for network byte order
 void writeUint16(uint8_t* buffer, uint16_t value, size_t& offset);
 void writeUint32(uint8_t* buffer, uint32_t value, size_t& offset);
 void writeUint64(uint8_t* buffer, uint64_t value, size_t& offset);
 void writeInt8(uint8_t* buffer, int8_t value, size_t& offset);
-void writeFixedString(uint8_t* buffer, const String& str, size_t maxLength, size_t& offset);
+// handle is a StringArena handle, the string is zero padded to maxLength
+void writeFixedString(uint8_t* buffer, uint16_t handle, size_t maxLength, size_t& offset);
 void writeMacAddress(uint8_t* buffer, const MacAddress& addr, size_t& offset);
 
 #endif // BLE_DATA_TRANSFER_H
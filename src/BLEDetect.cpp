@@ -3,6 +3,9 @@
 #include "AppPreferences.h"
 #include "BLE.h"
 #include "BLEStatusUpdater.h"
+#include "DetectionWatchlist.h"
+#include "Log.h"
+#include "Console.h"
 #include <mutex>
 
 BLEDetectClass BLEDetector;
@@ -12,19 +15,19 @@ BLEDetectClass::BLEDetectClass() : isDetecting(false), pBLEScan(nullptr) {
 
 void BLEDetectClass::setup()
 {
-    Serial.println("Setting up BLE Detector");
+    Console.println("Setting up BLE Detector");
     pBLEScan = BLEDevice::getScan();
     start();
-    Serial.println("BLE Detector setup complete");
+    Console.println("BLE Detector setup complete");
 }
 
 void BLEDetectClass::start()
 {
-    Serial.println("Starting BLE Detection task");
+    Console.println("Starting BLE Detection task");
     pBLEScan = BLEDevice::getScan();
     if (pBLEScan == nullptr)
     {
-        Serial.println("Error: Failed to initialize pBLEScan");
+        Console.println("Error: Failed to initialize pBLEScan");
         return;
     }
     pBLEScan->setAdvertisedDeviceCallbacks(new BLEDetectAdvertisedDeviceCallbacks(this));
@@ -37,12 +40,12 @@ void BLEDetectClass::start()
             { static_cast<BLEDetectClass *>(parameter)->detect_loop(); },
             "BLE_Detect_Task", 4096, this, 1, &detectTaskHandle, 0);
     }
-    Serial.println("BLE Detection task started");
+    Console.println("BLE Detection task started");
 }
 
 void BLEDetectClass::stop()
 {
-    Serial.println("Stopping BLE Detection task");
+    Console.println("Stopping BLE Detection task");
     isDetecting = false;
     if (pBLEScan != nullptr)
     {
@@ -54,7 +57,7 @@ void BLEDetectClass::stop()
         vTaskDelete(detectTaskHandle);
         detectTaskHandle = nullptr;
     }
-    Serial.println("BLE Detection task stopped");
+    Console.println("BLE Detection task stopped");
 }
 
 void BLEDetectClass::cleanDetectionData()
@@ -72,8 +75,6 @@ size_t BLEDetectClass::getDetectedDevicesCount()
 
 void BLEDetectClass::BLEDetectAdvertisedDeviceCallbacks::onResult(BLEAdvertisedDevice advertisedDevice)
 {
-    std::lock_guard<std::mutex> lock(parent->detectedDevicesMutex);
-
     int rssi = advertisedDevice.getRSSI();
 
     if (rssi >= appPrefs.minimal_rssi)
@@ -82,9 +83,14 @@ void BLEDetectClass::BLEDetectAdvertisedDeviceCallbacks::onResult(BLEAdvertisedD
         memcpy(bleaddr, advertisedDevice.getAddress().getNative(), sizeof(esp_bd_addr_t));
         MacAddress deviceMac(bleaddr);
 
-        if (bleDeviceList.is_device_in_list(deviceMac))
+        // Random addresses carry no vendor prefix
+        bool isPublic = advertisedDevice.getAddressType() == BLE_ADDR_TYPE_PUBLIC;
+        bool watched = detectionWatchlist.hasBLEDevice(bleaddr) || (isPublic && detectionWatchlist.hasVendor(bleaddr));
+        // Listed devices are judged by their recent signal, not by this advertisement alone
+        if (watched && bleDeviceList.trackRssi(deviceMac, rssi) >= appPrefs.detect_rssi)
         {
-            Serial.printf("Detected BLE device: %s\n", deviceMac.toString().c_str());
+            std::lock_guard<std::mutex> lock(parent->detectedDevicesMutex);
+            LOG_INFO("Detected BLE device: %s", deviceMac);
             parent->lastDetectionTime = millis() / 1000;
 
             auto it = std::find(parent->detectedDevices.begin(), parent->detectedDevices.end(), deviceMac);
@@ -121,29 +127,29 @@ bool BLEDetectClass::isSomethingDetected()
  */
 void BLEDetectClass::detect_loop()
 {
-    Serial.println("BLEDetectClass::detect_loop - Started");
+    Console.println("BLEDetectClass::detect_loop - Started");
     while (isDetecting)
     {
         try
         {
-            Serial.printf(">> BLEDetectClass::detect_loop - Starting BLE Detection pause during %d seconds\n", appPrefs.ble_scan_delay);
+            Console.printf(">> BLEDetectClass::detect_loop - Starting BLE Detection pause during %d seconds\n", appPrefs.ble_scan_delay);
             delay(appPrefs.ble_scan_delay * 1000);
             
-            Serial.printf(">> BLEDetectClass::detect_loop - Starting BLE Detection during %d seconds\n", appPrefs.ble_scan_duration);
+            Console.printf(">> BLEDetectClass::detect_loop - Starting BLE Detection during %d seconds\n", appPrefs.ble_scan_duration);
             
             if (pBLEScan == nullptr)
             {
-                Serial.println("Error: pBLEScan is null. Reinitializing...");
+                Console.println("Error: pBLEScan is null. Reinitializing...");
                 pBLEScan = BLEDevice::getScan();
                 if (pBLEScan == nullptr)
                 {
-                    Serial.println("Failed to reinitialize pBLEScan. Skipping this iteration.");
+                    Console.println("Failed to reinitialize pBLEScan. Skipping this iteration.");
                     continue;
                 }
             }
             
             BLEScanResults foundDevices = pBLEScan->start(appPrefs.ble_scan_duration, false);
-            Serial.printf(">> BLEDetectClass::detect_loop - BLE Detection complete. %d devices found.\n", foundDevices.getCount());
+            Console.printf(">> BLEDetectClass::detect_loop - BLE Detection complete. %d devices found.\n", foundDevices.getCount());
             pBLEScan->clearResults();
             
             {
@@ -156,12 +162,12 @@ void BLEDetectClass::detect_loop()
         }
         catch (const std::exception& e)
         {
-            Serial.printf("Exception in BLEDetectClass::detect_loop: %s\n", e.what());
+            Console.printf("Exception in BLEDetectClass::detect_loop: %s\n", e.what());
         }
         catch (...)
         {
-            Serial.println("Unknown exception in BLEDetectClass::detect_loop");
+            Console.println("Unknown exception in BLEDetectClass::detect_loop");
         }
     }
-    Serial.println("BLEDetectClass::detect_loop - Ended");
+    Console.println("BLEDetectClass::detect_loop - Ended");
 }
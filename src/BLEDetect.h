@@ -5,7 +5,7 @@
 #include <BLEScan.h>
 #include <BLEAdvertisedDevice.h>
 #include "AppPreferences.h"
-#include "MACAddress.h"
+#include "MacAddress.h"
 #include <vector>
 #include <mutex>
 
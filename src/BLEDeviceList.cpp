@@ -1,12 +1,20 @@
 #include "BLEDeviceList.h"
 #include <algorithm>
 #include "AppPreferences.h"
+#include "Log.h"
+#include "Console.h"
 #include <mutex>
 
 extern time_t base_time;
 
+// Evicted devices keep their name reference while they are tombstones
+static void releaseTombstone(const BLEFoundDevice &device) {
+  stringArena.release(device.name);
+}
+
 // Constructor
-BLEDeviceList::BLEDeviceList(size_t maxSize) : maxSize(maxSize) {
+BLEDeviceList::BLEDeviceList(size_t maxSize)
+    : maxSize(maxSize), index(maxSize), lru(maxSize), changes(maxSize), sync(releaseTombstone) {
   deviceList.reserve(maxSize);
 }
 
@@ -14,49 +22,60 @@ BLEDeviceList::BLEDeviceList(size_t maxSize) : maxSize(maxSize) {
 BLEDeviceList::~BLEDeviceList() = default;
 
 // Mètode per actualitzar o afegir un dispositiu
-void BLEDeviceList::updateOrAddDevice(const MacAddress &address, int rssi, const String &name, bool isPublic) {
+void BLEDeviceList::updateOrAddDevice(const MacAddress &address, int rssi, const char *name, bool isPublic) {
   std::lock_guard<std::mutex> lock(deviceMutex);
   
-  auto it = std::find_if(deviceList.begin(), deviceList.end(),
-                         [&address](const BLEFoundDevice &device) {
-                           return device.address == address;
-                         });
+  // Ignore devices with invalid MAC addresses
+  uint8_t invalid_mac[6] = {0,0,0,0,0,0};
+  if (memcmp(address.getBytes(), invalid_mac, 6) == 0) {
+    return;
+  }
+
+  uint16_t pos = index.find(address.toUint64());
+  size_t nameLen = strlen(name);
 
   time_t now = millis() / 1000 + base_time;
 
-  if (it != deviceList.end()) {
+  if (pos != MacIndex::NOT_FOUND) {
     // Update existing device
-    it->rssi = std::max<int>(it->rssi, rssi);
-    it->last_seen = now;
-    it->times_seen++;
-    if (name.length() > 0) {
-      it->name = name;
+    BLEFoundDevice &device = deviceList[pos];
+    device.rssi = std::max<int>(device.rssi, rssi);
+    device.last_seen = now;
+    device.times_seen++;
+    if (nameLen > 0 && stringArena.find(name, nameLen) != device.name) {
+      uint16_t renamed = stringArena.intern(name, nameLen);
+      if (renamed != STRING_NONE) {
+        stringArena.release(device.name);
+        device.name = renamed;
+      }
     }
-    it->isPublic = isPublic;  // Update isPublic flag
+    device.isPublic = isPublic;  // Update isPublic flag
+    device.sequence = sync.next();
+    rssiPool.add(device.rssi_track, rssi);
+    lru.touch(pos);
+    changes.mark(pos);
   } else {
     // Add new device
     if (deviceList.size() >= maxSize) {
-      // Remove the oldest device
-      auto oldest = std::min_element(deviceList.begin(), deviceList.end(),
-                                     [](const BLEFoundDevice &a, const BLEFoundDevice &b) {
-                                       return a.last_seen < b.last_seen;
-                                     });
-      *oldest = BLEFoundDevice(address, rssi, name, isPublic, now);
+      // Replace the oldest device
+      pos = lru.front();
+      index.erase(deviceList[pos].address.toUint64());
+      // The tombstone takes over the name reference
+      sync.tombstone(deviceList[pos]);
+      rssiPool.release(deviceList[pos].rssi_track);
+      deviceList[pos] = BLEFoundDevice(address, rssi, stringArena.intern(name, nameLen), isPublic, now);
+      lru.touch(pos);
     } else {
-      deviceList.emplace_back(address, rssi, name, isPublic, now);
+      pos = deviceList.size();
+      deviceList.emplace_back(address, rssi, stringArena.intern(name, nameLen), isPublic, now);
+      lru.pushBack(pos);
     }
-    Serial.printf("Added new BLE device: %s %s\n", address.toString().c_str(), name.c_str());
+    deviceList[pos].sequence = sync.next();
+    rssiPool.add(deviceList[pos].rssi_track, rssi);
+    index.insert(address.toUint64(), pos);
+    changes.mark(pos);
+    LOG_INFO("Added new BLE device: %s %s", address, name);
   }
-
-  // Remove devices with invalid MAC addresses
-  deviceList.erase(
-    std::remove_if(deviceList.begin(), deviceList.end(),
-      [](const BLEFoundDevice &device) {
-        uint8_t invalid_mac[6] = {0,0,0,0,0,0};
-        return memcmp(device.address.getBytes(), invalid_mac, 6) == 0;
-      }),
-    deviceList.end()
-  );
 }
 
 // Mètode per obtenir la mida de la llista
@@ -66,19 +85,99 @@ size_t BLEDeviceList::size() const {
 
 // Mètode per obtenir una còpia clonada de la llista
 std::vector<BLEFoundDevice> BLEDeviceList::getClonedList() const {
-  return deviceList;  // Return a copy of the list to avoid locking issues
+  std::lock_guard<std::mutex> lock(deviceMutex);
+  return deviceList;
+}
+
+ListChanges<BLEFoundDevice> BLEDeviceList::takeChanges(bool full) {
+  std::lock_guard<std::mutex> lock(deviceMutex);
+  return changes.take(deviceList, full);
+}
+
+void BLEDeviceList::markAllChanged() {
+  std::lock_guard<std::mutex> lock(deviceMutex);
+  changes.markAll();
+}
+
+SyncDelta<BLEFoundDevice> BLEDeviceList::getChangesSince(const SyncCursor &since) const {
+  std::lock_guard<std::mutex> lock(deviceMutex);
+  return sync.collect(deviceList, since);
 }
 
 void BLEDeviceList::addDevice(const BLEFoundDevice& device) {
   std::lock_guard<std::mutex> lock(deviceMutex);
+  uint8_t invalid_mac[6] = {0,0,0,0,0,0};
+  if (deviceList.size() >= maxSize || memcmp(device.address.getBytes(), invalid_mac, 6) == 0 ||
+      index.find(device.address.toUint64()) != MacIndex::NOT_FOUND) {
+    LOG_DEBUG("Skipped BLE device: %s", device.address);
+    stringArena.release(device.name);
+    return;
+  }
+  uint16_t pos = deviceList.size();
   deviceList.push_back(device);
-  Serial.printf("Added new BLE device: %s %s\n", device.address.toString().c_str(), device.name.c_str());
+  deviceList[pos].sequence = sync.next();
+  index.insert(device.address.toUint64(), pos);
+  changes.mark(pos);
+  lru.insertOrdered(pos, [this](uint16_t a, uint16_t b) {
+    return deviceList[a].last_seen < deviceList[b].last_seen;
+  });
+  LOG_DEBUG("Added new BLE device: %s %s", device.address, stringArena.get(device.name));
+}
+
+/**
+ * @brief Takes over the records decoded from flash under a single lock.
+ *
+ * Devices already in the list were seen while the load was running: they keep
+ * their live values and add the stored counters. Duplicates, null addresses
+ * and records past maxSize are dropped, and with them their name references.
+ */
+void BLEDeviceList::adoptLoaded(std::vector<BLEFoundDevice> &&loaded) {
+  std::lock_guard<std::mutex> lock(deviceMutex);
+  uint8_t invalid_mac[6] = {0,0,0,0,0,0};
+  size_t live = deviceList.size();
+  for (auto &device : loaded) {
+    if (memcmp(device.address.getBytes(), invalid_mac, 6) == 0) {
+      stringArena.release(device.name);
+      continue;
+    }
+    uint16_t pos = index.find(device.address.toUint64());
+    if (pos != MacIndex::NOT_FOUND) {
+      BLEFoundDevice &current = deviceList[pos];
+      current.times_seen += device.times_seen;
+      current.last_seen = std::max(current.last_seen, device.last_seen);
+      if (current.name == STRING_NONE) {
+        current.name = device.name;
+      } else {
+        stringArena.release(device.name);
+      }
+      current.sequence = sync.next();
+    } else if (deviceList.size() < maxSize) {
+      device.sequence = sync.next();
+      index.insert(device.address.toUint64(), deviceList.size());
+      deviceList.push_back(device);
+    } else {
+      stringArena.release(device.name);
+    }
+  }
+  lru.rebuild(deviceList.size(), [this](uint16_t a, uint16_t b) {
+    return deviceList[a].last_seen < deviceList[b].last_seen;
+  });
+  changes.markAll();
+  LOG_INFO("Adopted %zu stored BLE devices (%zu live)", deviceList.size() - live, live);
 }
 
 void BLEDeviceList::clear() {
   std::lock_guard<std::mutex> lock(deviceMutex);
+  for (auto &device : deviceList) {
+    rssiPool.release(device.rssi_track);
+    stringArena.release(device.name);
+  }
   deviceList.clear();
-  Serial.println("BLE device list cleared");
+  index.clear();
+  lru.clear();
+  changes.markAll();
+  sync.restart();
+  Console.println("BLE device list cleared");
 }
 
 void BLEDeviceList::remove_irrelevant_devices() {
@@ -89,29 +188,52 @@ void BLEDeviceList::remove_irrelevant_devices() {
   }
 
   size_t initial_size = deviceList.size();
-  Serial.printf("Removing irrelevant BLE devices. List size: %zu\n", initial_size);
-
+  LOG_INFO("Removing irrelevant BLE devices. List size: %zu", initial_size);
+
+  for (auto &device : deviceList) {
+    LOG_DEBUG("Checking BLE device: %s, rssi: %d (minimal_rssi: %d)",
+              device.address, device.rssi, appPrefs.minimal_rssi);
+    if (device.rssi < appPrefs.minimal_rssi) {
+      sync.tombstone(device);
+      rssiPool.release(device.rssi_track);
+    }
+  }
   deviceList.erase(
     std::remove_if(deviceList.begin(), deviceList.end(),
       [](const BLEFoundDevice &device) {
-        Serial.printf("Checking BLE device: %s, rssi: %d (minimal_rssi: %d)\n", 
-                      device.address.toString().c_str(), device.rssi, appPrefs.minimal_rssi);
         return device.rssi < appPrefs.minimal_rssi;
       }),
     deviceList.end()
   );
+  rebuildIndex();
 
-  Serial.printf("Removed %zu irrelevant BLE devices. New list size: %zu\n", initial_size - deviceList.size(), deviceList.size());
-  Serial.println("BLEDeviceList::remove_irrelevant_devices - Exiting");
+  LOG_INFO("Removed %zu irrelevant BLE devices. New list size: %zu", initial_size - deviceList.size(), deviceList.size());
 }
 
-bool BLEDeviceList::is_device_in_list(const MacAddress& address) {
-  auto deviceListCopy = getClonedList();
-  auto it = std::find_if(deviceListCopy.begin(), deviceListCopy.end(),
-                         [&address](const BLEFoundDevice &device) {
-                           return device.address == address;
-                         });
+// Must be called with deviceMutex held, after positions in deviceList changed
+void BLEDeviceList::rebuildIndex() {
+  index.clear();
+  changes.markAll();
+  for (uint16_t pos = 0; pos < deviceList.size(); pos++) {
+    index.insert(deviceList[pos].address.toUint64(), pos);
+  }
+  lru.rebuild(deviceList.size(), [this](uint16_t a, uint16_t b) {
+    return deviceList[a].last_seen < deviceList[b].last_seen;
+  });
+}
 
-  return it != deviceListCopy.end();
+bool BLEDeviceList::is_device_in_list(const MacAddress& address) {
+  std::lock_guard<std::mutex> lock(deviceMutex);
+  return index.find(address.toUint64()) != MacIndex::NOT_FOUND;
 }
 
+int8_t BLEDeviceList::trackRssi(const MacAddress &address, int8_t rssi) {
+  std::lock_guard<std::mutex> lock(deviceMutex);
+  uint16_t pos = index.find(address.toUint64());
+  if (pos == MacIndex::NOT_FOUND) {
+    return rssi;
+  }
+  RssiTrack &track = deviceList[pos].rssi_track;
+  rssiPool.add(track, rssi);
+  return track.current();
+}
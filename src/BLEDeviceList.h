@@ -3,22 +3,36 @@
 #include <Arduino.h>
 #include <vector>
 #include <mutex>
-#include "MACAddress.h"
+#include <type_traits>
+#include "MacAddress.h"
+#include "MacIndex.h"
+#include "LruList.h"
+#include "ListChanges.h"
+#include "SyncLog.h"
+#include "OuiVendor.h"
+#include "RssiTrack.h"
+#include "StringArena.h"
 
 // Estructura para dispositivos BLE encontrados
 struct BLEFoundDevice {
   MacAddress address;
   int8_t rssi;
-  String name;
+  uint16_t name;      // stringArena handle, one reference held by the list
   bool isPublic;
   time_t last_seen;
   uint32_t times_seen;
+  uint32_t sequence;  // SyncLog stamp of the last change
+  uint16_t vendor;    // OuiVendor id of public addresses, looked up once when the record is created
+  RssiTrack rssi_track; // Recent readings, unlike rssi
 
   // Constructor existente
-  BLEFoundDevice(const MacAddress& addr, int8_t r, const String& n, bool isPublic, time_t seen, uint32_t times_seen = 1)
-    : address(addr), rssi(r), name(n), isPublic(isPublic), last_seen(seen), times_seen(times_seen) {}
+  BLEFoundDevice(const MacAddress& addr, int8_t r, uint16_t n, bool isPublic, time_t seen, uint32_t times_seen = 1)
+    : address(addr), rssi(r), name(n), isPublic(isPublic), last_seen(seen), times_seen(times_seen), sequence(0),
+      vendor(isPublic ? ouiVendorId(addr.getBytes()) : OUI_VENDOR_UNKNOWN) {}
 };
 
+static_assert(std::is_trivially_copyable<BLEFoundDevice>::value, "clones and tombstones are flat copies");
+
 class BLEDeviceList {
 public:
   explicit BLEDeviceList(size_t maxSize);
@@ -29,17 +43,36 @@ public:
   BLEDeviceList& operator=(const BLEDeviceList&) = delete;
 
   // Métodos públicos
-  void updateOrAddDevice(const MacAddress &address, int rssi, const String &name, bool isPublic);
+  void updateOrAddDevice(const MacAddress &address, int rssi, const char *name, bool isPublic);
   size_t size() const;
   std::vector<BLEFoundDevice> getClonedList() const;
+  // Records changed since the previous call, the whole list when full is set
+  ListChanges<BLEFoundDevice> takeChanges(bool full = false);
+  // Makes the next takeChanges() return the whole list
+  void markAllChanged();
+  // Records changed after a delta sync cursor
+  SyncDelta<BLEFoundDevice> getChangesSince(const SyncCursor &since) const;
+  // Takes over the name reference of device, released if it is not added
   void addDevice(const BLEFoundDevice& device);
+  // Bulk load: takes over the records decoded from flash in one step, with
+  // their name references
+  void adoptLoaded(std::vector<BLEFoundDevice> &&loaded);
   void clear();
   void remove_irrelevant_devices();
   bool is_device_in_list(const MacAddress& address);
+  // Adds a reading to the RssiTrack of a listed device and returns its current
+  // proximity, rssi itself if the device is not listed
+  int8_t trackRssi(const MacAddress &address, int8_t rssi);
 
 private:
+  void rebuildIndex();
+
   std::vector<BLEFoundDevice> deviceList;
   size_t maxSize;
+  MacIndex index;   // address -> position in deviceList
+  LruList lru;      // positions ordered by last_seen, front is the eviction candidate
+  DirtyTracker changes; // positions changed since the last save
+  SyncLog<BLEFoundDevice> sync; // change sequence for delta sync clients
 
   // Mutex de C++
   mutable std::mutex deviceMutex;
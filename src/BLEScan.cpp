@@ -1,7 +1,9 @@
 #include "BLEScan.h"
 #include "BLEDeviceList.h"
-#include "MACAddress.h"
+#include "MacAddress.h"
 #include "AppPreferences.h"
+#include "Log.h"
+#include "Console.h"
 
 extern BLEDeviceList bleDeviceList;
 extern AppPreferencesData appPrefs;
@@ -11,15 +13,15 @@ BLEScanClass BLEScanner;
 BLEScanAdvertisedDeviceCallbacks::BLEScanAdvertisedDeviceCallbacks(BLEScanClass* scan) : scan(scan) {}
 
 void BLEScanClass::setup() {
-    Serial.println("Setting up BLE Scanner");
+    Console.println("Setting up BLE Scanner");
     pBLEScan = BLEDevice::getScan();
     callbacks = new BLEScanAdvertisedDeviceCallbacks(this);
     start();
-    Serial.println("BLE Scanner setup complete");
+    Console.println("BLE Scanner setup complete");
 }
 
 void BLEScanClass::start() {
-    Serial.println("Starting BLE Scan task");
+    Console.println("Starting BLE Scan task");
     pBLEScan->setAdvertisedDeviceCallbacks(callbacks);
     pBLEScan->setActiveScan(true);
     if (!isScanning) {
@@ -28,11 +30,11 @@ void BLEScanClass::start() {
             [](void* parameter) { static_cast<BLEScanClass*>(parameter)->scan_loop(); },
             "BLE_Scan_Task", 4096, this, 1, &scanTaskHandle, 0);
     }
-    Serial.println("BLE Scan task started");
+    Console.println("BLE Scan task started");
 }
 
 void BLEScanClass::stop() {
-    Serial.println("Stopping BLE Scan task");
+    Console.println("Stopping BLE Scan task");
     pBLEScan->stop();
     pBLEScan->setAdvertisedDeviceCallbacks(nullptr);
     if (isScanning) {
@@ -41,19 +43,19 @@ void BLEScanClass::stop() {
         scanTaskHandle = nullptr;
         pBLEScan->stop();
     }
-    Serial.println("BLE Scan task stopped");
+    Console.println("BLE Scan task stopped");
 }
 
 void BLEScanClass::scan_loop() {
-    Serial.println("ScanLoop started");
+    Console.println("ScanLoop started");
     while (true) {
         delay(appPrefs.ble_scan_delay * 1000);
-        Serial.println("Starting BLE Scan");
+        Console.println("Starting BLE Scan");
         pBLEScan->setInterval(100);
         pBLEScan->setWindow(90);
         pBLEScan->setActiveScan(!appPrefs.passive_scan);
         BLEScanResults foundDevices = pBLEScan->start(appPrefs.ble_scan_duration, false);
-        Serial.printf("BLE Scan complete. %d devices found.\n", foundDevices.getCount());
+        Console.printf("BLE Scan complete. %d devices found.\n", foundDevices.getCount());
     }
 }
 
@@ -65,9 +67,9 @@ void printHexDump(const uint8_t* data, size_t length) {
         // Print offset at the start of each line
         if (i % 16 == 0) {
             if (i != 0) {
-                Serial.printf("  |%s|\n", formatted_ascii);
+                Console.printf("  |%s|\n", formatted_ascii);
             }
-            Serial.printf("%08x  ", i);
+            Console.printf("%08x  ", i);
             // Initialize ascii buffer for new line
             memset(ascii, 0, sizeof(ascii));
             memset(formatted_ascii, ' ', sizeof(formatted_ascii) - 1);
@@ -75,7 +77,7 @@ void printHexDump(const uint8_t* data, size_t length) {
         }
 
         // Print hex value
-        Serial.printf("%02x ", data[i]);
+        Console.printf("%02x ", data[i]);
         
         // Store ASCII representation
         ascii[i % 16] = (data[i] >= 32 && data[i] <= 126) ? data[i] : '.';
@@ -83,7 +85,7 @@ void printHexDump(const uint8_t* data, size_t length) {
 
         // Print extra space between 8th and 9th bytes
         if ((i + 1) % 8 == 0 && (i + 1) % 16 != 0) {
-            Serial.print(" ");
+            Console.print(" ");
         }
     }
 
@@ -91,14 +93,14 @@ void printHexDump(const uint8_t* data, size_t length) {
     if (length % 16 != 0) {
         size_t padding = 16 - (length % 16);
         for (size_t i = 0; i < padding; i++) {
-            Serial.print("   ");
+            Console.print("   ");
             if ((length + i + 1) % 8 == 0 && (length + i + 1) % 16 != 0) {
-                Serial.print(" ");
+                Console.print(" ");
             }
         }
-        Serial.printf("  |%s|\n", formatted_ascii);
+        Console.printf("  |%s|\n", formatted_ascii);
     } else if (length > 0) {
-        Serial.printf("  |%s|\n", formatted_ascii);
+        Console.printf("  |%s|\n", formatted_ascii);
     }
 }
 
@@ -107,17 +109,11 @@ void BLEScanAdvertisedDeviceCallbacks::onResult(BLEAdvertisedDevice advertisedDe
         int rssi = advertisedDevice.getRSSI();
 
         if (rssi >= appPrefs.minimal_rssi) {
-            // Move string operations outside of the critical section
-            std::string addressStr = advertisedDevice.getAddress().toString();
-            std::string nameStr = advertisedDevice.haveName() ? advertisedDevice.getName() : "";
-            std::string appearanceStr = std::to_string(advertisedDevice.getAppearance());
-            std::string uuidStr = advertisedDevice.haveServiceUUID() ? advertisedDevice.getServiceUUID().toString() : "";
-
             esp_bd_addr_t bleaddr;
             memcpy(bleaddr, advertisedDevice.getAddress().getNative(), sizeof(esp_bd_addr_t));
 
             boolean isPublic = false;
-            String addressType;
+            const char *addressType;
             switch (advertisedDevice.getAddressType()) {
                 case BLE_ADDR_TYPE_PUBLIC:
                     addressType = "public";
@@ -138,33 +134,24 @@ void BLEScanAdvertisedDeviceCallbacks::onResult(BLEAdvertisedDevice advertisedDe
                     break;
             }
 
-            // Base output always includes address and type
-            Serial.printf("Address: %s (%s)", 
-                addressStr.c_str(), addressType.c_str());
-
-            // Optional fields only if they have value
-            if (!nameStr.empty()) {
-                Serial.printf(", Name: '%s'", nameStr.c_str());
-            }
-
-            uint16_t appearance = advertisedDevice.getAppearance();
-            if (appearance != 0) {
-                Serial.printf(", Appearance: %d", appearance);
-            }
-
-            if (advertisedDevice.haveServiceUUID()) {
-                Serial.printf(", Service UUID: %s", uuidStr.c_str());
-            }
-
-            Serial.println(); // End the line
+            // The arguments are only evaluated when debug logging is compiled in
+            LOG_DEBUG("Address: %s (%s), Name: '%s', Appearance: %u, Service UUID: %s",
+                      MacAddress(bleaddr), addressType,
+                      advertisedDevice.haveName() ? advertisedDevice.getName() : std::string(),
+                      advertisedDevice.getAppearance(),
+                      advertisedDevice.haveServiceUUID() ? advertisedDevice.getServiceUUID().toString() : std::string());
 
-            // Print payload in hexdump format
+#if SNEAK_LOG_LEVEL >= LOG_LEVEL_VERBOSE
+            // The hexdump writes to the serial port synchronously, verbose builds only
             if (advertisedDevice.getPayloadLength() > 0) {
-                Serial.println("Payload hexdump:");
+                logger.flush();
+                Console.println("Payload hexdump:");
                 printHexDump(advertisedDevice.getPayload(), advertisedDevice.getPayloadLength());
             }
+#endif
 
-            if (addressStr == "00:00:00:00:00:00") {
+            static const uint8_t invalidAddress[6] = {0, 0, 0, 0, 0, 0};
+            if (memcmp(bleaddr, invalidAddress, sizeof(invalidAddress)) == 0) {
                 // This is an invalid address, ignore it
                 return;
             }
@@ -179,14 +166,16 @@ void BLEScanAdvertisedDeviceCallbacks::onResult(BLEAdvertisedDevice advertisedDe
                 std::lock_guard<std::mutex> lock(scan->mtx);
 
                 if (!appPrefs.ignore_random_ble_addresses || isPublic) {
-                    bleDeviceList.updateOrAddDevice(MacAddress(bleaddr), rssi, String(nameStr.c_str()), isPublic);
+                    bleDeviceList.updateOrAddDevice(MacAddress(bleaddr), rssi,
+                                                    advertisedDevice.haveName() ? advertisedDevice.getName().c_str() : "",
+                                                    isPublic);
                 }
 
             }
         }
     } catch (const std::exception &e) {
-        Serial.printf("Exception in onResult: %s\n", e.what());
+        Console.printf("Exception in onResult: %s\n", e.what());
     } catch (...) {
-        Serial.println("Unknown exception in onResult");
+        Console.println("Unknown exception in onResult");
     }
 }
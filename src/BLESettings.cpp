@@ -6,6 +6,7 @@
 #include "WifiDetect.h"
 #include "BLEScan.h"
 #include "BLEDetect.h"
+#include "Console.h"
 
 extern AppPreferencesData appPrefs;
 extern void saveAppPreferences();
@@ -22,7 +23,7 @@ void SettingsCallbacks::onWrite(BLECharacteristic *pCharacteristic)
     int8_t wifi_tx_power = appPrefs.wifiTxPower;
     int8_t ble_tx_power = appPrefs.bleTxPower;
 
-    Serial.printf("SettingsCallbacks::onWrite -> %s\n", value.c_str());
+    Console.printf("SettingsCallbacks::onWrite -> %s\n", value.c_str());
 
     // Read values
     if (std::getline(ss, token, '|'))
@@ -149,7 +150,7 @@ void SettingsCallbacks::onRead(BLECharacteristic *pCharacteristic)
 
 void SettingsCallbacks::updateBLEDeviceName(const char *newName)
 {
-    Serial.printf("Updating BLE device name to: %s\n", newName);
+    Console.printf("Updating BLE device name to: %s\n", newName);
 
     // Stop advertising
     BLEDevice::stopAdvertising();
@@ -160,5 +161,5 @@ void SettingsCallbacks::updateBLEDeviceName(const char *newName)
     // Restart advertising
     BLEDevice::startAdvertising();
 
-    Serial.println("BLE device name updated and advertising restarted");
+    Console.println("BLE device name updated and advertising restarted");
 }
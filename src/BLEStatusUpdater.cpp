@@ -1,57 +1,112 @@
 #include "BLEStatusUpdater.h"
+#include <BLECharacteristic.h>
+#include <stddef.h>
+#include "WifiDetect.h"
+#include "WifiScan.h"
+#include "BLEDetect.h"
+#include "WifiDeviceList.h"
+#include "WifiNetworkList.h"
+#include "BLEDeviceList.h"
+#include "Log.h"
+
+// External variables from BLE.cpp
+extern BLECharacteristic *pStatusCharacteristic;
+extern bool deviceConnected;
+
+extern WifiNetworkList ssidList;
+extern WifiDeviceList stationsList;
+extern BLEDeviceList bleDeviceList;
 
 BLEStatusUpdaterClass BLEStatusUpdater;
 
-void BLEStatusUpdaterClass::update()
+namespace
+{
+    // The flags and the list counts; the uptime, the free heap and the capture counters move all the time
+    bool sameContent(const BLEStatusSnapshot &a, const BLEStatusSnapshot &b)
+    {
+        const size_t start = offsetof(BLEStatusSnapshot, wifi_networks);
+        const size_t end = offsetof(BLEStatusSnapshot, frames);
+        return a.version == b.version && a.flags == b.flags &&
+               memcmp(reinterpret_cast<const uint8_t *>(&a) + start, reinterpret_cast<const uint8_t *>(&b) + start,
+                      end - start) == 0;
+    }
+}
+
+BLEStatusUpdaterClass::BLEStatusUpdaterClass() : generation(0), notifiedGeneration(0), lastNotify(0)
 {
-    static String last_statusString = "";
-
-    // External variables from BLE.cpp
-    extern BLECharacteristic *pStatusCharacteristic;
-    extern bool deviceConnected;
-
-    // External variables from BLE.cpp
-    extern WifiNetworkList ssidList;
-    extern WifiDeviceList stationsList;
-    extern BLEDeviceList bleDeviceList;
-
-    // First 3 fields from updateListSizesCharacteristic
-    size_t ssids_size = ssidList.size();
-    size_t stations_size = stationsList.size();
-    size_t ble_devices_size = bleDeviceList.size();
-
-    // Next 3 fields from updateDetectedDevicesCharacteristic
-    size_t detected_ssids_size = WifiDetector.getDetectedNetworksCount();
-    size_t detected_stations_size = WifiDetector.getDetectedDevicesCount();
-    size_t detected_ble_devices_size = BLEDetector.getDetectedDevicesCount();
-
-    // Remaining fields
-    bool alarm = BLEDetector.isSomethingDetected() | WifiDetector.isSomethingDetected();
-    size_t free_heap = ESP.getFreeHeap();
-    unsigned long uptime = millis() / 1000; // Convert milliseconds to seconds
-
-    // Create comprehensive status string
-    String statusString = String(ssids_size) + ":" +
-                          String(stations_size) + ":" +
-                          String(ble_devices_size) + ":" +
-                          String(detected_ssids_size) + ":" +
-                          String(detected_stations_size) + ":" +
-                          String(detected_ble_devices_size) + ":" +
-                          String(alarm) + ":" +
-                          String(free_heap) + ":";
-
-    String statusStringWithUptime = statusString + String(uptime);
-
-    pStatusCharacteristic->setValue(statusStringWithUptime.c_str());
-    Serial.printf("Status updated -> %s\n", statusStringWithUptime.c_str());
-
-    if (deviceConnected)
+    memset(&current, 0, sizeof(current));
+}
+
+void BLEStatusUpdaterClass::build(BLEStatusSnapshot &status)
+{
+    CaptureStatsSnapshot capture = WifiScanner.getCaptureStats().snapshot();
+    uint32_t frames = 0;
+    for (uint8_t type = 0; type < 4; type++)
+        for (uint8_t subtype = 0; subtype < 16; subtype++)
+            frames += capture.frames[type][subtype];
+
+    memset(&status, 0, sizeof(status));
+    status.version = BLE_STATUS_VERSION;
+    status.flags = (BLEDetector.isSomethingDetected() || WifiDetector.isSomethingDetected()) ? BLE_STATUS_FLAG_ALARM : 0;
+    status.uptime = millis() / 1000;
+    status.free_heap = ESP.getFreeHeap();
+    status.wifi_networks = ssidList.size();
+    status.wifi_devices = stationsList.size();
+    status.ble_devices = bleDeviceList.size();
+    status.detected_networks = WifiDetector.getDetectedNetworksCount();
+    status.detected_devices = WifiDetector.getDetectedDevicesCount();
+    status.detected_ble_devices = BLEDetector.getDetectedDevicesCount();
+    status.frames = frames;
+    status.fcs_failures = capture.fcs_failures;
+    // Only the queue of the current operation mode is in use
+    status.queue_dropped = WifiScanner.getQueueStats().dropped + WifiDetector.getQueueStats().dropped;
+}
+
+void BLEStatusUpdaterClass::publish(bool setValue)
+{
+    BLEStatusSnapshot next;
+    build(next);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    bool changed = !sameContent(next, current);
+    if (changed)
     {
-        if (last_statusString.isEmpty() || last_statusString != statusString)
-        {
-            Serial.println("Notifying status");
-            pStatusCharacteristic->notify();
-            last_statusString = statusString;
-        }
+        generation++;
     }
-} 
\ No newline at end of file
+    next.generation = generation;
+    current = next;
+
+    if (pStatusCharacteristic == nullptr)
+    {
+        return;
+    }
+    bool notify = deviceConnected && notifiedGeneration != generation &&
+                  millis() - lastNotify >= BLE_STATUS_MIN_INTERVAL_MS;
+    if (changed || setValue || notify)
+    {
+        pStatusCharacteristic->setValue(reinterpret_cast<uint8_t *>(&current), sizeof(current));
+    }
+    if (notify)
+    {
+        LOG_DEBUG("Notifying status generation %u", generation);
+        pStatusCharacteristic->notify();
+        notifiedGeneration = generation;
+        lastNotify = millis();
+    }
+}
+
+void BLEStatusUpdaterClass::update()
+{
+    publish(false);
+}
+
+void BLEStatusUpdaterClass::refresh()
+{
+    publish(true);
+}
+
+uint32_t BLEStatusUpdaterClass::getGeneration()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return generation;
+}
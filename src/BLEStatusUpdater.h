@@ -1,19 +1,74 @@
 #pragma once
 
 #include <Arduino.h>
-#include "WifiDetect.h"
-#include "BLEDetect.h"
-#include "WifiDeviceList.h"
-#include "WifiNetworkList.h"
-#include "BLEDeviceList.h"
+#include <mutex>
 
+// Version 1 was the colon separated text, whose first byte is always a digit
+#define BLE_STATUS_VERSION 2
 
+#define BLE_STATUS_FLAG_ALARM 0x01
+
+// Minimum time between two status notifications, changes in between are coalesced
+#ifndef BLE_STATUS_MIN_INTERVAL_MS
+#define BLE_STATUS_MIN_INTERVAL_MS 1000
+#endif
+
+/**
+ * @brief Wire format of the status characteristic (little endian).
+ *
+ * The generation changes whenever the flags or a list count change, so a
+ * client only has to compare one integer. uptime, free_heap and the capture
+ * counters from frames on do not bump it; they are current in every value
+ * sent, but a change of theirs alone is not notified.
+ */
+struct __attribute__((packed)) BLEStatusSnapshot {
+    uint8_t version;                // BLE_STATUS_VERSION
+    uint8_t flags;                  // BLE_STATUS_FLAG_*
+    uint16_t reserved;
+    uint32_t generation;
+    uint32_t uptime;                // Seconds since boot
+    uint32_t free_heap;
+    uint16_t wifi_networks;
+    uint16_t wifi_devices;
+    uint16_t ble_devices;
+    uint16_t detected_networks;
+    uint16_t detected_devices;
+    uint16_t detected_ble_devices;
+    uint32_t frames;                // Valid frames captured since the last capture stats reset
+    uint32_t fcs_failures;
+    uint32_t queue_dropped;         // Frames lost because the frame queue was full
+};
+
+/**
+ * @brief Keeps the status characteristic up to date.
+ *
+ * update() is cheap enough for every loop iteration: the status is built on
+ * the stack, the characteristic value is only rewritten when something
+ * changed, and notifications are sent at most every BLE_STATUS_MIN_INTERVAL_MS.
+ * A change made during that interval is notified once it expires, by a later
+ * update().
+ */
 class BLEStatusUpdaterClass {
 
 public:
+    BLEStatusUpdaterClass();
+
     void update();
-};
 
-extern BLEStatusUpdaterClass BLEStatusUpdater;
+    // update() that always rewrites the value, for reads of the characteristic
+    void refresh();
+
+    uint32_t getGeneration();
 
+private:
+    void publish(bool setValue);
+    static void build(BLEStatusSnapshot &status);
 
+    std::mutex mutex;
+    BLEStatusSnapshot current;
+    uint32_t generation;
+    uint32_t notifiedGeneration;
+    uint32_t lastNotify;
+};
+
+extern BLEStatusUpdaterClass BLEStatusUpdater;
@@ -0,0 +1,93 @@
+#include "CaptureStats.h"
+
+namespace
+{
+  const char *const typeNames[4] = {"mgmt", "ctrl", "data", "ext"};
+}
+
+CaptureStats::CaptureStats() : tooShort(0), fcsFailures(0), belowRssi(0)
+{
+  for (uint8_t type = 0; type < 4; type++)
+    for (uint8_t subtype = 0; subtype < 16; subtype++)
+      frames[type][subtype].store(0);
+  for (uint8_t i = 0; i < CAPTURE_STATS_CHANNELS; i++)
+  {
+    channelFrames[i].store(0);
+    channelBytes[i].store(0);
+  }
+  memset(&baseline, 0, sizeof(baseline));
+}
+
+void CaptureStats::read(CaptureStatsSnapshot &raw) const
+{
+  memset(&raw, 0, sizeof(raw));
+  raw.version = CAPTURE_STATS_VERSION;
+  raw.channels = CAPTURE_STATS_CHANNELS;
+  raw.uptime = millis() / 1000;
+  raw.too_short = tooShort.load(std::memory_order_relaxed);
+  raw.fcs_failures = fcsFailures.load(std::memory_order_relaxed);
+  raw.below_rssi = belowRssi.load(std::memory_order_relaxed);
+  for (uint8_t type = 0; type < 4; type++)
+    for (uint8_t subtype = 0; subtype < 16; subtype++)
+      raw.frames[type][subtype] = frames[type][subtype].load(std::memory_order_relaxed);
+  for (uint8_t i = 0; i < CAPTURE_STATS_CHANNELS; i++)
+  {
+    raw.channel_frames[i] = channelFrames[i].load(std::memory_order_relaxed);
+    raw.channel_bytes[i] = channelBytes[i].load(std::memory_order_relaxed);
+  }
+}
+
+CaptureStatsSnapshot CaptureStats::snapshot() const
+{
+  CaptureStatsSnapshot stats;
+  read(stats);
+  stats.seconds = stats.uptime - baseline.uptime;
+  stats.too_short -= baseline.too_short;
+  stats.fcs_failures -= baseline.fcs_failures;
+  stats.below_rssi -= baseline.below_rssi;
+  for (uint8_t type = 0; type < 4; type++)
+    for (uint8_t subtype = 0; subtype < 16; subtype++)
+      stats.frames[type][subtype] -= baseline.frames[type][subtype];
+  for (uint8_t i = 0; i < CAPTURE_STATS_CHANNELS; i++)
+  {
+    stats.channel_frames[i] -= baseline.channel_frames[i];
+    stats.channel_bytes[i] -= baseline.channel_bytes[i];
+  }
+  return stats;
+}
+
+void CaptureStats::reset()
+{
+  read(baseline);
+}
+
+String CaptureStats::toString() const
+{
+  CaptureStatsSnapshot stats = snapshot();
+  char line[96];
+  String text;
+
+  snprintf(line, sizeof(line), "Capture stats over %u s: too short %u, FCS failures %u, below RSSI %u\n",
+           stats.seconds, stats.too_short, stats.fcs_failures, stats.below_rssi);
+  text += line;
+
+  for (uint8_t type = 0; type < 4; type++)
+  {
+    for (uint8_t subtype = 0; subtype < 16; subtype++)
+    {
+      if (stats.frames[type][subtype] > 0)
+      {
+        snprintf(line, sizeof(line), "  %s/%2u: %u\n", typeNames[type], subtype, stats.frames[type][subtype]);
+        text += line;
+      }
+    }
+  }
+
+  text += "Ch | Frames   | Bytes\n";
+  for (uint8_t i = 0; i < CAPTURE_STATS_CHANNELS; i++)
+  {
+    snprintf(line, sizeof(line), "%2u | %8u | %u\n", i + 1, stats.channel_frames[i], stats.channel_bytes[i]);
+    text += line;
+  }
+  return text;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+
+#define CAPTURE_STATS_VERSION 1
+#define CAPTURE_STATS_CHANNELS 14
+
+/**
+ * @brief Wire format of the capture statistics characteristic (little endian).
+ *
+ * Counters are totals since boot or the last reset.
+ */
+struct __attribute__((packed)) CaptureStatsSnapshot {
+  uint8_t version;                                // CAPTURE_STATS_VERSION
+  uint8_t channels;                               // CAPTURE_STATS_CHANNELS
+  uint16_t reserved;
+  uint32_t uptime;                                // Seconds since boot
+  uint32_t seconds;                               // Seconds covered by the counters
+  uint32_t too_short;                             // Shorter than a management header + FCS
+  uint32_t fcs_failures;                          // rx_state != 0
+  uint32_t below_rssi;                            // Under appPrefs.minimal_rssi
+  uint32_t frames[4][16];                         // Valid frames by type and subtype
+  uint32_t channel_frames[CAPTURE_STATS_CHANNELS];
+  uint32_t channel_bytes[CAPTURE_STATS_CHANNELS];
+};
+
+/**
+ * @brief Counters of the capture path, updated by the promiscuous callback.
+ *
+ * Only the WiFi driver task writes the counters, so plain load/store atomics
+ * are enough. A reset stores the current values as a baseline instead of
+ * touching the counters from another task.
+ */
+class CaptureStats {
+public:
+  CaptureStats();
+
+  CaptureStats(const CaptureStats&) = delete;
+  CaptureStats& operator=(const CaptureStats&) = delete;
+
+  void countTooShort() { increment(tooShort); }
+  void countFcsFailure() { increment(fcsFailures); }
+  void countBelowRssi() { increment(belowRssi); }
+
+  void countFrame(uint8_t type, uint8_t subtype, uint8_t channel, uint16_t length)
+  {
+    increment(frames[type & 0x03][subtype & 0x0F]);
+    if (channel >= 1 && channel <= CAPTURE_STATS_CHANNELS)
+    {
+      increment(channelFrames[channel - 1]);
+      channelBytes[channel - 1].store(channelBytes[channel - 1].load(std::memory_order_relaxed) + length,
+                                      std::memory_order_relaxed);
+    }
+  }
+
+  CaptureStatsSnapshot snapshot() const;
+  void reset();
+  String toString() const;
+
+private:
+  static void increment(std::atomic<uint32_t> &counter)
+  {
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+
+  void read(CaptureStatsSnapshot &raw) const;
+
+  std::atomic<uint32_t> tooShort;
+  std::atomic<uint32_t> fcsFailures;
+  std::atomic<uint32_t> belowRssi;
+  std::atomic<uint32_t> frames[4][16];
+  std::atomic<uint32_t> channelFrames[CAPTURE_STATS_CHANNELS];
+  std::atomic<uint32_t> channelBytes[CAPTURE_STATS_CHANNELS];
+
+  CaptureStatsSnapshot baseline;
+};
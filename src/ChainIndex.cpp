@@ -0,0 +1,48 @@
+#include "ChainIndex.h"
+
+const uint16_t ChainIndex::END;
+
+ChainIndex::ChainIndex(size_t maxEntries) : heads(maxEntries), links(maxEntries, END)
+{
+}
+
+void ChainIndex::insert(uint64_t key, uint16_t pos)
+{
+  links[pos] = heads.find(key);
+  heads.insert(key, pos);
+}
+
+void ChainIndex::remove(uint64_t key, uint16_t pos)
+{
+  uint16_t current = heads.find(key);
+  if (current == pos)
+  {
+    if (links[pos] == END)
+    {
+      heads.erase(key);
+    }
+    else
+    {
+      heads.insert(key, links[pos]);
+    }
+  }
+  else
+  {
+    while (current != END && links[current] != pos)
+    {
+      current = links[current];
+    }
+    if (current == END)
+    {
+      return;
+    }
+    links[current] = links[pos];
+  }
+  links[pos] = END;
+}
+
+void ChainIndex::clear()
+{
+  heads.clear();
+  std::fill(links.begin(), links.end(), END);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <Arduino.h>
+#include <vector>
+#include "MacIndex.h"
+
+/**
+ * @brief Hash index for non-unique 48-bit keys.
+ *
+ * A MacIndex maps each key to the first record position of a chain and an
+ * intrusive link array (one entry per record position) connects the rest of
+ * the records sharing the key. Callers walk the chain with first()/next() and
+ * check the full match themselves, so hash collisions between different keys
+ * are harmless.
+ */
+class ChainIndex {
+public:
+  static const uint16_t END = MacIndex::NOT_FOUND;
+
+  explicit ChainIndex(size_t maxEntries);
+
+  uint16_t first(uint64_t key) const { return heads.find(key); }
+  uint16_t next(uint16_t pos) const { return links[pos]; }
+
+  void insert(uint64_t key, uint16_t pos);
+  void remove(uint64_t key, uint16_t pos);
+  void clear();
+
+private:
+  MacIndex heads;
+  std::vector<uint16_t> links;
+};
@@ -0,0 +1,111 @@
+#include "ChannelScheduler.h"
+
+ChannelScheduler channelScheduler;
+
+ChannelScheduler::ChannelScheduler() : windowStartActivity(0), windowStart(0), current(WIFI_CHANNEL_COUNT)
+{
+  for (uint8_t i = 0; i < WIFI_CHANNEL_COUNT; i++)
+  {
+    counters[i].frames.store(0);
+    counters[i].newDevices.store(0);
+    counters[i].newNetworks.store(0);
+    scores[i] = 0;
+    dwells[i] = 0;
+  }
+}
+
+void ChannelScheduler::recordFrame(uint8_t channel)
+{
+  if (channel >= 1 && channel <= WIFI_CHANNEL_COUNT)
+    increment(counters[channel - 1].frames);
+}
+
+void ChannelScheduler::recordNewDevice(uint8_t channel)
+{
+  if (channel >= 1 && channel <= WIFI_CHANNEL_COUNT)
+    increment(counters[channel - 1].newDevices);
+}
+
+void ChannelScheduler::recordNewNetwork(uint8_t channel)
+{
+  if (channel >= 1 && channel <= WIFI_CHANNEL_COUNT)
+    increment(counters[channel - 1].newNetworks);
+}
+
+uint32_t ChannelScheduler::windowActivity(uint8_t index) const
+{
+  const Counters &c = counters[index];
+  return c.frames.load(std::memory_order_relaxed) +
+         c.newDevices.load(std::memory_order_relaxed) * CHANNEL_NEW_DEVICE_WEIGHT +
+         c.newNetworks.load(std::memory_order_relaxed) * CHANNEL_NEW_NETWORK_WEIGHT;
+}
+
+uint8_t ChannelScheduler::nextChannel(uint32_t baseDwellMs, uint32_t &dwellMs)
+{
+  unsigned long now = millis();
+
+  // Fold the activity of the window that just ended into the score of its channel
+  if (current < WIFI_CHANNEL_COUNT)
+  {
+    unsigned long elapsed = now - windowStart;
+    if (elapsed > 0)
+    {
+      uint32_t perSecond = (uint64_t)(windowActivity(current) - windowStartActivity) * 1000 / elapsed;
+      scores[current] = (scores[current] * 3 + perSecond) / 4;
+    }
+  }
+
+  current = (current + 1) % WIFI_CHANNEL_COUNT;
+
+  uint32_t totalScore = 0;
+  for (uint8_t i = 0; i < WIFI_CHANNEL_COUNT; i++)
+  {
+    totalScore += scores[i];
+  }
+
+  // The cycle keeps the length of plain round robin, only the split changes
+  uint32_t minDwell = baseDwellMs / CHANNEL_MIN_DWELL_DIVISOR;
+  uint32_t shared = (baseDwellMs - minDwell) * WIFI_CHANNEL_COUNT;
+  if (totalScore == 0)
+  {
+    dwellMs = baseDwellMs;
+  }
+  else
+  {
+    dwellMs = minDwell + (uint64_t)shared * scores[current] / totalScore;
+  }
+  dwells[current] = dwellMs;
+
+  windowStart = now;
+  windowStartActivity = windowActivity(current);
+  return current + 1;
+}
+
+ChannelStats ChannelScheduler::getStats(uint8_t channel) const
+{
+  ChannelStats stats = {};
+  if (channel >= 1 && channel <= WIFI_CHANNEL_COUNT)
+  {
+    const Counters &c = counters[channel - 1];
+    stats.frames = c.frames.load(std::memory_order_relaxed);
+    stats.new_devices = c.newDevices.load(std::memory_order_relaxed);
+    stats.new_networks = c.newNetworks.load(std::memory_order_relaxed);
+    stats.score = scores[channel - 1];
+    stats.dwell_ms = dwells[channel - 1];
+  }
+  return stats;
+}
+
+String ChannelScheduler::getSummary() const
+{
+  String summary = "Ch | Dwell ms | Score | Frames   | New dev | New net\n";
+  char line[64];
+  for (uint8_t channel = 1; channel <= WIFI_CHANNEL_COUNT; channel++)
+  {
+    ChannelStats stats = getStats(channel);
+    snprintf(line, sizeof(line), "%2u | %8u | %5u | %8u | %7u | %7u\n", channel, stats.dwell_ms, stats.score,
+             stats.frames, stats.new_devices, stats.new_networks);
+    summary += line;
+  }
+  return summary;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+
+#define WIFI_CHANNEL_COUNT 14
+
+// Share of the cycle every channel keeps no matter how quiet it is (1/N of the base dwell time)
+#define CHANNEL_MIN_DWELL_DIVISOR 4
+// Weights of the events in the activity score, a frame counts 1
+#define CHANNEL_NEW_DEVICE_WEIGHT 16
+#define CHANNEL_NEW_NETWORK_WEIGHT 8
+
+struct ChannelStats {
+  uint32_t frames;       // Frames received on the channel
+  uint32_t new_devices;  // Stations first seen on the channel
+  uint32_t new_networks; // Networks first seen on the channel
+  uint32_t score;        // Smoothed activity per second, see ChannelScheduler
+  uint32_t dwell_ms;     // Dwell time assigned on the last visit
+};
+
+/**
+ * @brief Activity-weighted channel hopping for scan mode.
+ *
+ * Channels are still visited in order, once per cycle, so a channel is never
+ * left unvisited for more than one cycle (WIFI_CHANNEL_COUNT times the base
+ * dwell time). Within the cycle every channel gets a minimum dwell time and the
+ * rest is shared out proportionally to a smoothed activity score built from
+ * frames, new stations and new networks per second. Busy channels get more
+ * listening time, empty ones (usually 12-14) close to the minimum.
+ *
+ * The record* methods are called from the WiFi processing task and only touch
+ * counters that task owns, nextChannel() runs in the main loop.
+ */
+class ChannelScheduler {
+public:
+  ChannelScheduler();
+
+  void recordFrame(uint8_t channel);
+  void recordNewDevice(uint8_t channel);
+  void recordNewNetwork(uint8_t channel);
+
+  // Closes the window of the current channel and returns the next one and how long to stay there
+  uint8_t nextChannel(uint32_t baseDwellMs, uint32_t &dwellMs);
+
+  ChannelStats getStats(uint8_t channel) const;
+  String getSummary() const;
+
+private:
+  struct Counters {
+    std::atomic<uint32_t> frames;
+    std::atomic<uint32_t> newDevices;
+    std::atomic<uint32_t> newNetworks;
+  };
+
+  static void increment(std::atomic<uint32_t> &counter)
+  {
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+
+  uint32_t windowActivity(uint8_t index) const;
+
+  Counters counters[WIFI_CHANNEL_COUNT];
+  // Counter values when the current window opened, only used by the main loop
+  uint32_t windowStartActivity;
+  unsigned long windowStart;
+  uint32_t scores[WIFI_CHANNEL_COUNT];
+  uint32_t dwells[WIFI_CHANNEL_COUNT];
+  uint8_t current; // Channel index 0..WIFI_CHANNEL_COUNT-1, WIFI_CHANNEL_COUNT before the first call
+};
+
+extern ChannelScheduler channelScheduler;
@@ -0,0 +1,312 @@
+#include "CompactCodec.h"
+#include <string.h>
+
+namespace
+{
+  const size_t LZ_MIN_MATCH = 3;
+  const size_t LZ_MAX_MATCH = 0x7F + LZ_MIN_MATCH;
+  const size_t LZ_MAX_LITERALS = 0x80;
+  const size_t LZ_MAX_DISTANCE = 0xFFFF;
+  const size_t LZ_HASH_BITS = 8;
+
+  void writeString(std::vector<uint8_t> &out, const char *text, size_t capacity)
+  {
+    size_t length = strnlen(text, capacity - 1);
+    out.push_back(length);
+    out.insert(out.end(), text, text + length);
+  }
+
+  bool readString(CompactReader &in, char *text, size_t capacity)
+  {
+    uint8_t length;
+    if (!in.readByte(length) || length >= capacity || !in.readBytes(text, length))
+    {
+      return false;
+    }
+    memset(text + length, 0, capacity - length);
+    return true;
+  }
+
+  void writeTimestamp(std::vector<uint8_t> &out, time_t lastSeen, uint64_t base)
+  {
+    writeVarint(out, static_cast<uint64_t>(lastSeen) - base);
+  }
+
+  bool readTimestamp(CompactReader &in, time_t &lastSeen, uint64_t base)
+  {
+    uint64_t delta;
+    if (!in.readVarint(delta))
+    {
+      return false;
+    }
+    lastSeen = static_cast<time_t>(base + delta);
+    return true;
+  }
+
+  bool readCounter(CompactReader &in, uint32_t &timesSeen)
+  {
+    uint64_t value;
+    if (!in.readVarint(value) || value > UINT32_MAX)
+    {
+      return false;
+    }
+    timesSeen = value;
+    return true;
+  }
+
+  size_t lzHash(const uint8_t *data)
+  {
+    uint32_t value = data[0] | (data[1] << 8) | (data[2] << 16);
+    return (value * 2654435761u) >> (32 - LZ_HASH_BITS);
+  }
+
+  void flushLiterals(std::vector<uint8_t> &out, const uint8_t *literals, size_t count)
+  {
+    while (count > 0)
+    {
+      size_t run = std::min(count, LZ_MAX_LITERALS);
+      out.push_back(run - 1);
+      out.insert(out.end(), literals, literals + run);
+      literals += run;
+      count -= run;
+    }
+  }
+}
+
+bool CompactReader::readByte(uint8_t &value)
+{
+  if (pos == end)
+  {
+    return false;
+  }
+  value = *pos++;
+  return true;
+}
+
+bool CompactReader::readBytes(void *out, size_t size)
+{
+  if (remaining() < size)
+  {
+    return false;
+  }
+  memcpy(out, pos, size);
+  pos += size;
+  return true;
+}
+
+bool CompactReader::readVarint(uint64_t &value)
+{
+  value = 0;
+  for (unsigned shift = 0; shift < 64; shift += 7)
+  {
+    uint8_t byte;
+    if (!readByte(byte))
+    {
+      return false;
+    }
+    value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if (!(byte & 0x80))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+void writeVarint(std::vector<uint8_t> &out, uint64_t value)
+{
+  while (value >= 0x80)
+  {
+    out.push_back(static_cast<uint8_t>(value) | 0x80);
+    value >>= 7;
+  }
+  out.push_back(static_cast<uint8_t>(value));
+}
+
+void encodeCompactRecord(std::vector<uint8_t> &out, const WifiDeviceStruct &record, uint64_t base)
+{
+  out.insert(out.end(), record.address, record.address + sizeof(record.address));
+  out.insert(out.end(), record.bssid, record.bssid + sizeof(record.bssid));
+  out.push_back(static_cast<uint8_t>(record.rssi));
+  out.push_back(record.channel);
+  writeTimestamp(out, record.last_seen, base);
+  writeVarint(out, record.times_seen);
+}
+
+void encodeCompactRecord(std::vector<uint8_t> &out, const BLEDeviceStruct &record, uint64_t base)
+{
+  out.insert(out.end(), record.address, record.address + sizeof(record.address));
+  writeString(out, record.name, sizeof(record.name));
+  out.push_back(static_cast<uint8_t>(record.rssi));
+  out.push_back(record.isPublic ? 1 : 0);
+  writeTimestamp(out, record.last_seen, base);
+  writeVarint(out, record.times_seen);
+}
+
+void encodeCompactRecord(std::vector<uint8_t> &out, const WifiNetworkStruct &record, uint64_t base)
+{
+  out.insert(out.end(), record.address, record.address + sizeof(record.address));
+  writeString(out, record.ssid, sizeof(record.ssid));
+  out.push_back(static_cast<uint8_t>(record.rssi));
+  out.push_back(record.channel);
+  out.push_back(record.type);
+  writeTimestamp(out, record.last_seen, base);
+  writeVarint(out, record.times_seen);
+}
+
+bool decodeCompactRecord(CompactReader &in, WifiDeviceStruct &record, uint64_t base)
+{
+  uint8_t rssi;
+  memset(&record, 0, sizeof(record));
+  if (!in.readBytes(record.address, sizeof(record.address)) || !in.readBytes(record.bssid, sizeof(record.bssid)) ||
+      !in.readByte(rssi) || !in.readByte(record.channel) || !readTimestamp(in, record.last_seen, base) ||
+      !readCounter(in, record.times_seen))
+  {
+    return false;
+  }
+  record.rssi = static_cast<int8_t>(rssi);
+  return true;
+}
+
+bool decodeCompactRecord(CompactReader &in, BLEDeviceStruct &record, uint64_t base)
+{
+  uint8_t rssi, isPublic;
+  memset(&record, 0, sizeof(record));
+  if (!in.readBytes(record.address, sizeof(record.address)) || !readString(in, record.name, sizeof(record.name)) ||
+      !in.readByte(rssi) || !in.readByte(isPublic) || isPublic > 1 || !readTimestamp(in, record.last_seen, base) ||
+      !readCounter(in, record.times_seen))
+  {
+    return false;
+  }
+  record.rssi = static_cast<int8_t>(rssi);
+  record.isPublic = isPublic;
+  return true;
+}
+
+bool decodeCompactRecord(CompactReader &in, WifiNetworkStruct &record, uint64_t base)
+{
+  uint8_t rssi;
+  memset(&record, 0, sizeof(record));
+  if (!in.readBytes(record.address, sizeof(record.address)) || !readString(in, record.ssid, sizeof(record.ssid)) ||
+      !in.readByte(rssi) || !in.readByte(record.channel) || !in.readByte(record.type) ||
+      !readTimestamp(in, record.last_seen, base) || !readCounter(in, record.times_seen))
+  {
+    return false;
+  }
+  record.rssi = static_cast<int8_t>(rssi);
+  return true;
+}
+
+void lzCompress(const uint8_t *data, size_t size, std::vector<uint8_t> &out)
+{
+  // Last position of every 3 byte hash, SIZE_MAX when unused
+  size_t table[1 << LZ_HASH_BITS];
+  std::fill(table, table + (1 << LZ_HASH_BITS), SIZE_MAX);
+
+  size_t literalStart = 0;
+  size_t pos = 0;
+  while (pos + LZ_MIN_MATCH <= size)
+  {
+    size_t hash = lzHash(data + pos);
+    size_t candidate = table[hash];
+    table[hash] = pos;
+
+    size_t length = 0;
+    if (candidate != SIZE_MAX && pos - candidate <= LZ_MAX_DISTANCE)
+    {
+      size_t limit = std::min(size - pos, LZ_MAX_MATCH);
+      while (length < limit && data[candidate + length] == data[pos + length])
+      {
+        length++;
+      }
+    }
+    if (length < LZ_MIN_MATCH)
+    {
+      pos++;
+      continue;
+    }
+
+    flushLiterals(out, data + literalStart, pos - literalStart);
+    size_t distance = pos - candidate;
+    out.push_back(0x80 | (length - LZ_MIN_MATCH));
+    out.push_back(distance & 0xFF);
+    out.push_back(distance >> 8);
+    pos += length;
+    literalStart = pos;
+  }
+  flushLiterals(out, data + literalStart, size - literalStart);
+}
+
+bool lzDecompress(const uint8_t *data, size_t size, size_t rawSize, std::vector<uint8_t> &out)
+{
+  // A 3 byte match token expands to at most LZ_MAX_MATCH bytes
+  if (rawSize > size / 3 * LZ_MAX_MATCH + LZ_MAX_LITERALS)
+  {
+    return false;
+  }
+  out.clear();
+  out.reserve(rawSize);
+  CompactReader in(data, size);
+  while (!in.atEnd())
+  {
+    uint8_t token;
+    in.readByte(token);
+    if (!(token & 0x80))
+    {
+      size_t run = token + 1;
+      if (out.size() + run > rawSize || in.remaining() < run)
+      {
+        return false;
+      }
+      size_t at = out.size();
+      out.resize(at + run);
+      in.readBytes(&out[at], run);
+      continue;
+    }
+
+    uint8_t low, high;
+    if (!in.readByte(low) || !in.readByte(high))
+    {
+      return false;
+    }
+    size_t length = (token & 0x7F) + LZ_MIN_MATCH;
+    size_t distance = low | (high << 8);
+    if (distance == 0 || distance > out.size() || out.size() + length > rawSize)
+    {
+      return false;
+    }
+    // Byte by byte, a match may overlap the bytes it produces
+    size_t from = out.size() - distance;
+    for (size_t i = 0; i < length; i++)
+    {
+      out.push_back(out[from + i]);
+    }
+  }
+  return out.size() == rawSize;
+}
+
+void writeCompactBlock(std::vector<uint8_t> &out, uint64_t base, uint32_t count, bool withOps,
+                       const uint8_t *records, size_t size, bool allowLz)
+{
+  std::vector<uint8_t> compressed;
+  if (allowLz)
+  {
+    lzCompress(records, size, compressed);
+  }
+  // The raw size varint must be paid for too
+  bool useLz = allowLz && compressed.size() + 5 < size;
+
+  out.push_back(COMPACT_CODEC_VERSION);
+  out.push_back((useLz ? COMPACT_FLAG_LZ : 0) | (withOps ? COMPACT_FLAG_OPS : 0));
+  writeVarint(out, base);
+  writeVarint(out, count);
+  if (useLz)
+  {
+    writeVarint(out, size);
+    out.insert(out.end(), compressed.begin(), compressed.end());
+  }
+  else
+  {
+    out.insert(out.end(), records, records + size);
+  }
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <Arduino.h>
+#include <vector>
+#include "FlashStorage.h"
+
+/**
+ * Compact encoding of the stored records, shared by FlashStorage snapshots and
+ * BLE transfers.
+ *
+ * A block starts with a version byte, a flags byte, the timestamp base and the
+ * record count (both varints). Records follow: addresses as raw bytes, SSIDs
+ * and names with a length byte, the frame kind as its enum value, last_seen as
+ * a varint delta from the base and times_seen as a varint. With
+ * COMPACT_FLAG_OPS every record is preceded by a delta sync op byte. With
+ * COMPACT_FLAG_LZ the records are LZ compressed and their raw size (varint)
+ * comes first.
+ */
+#define COMPACT_CODEC_VERSION 1
+#define COMPACT_FLAG_LZ 0x01
+#define COMPACT_FLAG_OPS 0x02
+// Largest block header: version, flags, base, count and raw size varints
+#define COMPACT_BLOCK_HEADER_MAX (2 + 10 + 5 + 5)
+
+// Cursor over an encoded buffer, every read fails once the end is reached
+class CompactReader {
+public:
+  CompactReader(const uint8_t *data, size_t size) : pos(data), end(data + size) {}
+
+  bool readByte(uint8_t &value);
+  bool readBytes(void *out, size_t size);
+  bool readVarint(uint64_t &value);
+  bool atEnd() const { return pos == end; }
+  const uint8_t *position() const { return pos; }
+  size_t remaining() const { return end - pos; }
+
+private:
+  const uint8_t *pos;
+  const uint8_t *end;
+};
+
+void writeVarint(std::vector<uint8_t> &out, uint64_t value);
+
+void encodeCompactRecord(std::vector<uint8_t> &out, const WifiDeviceStruct &record, uint64_t base);
+void encodeCompactRecord(std::vector<uint8_t> &out, const BLEDeviceStruct &record, uint64_t base);
+void encodeCompactRecord(std::vector<uint8_t> &out, const WifiNetworkStruct &record, uint64_t base);
+
+bool decodeCompactRecord(CompactReader &in, WifiDeviceStruct &record, uint64_t base);
+bool decodeCompactRecord(CompactReader &in, BLEDeviceStruct &record, uint64_t base);
+bool decodeCompactRecord(CompactReader &in, WifiNetworkStruct &record, uint64_t base);
+
+// LZ77 with byte tokens: 0x00-0x7F copies that many + 1 literals, 0x80-0xFF
+// repeats (token & 0x7F) + 3 bytes from a 16-bit little endian distance back
+void lzCompress(const uint8_t *data, size_t size, std::vector<uint8_t> &out);
+bool lzDecompress(const uint8_t *data, size_t size, size_t rawSize, std::vector<uint8_t> &out);
+
+// Appends a block around records already encoded with encodeCompactRecord,
+// compressed when allowLz is set and compression saves space
+void writeCompactBlock(std::vector<uint8_t> &out, uint64_t base, uint32_t count, bool withOps,
+                       const uint8_t *records, size_t size, bool allowLz);
+
+// Smallest last_seen of the records, the base that keeps their deltas small
+template <typename Record>
+uint64_t compactBase(const Record *records, size_t count)
+{
+  uint64_t base = count > 0 ? static_cast<uint64_t>(records[0].last_seen) : 0;
+  for (size_t i = 1; i < count; i++)
+  {
+    base = std::min<uint64_t>(base, records[i].last_seen);
+  }
+  return base;
+}
+
+template <typename Record>
+void encodeCompactBlock(std::vector<uint8_t> &out, const Record *records, size_t count, bool allowLz)
+{
+  uint64_t base = compactBase(records, count);
+  std::vector<uint8_t> encoded;
+  for (size_t i = 0; i < count; i++)
+  {
+    encodeCompactRecord(encoded, records[i], base);
+  }
+  writeCompactBlock(out, base, count, false, encoded.data(), encoded.size(), allowLz);
+}
+
+/**
+ * @brief Decodes a whole block, false if it is malformed or of another version.
+ *
+ * ops receives the op byte of every record when the block carries them.
+ */
+template <typename Record>
+bool decodeCompactBlock(const uint8_t *data, size_t size, std::vector<Record> &records, std::vector<uint8_t> *ops = nullptr)
+{
+  CompactReader header(data, size);
+  uint8_t version, flags;
+  uint64_t base, count;
+  if (!header.readByte(version) || version != COMPACT_CODEC_VERSION || !header.readByte(flags) ||
+      !header.readVarint(base) || !header.readVarint(count))
+  {
+    return false;
+  }
+
+  std::vector<uint8_t> raw;
+  CompactReader in(header.position(), header.remaining());
+  if (flags & COMPACT_FLAG_LZ)
+  {
+    uint64_t rawSize;
+    if (!header.readVarint(rawSize) || !lzDecompress(header.position(), header.remaining(), rawSize, raw))
+    {
+      return false;
+    }
+    in = CompactReader(raw.data(), raw.size());
+  }
+
+  // Every record takes at least 6 bytes, a larger count is corrupt
+  if (count > in.remaining() / 6 + 1)
+  {
+    return false;
+  }
+  records.resize(count);
+  for (uint64_t i = 0; i < count; i++)
+  {
+    uint8_t op = 0;
+    if ((flags & COMPACT_FLAG_OPS) && !in.readByte(op))
+    {
+      return false;
+    }
+    if (!decodeCompactRecord(in, records[i], base))
+    {
+      return false;
+    }
+    if (ops != nullptr)
+    {
+      ops->push_back(op);
+    }
+  }
+  return in.atEnd();
+}
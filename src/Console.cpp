@@ -0,0 +1,96 @@
+#include "Console.h"
+#include "Log.h"
+
+ConsoleClass Console;
+
+namespace
+{
+  int discardLog(const char *, va_list)
+  {
+    return 0;
+  }
+}
+
+ConsoleClass::ConsoleClass() : closed(false), debugOutput(false), idfVprintf(nullptr)
+{
+}
+
+size_t ConsoleClass::write(uint8_t c)
+{
+  return write(&c, 1);
+}
+
+size_t ConsoleClass::write(const uint8_t *buffer, size_t size)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  if (closed)
+  {
+    return size;
+  }
+  return Serial.write(buffer, size);
+}
+
+void ConsoleClass::flush()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!closed)
+  {
+    Serial.flush();
+  }
+}
+
+void ConsoleClass::setDebugOutput(bool enabled)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  debugOutput = enabled;
+  if (!closed)
+  {
+    Serial.setDebugOutput(enabled);
+  }
+}
+
+/**
+ * @brief Closes the gate, pending log messages are written first.
+ *
+ * Once it returns no other task is in the middle of a console write, so the
+ * caller may start its binary stream on Serial right away.
+ */
+bool ConsoleClass::close()
+{
+  // The logger writes through the gate, it stays suspended until open()
+  logger.flush();
+  logger.setSuspended(true);
+
+  std::lock_guard<std::mutex> lock(mutex);
+  if (closed)
+  {
+    return false;
+  }
+  closed = true;
+  Serial.flush();
+  Serial.setDebugOutput(false);
+  idfVprintf = esp_log_set_vprintf(discardLog);
+  return true;
+}
+
+void ConsoleClass::open()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!closed)
+    {
+      return;
+    }
+    Serial.flush();
+    esp_log_set_vprintf(idfVprintf);
+    Serial.setDebugOutput(debugOutput);
+    closed = false;
+  }
+  logger.setSuspended(false);
+}
+
+bool ConsoleClass::isOpen() const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return !closed;
+}
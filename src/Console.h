@@ -0,0 +1,41 @@
+#pragma once
+
+#include <Arduino.h>
+#include <mutex>
+#include <esp_log.h>
+
+/**
+ * @brief Gate in front of the serial console.
+ *
+ * All text meant for the serial port is printed through Console instead of
+ * Serial. While a binary stream owns the port (a serial pcap capture or a
+ * flash dump) the gate is closed: text printed meanwhile is discarded, log
+ * messages are counted as dropped and the ESP-IDF and Arduino core logs are
+ * muted, so only the owner writes to Serial until it opens the gate again.
+ */
+class ConsoleClass : public Print
+{
+public:
+  ConsoleClass();
+
+  using Print::write;
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *buffer, size_t size) override;
+  void flush() override;
+
+  // Routes the ESP-IDF and Arduino core logs to the serial port while the gate is open
+  void setDebugOutput(bool enabled);
+
+  // Hands the serial port to a binary stream, false if it already has an owner
+  bool close();
+  void open();
+  bool isOpen() const;
+
+private:
+  mutable std::mutex mutex;
+  bool closed;
+  bool debugOutput;
+  vprintf_like_t idfVprintf; // ESP-IDF log writer to restore when the gate opens
+};
+
+extern ConsoleClass Console;
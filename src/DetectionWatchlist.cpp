@@ -0,0 +1,107 @@
+#include "DetectionWatchlist.h"
+#include <algorithm>
+#include <string.h>
+#include "WifiDeviceList.h"
+#include "WifiNetworkList.h"
+#include "BLEDeviceList.h"
+#include "MacAddress.h"
+#include "Hash.h"
+#include "OuiVendor.h"
+#include "AppPreferences.h"
+#include "Console.h"
+
+extern WifiDeviceList stationsList;
+extern WifiNetworkList ssidList;
+extern BLEDeviceList bleDeviceList;
+
+DetectionWatchlist detectionWatchlist;
+
+DetectionWatchlist::DetectionWatchlist() : current(nullptr), retired(nullptr)
+{
+}
+
+DetectionWatchlist::~DetectionWatchlist()
+{
+  delete current.load();
+  delete retired;
+}
+
+void DetectionWatchlist::rebuild()
+{
+  std::lock_guard<std::mutex> lock(rebuildMutex);
+
+  auto stations = stationsList.getClonedList();
+  auto networks = ssidList.getClonedList();
+  auto bleDevices = bleDeviceList.getClonedList();
+
+  Snapshot *snapshot = new Snapshot(stations.size(), networks.size(), bleDevices.size());
+  for (const auto &station : stations)
+  {
+    snapshot->stations.insert(station.address.toUint64(), 0);
+  }
+  for (const auto &network : networks)
+  {
+    char ssid[STRING_ARENA_MAX_LEN + 1];
+    size_t len = stringArena.copy(network.ssid, ssid, sizeof(ssid));
+    if (len > 0)
+    {
+      snapshot->ssids.insert(ssidHashKey(ssid, len), 0);
+    }
+  }
+  for (const auto &device : bleDevices)
+  {
+    snapshot->bleDevices.insert(device.address.toUint64(), 0);
+  }
+
+  const char *names = appPrefs.watch_vendors;
+  while (*names != '\0')
+  {
+    size_t len = strcspn(names, ",");
+    uint16_t vendor = ouiVendorByName(names, len);
+    if (vendor != OUI_VENDOR_UNKNOWN)
+    {
+      snapshot->vendors.push_back(vendor);
+    }
+    else if (len > 0)
+    {
+      Console.printf("Unknown watched vendor: %.*s\n", (int)len, names);
+    }
+    names += len + (names[len] == ',' ? 1 : 0);
+  }
+  std::sort(snapshot->vendors.begin(), snapshot->vendors.end());
+
+  delete retired;
+  retired = current.exchange(snapshot, std::memory_order_acq_rel);
+
+  Console.printf("Detection watchlist rebuilt: %zu stations, %zu SSIDs, %zu BLE devices, %zu vendors\n",
+                snapshot->stations.size(), snapshot->ssids.size(), snapshot->bleDevices.size(), snapshot->vendors.size());
+}
+
+bool DetectionWatchlist::hasStation(const uint8_t *mac) const
+{
+  const Snapshot *snapshot = current.load(std::memory_order_acquire);
+  return snapshot != nullptr && snapshot->stations.find(MacAddress(mac).toUint64()) != MacIndex::NOT_FOUND;
+}
+
+bool DetectionWatchlist::hasBLEDevice(const uint8_t *mac) const
+{
+  const Snapshot *snapshot = current.load(std::memory_order_acquire);
+  return snapshot != nullptr && snapshot->bleDevices.find(MacAddress(mac).toUint64()) != MacIndex::NOT_FOUND;
+}
+
+bool DetectionWatchlist::hasSsid(const char *ssid, size_t len) const
+{
+  const Snapshot *snapshot = current.load(std::memory_order_acquire);
+  return snapshot != nullptr && len > 0 && snapshot->ssids.find(ssidHashKey(ssid, len)) != MacIndex::NOT_FOUND;
+}
+
+bool DetectionWatchlist::hasVendor(const uint8_t *mac) const
+{
+  const Snapshot *snapshot = current.load(std::memory_order_acquire);
+  if (snapshot == nullptr || snapshot->vendors.empty())
+  {
+    return false;
+  }
+  uint16_t vendor = ouiVendorId(mac);
+  return vendor != OUI_VENDOR_UNKNOWN && std::binary_search(snapshot->vendors.begin(), snapshot->vendors.end(), vendor);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "MacIndex.h"
+
+/**
+ * @brief Read-only membership index used by the detection callbacks.
+ *
+ * Holds hash sets of the station MACs, BLE MACs and SSID hashes found in the
+ * scanned lists, plus the OuiVendor ids of appPrefs.watch_vendors. A new snapshot is built by rebuild() when detection starts or
+ * the lists change and published with a single atomic pointer store, so the
+ * queries never lock and never allocate. The previous snapshot is kept alive
+ * until the next rebuild, which is seconds away from any in-flight query.
+ */
+class DetectionWatchlist {
+public:
+  DetectionWatchlist();
+  ~DetectionWatchlist();
+
+  DetectionWatchlist(const DetectionWatchlist&) = delete;
+  DetectionWatchlist& operator=(const DetectionWatchlist&) = delete;
+
+  // Builds a new snapshot from stationsList, ssidList and bleDeviceList
+  void rebuild();
+
+  bool hasStation(const uint8_t *mac) const;
+  bool hasBLEDevice(const uint8_t *mac) const;
+  bool hasSsid(const char *ssid, size_t len) const;
+  // Universally administered address of a watched vendor
+  bool hasVendor(const uint8_t *mac) const;
+
+private:
+  struct Snapshot {
+    MacIndex stations;
+    MacIndex ssids;
+    MacIndex bleDevices;
+    std::vector<uint16_t> vendors;  // Sorted
+
+    Snapshot(size_t stationCount, size_t ssidCount, size_t bleCount)
+        : stations(stationCount), ssids(ssidCount), bleDevices(bleCount) {}
+  };
+
+  std::atomic<const Snapshot*> current;
+  const Snapshot *retired;
+  std::mutex rebuildMutex;
+};
+
+extern DetectionWatchlist detectionWatchlist;
@@ -1,259 +1,791 @@
 #include "FlashStorage.h"
 #include <stdexcept>
+#include "Log.h"
+#include "Hash.h"
+#include "CompactCodec.h"
+#include "HistoryStore.h"
+#include "Console.h"
 
 extern WifiNetworkList ssidList;
 extern WifiDeviceList stationsList;
 extern BLEDeviceList bleDeviceList;
+extern time_t base_time;
 
 const char *FlashStorage::NAMESPACE = "device_lists";
 const char *FlashStorage::WIFI_DEVICES_KEY = "wifi_devices";
 const char *FlashStorage::BLE_DEVICES_KEY = "ble_devices";
-const char *FlashStorage::WIFI_NETWORKS_KEY = "wifi_networks";
+const char *FlashStorage::WIFI_NETWORKS_KEY = "wifi_nets";
+const char *FlashStorage::LEGACY_WIFI_NETWORKS_KEY = "wifi_networks";
+const char *FlashStorage::CLOCK_KEY = "clock";
 
 Preferences FlashStorage::preferences;
+FlashListStore FlashStorage::wifiDevicesStore = {{"wifi_dev_a", "wifi_dev_b"}, WIFI_DEVICES_KEY, "wd_j", 0, 0, false};
+FlashListStore FlashStorage::bleDevicesStore = {{"ble_dev_a", "ble_dev_b"}, BLE_DEVICES_KEY, "bd_j", 0, 0, false};
+FlashListStore FlashStorage::wifiNetworksStore = {{"wifi_nets_a", "wifi_nets_b"}, WIFI_NETWORKS_KEY, "wn_j", 0, 0, false};
+std::mutex FlashStorage::storageMutex;
+std::mutex FlashStorage::statsMutex;
+FlashSaveStats FlashStorage::saveStats = {};
+TaskHandle_t FlashStorage::autosaveTask = nullptr;
+std::atomic<bool> FlashStorage::loading(false);
+
+namespace
+{
+    // NVS keys of the journal: "<journal>n" holds the segment count, "<journal><i>" each segment
+    String journalCountKey(const char *journal)
+    {
+        return String(journal) + "n";
+    }
 
-void FlashStorage::saveWifiDevices()
+    String journalSegmentKey(const char *journal, uint8_t segment)
+    {
+        return String(journal) + String(segment);
+    }
+}
+
+void toRecord(const WifiDevice &device, WifiDeviceStruct &deviceStruct)
 {
-    WifiDeviceList &list = stationsList;
+    memset(&deviceStruct, 0, sizeof(deviceStruct));
+    memcpy(deviceStruct.address, device.address.getBytes(), 6);
+    memcpy(deviceStruct.bssid, device.bssid.getBytes(), 6);
+    deviceStruct.rssi = device.rssi;
+    deviceStruct.channel = device.channel;
+    deviceStruct.last_seen = device.last_seen;
+    deviceStruct.times_seen = device.times_seen;
+}
 
-    preferences.begin(NAMESPACE, false);
-    std::vector<WifiDevice> devices = list.getClonedList();
-    std::vector<WifiDeviceStruct> deviceStructs(devices.size());
+void toRecord(const BLEFoundDevice &device, BLEDeviceStruct &deviceStruct)
+{
+    memset(&deviceStruct, 0, sizeof(deviceStruct));
+    memcpy(deviceStruct.address, device.address.getBytes(), 6);
+    deviceStruct.rssi = device.rssi;
+    stringArena.copy(device.name, deviceStruct.name, sizeof(deviceStruct.name));
+    deviceStruct.isPublic = device.isPublic;
+    deviceStruct.last_seen = device.last_seen;
+    deviceStruct.times_seen = device.times_seen;
+}
 
-    for (size_t i = 0; i < devices.size(); ++i)
+void toRecord(const WifiNetwork &network, WifiNetworkStruct &networkStruct)
+{
+    memset(&networkStruct, 0, sizeof(networkStruct));
+    stringArena.copy(network.ssid, networkStruct.ssid, sizeof(networkStruct.ssid));
+    memcpy(networkStruct.address, network.address.getBytes(), 6);
+    networkStruct.rssi = network.rssi;
+    networkStruct.channel = network.channel;
+    networkStruct.type = static_cast<uint8_t>(network.type);
+    networkStruct.last_seen = network.last_seen;
+    networkStruct.times_seen = network.times_seen;
+}
+
+/**
+ * @brief Reads a blob written by writeBlob and checks its header and CRC.
+ *
+ * Must be called with the preferences namespace open.
+ * The payload of a compact blob is only checked against its CRC, the caller decodes it.
+ * @return false if the key is missing, was written with another layout or is corrupt.
+ */
+bool FlashStorage::readBlob(const char *key, size_t recordSize, FlashBlobHeader &header, std::vector<uint8_t> &blob)
+{
+    size_t size = preferences.getBytesLength(key);
+    if (size == 0)
+    {
+        return false;
+    }
+    if (size < sizeof(FlashBlobHeader))
+    {
+        LOG_WARN("%s: blob too short (%zu bytes)", key, size);
+        return false;
+    }
+    blob.resize(size);
+    if (preferences.getBytes(key, blob.data(), size) != size)
+    {
+        LOG_WARN("%s: read failed", key);
+        return false;
+    }
+    memcpy(&header, blob.data(), sizeof(header));
+    size_t payloadSize = size - sizeof(FlashBlobHeader);
+    bool compact = header.version == FLASH_BLOB_VERSION_COMPACT;
+    if ((header.version != FLASH_BLOB_VERSION && !compact) || header.record_size != recordSize ||
+        (!compact && payloadSize != static_cast<size_t>(header.count) * recordSize))
+    {
+        LOG_WARN("%s: unexpected layout (version %u, record size %u, %u records in %zu bytes)",
+                 key, header.version, header.record_size, header.count, payloadSize);
+        return false;
+    }
+    if (crc32(blob.data() + sizeof(FlashBlobHeader), payloadSize) != header.crc)
     {
-        const auto &device = devices[i];
-        auto &deviceStruct = deviceStructs[i];
+        LOG_WARN("%s: CRC mismatch, generation %u discarded", key, header.generation);
+        return false;
+    }
+    return true;
+}
 
-        memcpy(deviceStruct.address, device.address.getBytes(), 6);
-        memcpy(deviceStruct.bssid, device.bssid.getBytes(), 6);
-        deviceStruct.rssi = device.rssi;
-        deviceStruct.channel = device.channel;
-        deviceStruct.last_seen = device.last_seen;
-        deviceStruct.times_seen = device.times_seen;
+/**
+ * @brief Writes a header and the payload as one blob.
+ *
+ * The payload is count raw records, or a compact block of them.
+ * Must be called with the preferences namespace open for writing.
+ * @return bytes written, 0 on failure.
+ */
+size_t FlashStorage::writeBlob(const char *key, uint8_t version, uint32_t generation, const void *payload, size_t payloadSize,
+                               size_t count, size_t recordSize)
+{
+    FlashBlobHeader header;
+    header.version = version;
+    header.reserved = 0;
+    header.record_size = recordSize;
+    header.generation = generation;
+    header.count = count;
+    header.crc = crc32(payload, payloadSize);
+
+    std::vector<uint8_t> blob(sizeof(header) + payloadSize);
+    memcpy(blob.data(), &header, sizeof(header));
+    if (payloadSize > 0)
+    {
+        memcpy(blob.data() + sizeof(header), payload, payloadSize);
     }
+    return preferences.putBytes(key, blob.data(), blob.size()) == blob.size() ? blob.size() : 0;
+}
 
-    size_t serializedSize = deviceStructs.size() * sizeof(WifiDeviceStruct);
-    preferences.putBytes(WIFI_DEVICES_KEY, deviceStructs.data(), serializedSize);
-    preferences.end();
-    Serial.printf("Saved %zu WiFi devices\n", deviceStructs.size());
+void FlashStorage::recordWrite(bool snapshot, size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(statsMutex);
+    if (snapshot)
+    {
+        saveStats.snapshots++;
+    }
+    else
+    {
+        saveStats.journal_segments++;
+    }
+    saveStats.bytes_written += bytes;
 }
 
-void FlashStorage::saveBLEDevices()
+/**
+ * @brief Tells whether the journal of a list should be folded into a new snapshot.
+ *
+ * Must be called with the preferences namespace open.
+ */
+bool FlashStorage::needsCompaction(const FlashListStore &store)
 {
-    BLEDeviceList &list = bleDeviceList;
+    if (store.generation == 0)
+    {
+        return true; // Nothing a journal could extend
+    }
+    uint8_t segments = preferences.getUChar(journalCountKey(store.journal).c_str(), 0);
+    if (segments >= FLASH_JOURNAL_MAX_SEGMENTS)
+    {
+        return true;
+    }
+    size_t journalSize = 0;
+    for (uint8_t segment = 0; segment < segments; segment++)
+    {
+        journalSize += preferences.getBytesLength(journalSegmentKey(store.journal, segment).c_str());
+    }
+    return journalSize > 0 &&
+           journalSize * 100 >= preferences.getBytesLength(store.slotKeys[store.slot]) * FLASH_JOURNAL_MAX_RATIO;
+}
 
-    preferences.begin(NAMESPACE, false);
-    std::vector<BLEFoundDevice> devices = list.getClonedList();
-    std::vector<BLEDeviceStruct> deviceStructs(devices.size());
+/**
+ * @brief Writes a full snapshot into the free slot or appends a journal segment.
+ *
+ * Must be called with the preferences namespace open for writing.
+ * @return false if the data could not be written (e.g. the partition is full).
+ */
+template <typename Record, typename Item>
+bool FlashStorage::writeChanges(FlashListStore &store, const ListChanges<Item> &changes,
+                                void (*convert)(const Item &, Record &))
+{
+    String countKey = journalCountKey(store.journal);
 
-    for (size_t i = 0; i < devices.size(); ++i)
+    if (changes.full)
     {
-        const auto &device = devices[i];
-        auto &deviceStruct = deviceStructs[i];
+        std::vector<Record> records(changes.records.size());
+        for (size_t i = 0; i < records.size(); ++i)
+        {
+            convert(changes.records[i], records[i]);
+        }
 
-        memcpy(deviceStruct.address, device.address.getBytes(), 6);
-        deviceStruct.rssi = device.rssi;
-        memset(deviceStruct.name, 0, sizeof(deviceStruct.name));
-        strncpy(deviceStruct.name, device.name.c_str(), sizeof(deviceStruct.name) - 1);
-        deviceStruct.name[sizeof(deviceStruct.name) - 1] = '\0';
-        deviceStruct.isPublic = device.isPublic;
-        deviceStruct.last_seen = device.last_seen;
-        deviceStruct.times_seen = device.times_seen;
+#if FLASH_COMPACT_SNAPSHOTS
+        std::vector<uint8_t> payload;
+        encodeCompactBlock(payload, records.data(), records.size(), true);
+        const uint8_t version = FLASH_BLOB_VERSION_COMPACT;
+#else
+        std::vector<uint8_t> payload(reinterpret_cast<const uint8_t *>(records.data()),
+                                     reinterpret_cast<const uint8_t *>(records.data() + records.size()));
+        const uint8_t version = FLASH_BLOB_VERSION;
+#endif
+
+        uint8_t slot = store.generation > 0 ? 1 - store.slot : 0;
+        const char *key = store.slotKeys[slot];
+        size_t written = writeBlob(key, version, store.generation + 1, payload.data(), payload.size(),
+                                   records.size(), sizeof(Record));
+        if (written == 0 && preferences.isKey(key))
+        {
+            // The free slot holds an older generation, dropping it releases its space
+            preferences.remove(key);
+            written = writeBlob(key, version, store.generation + 1, payload.data(), payload.size(),
+                                records.size(), sizeof(Record));
+        }
+        if (written == 0)
+        {
+            return false;
+        }
+        store.generation++;
+        store.slot = slot;
+        recordWrite(true, written);
+
+        // Segments of the previous generation are ignored from now on, this only frees the space
+        uint8_t segments = preferences.getUChar(countKey.c_str(), 0);
+        if (segments > 0)
+        {
+            preferences.putUChar(countKey.c_str(), 0);
+        }
+        for (uint8_t segment = 0; segment < segments; segment++)
+        {
+            preferences.remove(journalSegmentKey(store.journal, segment).c_str());
+        }
+        if (preferences.isKey(store.legacyKey))
+        {
+            preferences.remove(store.legacyKey);
+        }
+        return true;
     }
 
-    size_t serializedSize = deviceStructs.size() * sizeof(BLEDeviceStruct);
-    preferences.putBytes(BLE_DEVICES_KEY, deviceStructs.data(), serializedSize);
-    preferences.end();
-    Serial.printf("Saved %zu BLE devices\n", deviceStructs.size());
+    if (changes.records.empty())
+    {
+        return true;
+    }
+
+    std::vector<JournalEntry<Record>> entries(changes.records.size());
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        memset(&entries[i], 0, sizeof(entries[i]));
+        entries[i].position = changes.positions[i];
+        convert(changes.records[i], entries[i].record);
+    }
+
+    uint8_t segment = preferences.getUChar(countKey.c_str(), 0);
+    size_t written = writeBlob(journalSegmentKey(store.journal, segment).c_str(), FLASH_BLOB_VERSION, store.generation,
+                               entries.data(), entries.size() * sizeof(JournalEntry<Record>), entries.size(),
+                               sizeof(JournalEntry<Record>));
+    if (written == 0 || preferences.putUChar(countKey.c_str(), segment + 1) != 1)
+    {
+        return false;
+    }
+    recordWrite(false, written);
+    return true;
 }
 
-void FlashStorage::saveWifiNetworks()
+/**
+ * @brief Reads the newest valid snapshot of a list and remembers its slot.
+ *
+ * Falls back to the headerless snapshot of older firmware when no slot is valid.
+ * Must be called with the preferences namespace open.
+ * @return false if the legacy snapshot does not match the record layout.
+ */
+template <typename Record>
+bool FlashStorage::readSnapshot(FlashListStore &store, std::vector<Record> &records)
 {
-    WifiNetworkList &list = ssidList;
+    FlashBlobHeader header;
+    std::vector<uint8_t> blob;
+
+    store.generation = 0;
+    store.slot = 0;
+    store.resolved = true;
+    records.clear();
+    for (uint8_t slot = 0; slot < 2; slot++)
+    {
+        if (!readBlob(store.slotKeys[slot], sizeof(Record), header, blob) || header.generation <= store.generation)
+        {
+            continue;
+        }
+        const uint8_t *payload = blob.data() + sizeof(FlashBlobHeader);
+        if (header.version == FLASH_BLOB_VERSION_COMPACT)
+        {
+            std::vector<Record> decoded;
+            if (!decodeCompactBlock(payload, blob.size() - sizeof(FlashBlobHeader), decoded) || decoded.size() != header.count)
+            {
+                LOG_WARN("%s: compact payload does not decode, generation %u discarded", store.slotKeys[slot], header.generation);
+                continue;
+            }
+            records.swap(decoded);
+        }
+        else
+        {
+            records.resize(header.count);
+            if (header.count > 0)
+            {
+                memcpy(records.data(), payload, header.count * sizeof(Record));
+            }
+        }
+        store.generation = header.generation;
+        store.slot = slot;
+    }
+    if (store.generation > 0)
+    {
+        LOG_INFO("Loading %s: generation %u, %zu records", store.slotKeys[store.slot], store.generation, records.size());
+        return true;
+    }
 
-    preferences.begin(NAMESPACE, false);
-    std::vector<WifiNetwork> networks = list.getClonedList();
-    std::vector<WifiNetworkStruct> networkStructs(networks.size());
+    size_t serializedSize = preferences.getBytesLength(store.legacyKey);
+    LOG_INFO("Loading %s. Serialized size: %zu bytes", store.legacyKey, serializedSize);
+    if (serializedSize % sizeof(Record) != 0)
+    {
+        Console.printf("Error: Serialized size (%zu) of %s is not a multiple of the record size (%zu)\n", serializedSize, store.legacyKey, sizeof(Record));
+        return false;
+    }
+    records.resize(serializedSize / sizeof(Record));
+    if (serializedSize > 0)
+    {
+        preferences.getBytes(store.legacyKey, records.data(), serializedSize);
+    }
+    return true;
+}
 
-    for (size_t i = 0; i < networks.size(); ++i)
+/**
+ * @brief Finds the slot in use when saving before anything was loaded.
+ *
+ * Must be called with the preferences namespace open.
+ */
+template <typename Record>
+void FlashStorage::resolveSlots(FlashListStore &store)
+{
+    if (!store.resolved)
     {
-        const auto &network = networks[i];
-        auto &networkStruct = networkStructs[i];
+        std::vector<Record> records;
+        readSnapshot(store, records);
+    }
+}
 
-        memset(networkStruct.ssid, 0, sizeof(networkStruct.ssid));
-        strncpy(networkStruct.ssid, network.ssid.c_str(), sizeof(networkStruct.ssid) - 1);
-        networkStruct.ssid[sizeof(networkStruct.ssid) - 1] = '\0';
-        memcpy(networkStruct.address, network.address.getBytes(), 6);
-        networkStruct.rssi = network.rssi;
-        networkStruct.channel = network.channel;
-        memset(networkStruct.type, 0, sizeof(networkStruct.type));
-        strncpy(networkStruct.type, network.type.c_str(), sizeof(networkStruct.type) - 1);
-        networkStruct.type[sizeof(networkStruct.type) - 1] = '\0';
-        networkStruct.last_seen = network.last_seen;
-        networkStruct.times_seen = network.times_seen;
+/**
+ * @brief Applies the journal segments of the loaded generation, in write order.
+ *
+ * Stops at the first segment that is corrupt or belongs to another generation,
+ * the later ones were written on top of it.
+ * Must be called with the preferences namespace open.
+ */
+template <typename Record>
+void FlashStorage::replayJournal(const FlashListStore &store, std::vector<Record> &records)
+{
+    if (store.generation == 0)
+    {
+        return;
     }
 
-    size_t serializedSize = networkStructs.size() * sizeof(WifiNetworkStruct);
-    preferences.putBytes(WIFI_NETWORKS_KEY, networkStructs.data(), serializedSize);
-    preferences.end();
-    Serial.printf("Saved %zu WiFi networks\n", networkStructs.size());
+    uint8_t segments = preferences.getUChar(journalCountKey(store.journal).c_str(), 0);
+    size_t applied = 0;
+    uint8_t segment = 0;
+    FlashBlobHeader header;
+    std::vector<uint8_t> blob;
+    for (; segment < segments; segment++)
+    {
+        String segmentKey = journalSegmentKey(store.journal, segment);
+        if (!readBlob(segmentKey.c_str(), sizeof(JournalEntry<Record>), header, blob) || header.version != FLASH_BLOB_VERSION ||
+            header.generation != store.generation)
+        {
+            Console.printf("Error: journal segment %s is not valid for generation %u, ignoring the rest\n", segmentKey.c_str(), store.generation);
+            break;
+        }
+        const uint8_t *data = blob.data() + sizeof(FlashBlobHeader);
+        for (uint32_t i = 0; i < header.count; i++)
+        {
+            JournalEntry<Record> entry;
+            memcpy(&entry, data + i * sizeof(entry), sizeof(entry));
+            if (entry.position < records.size())
+            {
+                records[entry.position] = entry.record;
+            }
+            else if (entry.position == records.size())
+            {
+                records.push_back(entry.record);
+            }
+            else
+            {
+                LOG_WARN("Journal %s: skipping record for position %u past the end (%zu)", store.journal, entry.position, records.size());
+                continue;
+            }
+            applied++;
+        }
+    }
+    if (segment > 0)
+    {
+        LOG_INFO("Replayed %zu journal records from %u segments of %s", applied, segment, store.journal);
+    }
 }
 
-void FlashStorage::loadWifiDevices()
+void FlashStorage::saveWifiDevices()
 {
     WifiDeviceList &list = stationsList;
+    FlashListStore &store = wifiDevicesStore;
+    std::lock_guard<std::mutex> lock(storageMutex);
 
-    preferences.begin(NAMESPACE, true);
-    size_t serializedSize = preferences.getBytesLength(WIFI_DEVICES_KEY);
-    Serial.printf("Loading WiFi devices. Serialized size: %zu bytes\n", serializedSize);
-    if (serializedSize > 0)
+    preferences.begin(NAMESPACE, false);
+    resolveSlots<WifiDeviceStruct>(store);
+    ListChanges<WifiDevice> changes = list.takeChanges(needsCompaction(store));
+    if (!writeChanges<WifiDeviceStruct>(store, changes, toRecord))
+    {
+        // Probably out of space: a snapshot replaces the journal and frees it
+        changes = list.takeChanges(true);
+        if (!writeChanges<WifiDeviceStruct>(store, changes, toRecord))
+        {
+            list.markAllChanged();
+            std::lock_guard<std::mutex> statsLock(statsMutex);
+            saveStats.failures++;
+            Console.println("Error: could not save WiFi devices");
+        }
+    }
+    preferences.end();
+    LOG_INFO("Saved %zu WiFi devices (%s)", changes.records.size(), changes.full ? "snapshot" : "journal");
+}
+
+void FlashStorage::saveBLEDevices()
+{
+    BLEDeviceList &list = bleDeviceList;
+    FlashListStore &store = bleDevicesStore;
+    std::lock_guard<std::mutex> lock(storageMutex);
+
+    preferences.begin(NAMESPACE, false);
+    resolveSlots<BLEDeviceStruct>(store);
+    ListChanges<BLEFoundDevice> changes = list.takeChanges(needsCompaction(store));
+    if (!writeChanges<BLEDeviceStruct>(store, changes, toRecord))
     {
-        if (serializedSize % sizeof(WifiDeviceStruct) != 0)
+        changes = list.takeChanges(true);
+        if (!writeChanges<BLEDeviceStruct>(store, changes, toRecord))
         {
-            Serial.printf("Error: Serialized size (%zu) is not a multiple of WifiDeviceStruct size (%zu)\n", serializedSize, sizeof(WifiDeviceStruct));
-            preferences.end();
-            return;
+            list.markAllChanged();
+            std::lock_guard<std::mutex> statsLock(statsMutex);
+            saveStats.failures++;
+            Console.println("Error: could not save BLE devices");
         }
-        std::vector<WifiDeviceStruct> deviceStructs(serializedSize / sizeof(WifiDeviceStruct));
-        preferences.getBytes(WIFI_DEVICES_KEY, deviceStructs.data(), serializedSize);
-        Serial.printf("Loaded %zu devices from flash\n", deviceStructs.size());
-        for (const auto &deviceStruct : deviceStructs)
+    }
+    preferences.end();
+    LOG_INFO("Saved %zu BLE devices (%s)", changes.records.size(), changes.full ? "snapshot" : "journal");
+}
+
+void FlashStorage::saveWifiNetworks()
+{
+    WifiNetworkList &list = ssidList;
+    FlashListStore &store = wifiNetworksStore;
+    std::lock_guard<std::mutex> lock(storageMutex);
+
+    preferences.begin(NAMESPACE, false);
+    resolveSlots<WifiNetworkStruct>(store);
+    ListChanges<WifiNetwork> changes = list.takeChanges(needsCompaction(store));
+    if (!writeChanges<WifiNetworkStruct>(store, changes, toRecord))
+    {
+        changes = list.takeChanges(true);
+        if (!writeChanges<WifiNetworkStruct>(store, changes, toRecord))
         {
-            Serial.printf("Loaded Device: %02X:%02X:%02X:%02X:%02X:%02X, BSSID: %02X:%02X:%02X:%02X:%02X:%02X, RSSI: %d, Channel: %d, Last seen: %ld, Times seen: %u\n",
-                          deviceStruct.address[0], deviceStruct.address[1], deviceStruct.address[2],
-                          deviceStruct.address[3], deviceStruct.address[4], deviceStruct.address[5],
-                          deviceStruct.bssid[0], deviceStruct.bssid[1], deviceStruct.bssid[2],
-                          deviceStruct.bssid[3], deviceStruct.bssid[4], deviceStruct.bssid[5],
-                          deviceStruct.rssi, deviceStruct.channel, deviceStruct.last_seen, deviceStruct.times_seen);
-            WifiDevice device(MacAddress(deviceStruct.address), MacAddress(deviceStruct.bssid), deviceStruct.rssi, deviceStruct.channel, deviceStruct.last_seen, deviceStruct.times_seen);
-            list.addDevice(device);
+            list.markAllChanged();
+            std::lock_guard<std::mutex> statsLock(statsMutex);
+            saveStats.failures++;
+            Console.println("Error: could not save WiFi networks");
         }
-        Serial.printf("Successfully loaded %zu WiFi devices\n", list.size());
     }
-    else
+    if (store.generation > 0 && preferences.isKey(LEGACY_WIFI_NETWORKS_KEY))
     {
-        Serial.println("No WiFi devices to load");
+        preferences.remove(LEGACY_WIFI_NETWORKS_KEY);
     }
     preferences.end();
+    LOG_INFO("Saved %zu WiFi networks (%s)", changes.records.size(), changes.full ? "snapshot" : "journal");
 }
 
-void FlashStorage::loadBLEDevices()
+time_t FlashStorage::loadWifiDevices()
 {
-    BLEDeviceList &list = bleDeviceList;
+    std::vector<WifiDeviceStruct> deviceStructs;
+    {
+        std::lock_guard<std::mutex> lock(storageMutex);
+        preferences.begin(NAMESPACE, true);
+        bool valid = readSnapshot(wifiDevicesStore, deviceStructs);
+        if (valid)
+        {
+            replayJournal(wifiDevicesStore, deviceStructs);
+        }
+        preferences.end();
+        if (!valid)
+        {
+            return 0;
+        }
+    }
 
-    preferences.begin(NAMESPACE, true);
-    size_t serializedSize = preferences.getBytesLength(BLE_DEVICES_KEY);
-    Serial.printf("Loading BLE devices. Serialized size: %zu bytes\n", serializedSize);
-    if (serializedSize > 0)
+    time_t newest = 0;
+    std::vector<WifiDevice> devices;
+    devices.reserve(deviceStructs.size());
+    for (const auto &deviceStruct : deviceStructs)
     {
-        if (serializedSize % sizeof(BLEDeviceStruct) != 0)
+        devices.emplace_back(MacAddress(deviceStruct.address), MacAddress(deviceStruct.bssid), deviceStruct.rssi, deviceStruct.channel,
+                             deviceStruct.last_seen, deviceStruct.times_seen);
+        newest = std::max(newest, deviceStruct.last_seen);
+    }
+    stationsList.adoptLoaded(std::move(devices));
+    return newest;
+}
+
+time_t FlashStorage::loadBLEDevices()
+{
+    std::vector<BLEDeviceStruct> deviceStructs;
+    {
+        std::lock_guard<std::mutex> lock(storageMutex);
+        preferences.begin(NAMESPACE, true);
+        bool valid = readSnapshot(bleDevicesStore, deviceStructs);
+        if (valid)
         {
-            Serial.printf("Error: Serialized size (%zu) is not a multiple of BLEDeviceStruct size (%zu)\n", serializedSize, sizeof(BLEDeviceStruct));
-            preferences.end();
-            return;
+            replayJournal(bleDevicesStore, deviceStructs);
         }
-        std::vector<BLEDeviceStruct> deviceStructs(serializedSize / sizeof(BLEDeviceStruct));
-        preferences.getBytes(BLE_DEVICES_KEY, deviceStructs.data(), serializedSize);
-        for (const auto &deviceStruct : deviceStructs)
+        preferences.end();
+        if (!valid)
         {
-            BLEFoundDevice device(MacAddress(deviceStruct.address), deviceStruct.rssi,
-                                  String(deviceStruct.name), deviceStruct.isPublic, deviceStruct.last_seen, deviceStruct.times_seen);
-            list.addDevice(device);
+            return 0;
         }
-        Serial.printf("Loaded %zu BLE devices\n", deviceStructs.size());
     }
-    else
+
+    time_t newest = 0;
+    std::vector<BLEFoundDevice> devices;
+    devices.reserve(deviceStructs.size());
+    for (auto &deviceStruct : deviceStructs)
     {
-        Serial.println("No BLE devices to load");
+        deviceStruct.name[sizeof(deviceStruct.name) - 1] = '\0';
+        devices.emplace_back(MacAddress(deviceStruct.address), deviceStruct.rssi,
+                             stringArena.intern(deviceStruct.name, strlen(deviceStruct.name)),
+                             deviceStruct.isPublic, deviceStruct.last_seen, deviceStruct.times_seen);
+        newest = std::max(newest, deviceStruct.last_seen);
     }
-    preferences.end();
+    bleDeviceList.adoptLoaded(std::move(devices));
+    return newest;
 }
 
-void FlashStorage::loadWifiNetworks()
+time_t FlashStorage::loadWifiNetworks()
 {
-    WifiNetworkList &list = ssidList;
+    std::vector<WifiNetworkStruct> networkStructs;
+    {
+        std::lock_guard<std::mutex> lock(storageMutex);
+        preferences.begin(NAMESPACE, true);
+        bool valid = readSnapshot(wifiNetworksStore, networkStructs);
+        if (valid)
+        {
+            replayJournal(wifiNetworksStore, networkStructs);
+        }
+        preferences.end();
+        if (!valid)
+        {
+            return 0;
+        }
+    }
 
-    preferences.begin(NAMESPACE, true);
-    size_t serializedSize = preferences.getBytesLength(WIFI_NETWORKS_KEY);
-    Serial.printf("Loading WiFi networks. Serialized size: %zu bytes\n", serializedSize);
-    if (serializedSize > 0)
+    if (networkStructs.empty() && wifiNetworksStore.generation == 0)
+    {
+        return loadLegacyWifiNetworks();
+    }
+
+    time_t newest = 0;
+    std::vector<WifiNetwork> networks;
+    networks.reserve(networkStructs.size());
+    for (auto &networkStruct : networkStructs)
     {
-        if (serializedSize % sizeof(WifiNetworkStruct) != 0)
+        networkStruct.ssid[sizeof(networkStruct.ssid) - 1] = '\0';
+        networks.emplace_back(stringArena.intern(networkStruct.ssid, strlen(networkStruct.ssid)), MacAddress(networkStruct.address), networkStruct.rssi, networkStruct.channel,
+                              static_cast<FrameKind>(networkStruct.type), networkStruct.last_seen, networkStruct.times_seen);
+        newest = std::max(newest, networkStruct.last_seen);
+    }
+    ssidList.adoptLoaded(std::move(networks));
+    return newest;
+}
+
+time_t FlashStorage::loadLegacyWifiNetworks()
+{
+    std::vector<LegacyWifiNetworkStruct> networkStructs;
+    {
+        std::lock_guard<std::mutex> lock(storageMutex);
+        preferences.begin(NAMESPACE, true);
+        size_t serializedSize = preferences.getBytesLength(LEGACY_WIFI_NETWORKS_KEY);
+        if (serializedSize % sizeof(LegacyWifiNetworkStruct) != 0)
         {
-            Serial.printf("Error: Serialized size (%zu) is not a multiple of WifiNetworkStruct size (%zu)\n", serializedSize, sizeof(WifiNetworkStruct));
-            preferences.end();
-            return;
+            Console.printf("Error: Serialized size (%zu) is not a multiple of LegacyWifiNetworkStruct size (%zu)\n", serializedSize, sizeof(LegacyWifiNetworkStruct));
+            serializedSize = 0;
         }
-        std::vector<WifiNetworkStruct> networkStructs(serializedSize / sizeof(WifiNetworkStruct));
-        preferences.getBytes(WIFI_NETWORKS_KEY, networkStructs.data(), serializedSize);
-        for (const auto &networkStruct : networkStructs)
+        networkStructs.resize(serializedSize / sizeof(LegacyWifiNetworkStruct));
+        if (serializedSize > 0)
         {
-            WifiNetwork network(String(networkStruct.ssid), MacAddress(networkStruct.address), networkStruct.rssi, networkStruct.channel,
-                                String(networkStruct.type), networkStruct.last_seen, networkStruct.times_seen);
-            list.addNetwork(network);
+            preferences.getBytes(LEGACY_WIFI_NETWORKS_KEY, networkStructs.data(), serializedSize);
         }
-        Serial.printf("Loaded %zu WiFi networks\n", networkStructs.size());
+        preferences.end();
     }
-    else
+    if (networkStructs.empty())
     {
-        Serial.println("No WiFi networks to load");
+        Console.println("No WiFi networks to load");
+        return 0;
     }
+
+    time_t newest = 0;
+    std::vector<WifiNetwork> networks;
+    networks.reserve(networkStructs.size());
+    for (auto &networkStruct : networkStructs)
+    {
+        networkStruct.ssid[sizeof(networkStruct.ssid) - 1] = '\0';
+        networkStruct.type[sizeof(networkStruct.type) - 1] = '\0';
+        networks.emplace_back(stringArena.intern(networkStruct.ssid, strlen(networkStruct.ssid)), MacAddress(networkStruct.address), networkStruct.rssi, networkStruct.channel,
+                              frameKindFromName(networkStruct.type), networkStruct.last_seen, networkStruct.times_seen);
+        newest = std::max(newest, networkStruct.last_seen);
+    }
+    ssidList.adoptLoaded(std::move(networks));
+    Console.printf("Loaded %zu WiFi networks (legacy format)\n", networkStructs.size());
+    return newest;
+}
+
+time_t FlashStorage::loadClock()
+{
+    std::lock_guard<std::mutex> lock(storageMutex);
+    preferences.begin(NAMESPACE, true);
+    time_t clock = preferences.getUInt(CLOCK_KEY, 0);
     preferences.end();
+    return clock;
 }
 
 void FlashStorage::saveAll()
 {
-    FlashStorage::saveWifiDevices();
-    FlashStorage::saveBLEDevices();
-    FlashStorage::saveWifiNetworks();
+    if (loading.load())
+    {
+        // A snapshot now would replace the stored lists with the few live entries
+        LOG_WARN("Lists still loading, save skipped");
+        return;
+    }
+    uint32_t start = millis();
+    bool failed = false;
+    try
+    {
+        FlashStorage::saveWifiDevices();
+        FlashStorage::saveBLEDevices();
+        FlashStorage::saveWifiNetworks();
+
+        std::lock_guard<std::mutex> lock(storageMutex);
+        preferences.begin(NAMESPACE, false);
+        preferences.putUInt(CLOCK_KEY, millis() / 1000 + base_time);
+        preferences.end();
+    }
+    catch (const std::exception &e)
+    {
+        Console.printf("Error saving to flash storage: %s\n", e.what());
+        failed = true;
+    }
+    uint32_t duration = millis() - start;
+
+    std::lock_guard<std::mutex> lock(statsMutex);
+    saveStats.saves++;
+    if (failed)
+    {
+        saveStats.failures++;
+    }
+    saveStats.last_duration_ms = duration;
+    if (duration > saveStats.max_duration_ms)
+    {
+        saveStats.max_duration_ms = duration;
+    }
+    saveStats.last_save_ms = millis();
 }
 
+void FlashStorage::beginAutosave(bool loadFirst)
+{
+    if (autosaveTask != nullptr)
+    {
+        return;
+    }
+    loading.store(loadFirst);
+    xTaskCreatePinnedToCore(
+        [](void *parameter)
+        { FlashStorage::autosave_loop(); },
+        "Autosave_Task", FLASH_AUTOSAVE_STACK_SIZE, nullptr, FLASH_AUTOSAVE_PRIORITY, &autosaveTask, tskNO_AFFINITY);
+}
 
-void FlashStorage::loadAll()
+void FlashStorage::requestSave()
 {
-    try
+    if (autosaveTask == nullptr)
     {
-        Serial.println("Starting to load all data from flash storage");
-        stationsList.clear();
-        Serial.println("Loading WiFi devices...");
-        FlashStorage::loadWifiDevices();
-        Serial.printf("Loaded %zu WiFi devices\n", stationsList.size());
+        saveAll();
+        return;
+    }
+    // Requests made while a save is running collapse into one more save
+    xTaskNotifyGive(autosaveTask);
+}
 
-        bleDeviceList.clear();
-        Serial.println("Loading BLE devices...");
-        FlashStorage::loadBLEDevices();
-        Serial.printf("Loaded %zu BLE devices\n", bleDeviceList.size());
+void FlashStorage::autosave_loop()
+{
+    if (loading.load())
+    {
+        // Lazy boot: capture is already running, merge the stored lists into the live ones
+        loadLists();
+        loading.store(false);
+    }
+    while (true)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        saveAll();
+        historyStore.recordSightings();
+        FlashSaveStats stats = getSaveStats();
+        LOG_INFO("Autosave took %u ms (max %u ms), %u failures, %u bytes written since boot",
+                 stats.last_duration_ms, stats.max_duration_ms, stats.failures, stats.bytes_written);
+    }
+}
+
+FlashSaveStats FlashStorage::getSaveStats()
+{
+    std::lock_guard<std::mutex> lock(statsMutex);
+    return saveStats;
+}
 
-        ssidList.clear();
-        Serial.println("Loading WiFi networks...");
-        FlashStorage::loadWifiNetworks();
-        Serial.printf("Loaded %zu WiFi networks\n", ssidList.size());
 
-        Serial.println("All data loaded successfully from flash storage");
+time_t FlashStorage::loadLists()
+{
+    uint32_t start = millis();
+    time_t newest = 0;
+    try
+    {
+        newest = std::max(newest, loadWifiDevices());
+        newest = std::max(newest, loadBLEDevices());
+        newest = std::max(newest, loadWifiNetworks());
+        Console.printf("Loaded %zu WiFi devices, %zu BLE devices and %zu WiFi networks in %lu ms\n",
+                      stationsList.size(), bleDeviceList.size(), ssidList.size(), (unsigned long)(millis() - start));
     }
     catch (const std::exception &e)
     {
-        Serial.printf("Error loading from flash storage: %s\n", e.what());
+        Console.printf("Error loading from flash storage: %s\n", e.what());
         // Clear all lists in case of an error
         stationsList.clear();
         bleDeviceList.clear();
         ssidList.clear();
-        Serial.println("All lists cleared due to error");
+        Console.println("All lists cleared due to error");
+        newest = 0;
     }
+    return newest;
+}
+
+time_t FlashStorage::loadAll()
+{
+    stationsList.clear();
+    bleDeviceList.clear();
+    ssidList.clear();
+    return loadLists();
 }
 
 void FlashStorage::clearAll()
 {
     // Clear the preferences namespace
-    preferences.begin(NAMESPACE, false);
-    preferences.clear();
-    preferences.end();
+    {
+        std::lock_guard<std::mutex> lock(storageMutex);
+        preferences.begin(NAMESPACE, false);
+        preferences.clear();
+        preferences.end();
+        for (FlashListStore *store : {&wifiDevicesStore, &bleDevicesStore, &wifiNetworksStore})
+        {
+            store->generation = 0;
+            store->slot = 0;
+            store->resolved = true;
+        }
+    }
 
     // Clear the lists
     stationsList.clear();
     bleDeviceList.clear();
     ssidList.clear();
 
-    Serial.println("All data cleared from flash storage");
+    Console.println("All data cleared from flash storage");
 }
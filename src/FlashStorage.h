@@ -3,10 +3,37 @@
 
 #include <Arduino.h>
 #include <Preferences.h>
+#include <atomic>
+#include <mutex>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "WifiDeviceList.h"
 #include "BLEDeviceList.h"
 #include "WifiNetworkList.h"
 
+// Journal segments written between two full snapshots of a list
+#define FLASH_JOURNAL_MAX_SEGMENTS 8
+// Compact once the journal of a list reaches this percentage of its snapshot
+#define FLASH_JOURNAL_MAX_RATIO 50
+// Layout of FlashBlobHeader, older blobs are ignored
+#define FLASH_BLOB_VERSION 1
+// Same header followed by a CompactCodec block instead of the raw records
+#define FLASH_BLOB_VERSION_COMPACT 2
+
+// Write snapshots with the compact record encoding, journal segments stay raw
+#ifndef FLASH_COMPACT_SNAPSHOTS
+#define FLASH_COMPACT_SNAPSHOTS 1
+#endif
+
+#define FLASH_AUTOSAVE_STACK_SIZE 6144
+#define FLASH_AUTOSAVE_PRIORITY 1
+
+// Scan mode starts capturing before the stored lists are loaded, the autosave
+// task loads them in the background
+#ifndef FLASH_LAZY_LOAD
+#define FLASH_LAZY_LOAD 1
+#endif
+
 struct WifiDeviceStruct {
     uint8_t address[6];
     uint8_t bssid[6];
@@ -26,6 +53,60 @@ struct BLEDeviceStruct {
 };
 
 struct WifiNetworkStruct {
+    char ssid[32];
+    uint8_t address[6];
+    int8_t rssi;
+    uint8_t channel;
+    uint8_t type; // FrameKind
+    time_t last_seen;
+    uint32_t times_seen;
+};
+
+// Stored form of a list entry, also used by the warm restart image
+void toRecord(const WifiDevice &device, WifiDeviceStruct &deviceStruct);
+void toRecord(const BLEFoundDevice &device, BLEDeviceStruct &deviceStruct);
+void toRecord(const WifiNetwork &network, WifiNetworkStruct &networkStruct);
+
+// Journal record: new content of one list position
+template <typename Record>
+struct JournalEntry {
+    uint16_t position;
+    Record record;
+};
+
+// Header in front of every snapshot slot and journal segment
+struct FlashBlobHeader {
+    uint8_t version;       // FLASH_BLOB_VERSION or FLASH_BLOB_VERSION_COMPACT
+    uint8_t reserved;
+    uint16_t record_size;  // sizeof the stored record, a layout change invalidates the blob
+    uint32_t generation;   // Snapshot generation, journal segments carry the one they extend
+    uint32_t count;        // Records following the header
+    uint32_t crc;          // CRC32 of the payload
+};
+
+// NVS keys of a list and the snapshot slot currently in use
+struct FlashListStore {
+    const char *slotKeys[2];  // Snapshot slots A and B
+    const char *legacyKey;    // Headerless snapshot written by older firmware
+    const char *journal;
+    uint32_t generation;      // Generation of the newest valid snapshot, 0 if there is none
+    uint8_t slot;             // Slot holding that snapshot
+    bool resolved;            // generation and slot have been read from flash
+};
+
+struct FlashSaveStats {
+    uint32_t saves;             // saveAll() runs, manual or automatic
+    uint32_t failures;          // Lists that could not be written
+    uint32_t snapshots;         // Snapshot slots written
+    uint32_t journal_segments;  // Journal segments appended
+    uint32_t bytes_written;     // Blob bytes handed to NVS
+    uint32_t last_duration_ms;
+    uint32_t max_duration_ms;
+    uint32_t last_save_ms;      // millis() at the end of the last save, 0 if none
+};
+
+// Record layout written by firmware that stored the frame kind as a string
+struct LegacyWifiNetworkStruct {
     char ssid[32];
     uint8_t address[6];
     int8_t rssi;
@@ -35,26 +116,97 @@ struct WifiNetworkStruct {
     uint32_t times_seen;
 };
 
+/**
+ * @brief Persistence of the device and network lists in the NVS partition.
+ *
+ * Every list is stored as a snapshot blob plus an append-only journal of
+ * JournalEntry segments. A save only appends the records that changed since
+ * the previous save; once the journal has too many segments or grows past
+ * FLASH_JOURNAL_MAX_RATIO of the snapshot, or when list positions changed,
+ * the whole list is written as a new snapshot and the journal is dropped.
+ * Loading replays the journal over the snapshot.
+ *
+ * Snapshots alternate between two slots and every blob starts with a
+ * FlashBlobHeader. A new snapshot never overwrites the one in use, so a reset
+ * or power loss in the middle of a save leaves the previous generation intact;
+ * loading picks the newest slot whose CRC matches and only replays the journal
+ * segments written for that generation. With FLASH_COMPACT_SNAPSHOTS the
+ * snapshot payload is a CompactCodec block; raw snapshots of older firmware
+ * are still read.
+ *
+ * Periodic saves run in a low priority task (requestSave()), the lists are
+ * copied under their own locks so every list is saved as a consistent snapshot.
+ * The same task appends the new sightings to the HistoryStore.
+ *
+ * Loading decodes every list into a vector and hands it to the list in one
+ * adoptLoaded() call. Every save also stores the current clock, so a lazy boot
+ * can set base_time without the lists and let the autosave task load them
+ * while capture is already running.
+ */
 class FlashStorage {
 public:
     static void saveWifiDevices();
     static void saveBLEDevices();
     static void saveWifiNetworks();
 
-    static void loadWifiDevices();
-    static void loadBLEDevices();
-    static void loadWifiNetworks();
-    static void loadAll();
+    // Loaders merge the stored records into the lists and return the newest last_seen, 0 if none
+    static time_t loadWifiDevices();
+    static time_t loadBLEDevices();
+    static time_t loadWifiNetworks();
+    // Clears the lists and loads them
+    static time_t loadAll();
+    // Clock stored by the last save, 0 if none
+    static time_t loadClock();
     static void saveAll();
     static void clearAll();
 
+    // Starts the autosave task, with loadFirst it loads the lists before the first save
+    static void beginAutosave(bool loadFirst = false);
+    // Wakes the autosave task, saves inline if it is not running
+    static void requestSave();
+    static FlashSaveStats getSaveStats();
+    // True until a lazy load has merged the stored lists
+    static bool loadPending() { return loading.load(); }
+
 private:
     static const char* NAMESPACE;
     static const char* WIFI_DEVICES_KEY;
     static const char* BLE_DEVICES_KEY;
     static const char* WIFI_NETWORKS_KEY;
+    static const char* LEGACY_WIFI_NETWORKS_KEY;
+    static const char* CLOCK_KEY;
+
+    static time_t loadLists();
+    static time_t loadLegacyWifiNetworks();
+    static bool needsCompaction(const FlashListStore &store);
+    static bool readBlob(const char *key, size_t recordSize, FlashBlobHeader &header, std::vector<uint8_t> &blob);
+    static size_t writeBlob(const char *key, uint8_t version, uint32_t generation, const void *payload, size_t payloadSize,
+                            size_t count, size_t recordSize);
+    static void recordWrite(bool snapshot, size_t bytes);
+    static void autosave_loop();
+
+    template <typename Record>
+    static bool readSnapshot(FlashListStore &store, std::vector<Record> &records);
+    template <typename Record>
+    static void resolveSlots(FlashListStore &store);
+    template <typename Record>
+    static void replayJournal(const FlashListStore &store, std::vector<Record> &records);
+    template <typename Record, typename Item>
+    static bool writeChanges(FlashListStore &store, const ListChanges<Item> &changes,
+                             void (*toRecord)(const Item &, Record &));
 
     static Preferences preferences;
+    static FlashListStore wifiDevicesStore;
+    static FlashListStore bleDevicesStore;
+    static FlashListStore wifiNetworksStore;
+
+    // Serializes the users of preferences and the stores
+    static std::mutex storageMutex;
+    static std::mutex statsMutex;
+    static FlashSaveStats saveStats;
+    static TaskHandle_t autosaveTask;
+    // Set while a lazy load is pending, saves are skipped meanwhile
+    static std::atomic<bool> loading;
 };
 
 #endif // FLASH_STORAGE_H
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <Arduino.h>
+
+/**
+ * @brief Kind of frame a WifiNetwork record was last classified from.
+ *
+ * Stored as a single byte in memory, in FlashStorage and in the BLE records.
+ * Values are part of the persisted and transferred formats, do not reorder.
+ */
+enum class FrameKind : uint8_t {
+  Probe = 0,   // Probe request
+  Beacon = 1,  // Beacon or probe response
+  Assoc = 2,   // (Re)association request
+  Control = 3, // Control frame, BSSID only
+  Data = 4,    // Data frame, BSSID only
+  Other = 5    // Any other management frame
+};
+
+inline const char *frameKindName(FrameKind kind)
+{
+  switch (kind)
+  {
+  case FrameKind::Probe:
+    return "probe";
+  case FrameKind::Beacon:
+    return "beacon";
+  case FrameKind::Assoc:
+    return "assoc";
+  case FrameKind::Control:
+    return "control";
+  case FrameKind::Data:
+    return "data";
+  default:
+    return "other";
+  }
+}
+
+// Only used to convert records saved by older firmware versions
+inline FrameKind frameKindFromName(const char *name)
+{
+  if (strcmp(name, "probe") == 0)
+    return FrameKind::Probe;
+  if (strcmp(name, "beacon") == 0 || strcmp(name, "probe-resp") == 0)
+    return FrameKind::Beacon;
+  if (strcmp(name, "assoc") == 0)
+    return FrameKind::Assoc;
+  if (strcmp(name, "control") == 0)
+    return FrameKind::Control;
+  if (strcmp(name, "data") == 0)
+    return FrameKind::Data;
+  return FrameKind::Other;
+}
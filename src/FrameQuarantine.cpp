@@ -0,0 +1,177 @@
+#include "FrameQuarantine.h"
+#include <esp_timer.h>
+
+FrameQuarantine frameQuarantine;
+
+static_assert((QUARANTINE_SLOTS & (QUARANTINE_SLOTS - 1)) == 0, "QUARANTINE_SLOTS must be a power of two");
+
+namespace
+{
+  const uint8_t REASON_COUNT = static_cast<uint8_t>(QuarantineReason::Count);
+  const char *const reasonNames[REASON_COUNT] = {"too short", "malformed IEs", "oversized SSID",
+                                                 "suspicious SSID", "null BSSID"};
+  const uint8_t nullAddress[6] = {0, 0, 0, 0, 0, 0};
+}
+
+const char *quarantineReasonName(QuarantineReason reason)
+{
+  uint8_t index = static_cast<uint8_t>(reason);
+  return index < REASON_COUNT ? reasonNames[index] : "unknown";
+}
+
+bool isSuspiciousSsid(const char *ssid)
+{
+  for (int i = 0; ssid[i] != '\0'; i++)
+  {
+    if (!isalnum(ssid[i]) && !isspace(ssid[i]) && ssid[i] != '-' && ssid[i] != '_')
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+FrameQuarantine::FrameQuarantine() : head_(0), clearedHead_(0)
+{
+  for (uint32_t i = 0; i < QUARANTINE_SLOTS; i++)
+  {
+    slots_[i].sequence.store(0);
+  }
+  for (uint8_t i = 0; i < REASON_COUNT; i++)
+  {
+    counts_[i].store(0);
+    baseline_[i] = 0;
+  }
+}
+
+void FrameQuarantine::add(const wifi_promiscuous_pkt_t *pkt, QuarantineReason reason)
+{
+  uint8_t index = static_cast<uint8_t>(reason);
+  counts_[index].store(counts_[index].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+  uint32_t pos = head_.load(std::memory_order_relaxed);
+  Slot &slot = slots_[pos & (QUARANTINE_SLOTS - 1)];
+
+  // Odd sequence: readers skip the slot until it is published again
+  slot.sequence.store(pos * 2 + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  QuarantineEntry &entry = slot.entry;
+  uint16_t len = pkt->rx_ctrl.sig_len;
+  entry.timestamp_us = esp_timer_get_time();
+  entry.reason = reason;
+  entry.rssi = pkt->rx_ctrl.rssi;
+  entry.channel = pkt->rx_ctrl.channel;
+  entry.rate = pkt->rx_ctrl.rate;
+  entry.orig_len = len;
+  entry.cap_len = len < QUARANTINE_SNAPLEN ? len : QUARANTINE_SNAPLEN;
+  memcpy(entry.data, pkt->payload, entry.cap_len);
+
+  slot.sequence.store(pos * 2 + 2, std::memory_order_release);
+  head_.store(pos + 1, std::memory_order_release);
+}
+
+bool FrameQuarantine::classify(const FrameDescriptor &frame, QuarantineReason &reason)
+{
+  if (frame.frame_type != 0)
+  {
+    return false;
+  }
+  if (frame.ie_flags & FRAME_IE_MALFORMED)
+  {
+    reason = QuarantineReason::MalformedIEs;
+  }
+  else if (frame.ie_flags & FRAME_IE_LONG_SSID)
+  {
+    reason = QuarantineReason::OversizedSsid;
+  }
+  else if (frame.subtype == 4 && isSuspiciousSsid(frame.ssid))
+  {
+    reason = QuarantineReason::SuspiciousSsid;
+  }
+  else if (memcmp(frame.addr3, nullAddress, 6) == 0)
+  {
+    reason = QuarantineReason::NullBssid;
+  }
+  else
+  {
+    return false;
+  }
+  return true;
+}
+
+bool FrameQuarantine::getEntry(uint32_t age, QuarantineEntry &entry) const
+{
+  uint32_t head = head_.load(std::memory_order_acquire);
+  if (age >= size())
+  {
+    return false;
+  }
+  uint32_t pos = head - 1 - age;
+  const Slot &slot = slots_[pos & (QUARANTINE_SLOTS - 1)];
+
+  uint32_t before = slot.sequence.load(std::memory_order_acquire);
+  if (before != pos * 2 + 2)
+  {
+    return false; // Overwritten or being written
+  }
+  memcpy(&entry, &slot.entry, sizeof(entry));
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return slot.sequence.load(std::memory_order_relaxed) == before;
+}
+
+uint32_t FrameQuarantine::size() const
+{
+  uint32_t stored = head_.load(std::memory_order_acquire) - clearedHead_.load(std::memory_order_relaxed);
+  return stored < QUARANTINE_SLOTS ? stored : QUARANTINE_SLOTS;
+}
+
+uint32_t FrameQuarantine::getCount(QuarantineReason reason) const
+{
+  uint8_t index = static_cast<uint8_t>(reason);
+  if (index >= REASON_COUNT)
+  {
+    return 0;
+  }
+  return counts_[index].load(std::memory_order_relaxed) - baseline_[index];
+}
+
+uint32_t FrameQuarantine::getTotal() const
+{
+  uint32_t total = 0;
+  for (uint8_t i = 0; i < REASON_COUNT; i++)
+  {
+    total += getCount(static_cast<QuarantineReason>(i));
+  }
+  return total;
+}
+
+void FrameQuarantine::clear()
+{
+  for (uint8_t i = 0; i < REASON_COUNT; i++)
+  {
+    baseline_[i] = counts_[i].load(std::memory_order_relaxed);
+  }
+  clearedHead_.store(head_.load(std::memory_order_acquire), std::memory_order_relaxed);
+}
+
+String FrameQuarantine::getSummary() const
+{
+  String summary = "Quarantined " + String(getTotal()) + " frames:";
+  for (uint8_t i = 0; i < REASON_COUNT; i++)
+  {
+    summary += String(i == 0 ? " " : ", ") + reasonNames[i] + " " + String(getCount(static_cast<QuarantineReason>(i)));
+  }
+  return summary;
+}
+
+String FrameQuarantine::describeEntry(const QuarantineEntry &entry) const
+{
+  char line[96];
+  const uint8_t *addr2 = entry.cap_len >= 16 ? &entry.data[10] : nullAddress;
+  snprintf(line, sizeof(line), "%lu.%03lu s, %s, ch %u, rssi %d, len %u, from %02X:%02X:%02X:%02X:%02X:%02X",
+           (unsigned long)(entry.timestamp_us / 1000000), (unsigned long)(entry.timestamp_us / 1000 % 1000),
+           quarantineReasonName(entry.reason), entry.channel, entry.rssi, entry.orig_len,
+           addr2[0], addr2[1], addr2[2], addr2[3], addr2[4], addr2[5]);
+  return String(line);
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+#include <esp_wifi_types.h>
+#include "FrameQueue.h"
+
+// Number of quarantined frames kept, must be a power of two
+#define QUARANTINE_SLOTS 16
+// Bytes of every quarantined frame that are kept
+#define QUARANTINE_SNAPLEN 128
+
+enum class QuarantineReason : uint8_t {
+  TooShort = 0,       // Shorter than a management header + FCS
+  MalformedIEs = 1,   // An Information Element runs past the end of the frame
+  OversizedSsid = 2,  // SSID element longer than 32 bytes
+  SuspiciousSsid = 3, // Probe request SSID with unexpected characters
+  NullBssid = 4,      // Management frame with a 00:00:00:00:00:00 BSSID
+  Count
+};
+
+const char *quarantineReasonName(QuarantineReason reason);
+
+// Probe request SSIDs are expected to be plain names
+bool isSuspiciousSsid(const char *ssid);
+
+/**
+ * @brief Copy of a quarantined frame with its rx metadata.
+ */
+struct QuarantineEntry {
+  int64_t timestamp_us;   // esp_timer_get_time() when received
+  QuarantineReason reason;
+  int8_t rssi;
+  uint8_t channel;
+  uint8_t rate;
+  uint16_t orig_len;      // Length on air, FCS included
+  uint16_t cap_len;       // Bytes stored in data
+  uint8_t data[QUARANTINE_SNAPLEN];
+};
+
+/**
+ * @brief Bounded ring of anomalous frames, filled from the promiscuous callback.
+ *
+ * add() never blocks and never fails: the newest frame overwrites the oldest.
+ * Every slot is protected by a sequence number (odd while being written), so
+ * readers copy entries from any task and discard the ones that were
+ * overwritten meanwhile. Per-reason counters keep counting after the ring wraps.
+ */
+class FrameQuarantine {
+public:
+  FrameQuarantine();
+
+  FrameQuarantine(const FrameQuarantine&) = delete;
+  FrameQuarantine& operator=(const FrameQuarantine&) = delete;
+
+  // Producer side, called from the WiFi driver task
+  void add(const wifi_promiscuous_pkt_t *pkt, QuarantineReason reason);
+
+  // Returns true and the reason when a described management frame is anomalous
+  static bool classify(const FrameDescriptor &frame, QuarantineReason &reason);
+
+  // Copies the entry received `age` frames ago (0 is the newest)
+  bool getEntry(uint32_t age, QuarantineEntry &entry) const;
+  // Number of entries currently retrievable
+  uint32_t size() const;
+  uint32_t getCount(QuarantineReason reason) const;
+  uint32_t getTotal() const;
+
+  // Hides the current entries and restarts the counters
+  void clear();
+
+  String getSummary() const;
+  String describeEntry(const QuarantineEntry &entry) const;
+
+private:
+  struct Slot {
+    std::atomic<uint32_t> sequence;
+    QuarantineEntry entry;
+  };
+
+  Slot slots_[QUARANTINE_SLOTS];
+  std::atomic<uint32_t> head_;
+  std::atomic<uint32_t> counts_[static_cast<uint8_t>(QuarantineReason::Count)];
+  std::atomic<uint32_t> clearedHead_;
+  uint32_t baseline_[static_cast<uint8_t>(QuarantineReason::Count)];
+};
+
+extern FrameQuarantine frameQuarantine;
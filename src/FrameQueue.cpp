@@ -0,0 +1,44 @@
+#include "FrameQueue.h"
+
+static_assert((FRAME_QUEUE_CAPACITY & (FRAME_QUEUE_CAPACITY - 1)) == 0, "FRAME_QUEUE_CAPACITY must be a power of two");
+
+FrameQueue::FrameQueue()
+    : head_(0), tail_(0), pushed_(0), processed_(0), dropped_(0), highWater_(0), consumer_(nullptr)
+{
+}
+
+void FrameQueue::setConsumer(TaskHandle_t task)
+{
+  consumer_ = task;
+}
+
+void FrameQueue::waitForFrames()
+{
+  if (size() == 0)
+  {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(FRAME_QUEUE_IDLE_WAIT_MS));
+  }
+}
+
+size_t FrameQueue::size() const
+{
+  return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+}
+
+FrameQueueStats FrameQueue::getStats() const
+{
+  FrameQueueStats stats;
+  stats.pushed = pushed_.load(std::memory_order_relaxed);
+  stats.processed = processed_.load(std::memory_order_acquire);
+  stats.dropped = dropped_.load(std::memory_order_relaxed);
+  stats.high_water = highWater_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void FrameQueue::resetStats()
+{
+  pushed_.store(0, std::memory_order_relaxed);
+  processed_.store(0, std::memory_order_relaxed);
+  dropped_.store(0, std::memory_order_relaxed);
+  highWater_.store(0, std::memory_order_relaxed);
+}
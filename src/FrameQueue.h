@@ -0,0 +1,143 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// Number of descriptors in each queue, must be a power of two
+#define FRAME_QUEUE_CAPACITY 64
+// Maximum number of descriptors processed before yielding to other tasks
+#define FRAME_QUEUE_BATCH 16
+// Maximum time the processing task sleeps when no notification arrives
+#define FRAME_QUEUE_IDLE_WAIT_MS 100
+
+#define FRAME_TASK_STACK_SIZE 4096
+#define FRAME_TASK_PRIORITY 2
+// On dual core chips keep the processing away from the WiFi driver (core 0)
+#define FRAME_TASK_CORE (portNUM_PROCESSORS - 1)
+
+#define FRAME_SSID_MAX_LEN 32
+
+// FrameDescriptor::ie_flags bits
+#define FRAME_IE_HT (1 << 0)
+#define FRAME_IE_VHT (1 << 1)
+#define FRAME_IE_RSN (1 << 2)
+#define FRAME_IE_WPA (1 << 3)
+#define FRAME_IE_LONG_SSID (1 << 4) // SSID element longer than FRAME_SSID_MAX_LEN, ssid is truncated
+#define FRAME_IE_MALFORMED (1 << 7)
+
+/**
+ * @brief Compact copy of the parts of a received 802.11 frame that the
+ * processing tasks need. The payload buffer is owned by the WiFi driver and
+ * is only valid inside the promiscuous callback, so everything is copied.
+ */
+struct FrameDescriptor {
+  uint8_t addr1[6];
+  uint8_t addr2[6];
+  uint8_t addr3[6];
+  uint16_t frame_control;
+  int8_t rssi;
+  uint8_t channel;
+  uint8_t frame_type;
+  uint8_t subtype;
+  uint8_t ds_channel; // Channel announced in the DS Parameter Set, 0 if absent
+  uint8_t ie_flags;
+  uint8_t ssid_len;
+  char ssid[FRAME_SSID_MAX_LEN + 1];
+  uint16_t seq;               // Sequence number from the Sequence Control field
+  uint32_t probe_fingerprint; // Probe requests only, see probeFingerprint(), 0 otherwise
+};
+
+struct FrameQueueStats {
+  uint32_t pushed;
+  uint32_t processed;
+  uint32_t dropped;
+  uint32_t high_water;
+};
+
+/**
+ * @brief Fixed size single-producer/single-consumer ring of frame descriptors.
+ *
+ * The producer is the WiFi driver task (promiscuous callback) and the consumer
+ * is a dedicated processing task. Head is only written by the producer and tail
+ * only by the consumer, so no locks or read-modify-write atomics are needed.
+ * When the ring is full the frame is dropped and counted, the callback never
+ * blocks.
+ */
+class FrameQueue {
+public:
+  FrameQueue();
+
+  FrameQueue(const FrameQueue&) = delete;
+  FrameQueue& operator=(const FrameQueue&) = delete;
+
+  void setConsumer(TaskHandle_t task);
+
+  // Producer side: reserve() returns a slot to fill or nullptr if full
+  FrameDescriptor* reserve()
+  {
+    uint32_t head = head_.load(std::memory_order_relaxed);
+    uint32_t used = head - tail_.load(std::memory_order_acquire);
+    if (used >= FRAME_QUEUE_CAPACITY)
+    {
+      dropped_.store(dropped_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    if (used + 1 > highWater_.load(std::memory_order_relaxed))
+    {
+      highWater_.store(used + 1, std::memory_order_relaxed);
+    }
+    return &slots_[head & (FRAME_QUEUE_CAPACITY - 1)];
+  }
+
+  // Producer side: publishes the slot returned by reserve()
+  void commit()
+  {
+    uint32_t head = head_.load(std::memory_order_relaxed);
+    bool wasEmpty = head == tail_.load(std::memory_order_acquire);
+    head_.store(head + 1, std::memory_order_release);
+    pushed_.store(pushed_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    if (wasEmpty && consumer_ != nullptr)
+    {
+      xTaskNotifyGive(consumer_);
+    }
+  }
+
+  // Consumer side: processes up to maxFrames descriptors, returns how many
+  template <typename Handler>
+  size_t drain(Handler handler, size_t maxFrames = FRAME_QUEUE_BATCH)
+  {
+    size_t processed = 0;
+    uint32_t tail = tail_.load(std::memory_order_relaxed);
+    while (processed < maxFrames && tail != head_.load(std::memory_order_acquire))
+    {
+      handler(slots_[tail & (FRAME_QUEUE_CAPACITY - 1)]);
+      tail++;
+      tail_.store(tail, std::memory_order_release);
+      processed++;
+    }
+    if (processed > 0)
+    {
+      processed_.store(processed_.load(std::memory_order_relaxed) + processed, std::memory_order_release);
+    }
+    return processed;
+  }
+
+  // Consumer side: blocks until the producer signals new frames or the timeout expires
+  void waitForFrames();
+
+  size_t size() const;
+  FrameQueueStats getStats() const;
+  void resetStats();
+
+private:
+  FrameDescriptor slots_[FRAME_QUEUE_CAPACITY];
+  std::atomic<uint32_t> head_;
+  std::atomic<uint32_t> tail_;
+  std::atomic<uint32_t> pushed_;
+  std::atomic<uint32_t> processed_;
+  std::atomic<uint32_t> dropped_;
+  std::atomic<uint32_t> highWater_;
+  TaskHandle_t consumer_;
+};
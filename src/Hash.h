@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// Small, fast hash helpers shared by the in-memory indexes.
+
+// Finalizer that spreads the bits of a 64-bit key over a 32-bit hash
+inline uint32_t hashMix64(uint64_t key)
+{
+  uint32_t h = static_cast<uint32_t>(key) ^ (static_cast<uint32_t>(key >> 32) * 0x85ebca6bu);
+  h ^= h >> 16;
+  h *= 0x9e3779b1u;
+  h ^= h >> 15;
+  return h;
+}
+
+
+// FNV-1a over a byte buffer, pass the previous result to continue a running hash
+inline uint64_t fnv1a64(const void *data, size_t len, uint64_t hash = 0xcbf29ce484222325ULL)
+{
+  const uint8_t *bytes = static_cast<const uint8_t *>(data);
+  for (size_t i = 0; i < len; i++)
+  {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+// 48-bit SSID hash, sized to be used as a MacIndex key
+inline uint64_t ssidHashKey(const char *ssid, size_t len)
+{
+  return fnv1a64(ssid, len) & 0xFFFFFFFFFFFFULL;
+}
+
+// CRC-32 (IEEE 802.3, same as zlib), pass the previous result to continue a running CRC
+inline uint32_t crc32(const void *data, size_t len, uint32_t crc = 0)
+{
+  static const uint32_t table[16] = {
+      0x00000000u, 0x1db71064u, 0x3b6e20c8u, 0x26d930acu, 0x76dc4190u, 0x6b6b51f4u, 0x4db26158u, 0x5005713cu,
+      0xedb88320u, 0xf00f9344u, 0xd6d6a3e8u, 0xcb61b38cu, 0x9b64c2b0u, 0x86d3d2d4u, 0xa00ae278u, 0xbdbdf21cu};
+  const uint8_t *bytes = static_cast<const uint8_t *>(data);
+  crc = ~crc;
+  for (size_t i = 0; i < len; i++)
+  {
+    crc = (crc >> 4) ^ table[(crc ^ bytes[i]) & 0x0f];
+    crc = (crc >> 4) ^ table[(crc ^ (bytes[i] >> 4)) & 0x0f];
+  }
+  return ~crc;
+}
@@ -0,0 +1,537 @@
+#include "HistoryStore.h"
+#include <esp_partition.h>
+#include <algorithm>
+#include <cstddef>
+#include "Hash.h"
+#include "Log.h"
+#include "WifiDeviceList.h"
+#include "WifiNetworkList.h"
+#include "BLEDeviceList.h"
+#include "Console.h"
+
+HistoryStore historyStore;
+
+extern WifiDeviceList stationsList;
+extern WifiNetworkList ssidList;
+extern BLEDeviceList bleDeviceList;
+
+namespace
+{
+  const uint32_t SECTOR_SIZE = 4096;
+  const uint32_t HEADER_MAGIC = 0x48535431; // "HST1"
+  const uint32_t FOOTER_MAGIC = 0x48534631; // "HSF1"
+
+  // Written right after the sector is erased
+  struct SectorHeader {
+    uint32_t magic;
+    uint32_t sequence;     // Increases with every sector opened
+    uint32_t erase_count;  // Erase cycles of this sector
+    uint32_t first_valid;  // Sectors with a lower sequence were cleared
+    uint32_t reserved[3];
+    uint32_t crc;
+  };
+
+  // Written once the sector is full
+  struct SectorFooter {
+    uint32_t magic;
+    uint16_t records;
+    uint16_t reserved;
+    uint32_t min_ts;
+    uint32_t max_ts;
+    uint8_t bloom[HISTORY_BLOOM_BITS / 8];
+    uint32_t reserved2[3];
+    uint32_t crc;
+  };
+
+  static_assert(sizeof(SectorHeader) == 32, "SectorHeader must stay 32 bytes");
+  static_assert(sizeof(SectorFooter) == 160, "SectorFooter must stay 160 bytes");
+
+  const uint32_t FOOTER_OFFSET = SECTOR_SIZE - sizeof(SectorFooter);
+  const uint32_t RECORDS_PER_SECTOR = (FOOTER_OFFSET - sizeof(SectorHeader)) / sizeof(HistoryRecord);
+  // Records read at once while scanning a sector
+  const uint32_t READ_CHUNK = 16;
+
+  const char *const kindNames[] = {"wifi", "ble", "network"};
+
+  const esp_partition_t *historyPartition()
+  {
+    return esp_partition_find_first(ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)HISTORY_PARTITION_SUBTYPE,
+                                     HISTORY_PARTITION_LABEL);
+  }
+
+  uint32_t recordOffset(uint32_t sector, uint32_t index)
+  {
+    return sector * SECTOR_SIZE + sizeof(SectorHeader) + index * sizeof(HistoryRecord);
+  }
+
+  bool isErased(const HistoryRecord &record)
+  {
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&record);
+    for (size_t i = 0; i < sizeof(record); i++)
+    {
+      if (bytes[i] != 0xFF)
+        return false;
+    }
+    return true;
+  }
+
+  bool isIntact(const HistoryRecord &record)
+  {
+    return crc32(&record, offsetof(HistoryRecord, crc)) == record.crc;
+  }
+
+  // Three bit positions per address
+  void bloomAdd(uint8_t *bloom, const uint8_t *address)
+  {
+    uint32_t h = hashMix64(MacAddress(address).toUint64());
+    for (int i = 0; i < 3; i++)
+    {
+      uint32_t bit = (h >> (i * 10)) & (HISTORY_BLOOM_BITS - 1);
+      bloom[bit / 8] |= 1 << (bit % 8);
+    }
+  }
+
+  bool bloomTest(const uint8_t *bloom, const uint8_t *address)
+  {
+    uint32_t h = hashMix64(MacAddress(address).toUint64());
+    for (int i = 0; i < 3; i++)
+    {
+      uint32_t bit = (h >> (i * 10)) & (HISTORY_BLOOM_BITS - 1);
+      if (!(bloom[bit / 8] & (1 << (bit % 8))))
+        return false;
+    }
+    return true;
+  }
+
+  void addToRange(uint32_t &minTs, uint32_t &maxTs, uint16_t records, uint32_t timestamp)
+  {
+    if (records == 0 || timestamp < minTs)
+      minTs = timestamp;
+    if (records == 0 || timestamp > maxTs)
+      maxTs = timestamp;
+  }
+}
+
+static_assert((HISTORY_BLOOM_BITS & (HISTORY_BLOOM_BITS - 1)) == 0, "HISTORY_BLOOM_BITS must be a power of two");
+
+const char *historyKindName(HistoryKind kind)
+{
+  uint8_t index = static_cast<uint8_t>(kind);
+  return index < sizeof(kindNames) / sizeof(kindNames[0]) ? kindNames[index] : "unknown";
+}
+
+HistoryStore::HistoryStore()
+    : mounted_(false), hasHead_(false), head_(0), nextSequence_(1), firstValidSequence_(0), storedNewest_(0),
+      wifiDevicesCursor_{0, 0}, bleDevicesCursor_{0, 0}, networksCursor_{0, 0}, appended_(0), writeErrors_(0)
+{
+  memset(headBloom_, 0, sizeof(headBloom_));
+}
+
+bool HistoryStore::begin()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  const esp_partition_t *partition = historyPartition();
+  if (partition == nullptr)
+  {
+    Console.println("HistoryStore: no history partition in the partition table");
+    return false;
+  }
+
+  uint32_t count = partition->size / SECTOR_SIZE;
+  sectors_.assign(count, SectorInfo());
+  hasHead_ = false;
+  uint32_t maxSequence = 0;
+  for (uint32_t sector = 0; sector < count; sector++)
+  {
+    SectorInfo &info = sectors_[sector];
+    memset(&info, 0, sizeof(info));
+    SectorHeader header;
+    if (esp_partition_read(partition, sector * SECTOR_SIZE, &header, sizeof(header)) != ESP_OK ||
+        header.magic != HEADER_MAGIC || crc32(&header, offsetof(SectorHeader, crc)) != header.crc)
+    {
+      continue;
+    }
+    info.valid = true;
+    info.sequence = header.sequence;
+    info.erase_count = header.erase_count;
+    if (!hasHead_ || header.sequence > maxSequence)
+    {
+      hasHead_ = true;
+      head_ = sector;
+      maxSequence = header.sequence;
+      firstValidSequence_ = header.first_valid;
+    }
+  }
+  nextSequence_ = maxSequence + 1;
+
+  // Sealed sectors are summarized by their footer, the others have to be read
+  memset(headBloom_, 0, sizeof(headBloom_));
+  storedNewest_ = 0;
+  for (uint32_t sector = 0; sector < count; sector++)
+  {
+    SectorInfo &info = sectors_[sector];
+    if (!info.valid)
+      continue;
+    SectorFooter footer;
+    if (esp_partition_read(partition, sector * SECTOR_SIZE + FOOTER_OFFSET, &footer, sizeof(footer)) == ESP_OK &&
+        footer.magic == FOOTER_MAGIC && crc32(&footer, offsetof(SectorFooter, crc)) == footer.crc)
+    {
+      info.sealed = true;
+      info.records = footer.records;
+      info.min_ts = footer.min_ts;
+      info.max_ts = footer.max_ts;
+    }
+    else
+    {
+      scanSector(sector, info, sector == head_ ? headBloom_ : nullptr);
+    }
+    if (isLive(info) && info.records > 0 && info.max_ts > storedNewest_)
+      storedNewest_ = info.max_ts;
+  }
+
+  mounted_ = true;
+  Console.printf("HistoryStore: %u sectors, %u records per sector, head %u, sequence %u\n", count,
+                RECORDS_PER_SECTOR, head_, maxSequence);
+  return true;
+}
+
+/**
+ * @brief Rebuilds the summary of a sector that has no footer from its records.
+ *
+ * Records are written in order, the first erased slot ends the sector. Slots
+ * with a torn write still count as used.
+ */
+void HistoryStore::scanSector(uint32_t sector, SectorInfo &info, uint8_t *bloom)
+{
+  const esp_partition_t *partition = historyPartition();
+  HistoryRecord chunk[READ_CHUNK];
+  info.records = 0;
+  for (uint32_t index = 0; index < RECORDS_PER_SECTOR; index += READ_CHUNK)
+  {
+    uint32_t n = RECORDS_PER_SECTOR - index < READ_CHUNK ? RECORDS_PER_SECTOR - index : READ_CHUNK;
+    if (esp_partition_read(partition, recordOffset(sector, index), chunk, n * sizeof(HistoryRecord)) != ESP_OK)
+      return;
+    for (uint32_t i = 0; i < n; i++)
+    {
+      if (isErased(chunk[i]))
+        return;
+      if (isIntact(chunk[i]))
+      {
+        addToRange(info.min_ts, info.max_ts, info.records, chunk[i].timestamp);
+        if (bloom)
+          bloomAdd(bloom, chunk[i].address);
+      }
+      info.records++;
+    }
+  }
+}
+
+bool HistoryStore::isLive(const SectorInfo &info) const
+{
+  return info.valid && info.sequence >= firstValidSequence_;
+}
+
+/**
+ * @brief Erases the sector after the head, dropping its old records, and opens it.
+ */
+bool HistoryStore::openNextSector()
+{
+  const esp_partition_t *partition = historyPartition();
+  uint32_t next = hasHead_ ? (head_ + 1) % sectors_.size() : 0;
+  SectorInfo &info = sectors_[next];
+
+  SectorHeader header;
+  memset(&header, 0xFF, sizeof(header));
+  header.magic = HEADER_MAGIC;
+  header.sequence = nextSequence_;
+  header.erase_count = info.erase_count + 1;
+  header.first_valid = firstValidSequence_;
+  header.crc = crc32(&header, offsetof(SectorHeader, crc));
+
+  info.valid = false;
+  if (esp_partition_erase_range(partition, next * SECTOR_SIZE, SECTOR_SIZE) != ESP_OK ||
+      esp_partition_write(partition, next * SECTOR_SIZE, &header, sizeof(header)) != ESP_OK)
+  {
+    LOG_ERROR("HistoryStore: could not open sector %u", next);
+    return false;
+  }
+
+  info.valid = true;
+  info.sealed = false;
+  info.sequence = nextSequence_++;
+  info.erase_count = header.erase_count;
+  info.records = 0;
+  info.min_ts = 0;
+  info.max_ts = 0;
+  memset(headBloom_, 0, sizeof(headBloom_));
+  head_ = next;
+  hasHead_ = true;
+  return true;
+}
+
+void HistoryStore::sealSector(uint32_t sector)
+{
+  const SectorInfo &info = sectors_[sector];
+  SectorFooter footer;
+  memset(&footer, 0xFF, sizeof(footer));
+  footer.magic = FOOTER_MAGIC;
+  footer.records = info.records;
+  footer.min_ts = info.min_ts;
+  footer.max_ts = info.max_ts;
+  memcpy(footer.bloom, headBloom_, sizeof(footer.bloom));
+  footer.crc = crc32(&footer, offsetof(SectorFooter, crc));
+
+  // Without a footer the sector is still readable, it is just scanned in full
+  if (esp_partition_write(historyPartition(), sector * SECTOR_SIZE + FOOTER_OFFSET, &footer, sizeof(footer)) == ESP_OK)
+  {
+    sectors_[sector].sealed = true;
+  }
+}
+
+bool HistoryStore::append(const HistoryRecord &record)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!mounted_)
+  {
+    return false;
+  }
+  if (!hasHead_ || sectors_[head_].records >= RECORDS_PER_SECTOR)
+  {
+    if (hasHead_ && !sectors_[head_].sealed)
+    {
+      sealSector(head_);
+    }
+    if (!openNextSector())
+    {
+      writeErrors_++;
+      return false;
+    }
+  }
+
+  HistoryRecord stored = record;
+  stored.crc = crc32(&stored, offsetof(HistoryRecord, crc));
+  SectorInfo &info = sectors_[head_];
+  if (esp_partition_write(historyPartition(), recordOffset(head_, info.records), &stored, sizeof(stored)) != ESP_OK)
+  {
+    // The slot may hold part of the record, its crc will not match
+    info.records++;
+    writeErrors_++;
+    return false;
+  }
+  addToRange(info.min_ts, info.max_ts, info.records, stored.timestamp);
+  bloomAdd(headBloom_, stored.address);
+  info.records++;
+  appended_++;
+  return true;
+}
+
+/**
+ * @brief Appends the list entries changed since the previous call.
+ *
+ * Each list stamps every insert and update with its SyncLog sequence, so the
+ * cursors catch every change exactly once whatever the clock does. A reset
+ * delta (the first call after boot or a cleared list) holds the whole list;
+ * then the entries last seen before the newest stored sighting are already in
+ * flash, or older, and are skipped.
+ */
+size_t HistoryStore::recordSightings()
+{
+  SyncCursor wifiDevicesSince, bleDevicesSince, networksSince;
+  uint32_t storedNewest;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!mounted_)
+      return 0;
+    wifiDevicesSince = wifiDevicesCursor_;
+    bleDevicesSince = bleDevicesCursor_;
+    networksSince = networksCursor_;
+    storedNewest = storedNewest_;
+  }
+
+  size_t appended = 0;
+  HistoryRecord record;
+
+  SyncDelta<WifiDevice> wifiDevices = stationsList.getChangesSince(wifiDevicesSince);
+  for (const auto &device : wifiDevices.changed)
+  {
+    if (wifiDevices.reset && static_cast<uint32_t>(device.last_seen) < storedNewest)
+      continue;
+    memset(&record, 0, sizeof(record));
+    record.timestamp = device.last_seen;
+    memcpy(record.address, device.address.getBytes(), 6);
+    memcpy(record.bssid, device.bssid.getBytes(), 6);
+    record.kind = HistoryKind::WifiDevice;
+    record.rssi = device.rssi;
+    record.channel = device.channel;
+    record.times_seen = device.times_seen;
+    appended += append(record) ? 1 : 0;
+  }
+
+  SyncDelta<BLEFoundDevice> bleDevices = bleDeviceList.getChangesSince(bleDevicesSince);
+  for (const auto &device : bleDevices.changed)
+  {
+    if (bleDevices.reset && static_cast<uint32_t>(device.last_seen) < storedNewest)
+      continue;
+    memset(&record, 0, sizeof(record));
+    record.timestamp = device.last_seen;
+    memcpy(record.address, device.address.getBytes(), 6);
+    record.kind = HistoryKind::BleDevice;
+    record.rssi = device.rssi;
+    record.flags = device.isPublic ? 1 : 0;
+    record.name_hash = static_cast<uint32_t>(stringArena.hash(device.name));
+    record.times_seen = device.times_seen;
+    appended += append(record) ? 1 : 0;
+  }
+
+  SyncDelta<WifiNetwork> networks = ssidList.getChangesSince(networksSince);
+  for (const auto &network : networks.changed)
+  {
+    if (networks.reset && static_cast<uint32_t>(network.last_seen) < storedNewest)
+      continue;
+    memset(&record, 0, sizeof(record));
+    record.timestamp = network.last_seen;
+    memcpy(record.address, network.address.getBytes(), 6);
+    record.kind = HistoryKind::WifiNetwork;
+    record.rssi = network.rssi;
+    record.channel = network.channel;
+    record.flags = static_cast<uint8_t>(network.type);
+    record.name_hash = static_cast<uint32_t>(stringArena.hash(network.ssid));
+    record.times_seen = network.times_seen;
+    appended += append(record) ? 1 : 0;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  wifiDevicesCursor_ = wifiDevices.cursor;
+  bleDevicesCursor_ = bleDevices.cursor;
+  networksCursor_ = networks.cursor;
+  if (appended > 0)
+    LOG_INFO("HistoryStore: %zu sightings recorded", appended);
+  return appended;
+}
+
+bool HistoryStore::sectorMayContain(uint32_t sector, const uint8_t *address)
+{
+  const SectorInfo &info = sectors_[sector];
+  if (!info.sealed)
+  {
+    return sector != head_ || bloomTest(headBloom_, address);
+  }
+  uint8_t bloom[HISTORY_BLOOM_BITS / 8];
+  if (esp_partition_read(historyPartition(), sector * SECTOR_SIZE + FOOTER_OFFSET + offsetof(SectorFooter, bloom),
+                         bloom, sizeof(bloom)) != ESP_OK)
+  {
+    return true;
+  }
+  return bloomTest(bloom, address);
+}
+
+size_t HistoryStore::query(const HistoryQuery &query, bool (*visit)(const HistoryRecord &, void *), void *context)
+{
+  const esp_partition_t *partition = historyPartition();
+  HistoryRecord chunk[READ_CHUNK];
+  size_t matches = 0;
+  uint32_t head;
+  uint32_t count;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!mounted_ || !hasHead_)
+    {
+      return 0;
+    }
+    head = head_;
+    count = sectors_.size();
+  }
+
+  // The sector after the head is the oldest one. The lock is only held to read
+  // a chunk, visit runs unlocked; the rest of a sector recycled meanwhile is skipped.
+  for (uint32_t i = 1; i <= count; i++)
+  {
+    uint32_t sector = (head + i) % count;
+    uint32_t sequence;
+    uint32_t records;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      const SectorInfo &info = sectors_[sector];
+      if (!isLive(info) || info.records == 0 || info.max_ts < query.from || info.min_ts > query.to)
+        continue;
+      if (!query.any_address && !sectorMayContain(sector, query.address))
+        continue;
+      sequence = info.sequence;
+      records = info.records;
+    }
+
+    for (uint32_t index = 0; index < records; index += READ_CHUNK)
+    {
+      uint32_t n = records - index < READ_CHUNK ? records - index : READ_CHUNK;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const SectorInfo &info = sectors_[sector];
+        if (!isLive(info) || info.sequence != sequence ||
+            esp_partition_read(partition, recordOffset(sector, index), chunk, n * sizeof(HistoryRecord)) != ESP_OK)
+          break;
+      }
+      for (uint32_t j = 0; j < n; j++)
+      {
+        const HistoryRecord &record = chunk[j];
+        if (record.timestamp < query.from || record.timestamp > query.to || !isIntact(record))
+          continue;
+        if (!query.any_address && memcmp(record.address, query.address, 6) != 0)
+          continue;
+        matches++;
+        if (!visit(record, context))
+          return matches;
+      }
+    }
+  }
+  return matches;
+}
+
+void HistoryStore::clear()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!mounted_)
+  {
+    return;
+  }
+  // Every sector opened from now on tells that the older ones are gone
+  if (hasHead_ && !sectors_[head_].sealed && sectors_[head_].records > 0)
+  {
+    sealSector(head_);
+  }
+  firstValidSequence_ = nextSequence_;
+  if (!openNextSector())
+  {
+    writeErrors_++;
+  }
+  Console.println("HistoryStore: cleared");
+}
+
+HistoryStats HistoryStore::getStats()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  HistoryStats stats;
+  memset(&stats, 0, sizeof(stats));
+  stats.mounted = mounted_;
+  stats.capacity = sectors_.size() > 0 ? (sectors_.size() - 1) * RECORDS_PER_SECTOR : 0;
+  stats.appended = appended_;
+  stats.write_errors = writeErrors_;
+
+  bool first = true;
+  for (const SectorInfo &info : sectors_)
+  {
+    if (first || info.erase_count < stats.min_erase_count)
+      stats.min_erase_count = info.erase_count;
+    if (info.erase_count > stats.max_erase_count)
+      stats.max_erase_count = info.erase_count;
+    first = false;
+
+    if (!isLive(info) || info.records == 0)
+      continue;
+    if (stats.records == 0 || info.min_ts < stats.oldest)
+      stats.oldest = info.min_ts;
+    if (info.max_ts > stats.newest)
+      stats.newest = info.max_ts;
+    stats.records += info.records;
+  }
+  return stats;
+}
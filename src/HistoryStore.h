@@ -0,0 +1,134 @@
+#pragma once
+
+#include <Arduino.h>
+#include <mutex>
+#include <vector>
+#include "SyncLog.h"
+
+// Data partition holding the sighting history (see custom_partitions.csv)
+#define HISTORY_PARTITION_LABEL "history"
+#define HISTORY_PARTITION_SUBTYPE 0x41
+
+// Bits of the per-sector MAC filter stored in the sector footer
+#define HISTORY_BLOOM_BITS 1024
+
+enum class HistoryKind : uint8_t {
+  WifiDevice = 0,
+  BleDevice = 1,
+  WifiNetwork = 2
+};
+
+const char *historyKindName(HistoryKind kind);
+
+/**
+ * @brief One sighting, as stored in flash.
+ */
+struct HistoryRecord {
+  uint32_t timestamp;    // Seconds, same clock as last_seen
+  uint8_t address[6];
+  uint8_t bssid[6];      // Access point of a WiFi device, zeros otherwise
+  HistoryKind kind;
+  int8_t rssi;
+  uint8_t channel;
+  uint8_t flags;         // FrameKind of a network, 1 for a public BLE address
+  uint32_t name_hash;    // FNV-1a of the SSID or BLE name, 0 if none
+  uint32_t times_seen;
+  uint32_t crc;          // CRC32 of the fields above, filled by append()
+};
+
+static_assert(sizeof(HistoryRecord) == 32, "HistoryRecord must stay 32 bytes");
+
+struct HistoryQuery {
+  uint32_t from;         // Inclusive
+  uint32_t to;           // Inclusive
+  bool any_address;
+  uint8_t address[6];
+};
+
+struct HistoryStats {
+  bool mounted;
+  uint32_t records;          // Records stored and not cleared
+  uint32_t capacity;         // Records the partition holds before the oldest are recycled
+  uint32_t oldest;           // Timestamp range of the stored records, 0 if empty
+  uint32_t newest;
+  uint32_t appended;         // Records appended since boot
+  uint32_t write_errors;
+  uint32_t min_erase_count;  // Erase cycles of the least and most worn sectors
+  uint32_t max_erase_count;
+};
+
+/**
+ * @brief Log-structured store of past sightings in its own flash partition.
+ *
+ * Records are appended to the current sector of a circular log; when it is
+ * full a footer with its time range and a Bloom filter of its MAC addresses
+ * seals it and the next sector is erased and opened, recycling the oldest
+ * sightings. Sectors are always used in the same round-robin order, so every
+ * sector sees the same number of erase cycles. Each sector header carries a
+ * sequence number, its erase count and the first sequence still valid, which
+ * lets clear() drop the whole history without erasing it.
+ *
+ * begin() only reads the headers and footers plus the records of the open
+ * sector; queries skip sectors by time range and MAC filter before reading
+ * their records.
+ */
+class HistoryStore {
+public:
+  HistoryStore();
+
+  HistoryStore(const HistoryStore&) = delete;
+  HistoryStore& operator=(const HistoryStore&) = delete;
+
+  // Mounts the history partition, false if there is none
+  bool begin();
+
+  // Stores a copy of the record, its crc is computed here
+  bool append(const HistoryRecord &record);
+  // Appends a record for every list entry changed since the previous call,
+  // following the change sequence (SyncLog) of each list
+  size_t recordSightings();
+
+  // Calls visit with every matching record, oldest first, until it returns false.
+  // visit runs without the store locked, on a copy of the record.
+  // Returns the number of matching records visited.
+  size_t query(const HistoryQuery &query, bool (*visit)(const HistoryRecord &, void *), void *context);
+
+  // Forgets every stored record
+  void clear();
+
+  HistoryStats getStats();
+
+private:
+  struct SectorInfo {
+    uint32_t sequence;
+    uint32_t erase_count;
+    uint32_t min_ts;
+    uint32_t max_ts;
+    uint16_t records;
+    bool valid;
+    bool sealed;  // The footer with the MAC filter was written
+  };
+
+  bool openNextSector();
+  void sealSector(uint32_t sector);
+  void scanSector(uint32_t sector, SectorInfo &info, uint8_t *bloom);
+  bool sectorMayContain(uint32_t sector, const uint8_t *address);
+  bool isLive(const SectorInfo &info) const;
+
+  std::mutex mutex_;
+  std::vector<SectorInfo> sectors_;
+  uint8_t headBloom_[HISTORY_BLOOM_BITS / 8];
+  bool mounted_;
+  bool hasHead_;
+  uint32_t head_;
+  uint32_t nextSequence_;
+  uint32_t firstValidSequence_;
+  uint32_t storedNewest_;        // Newest timestamp in flash at begin()
+  SyncCursor wifiDevicesCursor_; // Positions in the change sequence of the lists
+  SyncCursor bleDevicesCursor_;
+  SyncCursor networksCursor_;
+  uint32_t appended_;
+  uint32_t writeErrors_;
+};
+
+extern HistoryStore historyStore;
@@ -0,0 +1,181 @@
+#include "IEParser.h"
+
+size_t ieOffsetForSubtype(uint8_t subtype)
+{
+  switch (subtype)
+  {
+  case 0: // Association Request: capability info + listen interval
+    return 24 + 4;
+  case 1: // Association Response: capability info + status + AID
+  case 3: // Reassociation Response
+    return 24 + 6;
+  case 2: // Reassociation Request: capability info + listen interval + current AP
+    return 24 + 10;
+  case 4: // Probe Request: IEs right after the header
+    return 24;
+  case 5: // Probe Response: timestamp + beacon interval + capability info
+  case 8: // Beacon
+    return 24 + 12;
+  default:
+    return 0;
+  }
+}
+
+bool parseFrameIEs(const uint8_t *payload, size_t payload_len, uint8_t subtype, FrameIEs &ies)
+{
+  memset(&ies, 0, sizeof(ies));
+
+  size_t offset = ieOffsetForSubtype(subtype);
+  if (offset == 0 || payload_len < offset)
+  {
+    return false;
+  }
+
+  IEIterator it(payload + offset, payload_len - offset);
+  InfoElement ie;
+  while (it.next(ie))
+  {
+    ies.ie_count++;
+    switch (ie.id)
+    {
+    case IE_SSID:
+      // Only the first SSID element counts
+      if (!ies.has_ssid)
+      {
+        ies.ssid = ie;
+        ies.has_ssid = true;
+      }
+      break;
+    case IE_SUPPORTED_RATES:
+      ies.rates = ie;
+      break;
+    case IE_EXTENDED_RATES:
+      ies.ext_rates = ie;
+      break;
+    case IE_DS_PARAMETER:
+      if (ie.len >= 1)
+      {
+        ies.ds_channel = ie.data[0];
+      }
+      break;
+    case IE_HT_CAPABILITIES:
+      ies.ht_cap = ie;
+      break;
+    case IE_VHT_CAPABILITIES:
+      ies.vht_cap = ie;
+      break;
+    case IE_RSN:
+      ies.rsn = ie;
+      break;
+    case IE_VENDOR_SPECIFIC:
+      // Microsoft OUI 00:50:F2 type 1 is the WPA element
+      if (ie.len >= 4 && ie.data[0] == 0x00 && ie.data[1] == 0x50 && ie.data[2] == 0xF2 && ie.data[3] == 0x01)
+      {
+        ies.wpa = ie;
+      }
+      if (ies.vendor_count < FRAME_IE_MAX_VENDORS)
+      {
+        ies.vendor[ies.vendor_count++] = ie;
+      }
+      break;
+    default:
+      break;
+    }
+  }
+  ies.malformed = it.malformed();
+  return true;
+}
+
+uint8_t copySsid(const FrameIEs &ies, char *ssid, size_t ssid_size)
+{
+  uint8_t len = 0;
+  if (ies.has_ssid && ssid_size > 0)
+  {
+    len = ies.ssid.len < ssid_size - 1 ? ies.ssid.len : ssid_size - 1;
+    for (uint8_t i = 0; i < len; i++)
+    {
+      char c = static_cast<char>(ies.ssid.data[i]);
+      ssid[i] = isprint(static_cast<unsigned char>(c)) ? c : '.';
+    }
+  }
+  if (ssid_size > 0)
+  {
+    ssid[len] = '\0';
+  }
+  return len;
+}
+
+uint32_t probeFingerprint(const uint8_t *ies, size_t len)
+{
+  uint64_t hash = fnv1a64(nullptr, 0);
+  IEIterator it(ies, len);
+  InfoElement ie;
+  while (it.next(ie))
+  {
+    size_t used = 0;
+    switch (ie.id)
+    {
+    case IE_SSID:
+    case IE_DS_PARAMETER:
+      continue;
+    case IE_SUPPORTED_RATES:
+    case IE_EXTENDED_RATES:
+    case IE_EXT_CAPABILITIES:
+      used = ie.len;
+      break;
+    case IE_HT_CAPABILITIES:
+      // Capabilities info, A-MPDU parameters and supported MCS set
+      used = ie.len < 19 ? ie.len : 19;
+      break;
+    case IE_VHT_CAPABILITIES:
+      used = ie.len < 4 ? ie.len : 4;
+      break;
+    case IE_VENDOR_SPECIFIC:
+      // OUI and type, the content of some (WPS UUID, P2P) is per device
+      used = ie.len < 4 ? ie.len : 4;
+      break;
+    default:
+      break;
+    }
+    hash = fnv1a64(&ie.id, 1, hash);
+    hash = fnv1a64(ie.data, used, hash);
+  }
+  uint32_t fingerprint = static_cast<uint32_t>(hash ^ (hash >> 32));
+  return fingerprint != 0 ? fingerprint : 1;
+}
+
+void describeFrameIEs(const uint8_t *payload, size_t payload_len, FrameDescriptor &frame)
+{
+  frame.ds_channel = 0;
+  frame.ie_flags = 0;
+  frame.probe_fingerprint = 0;
+
+  FrameIEs ies;
+  size_t body_len = payload_len > FRAME_FCS_LEN ? payload_len - FRAME_FCS_LEN : 0;
+  if (!parseFrameIEs(payload, body_len, frame.subtype, ies))
+  {
+    frame.ssid[0] = '\0';
+    frame.ssid_len = 0;
+    return;
+  }
+
+  frame.ssid_len = copySsid(ies, frame.ssid, sizeof(frame.ssid));
+  frame.ds_channel = ies.ds_channel;
+  if (ies.ht_cap.data)
+    frame.ie_flags |= FRAME_IE_HT;
+  if (ies.vht_cap.data)
+    frame.ie_flags |= FRAME_IE_VHT;
+  if (ies.rsn.data)
+    frame.ie_flags |= FRAME_IE_RSN;
+  if (ies.wpa.data)
+    frame.ie_flags |= FRAME_IE_WPA;
+  if (ies.malformed)
+    frame.ie_flags |= FRAME_IE_MALFORMED;
+  if (ies.has_ssid && ies.ssid.len > FRAME_SSID_MAX_LEN)
+    frame.ie_flags |= FRAME_IE_LONG_SSID;
+  if (frame.subtype == 4)
+  {
+    size_t offset = ieOffsetForSubtype(frame.subtype);
+    frame.probe_fingerprint = probeFingerprint(payload + offset, body_len - offset);
+  }
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <Arduino.h>
+#include "FrameQueue.h"
+#include "Hash.h"
+
+// 802.11 Information Element ids
+#define IE_SSID 0
+#define IE_SUPPORTED_RATES 1
+#define IE_DS_PARAMETER 3
+#define IE_HT_CAPABILITIES 45
+#define IE_RSN 48
+#define IE_EXTENDED_RATES 50
+#define IE_EXT_CAPABILITIES 127
+#define IE_VHT_CAPABILITIES 191
+#define IE_VENDOR_SPECIFIC 221
+
+#define FRAME_IE_MAX_VENDORS 4
+
+// Length of the Frame Check Sequence included at the end of every captured frame
+#define FRAME_FCS_LEN 4
+
+/**
+ * @brief View of one Information Element, data points into the frame payload.
+ */
+struct InfoElement {
+  uint8_t id;
+  uint8_t len;
+  const uint8_t *data;
+};
+
+/**
+ * @brief Bounds-checked iterator over a sequence of Information Elements.
+ *
+ * Never reads outside [data, data + len). If an element claims more bytes than
+ * are left the iteration stops and malformed() returns true.
+ */
+class IEIterator {
+public:
+  IEIterator(const uint8_t *data, size_t len) : data(data), len(len), pos(0), bad(false) {}
+
+  bool next(InfoElement &ie)
+  {
+    if (pos + 2 > len)
+    {
+      bad = bad || pos != len;
+      return false;
+    }
+    uint8_t ieLen = data[pos + 1];
+    if (pos + 2 + ieLen > len)
+    {
+      bad = true;
+      return false;
+    }
+    ie.id = data[pos];
+    ie.len = ieLen;
+    ie.data = &data[pos + 2];
+    pos += 2 + ieLen;
+    return true;
+  }
+
+  bool malformed() const { return bad; }
+
+private:
+  const uint8_t *data;
+  size_t len;
+  size_t pos;
+  bool bad;
+};
+
+/**
+ * @brief Metadata extracted from the Information Elements of a management
+ * frame in a single pass. All pointers are views into the frame payload and
+ * are only valid while the payload is.
+ */
+struct FrameIEs {
+  InfoElement ssid;
+  InfoElement rates;
+  InfoElement ext_rates;
+  InfoElement ht_cap;
+  InfoElement vht_cap;
+  InfoElement rsn;
+  InfoElement wpa;
+  InfoElement vendor[FRAME_IE_MAX_VENDORS];
+  uint8_t vendor_count;
+  uint8_t ds_channel; // 0 if not present
+  uint8_t ie_count;
+  bool has_ssid;
+  bool malformed;
+};
+
+// Offset of the first Information Element for a management subtype, 0 if the subtype carries none we parse
+size_t ieOffsetForSubtype(uint8_t subtype);
+
+// Walks the Information Elements of a management frame once and fills ies.
+// payload_len must not include the FCS. Returns false if the subtype has no IEs.
+bool parseFrameIEs(const uint8_t *payload, size_t payload_len, uint8_t subtype, FrameIEs &ies);
+
+// Copies the SSID into a null terminated buffer, replacing non printable characters with '.'
+uint8_t copySsid(const FrameIEs &ies, char *ssid, size_t ssid_size);
+
+// Fills the SSID and IE metadata of a management frame descriptor from the raw payload (FCS included)
+void describeFrameIEs(const uint8_t *payload, size_t payload_len, FrameDescriptor &frame);
+
+// Hash of the parts of a probe request body that depend on the chipset and
+// driver rather than on the address: the order of the element ids, the rates,
+// the HT, VHT and extended capabilities and the OUI and type of vendor
+// elements. SSID and DS Parameter Set are left out, they change between probes.
+// Never 0, which descriptors use for "no fingerprint".
+uint32_t probeFingerprint(const uint8_t *ies, size_t len);
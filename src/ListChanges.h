@@ -0,0 +1,75 @@
+#pragma once
+
+#include <Arduino.h>
+#include <algorithm>
+#include <vector>
+
+/**
+ * @brief Records of a list that changed since the previous save.
+ *
+ * When full is set the positions of the list changed (removal, clear or
+ * first save after boot) and records holds the whole list in position order.
+ * Otherwise records[i] is the current content of positions[i].
+ */
+template <typename T>
+struct ListChanges {
+  bool full;
+  std::vector<uint16_t> positions;
+  std::vector<T> records;
+};
+
+/**
+ * @brief Dirty flags by list position, owned by a list and guarded by its mutex.
+ *
+ * Starts in the structural state, so the first save after boot writes a full
+ * snapshot whose positions match the list in memory.
+ */
+class DirtyTracker {
+public:
+  explicit DirtyTracker(size_t capacity) : dirty(capacity, false), count(0), structural(true) {}
+
+  void mark(uint16_t pos)
+  {
+    if (pos < dirty.size() && !dirty[pos])
+    {
+      dirty[pos] = true;
+      count++;
+    }
+  }
+
+  // Positions were shifted or removed, only a full snapshot is valid now
+  void markAll() { structural = true; }
+
+  template <typename T>
+  ListChanges<T> take(const std::vector<T> &list, bool forceFull)
+  {
+    ListChanges<T> changes;
+    changes.full = structural || forceFull;
+    if (changes.full)
+    {
+      changes.records = list;
+    }
+    else if (count > 0)
+    {
+      changes.positions.reserve(count);
+      changes.records.reserve(count);
+      for (uint16_t pos = 0; pos < list.size(); pos++)
+      {
+        if (dirty[pos])
+        {
+          changes.positions.push_back(pos);
+          changes.records.push_back(list[pos]);
+        }
+      }
+    }
+    std::fill(dirty.begin(), dirty.end(), false);
+    count = 0;
+    structural = false;
+    return changes;
+  }
+
+private:
+  std::vector<bool> dirty;
+  size_t count;
+  bool structural;
+};
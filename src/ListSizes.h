@@ -0,0 +1,12 @@
+#pragma once
+
+// Capacity of each list; the warm restart image is sized from them
+#ifndef MAX_STATIONS
+#define MAX_STATIONS 255
+#endif
+#ifndef MAX_SSIDS
+#define MAX_SSIDS 200
+#endif
+#ifndef MAX_BLE_DEVICES
+#define MAX_BLE_DEVICES 100
+#endif
@@ -0,0 +1,438 @@
+#include "Log.h"
+#include "MacAddress.h"
+#include "Console.h"
+
+Logger logger;
+
+static_assert((LOG_RING_SLOTS & (LOG_RING_SLOTS - 1)) == 0, "LOG_RING_SLOTS must be a power of two");
+static_assert(LOG_ARGS_SIZE < 256, "LogArgs::len is 8 bits");
+
+namespace
+{
+  // Longest string argument copied into a message
+  const size_t LOG_MAX_STRING = 63;
+
+  struct ArgReader {
+    const LogArgs &args;
+    size_t offset;
+    uint8_t index;
+
+    explicit ArgReader(const LogArgs &a) : args(a), offset(0), index(0) {}
+
+    bool next(LogArgs::Tag &tag, const uint8_t *&value)
+    {
+      if (index >= args.count || offset >= args.len)
+      {
+        return false;
+      }
+      tag = static_cast<LogArgs::Tag>(args.data[offset]);
+      value = &args.data[offset + 1];
+      offset += 1 + valueSize(tag, value);
+      index++;
+      return true;
+    }
+
+    static size_t valueSize(LogArgs::Tag tag, const uint8_t *value)
+    {
+      switch (tag)
+      {
+      case LogArgs::Int32:
+      case LogArgs::Uint32:
+        return 4;
+      case LogArgs::Int64:
+      case LogArgs::Uint64:
+      case LogArgs::Double:
+        return 8;
+      case LogArgs::Str:
+        return 2 + value[0];
+      case LogArgs::Mac:
+        return 6;
+      case LogArgs::Pointer:
+        return sizeof(uintptr_t);
+      }
+      return 0;
+    }
+  };
+
+  template <typename T>
+  T readValue(const uint8_t *p)
+  {
+    T v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+  }
+
+  bool isIntegerConversion(char c)
+  {
+    return c == 'd' || c == 'i' || c == 'u' || c == 'x' || c == 'X' || c == 'o' || c == 'c';
+  }
+
+  bool isFloatConversion(char c)
+  {
+    return c == 'f' || c == 'F' || c == 'e' || c == 'E' || c == 'g' || c == 'G' || c == 'a' || c == 'A';
+  }
+
+  // Formats one argument with the conversion spec, whose length modifiers have
+  // already been stripped. Mismatched arguments are printed in their natural form.
+  int formatArg(char *out, size_t size, const char *spec, size_t specLen, char conversion,
+                LogArgs::Tag tag, const uint8_t *value)
+  {
+    char fmt[24];
+    if (specLen + 3 >= sizeof(fmt))
+    {
+      specLen = 1;
+    }
+    memcpy(fmt, spec, specLen);
+
+    bool isString = tag == LogArgs::Str || tag == LogArgs::Mac;
+    char macBuf[18];
+    const char *str = nullptr;
+    if (tag == LogArgs::Str)
+    {
+      str = reinterpret_cast<const char *>(value + 1);
+    }
+    else if (tag == LogArgs::Mac)
+    {
+      snprintf(macBuf, sizeof(macBuf), "%02X:%02X:%02X:%02X:%02X:%02X",
+               value[0], value[1], value[2], value[3], value[4], value[5]);
+      str = macBuf;
+    }
+
+    if (isString)
+    {
+      if (conversion != 's')
+      {
+        return snprintf(out, size, "%s", str);
+      }
+      fmt[specLen] = 's';
+      fmt[specLen + 1] = '\0';
+      return snprintf(out, size, fmt, str);
+    }
+
+    if (tag == LogArgs::Pointer)
+    {
+      return snprintf(out, size, "%p", reinterpret_cast<void *>(readValue<uintptr_t>(value)));
+    }
+
+    if (tag == LogArgs::Double)
+    {
+      double v = readValue<double>(value);
+      if (!isFloatConversion(conversion))
+      {
+        return snprintf(out, size, "%g", v);
+      }
+      fmt[specLen] = conversion;
+      fmt[specLen + 1] = '\0';
+      return snprintf(out, size, fmt, v);
+    }
+
+    // Integers are widened to 64 bits, 32-bit values keep their printf semantics
+    long long sv;
+    unsigned long long uv;
+    switch (tag)
+    {
+    case LogArgs::Int32:
+      sv = readValue<int32_t>(value);
+      uv = static_cast<uint32_t>(sv);
+      break;
+    case LogArgs::Uint32:
+      uv = readValue<uint32_t>(value);
+      sv = static_cast<int32_t>(uv);
+      break;
+    case LogArgs::Int64:
+      sv = readValue<int64_t>(value);
+      uv = static_cast<unsigned long long>(sv);
+      break;
+    default:
+      uv = readValue<uint64_t>(value);
+      sv = static_cast<long long>(uv);
+      break;
+    }
+
+    if (conversion == 'c')
+    {
+      fmt[specLen] = 'c';
+      fmt[specLen + 1] = '\0';
+      return snprintf(out, size, fmt, static_cast<int>(sv));
+    }
+    if (!isIntegerConversion(conversion))
+    {
+      conversion = tag == LogArgs::Int32 || tag == LogArgs::Int64 ? 'd' : 'u';
+    }
+    fmt[specLen] = 'l';
+    fmt[specLen + 1] = 'l';
+    fmt[specLen + 2] = conversion;
+    fmt[specLen + 3] = '\0';
+    if (conversion == 'd' || conversion == 'i')
+    {
+      return snprintf(out, size, fmt, sv);
+    }
+    return snprintf(out, size, fmt, uv);
+  }
+}
+
+bool LogArgs::put(Tag tag, const void *value, size_t size)
+{
+  if (len + 1 + size > LOG_ARGS_SIZE)
+  {
+    len = LOG_ARGS_SIZE; // Later arguments would be misread, stop here
+    return false;
+  }
+  data[len] = tag;
+  memcpy(&data[len + 1], value, size);
+  len += 1 + size;
+  count++;
+  return true;
+}
+
+void LogArgs::add(const char *s)
+{
+  if (s == nullptr)
+  {
+    s = "(null)";
+  }
+  // Tag, length byte, characters and terminator
+  if (len + 3 > LOG_ARGS_SIZE)
+  {
+    len = LOG_ARGS_SIZE;
+    return;
+  }
+  size_t room = LOG_ARGS_SIZE - len - 3;
+  size_t n = strnlen(s, room < LOG_MAX_STRING ? room : LOG_MAX_STRING);
+  data[len] = Str;
+  data[len + 1] = static_cast<uint8_t>(n);
+  memcpy(&data[len + 2], s, n);
+  data[len + 2 + n] = '\0';
+  len += 3 + n;
+  count++;
+}
+
+void LogArgs::add(const MacAddress &mac)
+{
+  put(Mac, mac.getBytes(), 6);
+}
+
+void LogArgs::add(const void *p)
+{
+  uintptr_t v = reinterpret_cast<uintptr_t>(p);
+  put(Pointer, &v, sizeof(v));
+}
+
+Logger::Logger()
+    : enqueuePos_(0), dequeuePos_(0), logged_(0), dropped_(0), suspended_(false), reportedDropped_(0),
+      drainTask_(nullptr)
+{
+  for (uint32_t i = 0; i < LOG_RING_SLOTS; i++)
+  {
+    slots_[i].sequence.store(i, std::memory_order_relaxed);
+    slots_[i].format = nullptr;
+  }
+}
+
+void Logger::begin()
+{
+  if (drainTask_ != nullptr)
+  {
+    return;
+  }
+  xTaskCreatePinnedToCore(
+      [](void *parameter)
+      { static_cast<Logger *>(parameter)->drain_loop(); },
+      "Log_Task", LOG_TASK_STACK_SIZE, this, LOG_TASK_PRIORITY, &drainTask_, tskNO_AFFINITY);
+}
+
+/**
+ * @brief Claims a slot and copies the message into it.
+ *
+ * Bounded multi-producer ring: every slot carries a sequence number that tells
+ * producers whether it is free for the current lap and tells the consumer
+ * whether it has been published. Producers only contend on the claim of the
+ * enqueue position.
+ */
+void Logger::push(const char *format, const LogArgs &args)
+{
+  uint32_t pos = enqueuePos_.load(std::memory_order_relaxed);
+  Slot *slot;
+  while (true)
+  {
+    slot = &slots_[pos & (LOG_RING_SLOTS - 1)];
+    int32_t diff = static_cast<int32_t>(slot->sequence.load(std::memory_order_acquire) - pos);
+    if (diff == 0)
+    {
+      if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+      {
+        break;
+      }
+    }
+    else if (diff < 0)
+    {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    else
+    {
+      pos = enqueuePos_.load(std::memory_order_relaxed);
+    }
+  }
+
+  slot->format = format;
+  slot->args.len = args.len;
+  slot->args.count = args.count;
+  memcpy(slot->args.data, args.data, args.len);
+  slot->sequence.store(pos + 1, std::memory_order_release);
+
+  if (drainTask_ != nullptr && pos == dequeuePos_.load(std::memory_order_relaxed))
+  {
+    xTaskNotifyGive(drainTask_);
+  }
+}
+
+void Logger::drain_loop()
+{
+  while (true)
+  {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(LOG_IDLE_WAIT_MS));
+    while (writeNext())
+    {
+    }
+  }
+}
+
+/**
+ * @brief Formats and writes the oldest pending message, if any.
+ *
+ * Only called from the drain task, or from flush() while it is not running.
+ */
+bool Logger::writeNext()
+{
+  uint32_t pos = dequeuePos_.load(std::memory_order_relaxed);
+  Slot &slot = slots_[pos & (LOG_RING_SLOTS - 1)];
+  if (slot.sequence.load(std::memory_order_acquire) != pos + 1)
+  {
+    uint32_t dropped = dropped_.load(std::memory_order_relaxed);
+    if (dropped != reportedDropped_ && !suspended_.load(std::memory_order_relaxed))
+    {
+      Console.printf("Log: %u messages dropped\n", dropped - reportedDropped_);
+      reportedDropped_ = dropped;
+    }
+    return false;
+  }
+
+  if (suspended_.load(std::memory_order_relaxed))
+  {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+  }
+  else
+  {
+    char line[LOG_LINE_MAX + 1];
+    size_t len = formatMessage(slot, line, sizeof(line) - 1);
+    line[len++] = '\n';
+    Console.write(reinterpret_cast<const uint8_t *>(line), len);
+    logged_.store(logged_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+
+  slot.sequence.store(pos + LOG_RING_SLOTS, std::memory_order_release);
+  dequeuePos_.store(pos + 1, std::memory_order_relaxed);
+  return true;
+}
+
+/**
+ * @brief Expands the stored format string with the encoded arguments.
+ * @return Length of the formatted text, without terminator.
+ */
+size_t Logger::formatMessage(const Slot &slot, char *out, size_t size) const
+{
+  ArgReader reader(slot.args);
+  const char *p = slot.format;
+  size_t len = 0;
+
+  while (*p != '\0' && len + 1 < size)
+  {
+    if (*p != '%')
+    {
+      out[len++] = *p++;
+      continue;
+    }
+    if (p[1] == '%')
+    {
+      out[len++] = '%';
+      p += 2;
+      continue;
+    }
+
+    // Copy flags, width and precision, skip length modifiers
+    char spec[16];
+    size_t specLen = 0;
+    spec[specLen++] = *p++;
+    while (*p != '\0' && strchr("-+ #0123456789.", *p) != nullptr)
+    {
+      if (specLen < sizeof(spec))
+      {
+        spec[specLen++] = *p;
+      }
+      p++;
+    }
+    while (*p != '\0' && strchr("hlLqjzt", *p) != nullptr)
+    {
+      p++;
+    }
+    if (*p == '\0')
+    {
+      break;
+    }
+    char conversion = *p++;
+
+    LogArgs::Tag tag;
+    const uint8_t *value;
+    int written;
+    if (reader.next(tag, value))
+    {
+      written = formatArg(&out[len], size - len, spec, specLen, conversion, tag, value);
+    }
+    else
+    {
+      written = snprintf(&out[len], size - len, "?");
+    }
+    if (written > 0)
+    {
+      len += static_cast<size_t>(written) < size - len ? written : size - len - 1;
+    }
+  }
+
+  // The newline is added by the writer, do not double it
+  while (len > 0 && out[len - 1] == '\n')
+  {
+    len--;
+  }
+  out[len] = '\0';
+  return len;
+}
+
+void Logger::setSuspended(bool suspended)
+{
+  suspended_.store(suspended, std::memory_order_relaxed);
+}
+
+void Logger::flush()
+{
+  if (drainTask_ == nullptr)
+  {
+    while (writeNext())
+    {
+    }
+    return;
+  }
+  while (enqueuePos_.load(std::memory_order_relaxed) != dequeuePos_.load(std::memory_order_relaxed))
+  {
+    xTaskNotifyGive(drainTask_);
+    delay(10);
+  }
+}
+
+LogStats Logger::getStats() const
+{
+  LogStats stats;
+  stats.logged = logged_.load(std::memory_order_relaxed);
+  stats.dropped = dropped_.load(std::memory_order_relaxed);
+  return stats;
+}
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+#include <string>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+#define LOG_LEVEL_VERBOSE 5
+
+// Messages above this level are removed at compile time, arguments included
+#ifndef SNEAK_LOG_LEVEL
+#define SNEAK_LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+// Number of pending messages, must be a power of two
+#define LOG_RING_SLOTS 32
+// Bytes available for the encoded arguments of one message
+#define LOG_ARGS_SIZE 88
+// Longest formatted line, longer lines are truncated
+#define LOG_LINE_MAX 192
+
+#define LOG_TASK_STACK_SIZE 3072
+#define LOG_TASK_PRIORITY 1
+#define LOG_IDLE_WAIT_MS 200
+
+class MacAddress;
+
+/**
+ * @brief Arguments of a log message, encoded as tagged values.
+ *
+ * Strings are copied so the caller's buffers can go away before the message
+ * is formatted. Arguments that do not fit are left out and printed as '?'.
+ */
+class LogArgs {
+public:
+  enum Tag : uint8_t {
+    Int32,
+    Uint32,
+    Int64,
+    Uint64,
+    Double,
+    Str,
+    Mac,
+    Pointer
+  };
+
+  LogArgs() : len(0), count(0) {}
+
+  void add(bool v) { addInt(v ? 1 : 0); }
+  void add(char v) { addInt(v); }
+  void add(signed char v) { addInt(v); }
+  void add(unsigned char v) { addUint(v); }
+  void add(short v) { addInt(v); }
+  void add(unsigned short v) { addUint(v); }
+  void add(int v) { addInt(v); }
+  void add(unsigned int v) { addUint(v); }
+  void add(long v) { addInt(v); }
+  void add(unsigned long v) { addUint(v); }
+  void add(long long v) { addInt(v); }
+  void add(unsigned long long v) { addUint(v); }
+  void add(float v) { add(static_cast<double>(v)); }
+  void add(double v) { put(Double, &v, sizeof(v)); }
+  void add(const char *s);
+  void add(const String &s) { add(s.c_str()); }
+  void add(const std::string &s) { add(s.c_str()); }
+  void add(const MacAddress &mac);
+  void add(const void *p);
+
+  uint8_t data[LOG_ARGS_SIZE];
+  uint8_t len;
+  uint8_t count;
+
+private:
+  void addInt(long long v)
+  {
+    if (v >= INT32_MIN && v <= INT32_MAX)
+    {
+      int32_t v32 = static_cast<int32_t>(v);
+      put(Int32, &v32, sizeof(v32));
+    }
+    else
+    {
+      put(Int64, &v, sizeof(v));
+    }
+  }
+
+  void addUint(unsigned long long v)
+  {
+    if (v <= UINT32_MAX)
+    {
+      uint32_t v32 = static_cast<uint32_t>(v);
+      put(Uint32, &v32, sizeof(v32));
+    }
+    else
+    {
+      put(Uint64, &v, sizeof(v));
+    }
+  }
+
+  bool put(Tag tag, const void *value, size_t size);
+};
+
+inline void logAppend(LogArgs &) {}
+
+template <typename T, typename... Rest>
+inline void logAppend(LogArgs &args, const T &value, const Rest &...rest)
+{
+  args.add(value);
+  logAppend(args, rest...);
+}
+
+struct LogStats {
+  uint32_t logged;   // Messages written to the serial port
+  uint32_t dropped;  // Messages lost because the ring was full or output was suspended
+};
+
+/**
+ * @brief Asynchronous logger.
+ *
+ * The calling task only encodes the format pointer and the raw arguments into
+ * a slot of a bounded lock-free multi-producer ring; formatting and the slow
+ * serial write happen in a low priority task. When the ring is full the
+ * message is dropped and counted, logging never blocks the caller.
+ *
+ * Use the LOG_* macros: the levels above SNEAK_LOG_LEVEL compile to nothing.
+ * Format strings must be string literals (only the pointer is stored), the
+ * newline is added by the writer. printf conversions are supported, and %s also
+ * accepts String, std::string and MacAddress arguments.
+ */
+class Logger {
+public:
+  Logger();
+
+  Logger(const Logger&) = delete;
+  Logger& operator=(const Logger&) = delete;
+
+  // Starts the drain task, messages logged before are kept in the ring
+  void begin();
+
+  template <typename... Args>
+  void log(const char *format, const Args &...args)
+  {
+    LogArgs encoded;
+    logAppend(encoded, args...);
+    push(format, encoded);
+  }
+
+  // While suspended pending and new messages are discarded (e.g. while the
+  // serial port carries a binary pcap stream)
+  void setSuspended(bool suspended);
+
+  // Writes all pending messages before returning, for use before a restart
+  void flush();
+
+  LogStats getStats() const;
+
+private:
+  struct Slot {
+    std::atomic<uint32_t> sequence;
+    const char *format;
+    LogArgs args;
+  };
+
+  void push(const char *format, const LogArgs &args);
+  void drain_loop();
+  bool writeNext();
+  size_t formatMessage(const Slot &slot, char *out, size_t size) const;
+
+  Slot slots_[LOG_RING_SLOTS];
+  std::atomic<uint32_t> enqueuePos_;
+  std::atomic<uint32_t> dequeuePos_;
+  std::atomic<uint32_t> logged_;
+  std::atomic<uint32_t> dropped_;
+  std::atomic<bool> suspended_;
+  uint32_t reportedDropped_;
+  TaskHandle_t drainTask_;
+};
+
+extern Logger logger;
+
+#if SNEAK_LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) logger.log(__VA_ARGS__)
+#else
+#define LOG_ERROR(...) do {} while (0)
+#endif
+
+#if SNEAK_LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...) logger.log(__VA_ARGS__)
+#else
+#define LOG_WARN(...) do {} while (0)
+#endif
+
+#if SNEAK_LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) logger.log(__VA_ARGS__)
+#else
+#define LOG_INFO(...) do {} while (0)
+#endif
+
+#if SNEAK_LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) logger.log(__VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do {} while (0)
+#endif
+
+#if SNEAK_LOG_LEVEL >= LOG_LEVEL_VERBOSE
+#define LOG_VERBOSE(...) logger.log(__VA_ARGS__)
+#else
+#define LOG_VERBOSE(...) do {} while (0)
+#endif
@@ -0,0 +1,62 @@
+#include "LruList.h"
+
+const uint16_t LruList::NONE;
+
+LruList::LruList(size_t capacity) : prev(capacity, NONE), next(capacity, NONE), head(NONE), tail(NONE)
+{
+}
+
+void LruList::clear()
+{
+  std::fill(prev.begin(), prev.end(), NONE);
+  std::fill(next.begin(), next.end(), NONE);
+  head = NONE;
+  tail = NONE;
+}
+
+void LruList::pushBack(uint16_t pos)
+{
+  prev[pos] = tail;
+  next[pos] = NONE;
+  if (tail == NONE)
+  {
+    head = pos;
+  }
+  else
+  {
+    next[tail] = pos;
+  }
+  tail = pos;
+}
+
+void LruList::remove(uint16_t pos)
+{
+  if (prev[pos] == NONE)
+  {
+    head = next[pos];
+  }
+  else
+  {
+    next[prev[pos]] = next[pos];
+  }
+  if (next[pos] == NONE)
+  {
+    tail = prev[pos];
+  }
+  else
+  {
+    prev[next[pos]] = prev[pos];
+  }
+  prev[pos] = NONE;
+  next[pos] = NONE;
+}
+
+void LruList::touch(uint16_t pos)
+{
+  if (pos == tail)
+  {
+    return;
+  }
+  remove(pos);
+  pushBack(pos);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <Arduino.h>
+#include <algorithm>
+#include <vector>
+
+/**
+ * @brief Intrusive doubly linked recency list over record positions.
+ *
+ * The front is the least recently seen record, which is the one evicted when
+ * a list is full. Touching a record moves it to the back in O(1).
+ */
+class LruList {
+public:
+  static const uint16_t NONE = 0xFFFF;
+
+  explicit LruList(size_t capacity);
+
+  void clear();
+  void pushBack(uint16_t pos);
+  void remove(uint16_t pos);
+  void touch(uint16_t pos);
+  uint16_t front() const { return head; }
+
+  // Inserts a position keeping the list ordered, used for records that were
+  // not just seen (e.g. loaded from flash). isOlder(a, b) is true if a is older than b.
+  template <typename IsOlder>
+  void insertOrdered(uint16_t pos, IsOlder isOlder)
+  {
+    uint16_t after = tail;
+    while (after != NONE && isOlder(pos, after))
+    {
+      after = prev[after];
+    }
+    prev[pos] = after;
+    next[pos] = (after == NONE) ? head : next[after];
+    if (after == NONE)
+    {
+      head = pos;
+    }
+    else
+    {
+      next[after] = pos;
+    }
+    if (next[pos] == NONE)
+    {
+      tail = pos;
+    }
+    else
+    {
+      prev[next[pos]] = pos;
+    }
+  }
+
+  // Rebuilds the list from positions 0..count-1 with a single sort, isOlder as above
+  template <typename IsOlder>
+  void rebuild(uint16_t count, IsOlder isOlder)
+  {
+    clear();
+    std::vector<uint16_t> order(count);
+    for (uint16_t pos = 0; pos < count; pos++)
+    {
+      order[pos] = pos;
+    }
+    std::stable_sort(order.begin(), order.end(), isOlder);
+    for (uint16_t pos : order)
+    {
+      pushBack(pos);
+    }
+  }
+
+private:
+  std::vector<uint16_t> prev;
+  std::vector<uint16_t> next;
+  uint16_t head;
+  uint16_t tail;
+};
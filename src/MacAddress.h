@@ -20,6 +20,13 @@ public:
         return address.data();
     }
 
+    // 48-bit address packed into the low bits of an integer, used as hash key
+    uint64_t toUint64() const {
+        return (static_cast<uint64_t>(address[0]) << 40) | (static_cast<uint64_t>(address[1]) << 32) |
+               (static_cast<uint64_t>(address[2]) << 24) | (static_cast<uint64_t>(address[3]) << 16) |
+               (static_cast<uint64_t>(address[4]) << 8) | static_cast<uint64_t>(address[5]);
+    }
+
     std::string toString() const {
         char buf[18];
         snprintf(buf, sizeof(buf), "%02X:%02X:%02X:%02X:%02X:%02X",
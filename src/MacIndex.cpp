@@ -0,0 +1,104 @@
+#include "MacIndex.h"
+#include "Hash.h"
+
+const uint16_t MacIndex::NOT_FOUND;
+const uint64_t MacIndex::KEY_MASK;
+const uint64_t MacIndex::EMPTY_SLOT;
+
+MacIndex::MacIndex(size_t maxEntries) : count(0)
+{
+  // Keep the load factor under 0.75
+  size_t capacity = 16;
+  while (capacity * 3 < maxEntries * 4)
+  {
+    capacity <<= 1;
+  }
+  slots.assign(capacity, EMPTY_SLOT);
+  mask = capacity - 1;
+}
+
+size_t MacIndex::home(uint64_t key) const
+{
+  return hashMix64(key) & mask;
+}
+
+uint16_t MacIndex::find(uint64_t key) const
+{
+  key &= KEY_MASK;
+  for (size_t i = home(key);; i = (i + 1) & mask)
+  {
+    uint64_t slot = slots[i];
+    if (slot == EMPTY_SLOT)
+    {
+      return NOT_FOUND;
+    }
+    if (slotKey(slot) == key)
+    {
+      return slotValue(slot);
+    }
+  }
+}
+
+void MacIndex::insert(uint64_t key, uint16_t value)
+{
+  key &= KEY_MASK;
+  uint64_t entry = (key << 16) | value;
+  for (size_t i = home(key);; i = (i + 1) & mask)
+  {
+    if (slots[i] == EMPTY_SLOT)
+    {
+      if (count >= mask)
+      {
+        return; // Never fill the last free slot, lookups rely on it
+      }
+      slots[i] = entry;
+      count++;
+      return;
+    }
+    if (slotKey(slots[i]) == key)
+    {
+      slots[i] = entry;
+      return;
+    }
+  }
+}
+
+bool MacIndex::erase(uint64_t key)
+{
+  key &= KEY_MASK;
+  size_t i = home(key);
+  while (true)
+  {
+    if (slots[i] == EMPTY_SLOT)
+    {
+      return false;
+    }
+    if (slotKey(slots[i]) == key)
+    {
+      break;
+    }
+    i = (i + 1) & mask;
+  }
+
+  // Backward shift deletion: move later entries of the probe sequence into the hole
+  size_t hole = i;
+  for (size_t j = (hole + 1) & mask; slots[j] != EMPTY_SLOT; j = (j + 1) & mask)
+  {
+    size_t want = home(slotKey(slots[j]));
+    // Move the entry if its home is not cyclically inside (hole, j]
+    if (((j - want) & mask) >= ((j - hole) & mask))
+    {
+      slots[hole] = slots[j];
+      hole = j;
+    }
+  }
+  slots[hole] = EMPTY_SLOT;
+  count--;
+  return true;
+}
+
+void MacIndex::clear()
+{
+  std::fill(slots.begin(), slots.end(), EMPTY_SLOT);
+  count = 0;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <Arduino.h>
+#include <vector>
+
+/**
+ * @brief Fixed capacity open-addressing hash table mapping 48-bit keys to
+ * 16-bit record positions.
+ *
+ * Keys are usually MAC addresses packed with MacAddress::toUint64(). Each slot
+ * packs key and value into a single 64-bit word, linear probing is used for
+ * collisions and deletion shifts the following entries back, so no tombstones
+ * build up. The table is allocated once in the constructor and never grows.
+ */
+class MacIndex {
+public:
+  static const uint16_t NOT_FOUND = 0xFFFF;
+  static const uint64_t KEY_MASK = 0xFFFFFFFFFFFFULL;
+
+  explicit MacIndex(size_t maxEntries);
+
+  uint16_t find(uint64_t key) const;
+  void insert(uint64_t key, uint16_t value);
+  bool erase(uint64_t key);
+  void clear();
+  size_t size() const { return count; }
+
+private:
+  static const uint64_t EMPTY_SLOT = 0xFFFFFFFFFFFFFFFFULL;
+
+  static uint64_t slotKey(uint64_t slot) { return slot >> 16; }
+  static uint16_t slotValue(uint64_t slot) { return static_cast<uint16_t>(slot & 0xFFFF); }
+  size_t home(uint64_t key) const;
+
+  std::vector<uint64_t> slots;
+  size_t mask;
+  size_t count;
+};
@@ -0,0 +1,75 @@
+// Generated by scripts/generate_oui_table.py from oui_vendors.csv, do not edit
+#pragma once
+
+#include <stdint.h>
+
+#define OUI_TABLE_VENDORS 23
+#define OUI_TABLE_SIZE 137
+
+// Vendor names, id 0 is the empty name of unknown vendors
+static constexpr char OUI_VENDOR_NAMES[] =
+  "\0"
+  "Amazon Technologies\0"
+  "Apple\0"
+  "Atheros Communications\0"
+  "AVM\0"
+  "Broadcom\0"
+  "Cisco Systems\0"
+  "Dell\0"
+  "Espressif\0"
+  "Google\0"
+  "HUAWEI TECHNOLOGIES\0"
+  "Intel\0"
+  "Microsoft\0"
+  "NETGEAR\0"
+  "Nintendo\0"
+  "Raspberry Pi Foundation\0"
+  "Raspberry Pi Trading\0"
+  "Realtek Semiconductor\0"
+  "Samsung Electronics\0"
+  "Sonos\0"
+  "Texas Instruments\0"
+  "TP-LINK TECHNOLOGIES\0"
+  "Ubiquiti\0"
+  "Xiaomi Communications\0";
+
+static constexpr uint32_t OUI_VENDOR_OFFSETS[OUI_TABLE_VENDORS + 1] = {
+  0, 1, 21, 27, 50, 54, 63, 77, 82, 92,
+  99, 119, 125, 135, 143, 152, 176, 197, 219, 239,
+  245, 263, 284, 293,
+};
+
+// 24-bit prefixes in Eytzinger order, entry k - 1 is node k of the search tree
+static constexpr uint32_t OUI_TABLE_PREFIXES[OUI_TABLE_SIZE] = {
+  0x58BDA3, 0x14FEB5, 0xA040A0, 0x001B21, 0x347E5C, 0x7CBB8A, 0xDCA632, 0x001018, 0x00259E, 0x24A43C,
+  0x40F407, 0x687251, 0x8CAAB5, 0xB8E937, 0xF09FC2, 0x00095B, 0x0017F2, 0x001EC2, 0x00E0FC, 0x240AC4,
+  0x28CFE9, 0x3C5AB4, 0x500291, 0x600194, 0x7828CA, 0x84CCA8, 0x98DAC4, 0xACBC32, 0xD03972, 0xEC086B,
+  0xF8A45F, 0x000393, 0x000BDB, 0x001632, 0x001A11, 0x001B63, 0x002444, 0x0050F2, 0x0C47C9, 0x18FE34,
+  0x246511, 0x286C07, 0x2CCF67, 0x3810D5, 0x3CA62F, 0x44D9E7, 0x542A1B, 0x5CAAFD, 0x640980, 0x7483C2,
+  0x7C1E52, 0x802AA8, 0x8866A5, 0x989BCB, 0x9C99A0, 0xA47733, 0xB4FBE4, 0xC02506, 0xDC4F22, 0xE063DA,
+  0xF01898, 0xF4F5D8, 0xFCA667, 0x0000F0, 0x00040E, 0x000A95, 0x000D93, 0x00124B, 0x0017AB, 0x001882,
+  0x001AE9, 0x001B2F, 0x001DD8, 0x0022AA, 0x0024D7, 0x002722, 0x00E04C, 0x0418D6, 0x14CC20, 0x18E829,
+  0x204E7F, 0x245A4C, 0x246F28, 0x281878, 0x28CDC1, 0x2C3AE8, 0x30AEA4, 0x34CE00, 0x3C0754, 0x3C71BF,
+  0x3CA9F4, 0x44650D, 0x48A6B8, 0x50C7BF, 0x546009, 0x5C0A5B, 0x5CCF7F, 0x60455E, 0x6837E9, 0x68C63A,
+  0x74C246, 0x788A20, 0x7C9EBD, 0x7CFF4D, 0x840D8E, 0x84D6D0, 0x8C7712, 0x949F3E, 0x98B6E9, 0x9C3DCF,
+  0xA020A6, 0xA45E60, 0xA4CF12, 0xB0B448, 0xB827EB, 0xBCDDC2, 0xC04A00, 0xD83ADD, 0xDC9FDB, 0xE0286D,
+  0xE45F01, 0xECFABC, 0xF0272D, 0xF4F26D, 0xF88FCA, 0xF8BC12, 0xFCECDA, 0x00000C, 0x00037F, 0x0003FF,
+  0x000874, 0x0009BF, 0x000AF7, 0x000D3A, 0x000E58, 0x001247, 0x001422,
+};
+
+static constexpr uint16_t OUI_TABLE_VENDOR_IDS[OUI_TABLE_SIZE] = {
+  14, 7, 13, 11, 19, 14, 16, 5, 10, 22,
+  14, 22, 8, 19, 22, 13, 2, 2, 10, 8,
+  2, 9, 8, 8, 19, 8, 21, 2, 20, 21,
+  23, 2, 7, 18, 9, 2, 14, 12, 1, 8,
+  4, 23, 16, 4, 4, 22, 19, 19, 23, 22,
+  12, 22, 2, 4, 23, 9, 22, 4, 8, 22,
+  2, 9, 1, 18, 4, 2, 2, 20, 14, 10,
+  14, 13, 12, 14, 11, 22, 17, 22, 21, 22,
+  13, 22, 8, 12, 16, 8, 8, 23, 2, 8,
+  11, 1, 19, 21, 9, 18, 8, 12, 1, 8,
+  1, 22, 8, 4, 8, 1, 18, 19, 14, 13,
+  8, 2, 8, 20, 15, 8, 21, 16, 22, 4,
+  16, 8, 1, 21, 9, 7, 22, 6, 3, 12,
+  7, 14, 5, 12, 19, 18, 7,
+};
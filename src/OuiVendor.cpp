@@ -0,0 +1,45 @@
+#include "OuiVendor.h"
+#include <strings.h>
+#include "OuiTable.generated.h"
+
+uint16_t ouiVendorId(const uint8_t *mac)
+{
+  if (mac[0] & 0x03)
+  {
+    return OUI_VENDOR_UNKNOWN; // Multicast or locally administered
+  }
+  uint32_t prefix = (static_cast<uint32_t>(mac[0]) << 16) | (mac[1] << 8) | mac[2];
+
+  // Eytzinger lower bound: descend the implicit tree, then drop the right
+  // turns taken after the last left turn
+  size_t k = 1;
+  while (k <= OUI_TABLE_SIZE)
+  {
+    k = 2 * k + (OUI_TABLE_PREFIXES[k - 1] < prefix);
+  }
+  k >>= __builtin_ffs(~k);
+  return (k != 0 && OUI_TABLE_PREFIXES[k - 1] == prefix) ? OUI_TABLE_VENDOR_IDS[k - 1] : OUI_VENDOR_UNKNOWN;
+}
+
+const char *ouiVendorName(uint16_t id)
+{
+  return OUI_VENDOR_NAMES + (id <= OUI_TABLE_VENDORS ? OUI_VENDOR_OFFSETS[id] : 0);
+}
+
+uint16_t ouiVendorByName(const char *name, size_t len)
+{
+  for (uint16_t id = 1; id <= OUI_TABLE_VENDORS; id++)
+  {
+    const char *candidate = OUI_VENDOR_NAMES + OUI_VENDOR_OFFSETS[id];
+    if (strlen(candidate) == len && strncasecmp(candidate, name, len) == 0)
+    {
+      return id;
+    }
+  }
+  return OUI_VENDOR_UNKNOWN;
+}
+
+uint16_t ouiVendorCount()
+{
+  return OUI_TABLE_VENDORS;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Vendor id of addresses without a registered prefix
+#define OUI_VENDOR_UNKNOWN 0
+
+/**
+ * @brief Vendor lookup by the OUI of a MAC address.
+ *
+ * The table is generated at build time by scripts/generate_oui_table.py and
+ * lives in flash. Vendor ids index a deduplicated name pool, they are only
+ * stable within a build: persist vendor names, not ids.
+ */
+
+// Vendor of a universally administered unicast address, OUI_VENDOR_UNKNOWN otherwise
+uint16_t ouiVendorId(const uint8_t *mac);
+
+// Empty string for OUI_VENDOR_UNKNOWN or an id out of range
+const char *ouiVendorName(uint16_t id);
+
+// Case-insensitive exact match on the vendor name, OUI_VENDOR_UNKNOWN if none
+uint16_t ouiVendorByName(const char *name, size_t len);
+
+uint16_t ouiVendorCount();
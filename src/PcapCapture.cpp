@@ -0,0 +1,368 @@
+#include "PcapCapture.h"
+#include <esp_partition.h>
+#include "Console.h"
+
+PcapCapture pcapCapture;
+
+extern time_t base_time;
+
+static_assert((PCAP_RING_SLOTS & (PCAP_RING_SLOTS - 1)) == 0, "PCAP_RING_SLOTS must be a power of two");
+
+const uint8_t PcapCapture::FCS_LEN;
+
+namespace
+{
+  const uint32_t PCAP_MAGIC = 0xa1b2c3d4;
+  const uint32_t LINKTYPE_IEEE802_11_RADIOTAP = 127;
+  const size_t PCAP_RECORD_HEADER_LEN = 16;
+  const size_t FLASH_SECTOR_SIZE = 4096;
+
+  // Radiotap fields written for every frame
+  const uint32_t RADIOTAP_FLAGS = 1 << 1;
+  const uint32_t RADIOTAP_RATE = 1 << 2;
+  const uint32_t RADIOTAP_CHANNEL = 1 << 3;
+  const uint32_t RADIOTAP_DBM_ANTSIGNAL = 1 << 5;
+  const uint32_t RADIOTAP_DBM_ANTNOISE = 1 << 6;
+  const uint32_t RADIOTAP_MCS = 1 << 19;
+  const size_t RADIOTAP_MAX_LEN = 20;
+
+  const uint16_t CHANNEL_FLAG_2GHZ = 0x0080;
+  const uint8_t MCS_KNOWN = 0x07; // Bandwidth, MCS index and guard interval
+  const uint8_t MCS_FLAG_40MHZ = 0x01;
+  const uint8_t MCS_FLAG_SHORT_GI = 0x04;
+
+  // Legacy rate in 500 kbps units, indexed by rx_ctrl.rate (wifi_phy_rate_t)
+  const uint8_t legacyRates[16] = {2, 4, 11, 22, 0, 4, 11, 22, 96, 48, 24, 12, 108, 72, 36, 18};
+
+  const esp_partition_t *pcapPartition()
+  {
+    return esp_partition_find_first(ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)PCAP_PARTITION_SUBTYPE,
+                                     PCAP_PARTITION_LABEL);
+  }
+
+  void put16(uint8_t *p, uint16_t v)
+  {
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+  }
+
+  void put32(uint8_t *p, uint32_t v)
+  {
+    put16(p, v & 0xFFFF);
+    put16(p + 2, v >> 16);
+  }
+
+  uint32_t get32(const uint8_t *p)
+  {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+  }
+}
+
+PcapCapture::PcapCapture()
+    : head_(0), tail_(0), dropped_(0), active_(false), stopRequested_(false), dumpRequested_(false),
+      snaplen_(PCAP_DEFAULT_SNAPLEN), sink_(PcapSink::Serial), sinkOpen_(false), captured_(0),
+      sinkDropped_(0), bytesWritten_(0), flashOffset_(0), writerTask_(nullptr)
+{
+}
+
+bool PcapCapture::start(PcapSink sink, uint16_t snaplen)
+{
+  if (active_.load() || sinkOpen_)
+  {
+    return false;
+  }
+  if (sink == PcapSink::Flash && pcapPartition() == nullptr)
+  {
+    Console.println("PcapCapture: no pcap partition in the partition table");
+    return false;
+  }
+
+  sink_ = sink;
+  snaplen_ = snaplen == 0 || snaplen > PCAP_MAX_SNAPLEN ? PCAP_MAX_SNAPLEN : snaplen;
+  tail_.store(head_.load());
+  dropped_.store(0);
+  captured_ = 0;
+  sinkDropped_ = 0;
+  bytesWritten_ = 0;
+  stopRequested_.store(false);
+
+  if (writerTask_ == nullptr)
+  {
+    xTaskCreatePinnedToCore(
+        [](void *parameter)
+        { static_cast<PcapCapture *>(parameter)->writer_loop(); },
+        "PCAP_Writer_Task", PCAP_TASK_STACK_SIZE, this, PCAP_TASK_PRIORITY, &writerTask_, tskNO_AFFINITY);
+  }
+
+  if (sink == PcapSink::Serial)
+  {
+    // The stream starts with the pcap header, nothing else may reach the port until the capture stops
+    if (!Console.close())
+    {
+      return false;
+    }
+  }
+  else
+  {
+    Console.printf("PcapCapture: starting, sink flash, snaplen %u\n", snaplen_);
+  }
+  if (!openSink())
+  {
+    if (sink == PcapSink::Serial)
+    {
+      Console.open();
+    }
+    return false;
+  }
+  active_.store(true);
+  return true;
+}
+
+void PcapCapture::stop()
+{
+  if (!active_.load())
+  {
+    return;
+  }
+  active_.store(false);
+  stopRequested_.store(true);
+  xTaskNotifyGive(writerTask_);
+}
+
+bool PcapCapture::requestFlashDump()
+{
+  if (active_.load() || sinkOpen_ || pcapPartition() == nullptr)
+  {
+    return false;
+  }
+  if (writerTask_ == nullptr)
+  {
+    xTaskCreatePinnedToCore(
+        [](void *parameter)
+        { static_cast<PcapCapture *>(parameter)->writer_loop(); },
+        "PCAP_Writer_Task", PCAP_TASK_STACK_SIZE, this, PCAP_TASK_PRIORITY, &writerTask_, tskNO_AFFINITY);
+  }
+  dumpRequested_.store(true);
+  xTaskNotifyGive(writerTask_);
+  return true;
+}
+
+PcapCaptureStats PcapCapture::getStats() const
+{
+  const esp_partition_t *partition = pcapPartition();
+  PcapCaptureStats stats;
+  stats.active = active_.load();
+  stats.sink = sink_;
+  stats.snaplen = snaplen_;
+  stats.captured = captured_;
+  stats.dropped = dropped_.load(std::memory_order_relaxed);
+  stats.sink_dropped = sinkDropped_;
+  stats.bytes_written = bytesWritten_;
+  stats.flash_size = partition ? partition->size : 0;
+  return stats;
+}
+
+void PcapCapture::writer_loop()
+{
+  while (true)
+  {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(PCAP_IDLE_WAIT_MS));
+
+    if (dumpRequested_.load())
+    {
+      dumpFlash();
+      dumpRequested_.store(false);
+    }
+
+    uint32_t tail = tail_.load(std::memory_order_relaxed);
+    while (tail != head_.load(std::memory_order_acquire))
+    {
+      writeRecord(slots_[tail & (PCAP_RING_SLOTS - 1)]);
+      tail++;
+      tail_.store(tail, std::memory_order_release);
+    }
+
+    if (stopRequested_.load() && sinkOpen_)
+    {
+      closeSink();
+      stopRequested_.store(false);
+      if (sink_ == PcapSink::Flash)
+        Console.printf("PcapCapture: stopped, %u frames, %u dropped, %u bytes\n", captured_,
+                     dropped_.load() + sinkDropped_, bytesWritten_);
+    }
+  }
+}
+
+bool PcapCapture::openSink()
+{
+  flashOffset_ = 0;
+  sinkOpen_ = true;
+
+  uint8_t header[24];
+  put32(&header[0], PCAP_MAGIC);
+  put16(&header[4], 2); // Version 2.4
+  put16(&header[6], 4);
+  put32(&header[8], 0);  // GMT offset
+  put32(&header[12], 0); // Timestamp accuracy
+  put32(&header[16], snaplen_ + RADIOTAP_MAX_LEN);
+  put32(&header[20], LINKTYPE_IEEE802_11_RADIOTAP);
+  if (!writeToSink(header, sizeof(header)))
+  {
+    sinkOpen_ = false;
+    return false;
+  }
+  return true;
+}
+
+void PcapCapture::closeSink()
+{
+  if (sink_ == PcapSink::Flash)
+  {
+    // Make sure the dump stops here and not on a stale record of a previous capture
+    const esp_partition_t *partition = pcapPartition();
+    if (partition && flashOffset_ % FLASH_SECTOR_SIZE == 0 && flashOffset_ < partition->size)
+    {
+      esp_partition_erase_range(partition, flashOffset_, FLASH_SECTOR_SIZE);
+    }
+  }
+  else
+  {
+    Serial.flush();
+    Console.open();
+  }
+  sinkOpen_ = false;
+}
+
+bool PcapCapture::writeToSink(const uint8_t *data, size_t len)
+{
+  if (sink_ == PcapSink::Serial)
+  {
+    Serial.write(data, len);
+    bytesWritten_ += len;
+    return true;
+  }
+
+  const esp_partition_t *partition = pcapPartition();
+  if (partition == nullptr || flashOffset_ + len > partition->size)
+  {
+    return false;
+  }
+
+  // Erase every sector right before the first write into it
+  uint32_t end = flashOffset_ + len;
+  uint32_t nextSector = (flashOffset_ + FLASH_SECTOR_SIZE - 1) / FLASH_SECTOR_SIZE * FLASH_SECTOR_SIZE;
+  while (nextSector < end)
+  {
+    if (esp_partition_erase_range(partition, nextSector, FLASH_SECTOR_SIZE) != ESP_OK)
+    {
+      return false;
+    }
+    nextSector += FLASH_SECTOR_SIZE;
+  }
+  if (esp_partition_write(partition, flashOffset_, data, len) != ESP_OK)
+  {
+    return false;
+  }
+  flashOffset_ = end;
+  bytesWritten_ += len;
+  return true;
+}
+
+void PcapCapture::writeRecord(const Slot &slot)
+{
+  if (!sinkOpen_)
+  {
+    return;
+  }
+
+  uint8_t record[PCAP_RECORD_HEADER_LEN + RADIOTAP_MAX_LEN + PCAP_MAX_SNAPLEN];
+  uint8_t *rt = &record[PCAP_RECORD_HEADER_LEN];
+
+  bool ht = slot.sig_mode != 0;
+  uint32_t present = RADIOTAP_FLAGS | RADIOTAP_CHANNEL | RADIOTAP_DBM_ANTSIGNAL | RADIOTAP_DBM_ANTNOISE;
+  present |= ht ? RADIOTAP_MCS : RADIOTAP_RATE;
+
+  // Fixed layout: flags, rate (or padding), channel, signal, noise and MCS for HT frames
+  memset(rt, 0, RADIOTAP_MAX_LEN);
+  put32(&rt[4], present);
+  rt[8] = 0;
+  rt[9] = ht ? 0 : legacyRates[slot.rate & 0x0F];
+  put16(&rt[10], slot.channel == 14 ? 2484 : 2407 + 5 * slot.channel);
+  put16(&rt[12], CHANNEL_FLAG_2GHZ);
+  rt[14] = static_cast<uint8_t>(slot.rssi);
+  rt[15] = static_cast<uint8_t>(slot.noise);
+  size_t rtLen = 16;
+  if (ht)
+  {
+    rt[16] = MCS_KNOWN;
+    rt[17] = (slot.cwb ? MCS_FLAG_40MHZ : 0) | (slot.sgi ? MCS_FLAG_SHORT_GI : 0);
+    rt[18] = slot.mcs;
+    rtLen = 19;
+  }
+  put16(&rt[2], rtLen);
+
+  int64_t us = slot.timestamp_us;
+  put32(&record[0], static_cast<uint32_t>(base_time + us / 1000000));
+  put32(&record[4], static_cast<uint32_t>(us % 1000000));
+  put32(&record[8], rtLen + slot.cap_len);
+  put32(&record[12], rtLen + slot.orig_len);
+  memcpy(&rt[rtLen], slot.data, slot.cap_len);
+
+  if (writeToSink(record, PCAP_RECORD_HEADER_LEN + rtLen + slot.cap_len))
+  {
+    captured_++;
+  }
+  else
+  {
+    sinkDropped_++;
+    if (active_.load())
+    {
+      Console.println("PcapCapture: flash partition full, stopping capture");
+      active_.store(false);
+      stopRequested_.store(true);
+    }
+  }
+}
+
+void PcapCapture::dumpFlash()
+{
+  const esp_partition_t *partition = pcapPartition();
+  uint8_t buffer[256];
+
+  // Walk the stored records to find where the capture ends
+  uint32_t end = 0;
+  if (esp_partition_read(partition, 0, buffer, 24) == ESP_OK && get32(buffer) == PCAP_MAGIC)
+  {
+    uint32_t maxRecord = get32(&buffer[16]);
+    end = 24;
+    while (end + PCAP_RECORD_HEADER_LEN <= partition->size)
+    {
+      if (esp_partition_read(partition, end, buffer, PCAP_RECORD_HEADER_LEN) != ESP_OK)
+        break;
+      uint32_t inclLen = get32(&buffer[8]);
+      if (inclLen == 0 || inclLen > maxRecord || end + PCAP_RECORD_HEADER_LEN + inclLen > partition->size)
+        break;
+      end += PCAP_RECORD_HEADER_LEN + inclLen;
+    }
+  }
+
+  if (end == 0)
+  {
+    Console.println("PcapCapture: no capture stored in flash");
+    return;
+  }
+
+  if (!Console.close())
+  {
+    return;
+  }
+  for (uint32_t offset = 0; offset < end; offset += sizeof(buffer))
+  {
+    size_t len = end - offset < sizeof(buffer) ? end - offset : sizeof(buffer);
+    if (esp_partition_read(partition, offset, buffer, len) != ESP_OK)
+      break;
+    Serial.write(buffer, len);
+  }
+  Serial.flush();
+  Console.open();
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+#include <esp_wifi_types.h>
+#include <esp_timer.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// Number of frames buffered between the WiFi callback and the writer, must be a power of two
+#define PCAP_RING_SLOTS 32
+// Largest snaplen supported, each ring slot reserves this many bytes
+#define PCAP_MAX_SNAPLEN 256
+#define PCAP_DEFAULT_SNAPLEN 128
+
+#define PCAP_TASK_STACK_SIZE 3072
+#define PCAP_TASK_PRIORITY 1
+#define PCAP_IDLE_WAIT_MS 200
+
+// Data partition holding the capture in flash (see custom_partitions.csv)
+#define PCAP_PARTITION_LABEL "pcap"
+#define PCAP_PARTITION_SUBTYPE 0x40
+
+enum class PcapSink : uint8_t {
+  Serial = 0,
+  Flash = 1
+};
+
+struct PcapCaptureStats {
+  bool active;
+  PcapSink sink;
+  uint16_t snaplen;
+  uint32_t captured;      // Frames written to the sink
+  uint32_t dropped;       // Frames lost because the ring was full
+  uint32_t sink_dropped;  // Frames lost because the flash partition was full
+  uint32_t bytes_written;
+  uint32_t flash_size;    // Size of the pcap partition, 0 if missing
+};
+
+/**
+ * @brief Optional raw frame capture in pcap format (LINKTYPE_IEEE802_11_RADIOTAP).
+ *
+ * The promiscuous callbacks hand every accepted frame to capture(), which
+ * copies it (truncated to the snaplen) into a pre-allocated single-producer /
+ * single-consumer ring and never blocks: when the ring is full the frame is
+ * counted as dropped. A low priority writer task adds the radiotap header built
+ * from rx_ctrl and streams the records to the serial port or to the pcap flash
+ * partition. The serial sink and the flash dump close the Console gate while
+ * they own the port, so no text ends up inside the pcap stream.
+ */
+class PcapCapture {
+public:
+  PcapCapture();
+
+  PcapCapture(const PcapCapture&) = delete;
+  PcapCapture& operator=(const PcapCapture&) = delete;
+
+  bool start(PcapSink sink, uint16_t snaplen);
+  void stop();
+  // Streams the capture stored in flash to the serial port from the writer task
+  bool requestFlashDump();
+  bool isActive() const { return active_.load(std::memory_order_relaxed); }
+  PcapCaptureStats getStats() const;
+
+  // Producer side, called from the WiFi driver task
+  void capture(const wifi_promiscuous_pkt_t *pkt)
+  {
+    if (!active_.load(std::memory_order_relaxed))
+      return;
+
+    uint32_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) >= PCAP_RING_SLOTS)
+    {
+      dropped_.store(dropped_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      return;
+    }
+
+    Slot &slot = slots_[head & (PCAP_RING_SLOTS - 1)];
+    uint16_t frameLen = pkt->rx_ctrl.sig_len > FCS_LEN ? pkt->rx_ctrl.sig_len - FCS_LEN : 0;
+    slot.timestamp_us = esp_timer_get_time();
+    slot.orig_len = frameLen;
+    slot.cap_len = frameLen < snaplen_ ? frameLen : snaplen_;
+    slot.rssi = pkt->rx_ctrl.rssi;
+    slot.noise = pkt->rx_ctrl.noise_floor;
+    slot.channel = pkt->rx_ctrl.channel;
+    slot.rate = pkt->rx_ctrl.rate;
+    slot.sig_mode = pkt->rx_ctrl.sig_mode;
+    slot.mcs = pkt->rx_ctrl.mcs;
+    slot.cwb = pkt->rx_ctrl.cwb;
+    slot.sgi = pkt->rx_ctrl.sgi;
+    memcpy(slot.data, pkt->payload, slot.cap_len);
+
+    bool wasEmpty = head == tail_.load(std::memory_order_acquire);
+    head_.store(head + 1, std::memory_order_release);
+    if (wasEmpty && writerTask_ != nullptr)
+    {
+      xTaskNotifyGive(writerTask_);
+    }
+  }
+
+private:
+  static const uint8_t FCS_LEN = 4;
+
+  struct Slot {
+    int64_t timestamp_us;
+    uint16_t orig_len;
+    uint16_t cap_len;
+    int8_t rssi;
+    int8_t noise;
+    uint8_t channel;
+    uint8_t rate;
+    uint8_t sig_mode;
+    uint8_t mcs;
+    uint8_t cwb;
+    uint8_t sgi;
+    uint8_t data[PCAP_MAX_SNAPLEN];
+  };
+
+  void writer_loop();
+  bool openSink();
+  void closeSink();
+  bool writeToSink(const uint8_t *data, size_t len);
+  void writeRecord(const Slot &slot);
+  void dumpFlash();
+
+  Slot slots_[PCAP_RING_SLOTS];
+  std::atomic<uint32_t> head_;
+  std::atomic<uint32_t> tail_;
+  std::atomic<uint32_t> dropped_;
+  std::atomic<bool> active_;
+  std::atomic<bool> stopRequested_;
+  std::atomic<bool> dumpRequested_;
+  uint16_t snaplen_;
+  PcapSink sink_;
+  bool sinkOpen_;
+  uint32_t captured_;
+  uint32_t sinkDropped_;
+  uint32_t bytesWritten_;
+  uint32_t flashOffset_;
+  TaskHandle_t writerTask_;
+};
+
+extern PcapCapture pcapCapture;
@@ -0,0 +1,115 @@
+#include "RssiTrack.h"
+#include <algorithm>
+
+static_assert(RSSI_RING_SAMPLES > 0 && RSSI_RING_SAMPLES <= 255, "ring positions are 8 bit");
+static_assert(RSSI_POOL_RINGS < RSSI_RING_NONE, "ring handles are 16 bit");
+
+RssiPool rssiPool;
+
+RssiPool::RssiPool()
+{
+  memset(rings, 0, sizeof(rings));
+}
+
+// Must be called with mutex held
+bool RssiPool::owns(const RssiTrack &track) const
+{
+  return track.ring < RSSI_POOL_RINGS && rings[track.ring].used && rings[track.ring].generation == track.generation;
+}
+
+// Must be called with mutex held
+uint16_t RssiPool::allocate()
+{
+  uint16_t oldest = 0;
+  for (uint16_t i = 0; i < RSSI_POOL_RINGS; i++)
+  {
+    if (!rings[i].used)
+    {
+      oldest = i;
+      break;
+    }
+    if (static_cast<int32_t>(rings[i].last_ms - rings[oldest].last_ms) < 0)
+    {
+      oldest = i;
+    }
+  }
+  Ring &ring = rings[oldest];
+  ring.generation++;
+  ring.head = 0;
+  ring.count = 0;
+  ring.used = true;
+  return oldest;
+}
+
+void RssiPool::add(RssiTrack &track, int8_t rssi)
+{
+  if (track.empty())
+  {
+    track.ewma = rssi * 256;
+    track.min = rssi;
+    track.max = rssi;
+  }
+  else
+  {
+    track.ewma += (rssi * 256 - track.ewma) >> RSSI_EWMA_SHIFT;
+    track.min = std::min(track.min, rssi);
+    track.max = std::max(track.max, rssi);
+  }
+  track.last = rssi;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  uint32_t now = millis();
+  if (!owns(track))
+  {
+    track.ring = allocate();
+    track.generation = rings[track.ring].generation;
+  }
+  Ring &ring = rings[track.ring];
+  if (ring.count > 0 && now - ring.last_ms < RSSI_SAMPLE_INTERVAL_MS)
+  {
+    uint8_t newest = (ring.head + RSSI_RING_SAMPLES - 1) % RSSI_RING_SAMPLES;
+    if (rssi > rssiSampleValue(ring.samples[newest]))
+    {
+      ring.samples[newest] = packRssiSample(rssiSampleDelta(ring.samples[newest]), rssi);
+    }
+    return;
+  }
+  uint32_t delta = ring.count > 0 ? (now - ring.last_ms) / 1000 : 0;
+  ring.samples[ring.head] = packRssiSample(delta > 255 ? 255 : delta, rssi);
+  ring.head = (ring.head + 1) % RSSI_RING_SAMPLES;
+  if (ring.count < RSSI_RING_SAMPLES)
+  {
+    ring.count++;
+  }
+  ring.last_ms = now;
+}
+
+void RssiPool::release(RssiTrack &track)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  if (owns(track))
+  {
+    rings[track.ring].used = false;
+  }
+  track.ring = RSSI_RING_NONE;
+}
+
+bool RssiPool::read(const RssiTrack &track, RssiSeries &series)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  series.count = 0;
+  series.age_ms = 0;
+  if (!owns(track))
+  {
+    return false;
+  }
+  const Ring &ring = rings[track.ring];
+  uint8_t first = (ring.head + RSSI_RING_SAMPLES - ring.count) % RSSI_RING_SAMPLES;
+  for (uint8_t i = 0; i < ring.count; i++)
+  {
+    series.samples[i] = ring.samples[(first + i) % RSSI_RING_SAMPLES];
+  }
+  series.count = ring.count;
+  series.age_ms = millis() - ring.last_ms;
+  return series.count > 0;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <Arduino.h>
+#include <mutex>
+
+// Samples kept per ring, at most 255
+#ifndef RSSI_RING_SAMPLES
+#define RSSI_RING_SAMPLES 16
+#endif
+// Rings shared by every list, the least recently updated one is reused when they run out
+#ifndef RSSI_POOL_RINGS
+#define RSSI_POOL_RINGS 96
+#endif
+// Readings closer than this are merged into the newest sample, keeping the strongest
+#define RSSI_SAMPLE_INTERVAL_MS 1000
+// EWMA weight of a new reading is 1 / 2^RSSI_EWMA_SHIFT
+#define RSSI_EWMA_SHIFT 3
+
+#define RSSI_RING_NONE 0xFFFF
+
+/**
+ * @brief Signal statistics of one list record.
+ *
+ * Lives inside the record, so it is copied with it. The samples are in a ring
+ * of the shared rssiPool; ring and generation only refer to it while the ring
+ * has not been reused for another record. All updates happen under the lock
+ * of the list owning the record.
+ */
+struct RssiTrack
+{
+  int16_t ewma;        // dBm in Q8.8 fixed point
+  int8_t last;
+  int8_t min;          // min > max until the first reading
+  int8_t max;
+  uint8_t reserved;
+  uint16_t ring;       // rssiPool ring, RSSI_RING_NONE if none
+  uint16_t generation; // Generation of the ring when it was assigned
+
+  RssiTrack() : ewma(0), last(0), min(INT8_MAX), max(INT8_MIN), reserved(0), ring(RSSI_RING_NONE), generation(0) {}
+
+  bool empty() const { return min > max; }
+  // EWMA rounded to whole dBm, the current proximity
+  int8_t current() const { return static_cast<int8_t>((ewma + 128) >> 8); }
+};
+
+// Sample packing: seconds since the previous sample (saturated) in the high byte, RSSI in the low byte
+inline uint16_t packRssiSample(uint8_t delta, int8_t rssi)
+{
+  return static_cast<uint16_t>(delta) << 8 | static_cast<uint8_t>(rssi);
+}
+inline uint8_t rssiSampleDelta(uint16_t sample) { return sample >> 8; }
+inline int8_t rssiSampleValue(uint16_t sample) { return static_cast<int8_t>(sample & 0xFF); }
+
+// Samples of a track, oldest first
+struct RssiSeries
+{
+  uint32_t age_ms;  // Time since the newest sample
+  uint8_t count;
+  uint16_t samples[RSSI_RING_SAMPLES];
+};
+
+/**
+ * @brief Fixed pool of sample rings for the RssiTrack of every record.
+ *
+ * A ring is taken on the first reading of a record and given back when the
+ * record leaves its list. When all rings are in use the one updated least
+ * recently is reused and its generation bumped, which detaches it from its
+ * old record; a stale copy of a track (a cloned list) therefore never reads
+ * another record's samples.
+ */
+class RssiPool
+{
+public:
+  RssiPool();
+
+  // Adds a reading to the statistics and the ring of track
+  void add(RssiTrack &track, int8_t rssi);
+  // Gives the ring of track back to the pool
+  void release(RssiTrack &track);
+  // Copies the samples of track, false if it has none
+  bool read(const RssiTrack &track, RssiSeries &series);
+
+private:
+  struct Ring
+  {
+    uint32_t last_ms;  // millis() of the newest sample
+    uint16_t generation;
+    uint8_t head;      // Slot of the next sample
+    uint8_t count;
+    bool used;
+    uint16_t samples[RSSI_RING_SAMPLES];
+  };
+
+  bool owns(const RssiTrack &track) const;
+  uint16_t allocate();
+
+  Ring rings[RSSI_POOL_RINGS];
+  std::mutex mutex;
+};
+
+extern RssiPool rssiPool;
@@ -0,0 +1,195 @@
+#include "StringArena.h"
+#include <algorithm>
+#include "Hash.h"
+#include "Log.h"
+
+static_assert(STRING_ARENA_ENTRIES > 1 && STRING_ARENA_ENTRIES <= 4095, "entry indexes are 12 bit and never 0xFFF");
+static_assert(STRING_ARENA_SIZE <= 0xFFFF, "offsets are 16 bit");
+static_assert(STRING_ARENA_MAX_LEN <= 255, "lengths are 8 bit");
+
+const size_t StringArena::BLOCK_HEADER;
+
+StringArena stringArena;
+
+StringArena::StringArena() : freeHead(0), freeCount(0), used(0), garbage(0), byHash(STRING_ARENA_ENTRIES)
+{
+  memset(entries, 0, sizeof(entries));
+  // Entry 0 stays unused, handle 0 is STRING_NONE
+  for (uint16_t index = 1; index < STRING_ARENA_ENTRIES; index++)
+  {
+    freeList[freeCount++] = index;
+  }
+}
+
+// Must be called with mutex held
+const StringArena::Entry *StringArena::lookup(uint16_t handle) const
+{
+  uint16_t index = handle & 0x0FFF;
+  if (index == 0 || index >= STRING_ARENA_ENTRIES)
+  {
+    return nullptr;
+  }
+  const Entry &entry = entries[index];
+  return entry.refs > 0 && entry.generation == handle >> 12 ? &entry : nullptr;
+}
+
+// Must be called with mutex held
+uint16_t StringArena::match(const char *text, size_t len, uint64_t key) const
+{
+  for (uint16_t index = byHash.first(key); index != ChainIndex::END; index = byHash.next(index))
+  {
+    const Entry &entry = entries[index];
+    if (entry.length == len && memcmp(bytes + entry.offset + BLOCK_HEADER, text, len) == 0)
+    {
+      return index;
+    }
+  }
+  return ChainIndex::END;
+}
+
+uint16_t StringArena::intern(const char *text, size_t len)
+{
+  if (len == 0)
+  {
+    return STRING_NONE;
+  }
+  len = std::min<size_t>(len, STRING_ARENA_MAX_LEN);
+  uint64_t key = ssidHashKey(text, len);
+
+  std::lock_guard<std::mutex> lock(mutex);
+  uint16_t index = match(text, len, key);
+  if (index != ChainIndex::END)
+  {
+    entries[index].refs++;
+    return handleOf(index, entries[index]);
+  }
+
+  size_t block = BLOCK_HEADER + len;
+  if (used + block > STRING_ARENA_SIZE && garbage > 0)
+  {
+    compact();
+  }
+  if (freeCount == 0 || used + block > STRING_ARENA_SIZE)
+  {
+    LOG_WARN("String arena full (%u entries free, %u bytes used), string dropped", freeCount, used);
+    return STRING_NONE;
+  }
+
+  index = freeList[freeHead];
+  freeHead = (freeHead + 1) % STRING_ARENA_ENTRIES;
+  freeCount--;
+
+  Entry &entry = entries[index];
+  entry.offset = used;
+  entry.refs = 1;
+  entry.length = len;
+  bytes[used] = index & 0xFF;
+  bytes[used + 1] = index >> 8;
+  bytes[used + 2] = len;
+  memcpy(bytes + used + BLOCK_HEADER, text, len);
+  used += block;
+  byHash.insert(key, index);
+  return handleOf(index, entry);
+}
+
+uint16_t StringArena::find(const char *text, size_t len) const
+{
+  if (len == 0)
+  {
+    return STRING_NONE;
+  }
+  len = std::min<size_t>(len, STRING_ARENA_MAX_LEN);
+  uint64_t key = ssidHashKey(text, len);
+
+  std::lock_guard<std::mutex> lock(mutex);
+  uint16_t index = match(text, len, key);
+  return index != ChainIndex::END ? handleOf(index, entries[index]) : STRING_MISSING;
+}
+
+void StringArena::retain(uint16_t handle)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  if (lookup(handle) != nullptr)
+  {
+    entries[handle & 0x0FFF].refs++;
+  }
+}
+
+void StringArena::release(uint16_t handle)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  if (lookup(handle) == nullptr)
+  {
+    return;
+  }
+  uint16_t index = handle & 0x0FFF;
+  Entry &entry = entries[index];
+  if (--entry.refs > 0)
+  {
+    return;
+  }
+  byHash.remove(ssidHashKey(reinterpret_cast<const char *>(bytes + entry.offset + BLOCK_HEADER), entry.length), index);
+  garbage += BLOCK_HEADER + entry.length;
+  entry.generation = (entry.generation + 1) & 0x0F;
+  freeList[(freeHead + freeCount) % STRING_ARENA_ENTRIES] = index;
+  freeCount++;
+}
+
+/**
+ * @brief Moves the live blocks down over the freed ones.
+ *
+ * Blocks are walked in address order; a block is live when its entry is in
+ * use and still points at it, an entry freed and reused since points further
+ * up.
+ */
+void StringArena::compact()
+{
+  uint16_t write = 0;
+  for (uint16_t read = 0; read < used;)
+  {
+    uint16_t index = bytes[read] | bytes[read + 1] << 8;
+    uint16_t block = BLOCK_HEADER + bytes[read + 2];
+    Entry &entry = entries[index];
+    if (entry.refs > 0 && entry.offset == read)
+    {
+      memmove(bytes + write, bytes + read, block);
+      entry.offset = write;
+      write += block;
+    }
+    read += block;
+  }
+  LOG_DEBUG("String arena compacted: %u bytes freed", used - write);
+  used = write;
+  garbage = 0;
+}
+
+size_t StringArena::copy(uint16_t handle, char *buffer, size_t size) const
+{
+  if (size == 0)
+  {
+    return 0;
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  const Entry *entry = lookup(handle);
+  size_t len = entry != nullptr ? std::min<size_t>(entry->length, size - 1) : 0;
+  if (len > 0)
+  {
+    memcpy(buffer, bytes + entry->offset + BLOCK_HEADER, len);
+  }
+  buffer[len] = '\0';
+  return len;
+}
+
+String StringArena::get(uint16_t handle) const
+{
+  char text[STRING_ARENA_MAX_LEN + 1];
+  copy(handle, text, sizeof(text));
+  return String(text);
+}
+
+uint64_t StringArena::hash(uint16_t handle) const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  const Entry *entry = lookup(handle);
+  return entry != nullptr ? fnv1a64(bytes + entry->offset + BLOCK_HEADER, entry->length) : 0;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <Arduino.h>
+#include <mutex>
+#include "ChainIndex.h"
+
+// Bytes shared by the text of every interned string
+#ifndef STRING_ARENA_SIZE
+#define STRING_ARENA_SIZE 8192
+#endif
+// Distinct strings interned at once, at most 4095
+#ifndef STRING_ARENA_ENTRIES
+#define STRING_ARENA_ENTRIES 512
+#endif
+// Longer strings are truncated, the flash records keep no more either
+#define STRING_ARENA_MAX_LEN 32
+
+// Handle of the empty string, and of a string the arena had no room for
+#define STRING_NONE 0
+// Returned by find() for a string that is not interned
+#define STRING_MISSING 0xFFFF
+
+/**
+ * @brief Interning table for the SSIDs and names of the lists.
+ *
+ * Each distinct string is stored once in a fixed byte arena and records keep
+ * a 16-bit handle: the entry index in the low 12 bits and its generation in
+ * the high 4. Entries are reference counted; the last release() frees the
+ * entry, bumps its generation and leaves its bytes as garbage, which is
+ * compacted away when the arena runs out of room. Handles do not change when
+ * the bytes move.
+ *
+ * A handle kept after its references are gone (a record in a cloned list
+ * that has since been evicted) reads as the empty string. Freed entries are
+ * reused in FIFO order, so that takes many evictions to go wrong.
+ */
+class StringArena
+{
+public:
+  StringArena();
+
+  // Handle of text with a new reference, STRING_NONE if text is empty or does not fit
+  uint16_t intern(const char *text, size_t len);
+  // Handle of text without taking a reference, STRING_MISSING if it is not interned
+  uint16_t find(const char *text, size_t len) const;
+  void retain(uint16_t handle);
+  void release(uint16_t handle);
+  // Copies the string NUL terminated, truncated to size - 1, and returns its length
+  size_t copy(uint16_t handle, char *buffer, size_t size) const;
+  String get(uint16_t handle) const;
+  // fnv1a64 of the string, 0 for the empty string
+  uint64_t hash(uint16_t handle) const;
+
+private:
+  struct Entry
+  {
+    uint16_t offset;   // Block of the string in bytes
+    uint16_t refs;     // 0 for a free entry
+    uint8_t length;
+    uint8_t generation;
+  };
+
+  // Every block starts with the entry index (2 bytes) and the length
+  static const size_t BLOCK_HEADER = 3;
+
+  static uint16_t handleOf(uint16_t index, const Entry &entry) { return entry.generation << 12 | index; }
+  const Entry *lookup(uint16_t handle) const;
+  uint16_t match(const char *text, size_t len, uint64_t key) const;
+  void compact();
+
+  uint8_t bytes[STRING_ARENA_SIZE];
+  Entry entries[STRING_ARENA_ENTRIES];
+  uint16_t freeList[STRING_ARENA_ENTRIES]; // Ring of free entry indexes, oldest first
+  uint16_t freeHead;
+  uint16_t freeCount;
+  uint16_t used;      // Bytes up to the end of the newest block
+  uint16_t garbage;   // Bytes of freed blocks below used
+  ChainIndex byHash;  // ssidHashKey of the text -> entries
+  mutable std::mutex mutex;
+};
+
+extern StringArena stringArena;
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <Arduino.h>
+#include <vector>
+
+// Evicted records remembered per list for delta sync clients
+#define SYNC_TOMBSTONES 32
+
+/**
+ * @brief Position of a client in the change sequence of a list.
+ *
+ * The epoch changes at every boot and every clear(), a cursor from another
+ * epoch can only be answered with the whole list.
+ */
+struct SyncCursor {
+  uint32_t epoch;
+  uint32_t sequence;
+};
+
+/**
+ * @brief Records changed after a cursor.
+ *
+ * When reset is set the client must drop its copy: changed holds the whole
+ * list and removed is empty. Otherwise the removed records must be applied
+ * before the changed ones, a key may be in both when it came back.
+ */
+template <typename T>
+struct SyncDelta {
+  bool reset;
+  SyncCursor cursor;        // Cursor to send in the next request
+  std::vector<T> changed;   // Inserted or updated records, current content
+  std::vector<T> removed;   // Tombstones: last content of evicted records
+};
+
+/**
+ * @brief Change sequence of a list, owned by the list and guarded by its mutex.
+ *
+ * Every insert or update stamps the sequence field of the record with
+ * next(). Evicted records are copied to a bounded ring of tombstones; once
+ * the ring drops a tombstone, cursors older than it get a reset. A tombstone
+ * keeps whatever the record referenced (its stringArena handles) until it is
+ * dropped, when the optional dropped callback gives it back.
+ */
+template <typename T>
+class SyncLog {
+public:
+  explicit SyncLog(void (*dropped)(const T &) = nullptr)
+      : dropped(dropped), epoch(esp_random()), sequence(0), lost(0), head(0) {}
+
+  uint32_t next() { return ++sequence; }
+
+  void tombstone(const T &record)
+  {
+    uint32_t stamp = next();
+    if (tombstones.size() < SYNC_TOMBSTONES)
+    {
+      tombstones.push_back(Tombstone{stamp, record});
+      return;
+    }
+    lost = tombstones[head].sequence;
+    drop(tombstones[head].record);
+    tombstones[head] = Tombstone{stamp, record};
+    head = (head + 1) % SYNC_TOMBSTONES;
+  }
+
+  // Every cursor handed out so far is stale
+  void restart()
+  {
+    epoch++;
+    sequence = 0;
+    lost = 0;
+    head = 0;
+    for (const Tombstone &tombstone : tombstones)
+    {
+      drop(tombstone.record);
+    }
+    tombstones.clear();
+  }
+
+  // Records of list stamped after since, plus the newer tombstones
+  SyncDelta<T> collect(const std::vector<T> &list, const SyncCursor &since) const
+  {
+    SyncDelta<T> delta;
+    delta.cursor = SyncCursor{epoch, sequence};
+    delta.reset = since.epoch != epoch || since.sequence < lost || since.sequence > sequence;
+    for (const T &record : list)
+    {
+      if (delta.reset || record.sequence > since.sequence)
+      {
+        delta.changed.push_back(record);
+      }
+    }
+    if (!delta.reset)
+    {
+      for (size_t i = 0; i < tombstones.size(); i++)
+      {
+        const Tombstone &tombstone = tombstones[(head + i) % tombstones.size()];
+        if (tombstone.sequence > since.sequence)
+        {
+          delta.removed.push_back(tombstone.record);
+        }
+      }
+    }
+    return delta;
+  }
+
+private:
+  struct Tombstone {
+    uint32_t sequence;
+    T record;
+  };
+
+  void drop(const T &record)
+  {
+    if (dropped != nullptr)
+    {
+      dropped(record);
+    }
+  }
+
+  void (*dropped)(const T &);
+  uint32_t epoch;
+  uint32_t sequence;
+  uint32_t lost;      // Sequence of the newest tombstone dropped from the ring
+  size_t head;        // Oldest tombstone once the ring is full
+  std::vector<Tombstone> tombstones;
+};
@@ -0,0 +1,167 @@
+#include "WarmRestart.h"
+#include <esp_attr.h>
+#include <esp_system.h>
+#include <stddef.h>
+#include "Hash.h"
+#include "Log.h"
+#include "Console.h"
+
+extern WifiNetworkList ssidList;
+extern WifiDeviceList stationsList;
+extern BLEDeviceList bleDeviceList;
+extern time_t base_time;
+
+WarmRestart warmRestart;
+
+#if WARM_RESTART_ENABLED
+// Not zeroed at boot, survives every reset that keeps the chip powered
+static __NOINIT_ATTR WarmRestartImage image;
+#endif
+
+namespace
+{
+  const uint16_t RECORD_SIZES = sizeof(WifiDeviceStruct) + sizeof(BLEDeviceStruct) + sizeof(WifiNetworkStruct);
+
+#if WARM_RESTART_ENABLED
+  uint32_t imageCrc()
+  {
+    // Header fields between magic and crc, then the records in use
+    uint32_t crc = crc32(&image.record_sizes, offsetof(WarmRestartImage, crc) - offsetof(WarmRestartImage, record_sizes));
+    crc = crc32(image.wifiDevices, image.wifi_devices * sizeof(WifiDeviceStruct), crc);
+    crc = crc32(image.bleDevices, image.ble_devices * sizeof(BLEDeviceStruct), crc);
+    return crc32(image.wifiNetworks, image.wifi_networks * sizeof(WifiNetworkStruct), crc);
+  }
+#endif
+}
+
+WarmRestart::WarmRestart() : lastUpdate_(0), updated_(false)
+{
+}
+
+bool WarmRestart::restore(time_t &clock)
+{
+#if WARM_RESTART_ENABLED
+  std::lock_guard<std::mutex> lock(mutex_);
+  esp_reset_reason_t reason = esp_reset_reason();
+  if (reason == ESP_RST_POWERON || reason == ESP_RST_UNKNOWN || image.magic != WARM_RESTART_MAGIC)
+  {
+    return false;
+  }
+  if (image.record_sizes != RECORD_SIZES || image.wifi_devices > WARM_RESTART_WIFI_DEVICES ||
+      image.ble_devices > WARM_RESTART_BLE_DEVICES || image.wifi_networks > WARM_RESTART_WIFI_NETWORKS ||
+      imageCrc() != image.crc)
+  {
+    LOG_WARN("Warm restart image is not valid, loading from flash");
+    image.magic = 0;
+    return false;
+  }
+
+  uint32_t start = micros();
+  std::vector<WifiDevice> devices;
+  devices.reserve(image.wifi_devices);
+  for (uint16_t i = 0; i < image.wifi_devices; i++)
+  {
+    const WifiDeviceStruct &record = image.wifiDevices[i];
+    devices.emplace_back(MacAddress(record.address), MacAddress(record.bssid), record.rssi, record.channel,
+                         record.last_seen, record.times_seen);
+  }
+
+  std::vector<BLEFoundDevice> bleDevices;
+  bleDevices.reserve(image.ble_devices);
+  for (uint16_t i = 0; i < image.ble_devices; i++)
+  {
+    BLEDeviceStruct &record = image.bleDevices[i];
+    record.name[sizeof(record.name) - 1] = '\0';
+    bleDevices.emplace_back(MacAddress(record.address), record.rssi, stringArena.intern(record.name, strlen(record.name)),
+                            record.isPublic, record.last_seen, record.times_seen);
+  }
+
+  std::vector<WifiNetwork> networks;
+  networks.reserve(image.wifi_networks);
+  for (uint16_t i = 0; i < image.wifi_networks; i++)
+  {
+    WifiNetworkStruct &record = image.wifiNetworks[i];
+    record.ssid[sizeof(record.ssid) - 1] = '\0';
+    networks.emplace_back(stringArena.intern(record.ssid, strlen(record.ssid)), MacAddress(record.address), record.rssi, record.channel,
+                          static_cast<FrameKind>(record.type), record.last_seen, record.times_seen);
+  }
+
+  stationsList.clear();
+  bleDeviceList.clear();
+  ssidList.clear();
+  stationsList.adoptLoaded(std::move(devices));
+  bleDeviceList.adoptLoaded(std::move(bleDevices));
+  ssidList.adoptLoaded(std::move(networks));
+  clock = image.clock;
+
+  Console.printf("Restored %u WiFi devices, %u BLE devices and %u WiFi networks after a warm restart in %lu us\n",
+                image.wifi_devices, image.ble_devices, image.wifi_networks, (unsigned long)(micros() - start));
+  return true;
+#else
+  return false;
+#endif
+}
+
+void WarmRestart::update(bool force)
+{
+#if WARM_RESTART_ENABLED
+  if (!force && updated_ && millis() - lastUpdate_ < WARM_RESTART_INTERVAL_MS)
+  {
+    return;
+  }
+  if (FlashStorage::loadPending())
+  {
+    // The lists only hold what was captured since boot
+    return;
+  }
+
+  std::vector<WifiDevice> devices = stationsList.getClonedList();
+  std::vector<BLEFoundDevice> bleDevices = bleDeviceList.getClonedList();
+  std::vector<WifiNetwork> networks = ssidList.getClonedList();
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  lastUpdate_ = millis();
+  updated_ = true;
+
+  // A reset from here on finds no image and loads from flash
+  image.magic = 0;
+  if (devices.size() > WARM_RESTART_WIFI_DEVICES || bleDevices.size() > WARM_RESTART_BLE_DEVICES ||
+      networks.size() > WARM_RESTART_WIFI_NETWORKS)
+  {
+    LOG_WARN("Lists larger than the warm restart image, not kept");
+    return;
+  }
+
+  image.record_sizes = RECORD_SIZES;
+  image.reserved = 0;
+  image.clock = millis() / 1000 + base_time;
+  image.wifi_devices = devices.size();
+  image.ble_devices = bleDevices.size();
+  image.wifi_networks = networks.size();
+  image.reserved2 = 0;
+  for (size_t i = 0; i < devices.size(); i++)
+  {
+    toRecord(devices[i], image.wifiDevices[i]);
+  }
+  for (size_t i = 0; i < bleDevices.size(); i++)
+  {
+    toRecord(bleDevices[i], image.bleDevices[i]);
+  }
+  for (size_t i = 0; i < networks.size(); i++)
+  {
+    toRecord(networks[i], image.wifiNetworks[i]);
+  }
+  image.crc = imageCrc();
+  image.magic = WARM_RESTART_MAGIC;
+#else
+  (void)force;
+#endif
+}
+
+void WarmRestart::invalidate()
+{
+#if WARM_RESTART_ENABLED
+  std::lock_guard<std::mutex> lock(mutex_);
+  image.magic = 0;
+#endif
+}
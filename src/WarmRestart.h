@@ -0,0 +1,73 @@
+#pragma once
+
+#include <Arduino.h>
+#include <mutex>
+#include "FlashStorage.h"
+#include "ListSizes.h"
+
+// Keep a copy of the lists in RAM that survives software resets
+#ifndef WARM_RESTART_ENABLED
+#define WARM_RESTART_ENABLED 1
+#endif
+
+// Entries kept per list, the whole capacity of each list
+#define WARM_RESTART_WIFI_DEVICES MAX_STATIONS
+#define WARM_RESTART_BLE_DEVICES MAX_BLE_DEVICES
+#define WARM_RESTART_WIFI_NETWORKS MAX_SSIDS
+
+// Minimum time between two refreshes of the image
+#define WARM_RESTART_INTERVAL_MS 5000
+
+#define WARM_RESTART_MAGIC 0x57524D31 // "WRM1"
+
+/**
+ * @brief Image of the lists in a RAM section that is not initialized at boot.
+ *
+ * Entries use the same records as FlashStorage. The header CRC covers the
+ * counts, the clock and every record in use.
+ */
+struct WarmRestartImage {
+  uint32_t magic;         // WARM_RESTART_MAGIC once the image is complete
+  uint16_t record_sizes;  // Sum of the record sizes, a layout change invalidates the image
+  uint16_t reserved;
+  uint32_t clock;         // millis() / 1000 + base_time when written
+  uint16_t wifi_devices;
+  uint16_t ble_devices;
+  uint16_t wifi_networks;
+  uint16_t reserved2;
+  uint32_t crc;
+  WifiDeviceStruct wifiDevices[WARM_RESTART_WIFI_DEVICES];
+  BLEDeviceStruct bleDevices[WARM_RESTART_BLE_DEVICES];
+  WifiNetworkStruct wifiNetworks[WARM_RESTART_WIFI_NETWORKS];
+};
+
+/**
+ * @brief Restores the lists after a software reset without reading flash.
+ *
+ * The scan loop refreshes the image every WARM_RESTART_INTERVAL_MS, and the
+ * restart command refreshes it right before restarting. A restart, watchdog,
+ * panic or brownout reset keeps the RAM contents, so the next boot finds a
+ * valid image and restores it. After a power-on, or if a reset hit while the
+ * image was being written, the magic or the CRC do not match and the lists
+ * are loaded from flash as usual.
+ */
+class WarmRestart {
+public:
+  WarmRestart();
+
+  // Restores the lists from a valid image, returns false if there is none
+  bool restore(time_t &clock);
+
+  // Copies the lists to the image, at most every WARM_RESTART_INTERVAL_MS unless forced
+  void update(bool force = false);
+
+  // The next boot loads from flash
+  void invalidate();
+
+private:
+  std::mutex mutex_;
+  uint32_t lastUpdate_;
+  bool updated_;
+};
+
+extern WarmRestart warmRestart;
@@ -1,23 +1,27 @@
 #include <Arduino.h>
+#include <algorithm>
 #include <mutex>
 
 #include "WifiDetect.h"
 #include "WifiDeviceList.h"
 #include "WifiNetworkList.h"
-#include "MACAddress.h"
+#include "MacAddress.h"
 #include "AppPreferences.h"
+#include "IEParser.h"
+#include "PcapCapture.h"
+#include "DetectionWatchlist.h"
+#include "Log.h"
+#include "FrameQuarantine.h"
 #include "esp_event.h"
 #include "esp_wifi.h"
-#include "BLE.h"
 #include "BLEStatusUpdater.h"
+#include "Console.h"
 
 extern WifiDeviceList stationsList;
 extern WifiNetworkList ssidList;
 
 WifiDetectClass WifiDetector;
 
-#define SSID_MAX_LEN 33
-
 WifiDetectClass* WifiDetectClass::instance = nullptr;
 
 WifiDetectClass::WifiDetectClass() {
@@ -28,26 +32,34 @@ void WifiDetectClass::setup()
 {
     WiFi.mode(WIFI_AP_STA);
     WiFi.setTxPower(WIFI_POWER_8_5dBm); // Super Mini se calienta con más potencia.
+    if (processTaskHandle == nullptr)
+    {
+        xTaskCreatePinnedToCore(
+            [](void *parameter)
+            { static_cast<WifiDetectClass *>(parameter)->process_loop(); },
+            "WiFi_Detect_Task", FRAME_TASK_STACK_SIZE, this, FRAME_TASK_PRIORITY, &processTaskHandle, FRAME_TASK_CORE);
+        frameQueue.setConsumer(processTaskHandle);
+    }
     start();
-    Serial.println("WifiDetectClass: Setup completed");
+    Console.println("WifiDetectClass: Setup completed");
 }
 
 void WifiDetectClass::start()
 {
-    Serial.println("WifiDetectClass: Starting");
+    Console.println("WifiDetectClass: Starting");
     setFilter(appPrefs.only_management_frames);
     registerWifiEventHandlers();
     esp_wifi_set_promiscuous(true);
-    Serial.println("WifiDetectClass: Started");
+    Console.println("WifiDetectClass: Started");
 }
 
 void WifiDetectClass::stop()
 {
-    Serial.println("WifiDetectClass: Stopping");
+    Console.println("WifiDetectClass: Stopping");
     WiFi.softAPdisconnect(true);
     deregisterWifiEventHandlers();
     esp_wifi_set_promiscuous(false);
-    Serial.println("WifiDetectClass: Stopped");
+    Console.println("WifiDetectClass: Stopped");
 }
 
 void WifiDetectClass::setFilter(bool onlyManagementFrames)
@@ -139,190 +151,137 @@ void WifiDetectClass::addDetectedDevice(const MacAddress &device)
     }
 }
 
-void WifiDetectClass::process_management_frame(const uint8_t *payload, int payload_len, uint8_t subtype, int8_t rssi, uint8_t channel)
+/**
+ * @brief Watched station or vendor that is close right now.
+ *
+ * Listed stations are judged by the EWMA of their RssiTrack, so a single strong
+ * frame of a device walking away does not trigger; unlisted vendor matches only
+ * have the rssi of this frame.
+ */
+bool WifiDetectClass::isWatchedNearby(const uint8_t *mac, int8_t rssi)
 {
-    const uint8_t *src_addr = nullptr;
-    char ssid[SSID_MAX_LEN] = {0};
-    String frameType;
+    if (!detectionWatchlist.hasStation(mac) && !detectionWatchlist.hasVendor(mac))
+    {
+        return false;
+    }
+    return stationsList.trackRssi(MacAddress(mac), rssi) >= appPrefs.detect_rssi;
+}
 
-    switch (subtype)
+/**
+ * @brief Processing task loop.
+ *
+ * Drains the frame queue in batches and checks every descriptor against the
+ * station and network lists, outside of the WiFi driver task.
+ */
+void WifiDetectClass::process_loop()
+{
+    while (true)
+    {
+        frameQueue.waitForFrames();
+        while (frameQueue.drain([this](const FrameDescriptor &frame)
+                                { process_frame(frame); }) > 0)
+        {
+            taskYIELD();
+        }
+    }
+}
+
+void WifiDetectClass::process_frame(const FrameDescriptor &frame)
+{
+    switch (frame.frame_type)
+    {
+    case 0: // Management frame
+        process_management_frame(frame);
+        break;
+    case 1: // Control frame
+        process_control_frame(frame);
+        break;
+    case 2: // Data frame
+        process_data_frame(frame);
+        break;
+    default:
+        break;
+    }
+}
+
+void WifiDetectClass::process_management_frame(const FrameDescriptor &frame)
+{
+    const uint8_t *src_addr = frame.addr2;
+    const char *frameType;
+
+    switch (frame.subtype)
     {
     case 0: // Association Request
     case 2: // Reassociation Request
-        src_addr = &payload[10];
-        parse_ssid(payload, payload_len, subtype, ssid);
         frameType = "assoc";
         break;
 
     case 4: // Probe Request
-        src_addr = &payload[10];
-        parse_ssid(payload, payload_len, subtype, ssid);
         frameType = "probe";
         break;
 
-    case 8: // Ignore Beacons
-        if (false)
-        {
-            src_addr = &payload[10];
-            parse_ssid(payload, payload_len, subtype, ssid);
-            frameType = "beacon";
-        }
-        break;
-
     case 10: // Disassociation
     case 12: // Deauthentication
         frameType = "deauth";
-        src_addr = &payload[10];
         break;
     default:
         return; // Ignore other subtypes
     }
 
-    if (ssid[0] != 0)
+    if (frame.ssid[0] != 0)
     {
-        if (ssidList.is_ssid_in_list(String(ssid)))
+        if (detectionWatchlist.hasSsid(frame.ssid, frame.ssid_len))
         {
-            Serial.printf("SSID detected (%s): %s\n", frameType.c_str(), String(ssid).c_str());
-            addDetectedNetwork(String(ssid));
+            LOG_INFO("SSID detected (%s): %s", frameType, frame.ssid);
+            addDetectedNetwork(String(frame.ssid));
         }
     }
 
-    if (src_addr)
+    if (isWatchedNearby(src_addr, frame.rssi))
     {
-        if (stationsList.is_device_in_list(MacAddress(src_addr)))
-        {
-            Serial.printf("Device detected (%s): %s\n", frameType.c_str(), MacAddress(src_addr).toString().c_str());
-            addDetectedDevice(MacAddress(src_addr));
-        }
+        LOG_INFO("Device detected (%s): %s", frameType, MacAddress(src_addr));
+        addDetectedDevice(MacAddress(src_addr));
     }
 }
 
-void WifiDetectClass::process_control_frame(const uint8_t *payload, int payload_len, uint8_t subtype, int8_t rssi, uint8_t channel)
+void WifiDetectClass::process_control_frame(const FrameDescriptor &frame)
 {
     const uint8_t *src_addr;
 
-    switch (subtype)
+    switch (frame.subtype)
     {
     case 8:  // Block Ack Request
     case 9:  // Block Ack
     case 10: // PS-Poll
     case 11: // RTS
-    case 13: // Acknowledgement
-        src_addr = &payload[10];
+        src_addr = frame.addr2;
         break;
     case 14: // CF-End
     case 15: // CF-End + CF-Ack
-        src_addr = &payload[4];
+        src_addr = frame.addr1;
         break;
     default:
         return; // Ignore other subtypes
     }
 
-    if (stationsList.is_device_in_list(MacAddress(src_addr)))
+    if (isWatchedNearby(src_addr, frame.rssi))
     {
-        Serial.printf("Device detected (%02x): %s\n", subtype, MacAddress(src_addr).toString().c_str());
+        LOG_INFO("Device detected (%02x): %s", frame.subtype, MacAddress(src_addr));
         addDetectedDevice(MacAddress(src_addr));
     }
 }
 
-void WifiDetectClass::process_data_frame(const uint8_t *payload, int payload_len, uint8_t subtype, int8_t rssi, uint8_t channel)
+void WifiDetectClass::process_data_frame(const FrameDescriptor &frame)
 {
-    const uint8_t *src_addr = &payload[10];
+    const uint8_t *src_addr = frame.addr2;
 
-    if (stationsList.is_device_in_list(MacAddress(src_addr)))
+    if (isWatchedNearby(src_addr, frame.rssi))
     {
-        Serial.printf("Device detected (data): %s\n", MacAddress(src_addr).toString().c_str());
+        LOG_INFO("Device detected (data): %s", MacAddress(src_addr));
         addDetectedDevice(MacAddress(src_addr));
     }
 }
 
-/**
- * @brief Parses the SSID from a WiFi packet.
- *
- * This function extracts the SSID from a WiFi management frame (Beacon or Probe Request).
- * It validates the SSID to ensure it contains only printable characters.
- *
- * @param payload Pointer to the packet payload.
- * @param payload_len Length of the payload.
- * @param subtype Subtype of the management frame.
- * @param ssid Buffer to store the extracted SSID.
- */
-void WifiDetectClass::parse_ssid(const uint8_t *payload, int payload_len, uint8_t subtype, char ssid[SSID_MAX_LEN])
-{
-    int pos = 24;   // Start after the management frame header
-    ssid[0] = '\0'; // Default empty SSID
-
-    // Ensure there are enough bytes for the header and at least one IE
-    if (payload_len < pos + 2)
-    {
-        return;
-    }
-
-    // Determine if it's a Beacon frame or a Probe Request
-    uint16_t frame_control = payload[0] | (payload[1] << 8);
-    uint8_t frame_type = (frame_control & 0x000C) >> 2;
-    uint8_t frame_subtype = (frame_control & 0x00F0) >> 4;
-
-    // For Probe Requests, SSID is immediately after the frame header
-    // For Beacon frames, there are additional fields before the SSID
-    if (frame_type == 0 && frame_subtype == 4)
-    { // Probe Request
-        pos = 24;
-    }
-    else if (frame_type == 0 && frame_subtype == 8)
-    {             // Beacon frame
-        pos = 36; // Skip additional Beacon frame fields
-    }
-    else
-    {
-        return;
-    }
-
-    while (pos < payload_len - 2)
-    {
-        uint8_t id = payload[pos];
-        uint8_t len = payload[pos + 1];
-
-        if (id == 0)
-        { // SSID
-            if (len == 0)
-            {
-                // Probe Request with hidden SSID, do not display, others do
-                if (subtype != 4)
-                {
-                }
-                return; // Hidden SSID, exit function
-            }
-            else if (len > SSID_MAX_LEN - 1)
-            {
-                len = SSID_MAX_LEN - 1;
-            }
-
-            if (len > 0 && pos + 2 + len <= payload_len)
-            {
-                memcpy(ssid, &payload[pos + 2], len);
-                ssid[len] = '\0'; // Null-terminate
-
-                // Validate that SSID contains only printable characters
-                for (int i = 0; i < len; i++)
-                {
-                    if (!isprint((unsigned char)ssid[i]))
-                    {
-                        ssid[i] = '.'; // Replace non-printable characters
-                    }
-                }
-                return; // SSID found, exit function
-            }
-            else
-            {
-                return;
-            }
-        }
-
-        pos += 2 + len; // Move to the next IE
-    }
-}
-
 time_t WifiDetectClass::getLastDetectionTime()
 {
     return lastDetectionTime;
@@ -343,12 +302,38 @@ size_t WifiDetectClass::getDetectedNetworksCount()
     return detectedNetworks.size();
 }
 
+FrameQueueStats WifiDetectClass::getQueueStats() const
+{
+    return frameQueue.getStats();
+}
+
+/**
+ * @brief Bytes a control frame must hold (FCS included) for the address that
+ * process_control_frame reads, 0 for the subtypes without a transmitter.
+ */
+static int controlFrameMinLength(uint8_t subtype)
+{
+    switch (subtype)
+    {
+    case 8:  // Block Ack Request
+    case 9:  // Block Ack
+    case 10: // PS-Poll
+    case 11: // RTS
+        return 16 + 4; // addr2
+    case 14: // CF-End
+    case 15: // CF-End + CF-Ack
+        return 10 + 4; // addr1
+    default:
+        return 0; // ACK and CTS only carry the receiver
+    }
+}
+
 /**
  * @brief Callback function for WiFi promiscuous mode.
  *
- * This function is called for each received WiFi packet. It processes the packet
- * based on its type (management, control, or data) and updates the corresponding
- * data structures.
+ * This function is called from the WiFi driver task for each received packet.
+ * It only filters the frame and pushes a compact descriptor into the frame
+ * queue, the list lookups happen in the processing task.
  *
  * @param buf Pointer to the received packet buffer.
  * @param type Type of the WiFi packet.
@@ -370,33 +355,82 @@ void WifiDetectClass::handle_rx(void *buf, wifi_promiscuous_pkt_type_t type)
     int payload_len = pkt->rx_ctrl.sig_len;
     int8_t rssi = pkt->rx_ctrl.rssi;
 
+    // 24 bytes de cabecera + 4 bytes de FCS, los control frames son más cortos:
+    // basta con que lleven la dirección que lee process_control_frame
+    bool control = payload_len >= 2 && ((payload[0] & 0x0C) >> 2) == 1;
+    int min_len = control ? controlFrameMinLength((payload[0] & 0xF0) >> 4) : 28;
+    if (min_len == 0)
+    {
+        return;
+    }
+    if (payload_len < min_len)
+    {
+        if (!control)
+        {
+            frameQuarantine.add(pkt, QuarantineReason::TooShort);
+        }
+        return;
+    }
+
+    if (rssi < appPrefs.minimal_rssi)
+    {
+        return;
+    }
+
     uint16_t frame_control = payload[0] | (payload[1] << 8);
     uint8_t frame_type = (frame_control & 0x000C) >> 2;
     uint8_t frame_subtype = (frame_control & 0x00F0) >> 4;
 
-    uint8_t channel = pkt->rx_ctrl.channel;
+    if (frame_type > 2 || (frame_type != 0 && appPrefs.only_management_frames))
+    {
+        return;
+    }
+
+    // Beacons and other management subtypes are ignored in detection mode
+    if (frame_type == 0 && frame_subtype != 0 && frame_subtype != 2 && frame_subtype != 4 &&
+        frame_subtype != 10 && frame_subtype != 12)
+    {
+        return;
+    }
+
+    pcapCapture.capture(pkt);
 
-    if (rssi >= appPrefs.minimal_rssi)
+    FrameDescriptor *frame = frameQueue.reserve();
+    if (frame == nullptr)
     {
-        switch (frame_type)
+        return; // Queue full, counted as a drop
+    }
+
+    // Short control frames end before addr3 and the sequence number, missing bytes read as zero
+    uint8_t header[24] = {0};
+    memcpy(header, payload, std::min(payload_len - 4, (int)sizeof(header)));
+    memcpy(frame->addr1, &header[4], 6);
+    memcpy(frame->addr2, &header[10], 6);
+    memcpy(frame->addr3, &header[16], 6);
+    frame->frame_control = frame_control;
+    frame->rssi = rssi;
+    frame->channel = pkt->rx_ctrl.channel;
+    frame->frame_type = frame_type;
+    frame->subtype = frame_subtype;
+    frame->seq = (header[22] | (header[23] << 8)) >> 4;
+
+    if (frame_type == 0)
+    {
+        describeFrameIEs(payload, payload_len, *frame);
+        QuarantineReason reason;
+        if (FrameQuarantine::classify(*frame, reason))
         {
-        case 0: // Management frame
-            process_management_frame(payload, payload_len, frame_subtype, rssi, channel);
-            break;
-        case 1: // Control frame
-            if (!appPrefs.only_management_frames)
-            {
-                process_control_frame(payload, payload_len, frame_subtype, rssi, channel);
-            }
-            break;
-        case 2: // Data frame
-            if (!appPrefs.only_management_frames)
-            {
-                process_data_frame(payload, payload_len, frame_subtype, rssi, channel);
-            }
-            break;
-        default:
-            break;
+            frameQuarantine.add(pkt, reason);
         }
     }
+    else
+    {
+        frame->ssid[0] = '\0';
+        frame->ssid_len = 0;
+        frame->ds_channel = 0;
+        frame->ie_flags = 0;
+        frame->probe_fingerprint = 0;
+    }
+
+    frameQueue.commit();
 }
@@ -4,8 +4,9 @@
 #include <esp_wifi.h>
 #include <esp_wifi_types.h>
 #include <vector>
-#include "MACAddress.h"
+#include "MacAddress.h"
 #include <mutex>
+#include "FrameQueue.h"
 
 class WifiDetectClass {
 public:
@@ -24,17 +25,20 @@ public:
     bool isSomethingDetected();
     size_t getDetectedDevicesCount();
     size_t getDetectedNetworksCount();
+    FrameQueueStats getQueueStats() const;
     esp_event_handler_instance_t instance_any_id;
 
 private:
     static void promiscuous_rx_cb(void *buf, wifi_promiscuous_pkt_type_t type);
     void handle_rx(void *buf, wifi_promiscuous_pkt_type_t type);
-    void process_management_frame(const uint8_t *payload, int payload_len, uint8_t subtype, int8_t rssi, uint8_t channel);
-    void process_control_frame(const uint8_t *payload, int payload_len, uint8_t subtype, int8_t rssi, uint8_t channel);
-    void process_data_frame(const uint8_t *payload, int payload_len, uint8_t subtype, int8_t rssi, uint8_t channel);
-    void parse_ssid(const uint8_t *payload, int payload_len, uint8_t subtype, char ssid[33]);
+    void process_loop();
+    void process_frame(const FrameDescriptor &frame);
+    void process_management_frame(const FrameDescriptor &frame);
+    void process_control_frame(const FrameDescriptor &frame);
+    void process_data_frame(const FrameDescriptor &frame);
     void addDetectedNetwork(const String &ssid);
     void addDetectedDevice(const MacAddress &device);
+    bool isWatchedNearby(const uint8_t *mac, int8_t rssi);
     std::vector<MacAddress> detectedDevices;
     std::vector<String> detectedNetworks;
     time_t lastDetectionTime;
@@ -44,6 +48,9 @@ private:
 
     std::mutex detectionMutex;
     static WifiDetectClass* instance;
+
+    FrameQueue frameQueue;
+    TaskHandle_t processTaskHandle = nullptr;
 };
 
 extern WifiDetectClass WifiDetector;
@@ -1,75 +1,226 @@
 #include "WifiDeviceList.h"
 #include <algorithm>
 #include "AppPreferences.h"
+#include "Log.h"
+#include "Console.h"
 
 extern time_t base_time;
 
-WifiDeviceList::WifiDeviceList(size_t maxSize) : maxSize(maxSize)
+WifiDeviceList::WifiDeviceList(size_t maxSize)
+    : maxSize(maxSize), index(maxSize), aliasIndex(maxSize), lru(maxSize), changes(maxSize)
 {
   deviceList.reserve(maxSize);
+  memset(pending, 0, sizeof(pending));
 }
 
 WifiDeviceList::~WifiDeviceList() = default;
 
-void WifiDeviceList::updateOrAddDevice(const MacAddress &address, const MacAddress &bssid, int8_t rssi, uint8_t channel)
+bool WifiDeviceList::updateOrAddDevice(const MacAddress &address, const MacAddress &bssid, int8_t rssi, uint8_t channel,
+                                       uint32_t fingerprint, uint16_t seq)
 {
   std::lock_guard<std::mutex> lock(deviceMutex);
 
   // Local addresses start with bit 2 set
-  if (appPrefs.ignore_local_wifi_addresses && address.getBytes()[0] & 0x02)
+  bool local = address.getBytes()[0] & 0x02;
+  if (appPrefs.ignore_local_wifi_addresses && local)
   {
-    return;
+    return false;
   }
 
   uint8_t nullAddress[6] = {0, 0, 0, 0, 0, 0};
   if (memcmp(address.getBytes(), nullAddress, 6) == 0)
   {
-    return;
+    return false;
   }
 
   uint8_t broadcastAddress[6] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
   if (memcmp(address.getBytes(), broadcastAddress, 6) == 0)
   {
-    return;
+    return false;
   }
 
-  auto it = std::find_if(deviceList.begin(), deviceList.end(),
-                         [&address](const WifiDevice &device)
-                         {
-                           return device.address == address;
-                         });
+  // Only random addresses are linked, a global address is the device itself
+  if (!local)
+  {
+    fingerprint = 0;
+  }
 
   time_t now = millis() / 1000 + base_time;
 
-  if (it != deviceList.end())
+  uint16_t pos = index.find(address.toUint64());
+  if (pos == MacIndex::NOT_FOUND)
+  {
+    pos = aliasIndex.find(address.toUint64());
+  }
+  if (pos == MacIndex::NOT_FOUND && fingerprint != 0)
+  {
+    bool held;
+    pos = linkProbe(address, fingerprint, seq, now, held);
+    if (held)
+    {
+      return false;
+    }
+  }
+
+  if (pos != MacIndex::NOT_FOUND)
   {
-    it->rssi = std::max(it->rssi, rssi);
-    it->bssid = bssid;
-    it->channel = channel;
-    it->last_seen = now;
-    it->times_seen++;
+    WifiDevice &device = deviceList[pos];
+    device.rssi = std::max(device.rssi, rssi);
+    device.bssid = bssid;
+    device.channel = channel;
+    device.last_seen = now;
+    device.times_seen++;
+    device.sequence = sync.next();
+    rssiPool.add(device.rssi_track, rssi);
+    if (fingerprint != 0)
+    {
+      // A record created from other frames takes the fingerprint of its first probe
+      if (device.fingerprint == 0)
+      {
+        device.fingerprint = fingerprint;
+      }
+      if (device.fingerprint == fingerprint)
+      {
+        device.probe_seq = seq;
+      }
+    }
+    lru.touch(pos);
+    changes.mark(pos);
+    return false;
   }
   else
   {
     WifiDevice newDevice(address, bssid, rssi, channel, now);
+    newDevice.sequence = sync.next();
+    newDevice.fingerprint = fingerprint;
+    newDevice.probe_seq = seq;
 
     if (deviceList.size() < maxSize)
     {
+      pos = deviceList.size();
       deviceList.push_back(newDevice);
-      Serial.printf("Added new WiFi device: %s\n", newDevice.address.toString().c_str());
+      lru.pushBack(pos);
+      LOG_INFO("Added new WiFi device: %s", newDevice.address);
     }
     else
     {
-      auto oldest = std::min_element(deviceList.begin(), deviceList.end(),
-                                     [](const WifiDevice &a, const WifiDevice &b)
-                                     {
-                                       return a.last_seen < b.last_seen;
-                                     });
-      Serial.printf("Replacing WiFi device: %s (seen %u times) with new device: %s\n",
-                    oldest->address.toString().c_str(), oldest->times_seen, newDevice.address.toString().c_str());
-      *oldest = newDevice;
+      pos = lru.front();
+      WifiDevice &oldest = deviceList[pos];
+      LOG_INFO("Replacing WiFi device: %s (seen %u times) with new device: %s",
+               oldest.address, oldest.times_seen, newDevice.address);
+      unlink(pos);
+      sync.tombstone(oldest);
+      rssiPool.release(oldest.rssi_track);
+      oldest = newDevice;
+      lru.touch(pos);
+    }
+    rssiPool.add(deviceList[pos].rssi_track, rssi);
+    index.insert(address.toUint64(), pos);
+    changes.mark(pos);
+    return true;
+  }
+}
+
+/**
+ * @brief Finds the record an unknown random address continues, must be called
+ * with deviceMutex held.
+ *
+ * The first probe of the address only picks the candidate record and is held
+ * (held is set, the probe is not counted). The next probe confirms the link if
+ * it continues the sequence and the candidate has not been seen since the
+ * first one; then the record takes address as its alias and its position is
+ * returned. Otherwise, or without a candidate, returns NOT_FOUND.
+ *
+ * Only runs for the first probes of an address, so a scan of the list is
+ * cheaper than keeping an index of fingerprints that several records share.
+ */
+uint16_t WifiDeviceList::linkProbe(const MacAddress &address, uint32_t fingerprint, uint16_t seq, time_t now, bool &held)
+{
+  held = false;
+  PendingLink *link = nullptr;
+  PendingLink *slot = nullptr;
+  for (PendingLink &entry : pending)
+  {
+    if (entry.used && now - entry.first_seen > PROBE_LINK_CONFIRM_S)
+    {
+      entry.used = false;
+    }
+    if (entry.used && entry.address == address.toUint64())
+    {
+      link = &entry;
+    }
+    else if (!entry.used && slot == nullptr)
+    {
+      slot = &entry;
+    }
+  }
+
+  if (link != nullptr)
+  {
+    link->used = false;
+    uint16_t pos = index.find(link->target);
+    // Sequence numbers are 12 bits and wrap around
+    uint16_t advance = (seq - link->seq) & 0x0FFF;
+    if (pos == MacIndex::NOT_FOUND || advance == 0 || advance > PROBE_LINK_SEQ_WINDOW ||
+        deviceList[pos].last_seen >= link->first_seen)
+    {
+      LOG_DEBUG("Random address %s not linked, its second probe does not confirm the link", address);
+      return MacIndex::NOT_FOUND;
+    }
+    WifiDevice &device = deviceList[pos];
+    if (!(device.alias == device.address))
+    {
+      aliasIndex.erase(device.alias.toUint64());
+    }
+    device.alias = address;
+    device.aliases++;
+    aliasIndex.insert(address.toUint64(), pos);
+    LOG_DEBUG("Linked random address %s to WiFi device %s (fingerprint %08X, %u aliases)",
+              address, device.address, fingerprint, device.aliases);
+    return pos;
+  }
+
+  uint16_t pos = MacIndex::NOT_FOUND;
+  uint16_t best = PROBE_LINK_SEQ_WINDOW + 1;
+  for (uint16_t i = 0; i < deviceList.size(); i++)
+  {
+    const WifiDevice &candidate = deviceList[i];
+    // A record seen in the same second is still sending from its own address
+    if (candidate.fingerprint != fingerprint || candidate.last_seen >= now ||
+        now - candidate.last_seen > PROBE_LINK_MAX_GAP_S)
+    {
+      continue;
+    }
+    uint16_t advance = (seq - candidate.probe_seq) & 0x0FFF;
+    if (advance != 0 && advance < best)
+    {
+      best = advance;
+      pos = i;
     }
   }
+  // Without a free slot the address simply takes a record of its own
+  if (pos == MacIndex::NOT_FOUND || slot == nullptr)
+  {
+    return MacIndex::NOT_FOUND;
+  }
+  slot->address = address.toUint64();
+  slot->target = deviceList[pos].address.toUint64();
+  slot->seq = seq;
+  slot->first_seen = now;
+  slot->used = true;
+  held = true;
+  return MacIndex::NOT_FOUND;
+}
+
+// Drops the index entries of the record at pos, must be called with deviceMutex held
+void WifiDeviceList::unlink(uint16_t pos)
+{
+  const WifiDevice &device = deviceList[pos];
+  index.erase(device.address.toUint64());
+  if (!(device.alias == device.address))
+  {
+    aliasIndex.erase(device.alias.toUint64());
+  }
 }
 
 size_t WifiDeviceList::size() const
@@ -79,21 +230,94 @@ size_t WifiDeviceList::size() const
 
 std::vector<WifiDevice> WifiDeviceList::getClonedList() const
 {
-  return deviceList; // Return a copy of the list to avoid locking issues
+  std::lock_guard<std::mutex> lock(deviceMutex);
+  return deviceList;
+}
+
+ListChanges<WifiDevice> WifiDeviceList::takeChanges(bool full)
+{
+  std::lock_guard<std::mutex> lock(deviceMutex);
+  return changes.take(deviceList, full);
+}
+
+void WifiDeviceList::markAllChanged()
+{
+  std::lock_guard<std::mutex> lock(deviceMutex);
+  changes.markAll();
+}
+
+SyncDelta<WifiDevice> WifiDeviceList::getChangesSince(const SyncCursor &since) const
+{
+  std::lock_guard<std::mutex> lock(deviceMutex);
+  return sync.collect(deviceList, since);
 }
 
 void WifiDeviceList::addDevice(const WifiDevice &device)
 {
   std::lock_guard<std::mutex> lock(deviceMutex);
+  if (deviceList.size() >= maxSize || index.find(device.address.toUint64()) != MacIndex::NOT_FOUND)
+  {
+    LOG_DEBUG("Skipped WiFi device: %s", device.address);
+    return;
+  }
+  uint16_t pos = deviceList.size();
   deviceList.push_back(device);
-  Serial.printf("Added new WiFi device: %s\n", device.address.toString().c_str());
+  deviceList[pos].sequence = sync.next();
+  index.insert(device.address.toUint64(), pos);
+  changes.mark(pos);
+  lru.insertOrdered(pos, [this](uint16_t a, uint16_t b)
+                    { return deviceList[a].last_seen < deviceList[b].last_seen; });
+  LOG_DEBUG("Added new WiFi device: %s", device.address);
+}
+
+/**
+ * @brief Takes over the records decoded from flash under a single lock.
+ *
+ * Devices already in the list were seen while the load was running: they keep
+ * their live values and add the stored counters. Duplicates and records past
+ * maxSize are dropped.
+ */
+void WifiDeviceList::adoptLoaded(std::vector<WifiDevice> &&loaded)
+{
+  std::lock_guard<std::mutex> lock(deviceMutex);
+  size_t live = deviceList.size();
+  for (auto &device : loaded)
+  {
+    uint16_t pos = index.find(device.address.toUint64());
+    if (pos != MacIndex::NOT_FOUND)
+    {
+      deviceList[pos].times_seen += device.times_seen;
+      deviceList[pos].last_seen = std::max(deviceList[pos].last_seen, device.last_seen);
+      deviceList[pos].sequence = sync.next();
+    }
+    else if (deviceList.size() < maxSize)
+    {
+      device.sequence = sync.next();
+      index.insert(device.address.toUint64(), deviceList.size());
+      deviceList.push_back(std::move(device));
+    }
+  }
+  lru.rebuild(deviceList.size(), [this](uint16_t a, uint16_t b)
+              { return deviceList[a].last_seen < deviceList[b].last_seen; });
+  changes.markAll();
+  LOG_INFO("Adopted %zu stored WiFi devices (%zu live)", deviceList.size() - live, live);
 }
 
 void WifiDeviceList::clear()
 {
   std::lock_guard<std::mutex> lock(deviceMutex);
+  for (auto &device : deviceList)
+  {
+    rssiPool.release(device.rssi_track);
+  }
   deviceList.clear();
-  Serial.println("WiFi device list cleared");
+  index.clear();
+  aliasIndex.clear();
+  memset(pending, 0, sizeof(pending));
+  lru.clear();
+  changes.markAll();
+  sync.restart();
+  Console.println("WiFi device list cleared");
 }
 
 void WifiDeviceList::remove_irrelevant_stations()
@@ -106,7 +330,7 @@ void WifiDeviceList::remove_irrelevant_stations()
   }
 
   size_t initial_size = deviceList.size();
-  Serial.printf("Removing irrelevant stations. List size: %zu\n", initial_size);
+  LOG_INFO("Removing irrelevant stations. List size: %zu", initial_size);
 
   uint32_t total_seens = 0;
   for (const auto &device : deviceList)
@@ -116,27 +340,65 @@ void WifiDeviceList::remove_irrelevant_stations()
 
   uint32_t min_seens = static_cast<uint32_t>(round(total_seens / static_cast<double>(deviceList.size()) / 3.0));
 
-  deviceList.erase(
-      std::remove_if(deviceList.begin(), deviceList.end(),
-                     [min_seens](const WifiDevice &device)
-                     {
-                       Serial.printf("Irrelevant device: %s, seen: %u (min_seens: %u), rssi: %d (minimal_rssi: %d)\n",
-                                     device.address.toString().c_str(), device.times_seen, min_seens, device.rssi, appPrefs.minimal_rssi);
-                       return device.times_seen < min_seens || device.rssi < appPrefs.minimal_rssi;
-                     }),
-      deviceList.end());
+  auto irrelevant = [min_seens](const WifiDevice &device)
+  {
+    return device.times_seen < min_seens || device.rssi < appPrefs.minimal_rssi;
+  };
+  for (auto &device : deviceList)
+  {
+    if (irrelevant(device))
+    {
+      LOG_DEBUG("Irrelevant device: %s, seen: %u (min_seens: %u), rssi: %d (minimal_rssi: %d)",
+                device.address, device.times_seen, min_seens, device.rssi, appPrefs.minimal_rssi);
+      sync.tombstone(device);
+      rssiPool.release(device.rssi_track);
+    }
+  }
+  deviceList.erase(std::remove_if(deviceList.begin(), deviceList.end(), irrelevant), deviceList.end());
+  rebuildIndex();
 
-  Serial.printf("Removed %zu irrelevant stations. New list size: %zu\n", initial_size - deviceList.size(), deviceList.size());
-  Serial.println("WifiDeviceList::remove_irrelevant_stations - Exiting");
+  LOG_INFO("Removed %zu irrelevant stations. New list size: %zu", initial_size - deviceList.size(), deviceList.size());
+}
+
+// Must be called with deviceMutex held, after positions in deviceList changed
+void WifiDeviceList::rebuildIndex()
+{
+  index.clear();
+  aliasIndex.clear();
+  changes.markAll();
+  for (uint16_t pos = 0; pos < deviceList.size(); pos++)
+  {
+    const WifiDevice &device = deviceList[pos];
+    index.insert(device.address.toUint64(), pos);
+    if (!(device.alias == device.address))
+    {
+      aliasIndex.insert(device.alias.toUint64(), pos);
+    }
+  }
+  lru.rebuild(deviceList.size(), [this](uint16_t a, uint16_t b)
+              { return deviceList[a].last_seen < deviceList[b].last_seen; });
 }
 
 bool WifiDeviceList::is_device_in_list(const MacAddress &address)
 {
-  auto deviceListCopy = getClonedList();
-  auto it = std::find_if(deviceListCopy.begin(), deviceListCopy.end(),
-                         [&address](const WifiDevice &device)
-                         {
-                           return device.address == address;
-                         });
-  return it != deviceListCopy.end();
+  std::lock_guard<std::mutex> lock(deviceMutex);
+  return index.find(address.toUint64()) != MacIndex::NOT_FOUND ||
+         aliasIndex.find(address.toUint64()) != MacIndex::NOT_FOUND;
+}
+
+int8_t WifiDeviceList::trackRssi(const MacAddress &address, int8_t rssi)
+{
+  std::lock_guard<std::mutex> lock(deviceMutex);
+  uint16_t pos = index.find(address.toUint64());
+  if (pos == MacIndex::NOT_FOUND)
+  {
+    pos = aliasIndex.find(address.toUint64());
+  }
+  if (pos == MacIndex::NOT_FOUND)
+  {
+    return rssi;
+  }
+  RssiTrack &track = deviceList[pos].rssi_track;
+  rssiPool.add(track, rssi);
+  return track.current();
 }
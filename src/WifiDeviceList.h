@@ -3,7 +3,31 @@
 #include <Arduino.h>
 #include <vector>
 #include <mutex>
-#include "MACAddress.h"
+#include "MacAddress.h"
+#include "MacIndex.h"
+#include "LruList.h"
+#include "ListChanges.h"
+#include "SyncLog.h"
+#include "OuiVendor.h"
+#include "RssiTrack.h"
+
+// Largest sequence number advance between the last probe of a record and a
+// probe from a new random address that is linked to it
+#ifndef PROBE_LINK_SEQ_WINDOW
+#define PROBE_LINK_SEQ_WINDOW 64
+#endif
+// Seconds after which a record is no longer linked to new random addresses
+#ifndef PROBE_LINK_MAX_GAP_S
+#define PROBE_LINK_MAX_GAP_S 300
+#endif
+// Seconds the first probe of a new random address waits for the next one,
+// which confirms the link, and the number of them waiting at once
+#ifndef PROBE_LINK_CONFIRM_S
+#define PROBE_LINK_CONFIRM_S 10
+#endif
+#ifndef PROBE_LINK_PENDING
+#define PROBE_LINK_PENDING 8
+#endif
 
 struct WifiDevice {
   MacAddress address;
@@ -12,11 +36,40 @@ struct WifiDevice {
   uint8_t channel;
   time_t last_seen;
   uint32_t times_seen;  // New field
+  uint32_t sequence;    // SyncLog stamp of the last change
+  uint16_t vendor;      // OuiVendor id, looked up once when the record is created
+  // Probe linking state, kept in RAM only: not stored in flash or the warm restart image
+  uint32_t fingerprint; // Probe fingerprint of a random address record, 0 if none
+  uint16_t probe_seq;   // Sequence number of its last probe request
+  uint16_t aliases;     // Random addresses linked to this record
+  MacAddress alias;     // Last linked address, equal to address if none
+  RssiTrack rssi_track; // Recent signal, rssi above is the best ever seen
 
   WifiDevice(const MacAddress& addr, const MacAddress& bssid, int8_t r, uint8_t ch, time_t seen, uint32_t times_seen = 1)
-    : address(addr), bssid(bssid), rssi(r), channel(ch), last_seen(seen), times_seen(times_seen) {}
+    : address(addr), bssid(bssid), rssi(r), channel(ch), last_seen(seen), times_seen(times_seen), sequence(0),
+      vendor(ouiVendorId(addr.getBytes())), fingerprint(0), probe_seq(0), aliases(0), alias(addr) {}
 };
 
+/**
+ * @brief Stations seen by the scanner, at most maxSize, least recently seen
+ * evicted first.
+ *
+ * Phones probe from random (locally administered) addresses that rotate, so
+ * one phone would take a new record on every rotation. A probe request from an
+ * unknown random address is matched to the record holding the same probe
+ * fingerprint whose sequence number it continues (within
+ * PROBE_LINK_SEQ_WINDOW) and that was not seen in the same second. That probe
+ * is held back; the link is only made when the next probe from the address
+ * continues the sequence again and the record has stayed silent meanwhile,
+ * otherwise the address takes a record of its own. The record keeps its first
+ * address and the new one becomes its alias.
+ *
+ * This is a heuristic: phones of the same model share a fingerprint and are
+ * only told apart while their sequence numbers are far enough apart, so two of
+ * them can still end up in one record. Devices that reset the sequence number
+ * together with the address are not linked. Links are not persisted, after a
+ * reboot a rotated address takes a record of its own again.
+ */
 class WifiDeviceList {
 public:
   explicit WifiDeviceList(size_t maxSize);
@@ -25,16 +78,49 @@ public:
   WifiDeviceList(const WifiDeviceList&) = delete;
   WifiDeviceList& operator=(const WifiDeviceList&) = delete;
 
-  void updateOrAddDevice(const MacAddress &address, const MacAddress &bssid, int8_t rssi, uint8_t channel);
+  // Returns true if the device was not in the list yet. fingerprint and seq
+  // come from probe requests sent by address, fingerprint is 0 for other frames
+  bool updateOrAddDevice(const MacAddress &address, const MacAddress &bssid, int8_t rssi, uint8_t channel,
+                         uint32_t fingerprint = 0, uint16_t seq = 0);
   size_t size() const;
   std::vector<WifiDevice> getClonedList() const;
+  // Records changed since the previous call, the whole list when full is set
+  ListChanges<WifiDevice> takeChanges(bool full = false);
+  // Makes the next takeChanges() return the whole list
+  void markAllChanged();
+  // Records changed after a delta sync cursor
+  SyncDelta<WifiDevice> getChangesSince(const SyncCursor &since) const;
   void addDevice(const WifiDevice& device);
+  // Bulk load: takes over the records decoded from flash in one step
+  void adoptLoaded(std::vector<WifiDevice> &&loaded);
   void clear();
   void remove_irrelevant_stations();
   bool is_device_in_list(const MacAddress& address);
+  // Adds a reading to the RssiTrack of a listed device and returns its current
+  // proximity, rssi itself if the device is not listed
+  int8_t trackRssi(const MacAddress &address, int8_t rssi);
 
 private:
+  void rebuildIndex();
+  uint16_t linkProbe(const MacAddress &address, uint32_t fingerprint, uint16_t seq, time_t now, bool &held);
+  void unlink(uint16_t pos);
+
+  // First probe of a new random address, waiting for the next one to confirm its link
+  struct PendingLink {
+    uint64_t address;
+    uint64_t target;    // Address of the record it continues
+    uint16_t seq;
+    time_t first_seen;
+    bool used;
+  };
+
   std::vector<WifiDevice> deviceList;
   size_t maxSize;
+  MacIndex index;   // address -> position in deviceList
+  MacIndex aliasIndex; // alias -> position
+  LruList lru;      // positions ordered by last_seen, front is the eviction candidate
+  DirtyTracker changes; // positions changed since the last save
+  SyncLog<WifiDevice> sync; // change sequence for delta sync clients
+  PendingLink pending[PROBE_LINK_PENDING];
   mutable std::mutex deviceMutex;
 };
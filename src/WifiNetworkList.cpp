@@ -1,88 +1,168 @@
 #include "WifiNetworkList.h"
 #include <algorithm>
 #include "AppPreferences.h"
+#include "Log.h"
+#include "Console.h"
 
 extern time_t base_time;
 
-WifiNetworkList::WifiNetworkList(size_t maxSize) : maxSize(maxSize)
+namespace
+{
+  uint64_t pairKeyOf(uint16_t ssid, const MacAddress &address)
+  {
+    return ((ssid * 0x9e3779b97f4a7c15ULL) ^ address.toUint64()) & MacIndex::KEY_MASK;
+  }
+
+  // Evicted networks keep their SSID reference while they are tombstones
+  void releaseTombstone(const WifiNetwork &network)
+  {
+    stringArena.release(network.ssid);
+  }
+}
+
+WifiNetworkList::WifiNetworkList(size_t maxSize)
+    : maxSize(maxSize), bySsid(maxSize), byAddress(maxSize), bySsidAddress(maxSize), lru(maxSize), changes(maxSize),
+      sync(releaseTombstone)
 {
   networkList.reserve(maxSize);
 }
 
 WifiNetworkList::~WifiNetworkList() = default;
 
-void WifiNetworkList::updateOrAddNetwork(const String &ssid, const MacAddress &address, int8_t rssi, uint8_t channel, const String &type)
+/**
+ * @brief Finds the record a frame should update, using the indexes.
+ *
+ * - probe: any previous network with the same SSID.
+ * - beacon/assoc: a network with the same SSID and address, or a non-beacon
+ *   entry (e.g. a probe) with the same SSID, which gets upgraded.
+ * - data, control and other frames: any network with the same address.
+ *
+ * SSIDs are compared by handle; STRING_MISSING (an SSID nobody interned)
+ * matches no record.
+ */
+uint16_t WifiNetworkList::findMatch(uint16_t ssid, const MacAddress &address, FrameKind type) const
+{
+  if (type == FrameKind::Probe)
+  {
+    return bySsid.first(ssid);
+  }
+  else if (type == FrameKind::Beacon || type == FrameKind::Assoc)
+  {
+    uint64_t pairKey = pairKeyOf(ssid, address);
+    for (uint16_t pos = bySsidAddress.first(pairKey); pos != ChainIndex::END; pos = bySsidAddress.next(pos))
+    {
+      if (networkList[pos].address == address && networkList[pos].ssid == ssid)
+        return pos;
+    }
+    for (uint16_t pos = bySsid.first(ssid); pos != ChainIndex::END; pos = bySsid.next(pos))
+    {
+      if (networkList[pos].type != FrameKind::Beacon)
+        return pos;
+    }
+  }
+  else
+  {
+    for (uint16_t pos = byAddress.first(address.toUint64()); pos != ChainIndex::END; pos = byAddress.next(pos))
+    {
+      if (networkList[pos].address == address)
+        return pos;
+    }
+  }
+  return ChainIndex::END;
+}
+
+void WifiNetworkList::indexNetwork(uint16_t pos)
+{
+  const WifiNetwork &network = networkList[pos];
+  bySsid.insert(network.ssid, pos);
+  byAddress.insert(network.address.toUint64(), pos);
+  bySsidAddress.insert(pairKeyOf(network.ssid, network.address), pos);
+}
+
+void WifiNetworkList::unindexNetwork(uint16_t pos)
+{
+  const WifiNetwork &network = networkList[pos];
+  bySsid.remove(network.ssid, pos);
+  byAddress.remove(network.address.toUint64(), pos);
+  bySsidAddress.remove(pairKeyOf(network.ssid, network.address), pos);
+}
+
+bool WifiNetworkList::updateOrAddNetwork(const char *ssid, const MacAddress &address, int8_t rssi, uint8_t channel, FrameKind type)
 {
   std::lock_guard<std::mutex> lock(networkMutex);
 
-  auto it = std::find_if(networkList.begin(), networkList.end(),
-                         [&ssid, &address, &type](const WifiNetwork &network)
-                         {
-                           if (type == "probe")
-                           {
-                             // si es tracta d'un probe request busquem si existeix una xarxa previa amb el mateix ssid
-                             return network.ssid == ssid;
-                           }
-                           else if (type == "beacon" || type == "assoc")
-                           {
-                             // si es tracta d'un beacon, busquem si existeix una xarxa previa amb el mateix ssid i address, o un probe amb el mateix ssid
-                             return network.ssid == ssid && (network.address == address || network.type != "beacon");
-                           }
-                           else 
-                           {
-                             // data, deauth, auth, action, timing, other
-                             // busquem si existeix una xarxa previa amb el mateix address
-                             return network.address == address;
-                           }
-
-                           return false;
-                         });
+  size_t ssidLen = strlen(ssid);
+  uint16_t pos = findMatch(stringArena.find(ssid, ssidLen), address, type);
 
   time_t now = millis() / 1000 + base_time;
 
-  if (it != networkList.end())
+  if (pos != ChainIndex::END)
   {
-    it->rssi = std::max(it->rssi, rssi); // El mejor de los rssi
-    if (type == "beacon")
+    WifiNetwork &network = networkList[pos];
+    network.rssi = std::max(network.rssi, rssi); // El mejor de los rssi
+    if ((type == FrameKind::Beacon || type == FrameKind::Assoc) && !(network.address == address))
+    {
+      // The address is part of two index keys, and of the key delta sync clients use
+      stringArena.retain(network.ssid);
+      sync.tombstone(network);
+      byAddress.remove(network.address.toUint64(), pos);
+      bySsidAddress.remove(pairKeyOf(network.ssid, network.address), pos);
+      network.address = address;
+      byAddress.insert(address.toUint64(), pos);
+      bySsidAddress.insert(pairKeyOf(network.ssid, address), pos);
+    }
+    if (type == FrameKind::Beacon)
     {
       // Los beacons lo cambiamos todo
-      it->channel = channel;
-      it->type = type;
-      it->address = address;
+      network.channel = channel;
+      network.type = type;
     }
     
-    if (type == "assoc")
+    if (type == FrameKind::Assoc)
     {
       // No cambiamos el tipo, solo el canal y el address
-      it->channel = channel;
-      it->address = address;
+      network.channel = channel;
     }
     // Para el resto solo actualizamos el último visto y el número de veces visto
-    it->last_seen = now;
-    it->times_seen++;
+    network.last_seen = now;
+    network.times_seen++;
+    network.sequence = sync.next();
+    rssiPool.add(network.rssi_track, rssi);
+    lru.touch(pos);
+    changes.mark(pos);
+    return false;
   }
   else
   {
-    WifiNetwork newNetwork(ssid, address, rssi, channel, type, now, 1);
+    WifiNetwork newNetwork(stringArena.intern(ssid, ssidLen), address, rssi, channel, type, now, 1);
+    newNetwork.sequence = sync.next();
 
     if (networkList.size() < maxSize)
     {
+      pos = networkList.size();
       networkList.push_back(newNetwork);
-      Serial.printf("Added new network: %s '%s' (type: %s)\n", 
-      newNetwork.address.toString().c_str(), newNetwork.ssid.c_str(), newNetwork.type.c_str());
+      lru.pushBack(pos);
+      LOG_INFO("Added new network: %s '%s' (type: %s)",
+               newNetwork.address, ssid, frameKindName(newNetwork.type));
     }
     else
     {
-      auto oldest = std::min_element(networkList.begin(), networkList.end(),
-                                     [](const WifiNetwork &a, const WifiNetwork &b)
-                                     {
-                                       return a.last_seen < b.last_seen;
-                                     });
-      Serial.printf("Replacing network: %s '%s' (seen %u times) with new network: %s '%s' (type: %s) \n",
-                    oldest->address.toString().c_str(), oldest->ssid.c_str(), oldest->times_seen, 
-                    newNetwork.address.toString().c_str(), newNetwork.ssid.c_str(), newNetwork.type.c_str());
-      *oldest = newNetwork;
+      pos = lru.front();
+      WifiNetwork &oldest = networkList[pos];
+      LOG_INFO("Replacing network: %s '%s' (seen %u times) with new network: %s '%s' (type: %s)",
+               oldest.address, stringArena.get(oldest.ssid), oldest.times_seen,
+               newNetwork.address, ssid, frameKindName(newNetwork.type));
+      unindexNetwork(pos);
+      // The tombstone takes over the SSID reference
+      sync.tombstone(oldest);
+      rssiPool.release(oldest.rssi_track);
+      oldest = newNetwork;
+      lru.touch(pos);
     }
+    rssiPool.add(networkList[pos].rssi_track, rssi);
+    indexNetwork(pos);
+    changes.mark(pos);
+    return true;
   }
 }
 
@@ -93,21 +173,113 @@ size_t WifiNetworkList::size() const
 
 std::vector<WifiNetwork> WifiNetworkList::getClonedList() const
 {
-  return networkList; // Copy the vector to avoid locking issues
+  std::lock_guard<std::mutex> lock(networkMutex);
+  return networkList;
+}
+
+ListChanges<WifiNetwork> WifiNetworkList::takeChanges(bool full)
+{
+  std::lock_guard<std::mutex> lock(networkMutex);
+  return changes.take(networkList, full);
+}
+
+void WifiNetworkList::markAllChanged()
+{
+  std::lock_guard<std::mutex> lock(networkMutex);
+  changes.markAll();
+}
+
+SyncDelta<WifiNetwork> WifiNetworkList::getChangesSince(const SyncCursor &since) const
+{
+  std::lock_guard<std::mutex> lock(networkMutex);
+  return sync.collect(networkList, since);
 }
 
 void WifiNetworkList::addNetwork(const WifiNetwork &network)
 {
   std::lock_guard<std::mutex> lock(networkMutex);
+  if (networkList.size() >= maxSize)
+  {
+    LOG_DEBUG("Skipped WiFi network: %s", stringArena.get(network.ssid));
+    stringArena.release(network.ssid);
+    return;
+  }
+  uint16_t pos = networkList.size();
   networkList.push_back(network);
-  Serial.printf("Added new WiFi network: %s\n", network.ssid.c_str());
+  networkList[pos].sequence = sync.next();
+  indexNetwork(pos);
+  changes.mark(pos);
+  lru.insertOrdered(pos, [this](uint16_t a, uint16_t b)
+                    { return networkList[a].last_seen < networkList[b].last_seen; });
+  LOG_DEBUG("Added new WiFi network: %s", stringArena.get(network.ssid));
+}
+
+/**
+ * @brief Takes over the records decoded from flash under a single lock.
+ *
+ * A network with the same SSID and address already in the list was seen while
+ * the load was running: it keeps its live values and adds the stored counters.
+ * Records past maxSize are dropped, and with them their SSID references.
+ */
+void WifiNetworkList::adoptLoaded(std::vector<WifiNetwork> &&loaded)
+{
+  std::lock_guard<std::mutex> lock(networkMutex);
+  size_t live = networkList.size();
+  for (auto &network : loaded)
+  {
+    uint16_t match = ChainIndex::END;
+    if (live > 0)
+    {
+      uint64_t pairKey = pairKeyOf(network.ssid, network.address);
+      for (uint16_t pos = bySsidAddress.first(pairKey); pos != ChainIndex::END; pos = bySsidAddress.next(pos))
+      {
+        if (networkList[pos].address == network.address && networkList[pos].ssid == network.ssid)
+        {
+          match = pos;
+          break;
+        }
+      }
+    }
+    if (match != ChainIndex::END)
+    {
+      networkList[match].times_seen += network.times_seen;
+      networkList[match].last_seen = std::max(networkList[match].last_seen, network.last_seen);
+      networkList[match].sequence = sync.next();
+      stringArena.release(network.ssid);
+    }
+    else if (networkList.size() < maxSize)
+    {
+      network.sequence = sync.next();
+      networkList.push_back(network);
+      indexNetwork(networkList.size() - 1);
+    }
+    else
+    {
+      stringArena.release(network.ssid);
+    }
+  }
+  lru.rebuild(networkList.size(), [this](uint16_t a, uint16_t b)
+              { return networkList[a].last_seen < networkList[b].last_seen; });
+  changes.markAll();
+  LOG_INFO("Adopted %zu stored WiFi networks (%zu live)", networkList.size() - live, live);
 }
 
 void WifiNetworkList::clear()
 {
   std::lock_guard<std::mutex> lock(networkMutex);
+  for (auto &network : networkList)
+  {
+    rssiPool.release(network.rssi_track);
+    stringArena.release(network.ssid);
+  }
   networkList.clear();
-  Serial.println("WiFi network list cleared");
+  bySsid.clear();
+  byAddress.clear();
+  bySsidAddress.clear();
+  lru.clear();
+  changes.markAll();
+  sync.restart();
+  Console.println("WiFi network list cleared");
 }
 
 void WifiNetworkList::remove_irrelevant_networks()
@@ -120,13 +292,13 @@ void WifiNetworkList::remove_irrelevant_networks()
   }
 
   size_t initial_size = networkList.size();
-  Serial.printf("Removing irrelevant networks. List size: %zu\n", initial_size);
+  LOG_INFO("Removing irrelevant networks. List size: %zu", initial_size);
 
   uint32_t total_seens = 0;
   uint32_t total_beaconed_networks = 0;
   for (const auto &network : networkList)
   {
-    if (network.type == "beacon")
+    if (network.type == FrameKind::Beacon)
     {
       total_seens += network.times_seen;
       total_beaconed_networks++;
@@ -135,27 +307,43 @@ void WifiNetworkList::remove_irrelevant_networks()
 
   uint32_t min_seens = static_cast<uint32_t>(round(total_seens / static_cast<double>(total_beaconed_networks) * 3.0));
 
-  networkList.erase(
-      std::remove_if(networkList.begin(), networkList.end(),
-                     [min_seens](const WifiNetwork &network)
-                     {
-                       Serial.printf("Irrelevant network: %s, seen: %u (min_seens: %u), rssi: %d (minimal_rssi: %d)\n",
-                                     network.ssid.c_str(), network.times_seen, min_seens, network.rssi, appPrefs.minimal_rssi);
-                       return (network.times_seen < min_seens && network.type == "beacon") || network.rssi < appPrefs.minimal_rssi;
-                     }),
-      networkList.end());
+  auto irrelevant = [min_seens](const WifiNetwork &network)
+  {
+    return (network.times_seen < min_seens && network.type == FrameKind::Beacon) || network.rssi < appPrefs.minimal_rssi;
+  };
+  for (auto &network : networkList)
+  {
+    if (irrelevant(network))
+    {
+      LOG_DEBUG("Irrelevant network: %s, seen: %u (min_seens: %u), rssi: %d (minimal_rssi: %d)",
+                stringArena.get(network.ssid), network.times_seen, min_seens, network.rssi, appPrefs.minimal_rssi);
+      sync.tombstone(network);
+      rssiPool.release(network.rssi_track);
+    }
+  }
+  networkList.erase(std::remove_if(networkList.begin(), networkList.end(), irrelevant), networkList.end());
+  rebuildIndex();
 
-  Serial.printf("Removed %zu irrelevant networks. New list size: %zu\n", initial_size - networkList.size(), networkList.size());
+  LOG_INFO("Removed %zu irrelevant networks. New list size: %zu", initial_size - networkList.size(), networkList.size());
 }
 
-bool WifiNetworkList::is_ssid_in_list(const String &ssid)
+// Must be called with networkMutex held, after positions in networkList changed
+void WifiNetworkList::rebuildIndex()
 {
-  auto networkListCopy = getClonedList();
+  bySsid.clear();
+  byAddress.clear();
+  bySsidAddress.clear();
+  changes.markAll();
+  for (uint16_t pos = 0; pos < networkList.size(); pos++)
+  {
+    indexNetwork(pos);
+  }
+  lru.rebuild(networkList.size(), [this](uint16_t a, uint16_t b)
+              { return networkList[a].last_seen < networkList[b].last_seen; });
+}
 
-  auto it = std::find_if(networkListCopy.begin(), networkListCopy.end(),
-                         [&ssid](const WifiNetwork &network)
-                         {
-                           return network.ssid == ssid;
-                         });
-  return it != networkListCopy.end();
+bool WifiNetworkList::is_ssid_in_list(const String &ssid)
+{
+  std::lock_guard<std::mutex> lock(networkMutex);
+  return bySsid.first(stringArena.find(ssid.c_str(), ssid.length())) != ChainIndex::END;
 }
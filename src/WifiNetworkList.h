@@ -3,21 +3,33 @@
 #include <Arduino.h>
 #include <vector>
 #include <mutex>
-#include "MACAddress.h"
+#include <type_traits>
+#include "MacAddress.h"
+#include "FrameKind.h"
+#include "ChainIndex.h"
+#include "LruList.h"
+#include "ListChanges.h"
+#include "SyncLog.h"
+#include "RssiTrack.h"
+#include "StringArena.h"
 
 struct WifiNetwork {
-  String ssid;
+  uint16_t ssid;      // stringArena handle, the list holds one reference
   MacAddress address;
   int8_t rssi;
   uint8_t channel;
-  String type;
+  FrameKind type;
   time_t last_seen;
   uint32_t times_seen;
+  uint32_t sequence;  // SyncLog stamp of the last change
+  RssiTrack rssi_track; // Signal of the last frames
 
-  WifiNetwork(const String& s, const MacAddress& addr, int8_t r, uint8_t ch, const String& t, time_t seen, uint32_t times_seen = 1)
-    : ssid(s), address(addr), rssi(r), channel(ch), type(t), last_seen(seen), times_seen(times_seen) {}
+  WifiNetwork(uint16_t s, const MacAddress& addr, int8_t r, uint8_t ch, FrameKind t, time_t seen, uint32_t times_seen = 1)
+    : ssid(s), address(addr), rssi(r), channel(ch), type(t), last_seen(seen), times_seen(times_seen), sequence(0) {}
 };
 
+static_assert(std::is_trivially_copyable<WifiNetwork>::value, "clones and tombstones are flat copies");
+
 class WifiNetworkList {
 public:
   explicit WifiNetworkList(size_t maxSize);
@@ -26,16 +38,38 @@ public:
   WifiNetworkList(const WifiNetworkList&) = delete;
   WifiNetworkList& operator=(const WifiNetworkList&) = delete;
 
-  void updateOrAddNetwork(const String &ssid, const MacAddress &address, int8_t rssi, uint8_t channel, const String &type);
+  // Returns true if the network was not in the list yet
+  bool updateOrAddNetwork(const char *ssid, const MacAddress &address, int8_t rssi, uint8_t channel, FrameKind type);
   size_t size() const;
   std::vector<WifiNetwork> getClonedList() const;
+  // Records changed since the previous call, the whole list when full is set
+  ListChanges<WifiNetwork> takeChanges(bool full = false);
+  // Makes the next takeChanges() return the whole list
+  void markAllChanged();
+  // Records changed after a delta sync cursor, keyed by SSID and address
+  SyncDelta<WifiNetwork> getChangesSince(const SyncCursor &since) const;
+  // Takes over the SSID reference of network, released if it is not added
   void addNetwork(const WifiNetwork& network);
+  // Bulk load: takes over the records decoded from flash in one step, with
+  // their SSID references
+  void adoptLoaded(std::vector<WifiNetwork> &&loaded);
   void clear();
   void remove_irrelevant_networks();
   bool is_ssid_in_list(const String& ssid);
 
 private:
+  uint16_t findMatch(uint16_t ssid, const MacAddress &address, FrameKind type) const;
+  void indexNetwork(uint16_t pos);
+  void unindexNetwork(uint16_t pos);
+  void rebuildIndex();
+
   std::vector<WifiNetwork> networkList;
   size_t maxSize;
+  ChainIndex bySsid;        // SSID handle -> networks with that SSID
+  ChainIndex byAddress;     // BSSID -> networks with that address
+  ChainIndex bySsidAddress; // (SSID handle, BSSID) -> networks with both
+  LruList lru;              // positions ordered by last_seen, front is the eviction candidate
+  DirtyTracker changes;     // positions changed since the last save
+  SyncLog<WifiNetwork> sync; // change sequence for delta sync clients
   mutable std::mutex networkMutex;
 };
@@ -1,8 +1,13 @@
 #include "WifiScan.h"
 #include "WifiDeviceList.h"
 #include "WifiNetworkList.h"
-#include "MACAddress.h"
+#include "MacAddress.h"
 #include "AppPreferences.h"
+#include "IEParser.h"
+#include "PcapCapture.h"
+#include "ChannelScheduler.h"
+#include "Log.h"
+#include "FrameQuarantine.h"
 #include <Arduino.h>
 
 extern WifiDeviceList stationsList;
@@ -13,8 +18,6 @@ WifiScanClass WifiScanner;
 uint8_t broadcast_addr[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
 uint8_t null_addr[6] = {0, 0, 0, 0, 0, 0};
 
-#define SSID_MAX_LEN 33
-
 WifiScanClass *WifiScanClass::instance = nullptr;
 
 WifiScanClass::WifiScanClass()
@@ -26,6 +29,14 @@ void WifiScanClass::setup()
 {
   WiFi.mode(WIFI_STA);
   WiFi.setTxPower(WIFI_POWER_8_5dBm); // Super Mini se calienta con más potencia.
+  if (processTaskHandle == nullptr)
+  {
+    xTaskCreatePinnedToCore(
+        [](void *parameter)
+        { static_cast<WifiScanClass *>(parameter)->process_loop(); },
+        "WiFi_Scan_Task", FRAME_TASK_STACK_SIZE, this, FRAME_TASK_PRIORITY, &processTaskHandle, FRAME_TASK_CORE);
+    frameQueue.setConsumer(processTaskHandle);
+  }
   start();
   // Serial.println("WifiScanClass: Setup completed");
 }
@@ -66,57 +77,97 @@ void WifiScanClass::setFilter(bool onlyManagementFrames)
   esp_wifi_set_promiscuous_filter(&filter);
 }
 
-void WifiScanClass::process_management_frame(const uint8_t *payload, int payload_len, uint8_t subtype, int8_t rssi, uint8_t channel)
+CaptureStats &WifiScanClass::getCaptureStats()
 {
-  const uint8_t *dst_addr = &payload[4];
-  const uint8_t *src_addr = &payload[10];
-  const uint8_t *bssid = &payload[16];
+  return captureStats;
+}
 
-  char ssid[SSID_MAX_LEN] = {0};
-  String frameType;
-  bool suspicious = false;
+FrameQueueStats WifiScanClass::getQueueStats() const
+{
+  return frameQueue.getStats();
+}
 
-  switch (subtype)
+/**
+ * @brief Processing task loop.
+ *
+ * Drains the frame queue in batches and applies every descriptor to the
+ * station and network lists, outside of the WiFi driver task.
+ */
+void WifiScanClass::process_loop()
+{
+  while (true)
   {
-  case 0: // Association Request
-  case 2: // Reassociation Request
-    parse_ssid(payload, payload_len, subtype, ssid);
-    frameType = "assoc";
+    frameQueue.waitForFrames();
+    while (frameQueue.drain([this](const FrameDescriptor &frame)
+                            { process_frame(frame); }) > 0)
+    {
+      taskYIELD();
+    }
+  }
+}
+
+void WifiScanClass::process_frame(const FrameDescriptor &frame)
+{
+  channelScheduler.recordFrame(frame.channel);
+
+  switch (frame.frame_type)
+  {
+  case 0: // Management frame
+    process_management_frame(frame);
+    break;
+  case 1: // Control frame
+    process_control_frame(frame);
+    break;
+  case 2: // Data frame
+    process_data_frame(frame);
     break;
+  default:
+    break;
+  }
+}
 
-  case 4: // Probe Request
-    parse_ssid(payload, payload_len, subtype, ssid);
-    frameType = "probe";
+void WifiScanClass::addStation(const uint8_t *address, const uint8_t *bssid, const FrameDescriptor &frame)
+{
+  // The probe fingerprint describes the sender only
+  bool prober = frame.probe_fingerprint != 0 && memcmp(address, frame.addr2, 6) == 0;
+  if (stationsList.updateOrAddDevice(MacAddress(address), MacAddress(bssid), frame.rssi, frame.channel,
+                                     prober ? frame.probe_fingerprint : 0, frame.seq))
+  {
+    channelScheduler.recordNewDevice(frame.channel);
+  }
+}
 
-    // Verificar si el SSID contiene caracteres sospechosos
-    for (int i = 0; ssid[i] != '\0'; i++)
-    {
-      if (!isalnum(ssid[i]) && !isspace(ssid[i]) && ssid[i] != '-' && ssid[i] != '_')
-      {
-        suspicious = true;
-        break;
-      }
-    }
+void WifiScanClass::addNetwork(const char *ssid, const uint8_t *bssid, uint8_t channel, FrameKind kind, const FrameDescriptor &frame)
+{
+  if (ssidList.updateOrAddNetwork(ssid, MacAddress(bssid), frame.rssi, channel, kind))
+  {
+    channelScheduler.recordNewNetwork(frame.channel);
+  }
+}
 
-    if (suspicious)
-    {
-      // Serial.printf("\nSuspicious Probe Request SSID found: '%s'\n", ssid);
-      // Serial.println("Frame hexdump:");
-      printHexDump(payload, payload_len);
-      // Wait until user press button
-      while (!digitalRead(0))
-      {
-        delay(100);
-      }
-    }
+void WifiScanClass::process_management_frame(const FrameDescriptor &frame)
+{
+  const uint8_t *dst_addr = frame.addr1;
+  const uint8_t *src_addr = frame.addr2;
+  const uint8_t *bssid = frame.addr3;
+
+  const char *ssid = frame.ssid;
+  FrameKind frameKind;
+
+  switch (frame.subtype)
+  {
+  case 0: // Association Request
+  case 2: // Reassociation Request
+    frameKind = FrameKind::Assoc;
     break;
-  case 5: // Probe Response
-    parse_ssid(payload, payload_len, subtype, ssid);
-    frameType = "probe-resp";
+
+  case 4: // Probe Request
+    // Suspicious SSIDs are kept in the frame quarantine, not reported here
+    frameKind = FrameKind::Probe;
     break;
+  case 5: // Probe Response, es lo mismo que un beacon para nosotros
   case 8: // Beacon
-    parse_ssid(payload, payload_len, subtype, ssid);
-    frameType = "beacon";
+    frameKind = FrameKind::Beacon;
     break;
   case 1:  // Association Response
   case 3:  // Reassociation Response
@@ -126,134 +177,96 @@ void WifiScanClass::process_management_frame(const uint8_t *payload, int payload
   case 12: // Deauthentication
   case 14: // Action
   default:
-    frameType = "other";
+    frameKind = FrameKind::Other;
     break;
   }
 
-  if (memcmp(bssid, null_addr, 6) == 0)
-  {
-    // Serial.println("Null BSSID detected");
-    printHexDump(payload, payload_len);
-  }
-
-  if (frameType == "probe" || frameType == "assoc" || frameType == "probe-resp")
+  // Beacons leak into adjacent channels, the DS Parameter Set tells the real one
+  uint8_t channel = frame.channel;
+  if (frameKind == FrameKind::Beacon && frame.ds_channel != 0)
   {
-    // Serial.printf(">> Src: %s, Dst: %s, BSSID: %s, RSSI: %d, Channel: %d, FrameType: %s (%d) %s\n",
-    //               MacAddress(src_addr).toString().c_str(),
-    //               MacAddress(dst_addr).toString().c_str(),
-    //               MacAddress(bssid).toString().c_str(),
-    //               rssi,
-    //               channel,
-    //               frameType.c_str(),
-    //               subtype,
-    //               ssid[0] ? ssid : "WILDCARD-SSID");
-  }
-  else if (!ssid[0])
-  {
-    // Serial.printf(">> Src: %s, Dst: %s, BSSID: %s, RSSI: %d, Channel: %d, FrameType: %s (%d)\n",
-    //               MacAddress(src_addr).toString().c_str(),
-    //               MacAddress(dst_addr).toString().c_str(),
-    //               MacAddress(bssid).toString().c_str(),
-    //               rssi,
-    //               channel,
-    //               frameType.c_str(),
-    //               subtype);
-  }
-
-  // Si es una respuesta de probe, usamos el tipo beacon, ya que es lo mismo para nosotros.
-  if (frameType == "probe-resp")
-  {
-    frameType = "beacon";
+    channel = frame.ds_channel;
   }
 
   // Actualizamos la lista de redes si existen el BSSID o el SSID.
   if (ssid[0] || memcmp(bssid, broadcast_addr, 6) != 0)
   {
-    ssidList.updateOrAddNetwork(String(ssid), MacAddress(bssid), rssi, channel, frameType);
+    addNetwork(ssid, bssid, channel, frameKind, frame);
   }
 
   // Actualizamos la lista de estaciones con el origen
-  stationsList.updateOrAddDevice(MacAddress(src_addr), MacAddress(bssid), rssi, channel);
+  addStation(src_addr, bssid, frame);
 
   // Si el destino no es broadcast, actualizamos la lista de estaciones con el destino
   if (memcmp(dst_addr, broadcast_addr, 6) != 0)
   {
-    stationsList.updateOrAddDevice(MacAddress(dst_addr), MacAddress(bssid), rssi, channel);
+    addStation(dst_addr, bssid, frame);
   }
 
   // actualizamos con el BSSID para que sume el tráfico de toda la red al AP 
   if (memcmp(bssid, broadcast_addr, 6) != 0 && memcmp(bssid, null_addr, 6) != 0)
   {
-    stationsList.updateOrAddDevice(MacAddress(bssid), MacAddress(bssid), rssi, channel);
+    addStation(bssid, bssid, frame);
   }
 
 }
 
-void WifiScanClass::process_control_frame(const uint8_t *payload, int payload_len, uint8_t subtype, int8_t rssi, uint8_t channel)
+void WifiScanClass::process_control_frame(const FrameDescriptor &frame)
 {
   const uint8_t *dst_addr = nullptr;
   const uint8_t *src_addr;
   const uint8_t *bssid;
 
-  switch (subtype)
+  switch (frame.subtype)
   {
   case 8:  // Block Ack Request
   case 9:  // Block Ack
   case 10: // PS-Poll
   case 11: // RTS
   case 13: // Acknowledgement
-    dst_addr = &payload[4];
-    src_addr = &payload[10];
-    bssid = &payload[16];
+    dst_addr = frame.addr1;
+    src_addr = frame.addr2;
+    bssid = frame.addr3;
     break;
   case 14: // CF-End
   case 15: // CF-End + CF-Ack
-    src_addr = &payload[4];
-    bssid = &payload[10];
+    src_addr = frame.addr1;
+    bssid = frame.addr2;
     break;
   default:
     return; // Ignore other subtypes
   }
 
-  // Serial.printf(">> Src: %s, Dst: %s, BSSID: %s, RSSI: %d, Channel: %d, FrameType: Control (%d) \n",
-  //               MacAddress(src_addr).toString().c_str(),
-  //               dst_addr ? MacAddress(dst_addr).toString().c_str() : "EMPTY",
-  //               MacAddress(bssid).toString().c_str(),
-  //               rssi,
-  //               channel,
-  //               subtype);
-
   // Actualizamos la lista de redes si existe el BSSID.
   if (memcmp(bssid, broadcast_addr, 6) != 0)
   {
-    ssidList.updateOrAddNetwork("", MacAddress(bssid), rssi, channel, "control");
+    addNetwork("", bssid, frame.channel, FrameKind::Control, frame);
   }
 
-  stationsList.updateOrAddDevice(MacAddress(src_addr), MacAddress(bssid), rssi, channel);
+  addStation(src_addr, bssid, frame);
 
   // Si el destino no es broadcast, actualizamos la lista de estaciones con el destino
   if (dst_addr && memcmp(dst_addr, broadcast_addr, 6) != 0)
   {
-    stationsList.updateOrAddDevice(MacAddress(dst_addr), MacAddress(bssid), rssi, channel);
+    addStation(dst_addr, bssid, frame);
   }
 
   // actualizamos con el BSSID para que sume el tráfico de toda la red al AP 
   if (memcmp(bssid, broadcast_addr, 6) != 0 && memcmp(bssid, null_addr, 6) != 0)
   {
-    stationsList.updateOrAddDevice(MacAddress(bssid), MacAddress(bssid), rssi, channel);
+    addStation(bssid, bssid, frame);
   }
 }
 
-void WifiScanClass::process_data_frame(const uint8_t *payload, int payload_len, uint8_t subtype, int8_t rssi, uint8_t channel)
+void WifiScanClass::process_data_frame(const FrameDescriptor &frame)
 {
   // Data frames pueden tener 3 o 4 addresses dependiendo de los flags DS
-  const uint8_t *addr1 = &payload[4];  // Destination
-  const uint8_t *addr2 = &payload[10]; // Source
-  const uint8_t *addr3 = &payload[16]; // BSSID/Source/Destination dependiendo de DS flags
+  const uint8_t *addr1 = frame.addr1; // Destination
+  const uint8_t *addr2 = frame.addr2; // Source
+  const uint8_t *addr3 = frame.addr3; // BSSID/Source/Destination dependiendo de DS flags
 
-  uint16_t frame_ctrl = payload[0] | (payload[1] << 8);
-  bool toDS = frame_ctrl & 0x0100;
-  bool fromDS = frame_ctrl & 0x0200;
+  bool toDS = frame.frame_control & 0x0100;
+  bool fromDS = frame.frame_control & 0x0200;
 
   const uint8_t *src_addr;
   const uint8_t *dst_addr;
@@ -284,135 +297,34 @@ void WifiScanClass::process_data_frame(const uint8_t *payload, int payload_len,
     bssid = addr1;
   }
 
-  // Serial.printf(">> Src: %s, Dst: %s, BSSID: %s, RSSI: %d, Channel: %d, FrameType: Data (len %d) \n",
-  //               MacAddress(src_addr).toString().c_str(),
-  //               MacAddress(dst_addr).toString().c_str(),
-  //               MacAddress(bssid).toString().c_str(),
-  //               rssi,
-  //               channel, payload_len);
-
-
   // Actualizamos la lista de redes si existe el BSSID.
   if (memcmp(bssid, broadcast_addr, 6) != 0)
   {
-    ssidList.updateOrAddNetwork("", MacAddress(bssid), rssi, channel, "data");
+    addNetwork("", bssid, frame.channel, FrameKind::Data, frame);
   }
 
-  stationsList.updateOrAddDevice(MacAddress(src_addr), MacAddress(bssid), rssi, channel);
+  addStation(src_addr, bssid, frame);
 
   // Si el destino no es broadcast, actualizamos la lista de estaciones con el destino
   if (memcmp(dst_addr, broadcast_addr, 6) != 0)
   {
-    stationsList.updateOrAddDevice(MacAddress(dst_addr), MacAddress(bssid), rssi, channel);
+    addStation(dst_addr, bssid, frame);
   }
 
   // actualizamos con el BSSID para que sume el tráfico de toda la red al AP 
   if (memcmp(bssid, broadcast_addr, 6) != 0 && memcmp(bssid, null_addr, 6) != 0)
   {
-    stationsList.updateOrAddDevice(MacAddress(bssid), MacAddress(bssid), rssi, channel);
-  }
-
-}
-
-/**
- * @brief Parses the SSID from a WiFi packet.
- *
- * This function extracts the SSID from a WiFi management frame (Beacon or Probe Request).
- * It validates the SSID to ensure it contains only printable characters.
- *
- * @param payload Pointer to the packet payload.
- * @param payload_len Length of the payload.
- * @param subtype Subtype of the management frame.
- * @param ssid Buffer to store the extracted SSID.
- */
-void WifiScanClass::parse_ssid(const uint8_t *payload, int payload_len, uint8_t subtype, char ssid[SSID_MAX_LEN])
-{
-  int pos = 24;   // Start after the management frame header
-  ssid[0] = '\0'; // Default empty SSID
-
-  // Ensure there are enough bytes for the header and at least one IE
-  if (payload_len < pos + 2)
-  {
-    // Serial.println("Payload too short for header");
-    return;
-  }
-
-  // Determine starting position based on frame subtype
-  switch (subtype) {
-    case 0:  // Association Request
-    case 2:  // Reassociation Request
-      pos = 28; // Skip capability info + listen interval
-      if (subtype == 2) pos += 6; // Reassoc has current AP field
-      break;
-    case 4:  // Probe Request
-      pos = 24; // Start right after the header
-      break;
-    case 5:  // Probe Response
-    case 8:  // Beacon
-      pos = 36; // Skip timestamp + beacon interval + capability info
-      break;
-    default:
-      // Serial.println("Unknown subtype");
-      return;
-  }
-
-  // Ensure we have enough bytes to read IEs
-  if (pos + 2 > payload_len)
-  {
-    // Serial.println("Payload too short for IEs");
-    return;
+    addStation(bssid, bssid, frame);
   }
 
-  // Parse Information Elements
-  while (pos + 2 <= payload_len)
-  {
-    uint8_t id = payload[pos];
-    uint8_t len = payload[pos + 1];
-
-    // Check if we can safely read the IE
-    if (pos + 2 + len > payload_len)
-    {
-      // Serial.println("IE length exceeds payload");
-      break;
-    }
-
-    if (id == 0)
-    { // SSID element
-      if (len == 0)
-      {
-        // Serial.println("Empty SSID");
-        return;
-      }
-      else if (len >= SSID_MAX_LEN)
-      {
-        // Serial.println("SSID too long, truncating");
-        len = SSID_MAX_LEN - 1;
-      }
-
-      memcpy(ssid, &payload[pos + 2], len);
-      ssid[len] = '\0';
-
-      // Validate SSID characters
-      for (int i = 0; i < len; i++)
-      {
-        if (!isprint((unsigned char)ssid[i]))
-        {
-          ssid[i] = '.';
-        }
-      }
-      return;
-    }
-
-    pos += 2 + len; // Move to next IE
-  }
 }
 
 /**
  * @brief Callback function for WiFi promiscuous mode.
  *
- * This function is called for each received WiFi packet. It processes the packet
- * based on its type (management, control, or data) and updates the corresponding
- * data structures.
+ * This function is called from the WiFi driver task for each received packet.
+ * It only validates the frame and pushes a compact descriptor into the frame
+ * queue, all list updates happen in the processing task.
  *
  * @param buf Pointer to the received packet buffer.
  * @param type Type of the WiFi packet.
@@ -435,48 +347,77 @@ void WifiScanClass::handle_rx(void *buf, wifi_promiscuous_pkt_type_t type)
   int payload_len = pkt->rx_ctrl.sig_len;
   int8_t rssi = pkt->rx_ctrl.rssi;
 
-  uint16_t frame_control = payload[0] | (payload[1] << 8);
-  uint8_t frame_type = (frame_control & 0x000C) >> 2;
-  uint8_t frame_subtype = (frame_control & 0x00F0) >> 4;
-
-  uint8_t channel = pkt->rx_ctrl.channel;
-
   // Verificar la longitud mínima del paquete
   if (payload_len < 28)
   { // 24 bytes de cabecera + 4 bytes de FCS
-    // Serial.printf("Packet too short %d\n", payload_len);
+    captureStats.countTooShort();
+    // Control frames are legitimately shorter, only quarantine the rest
+    if (payload_len < 2 || ((payload[0] & 0x0C) >> 2) != 1)
+    {
+      frameQuarantine.add(pkt, QuarantineReason::TooShort);
+    }
     return;
   }
 
   // Verificar el FCS (Frame Check Sequence) del hardware
   if (pkt->rx_ctrl.rx_state != 0)
   {
-    // Serial.println("FCS check failed");
+    captureStats.countFcsFailure();
+    return;
+  }
+
+  uint16_t frame_control = payload[0] | (payload[1] << 8);
+  uint8_t frame_type = (frame_control & 0x000C) >> 2;
+  uint8_t frame_subtype = (frame_control & 0x00F0) >> 4;
+
+  captureStats.countFrame(frame_type, frame_subtype, pkt->rx_ctrl.channel, payload_len);
+
+  if (rssi < appPrefs.minimal_rssi)
+  {
+    captureStats.countBelowRssi();
     return;
   }
 
-  if (rssi >= appPrefs.minimal_rssi)
+  if (frame_type > 2 || (frame_type != 0 && appPrefs.only_management_frames))
+  {
+    return;
+  }
+
+  pcapCapture.capture(pkt);
+
+  FrameDescriptor *frame = frameQueue.reserve();
+  if (frame == nullptr)
+  {
+    return; // Queue full, counted as a drop
+  }
+
+  memcpy(frame->addr1, &payload[4], 6);
+  memcpy(frame->addr2, &payload[10], 6);
+  memcpy(frame->addr3, &payload[16], 6);
+  frame->frame_control = frame_control;
+  frame->rssi = rssi;
+  frame->channel = pkt->rx_ctrl.channel;
+  frame->frame_type = frame_type;
+  frame->subtype = frame_subtype;
+  frame->seq = (payload[22] | (payload[23] << 8)) >> 4;
+
+  if (frame_type == 0)
   {
-    switch (frame_type)
+    describeFrameIEs(payload, payload_len, *frame);
+    QuarantineReason reason;
+    if (FrameQuarantine::classify(*frame, reason))
     {
-    case 0: // Management frame
-      process_management_frame(payload, payload_len, frame_subtype, rssi, channel);
-      break;
-    case 1: // Control frame
-      if (!appPrefs.only_management_frames)
-      {
-        process_control_frame(payload, payload_len, frame_subtype, rssi, channel);
-      }
-      break;
-    case 2: // Data frame
-      if (!appPrefs.only_management_frames)
-      {
-        process_data_frame(payload, payload_len, frame_subtype, rssi, channel);
-      }
-      break;
-    default:
-      break;
+      frameQuarantine.add(pkt, reason);
     }
   }
-}
+  else
+  {
+    frame->ssid[0] = '\0';
+    frame->ssid_len = 0;
+    frame->ds_channel = 0;
+    frame->ie_flags = 0;
+    frame->probe_fingerprint = 0;
+  }
 
+  frameQueue.commit();
+}
@@ -3,6 +3,9 @@
 #include <WiFi.h>
 #include <esp_wifi.h>
 #include <esp_wifi_types.h>
+#include "FrameQueue.h"
+#include "FrameKind.h"
+#include "CaptureStats.h"
 
 class WifiScanClass {
 public:
@@ -12,16 +15,25 @@ public:
     void stop();
     void setChannel(int channel);
     void setFilter(bool onlyManagementFrames);
+    FrameQueueStats getQueueStats() const;
+    CaptureStats &getCaptureStats();
 
 private:
     static void promiscuous_rx_cb(void *buf, wifi_promiscuous_pkt_type_t type);
     void handle_rx(void *buf, wifi_promiscuous_pkt_type_t type);
-    void process_management_frame(const uint8_t *payload, int payload_len, uint8_t subtype, int8_t rssi, uint8_t channel);
-    void process_control_frame(const uint8_t *payload, int payload_len, uint8_t subtype, int8_t rssi, uint8_t channel);
-    void process_data_frame(const uint8_t *payload, int payload_len, uint8_t subtype, int8_t rssi, uint8_t channel);
-    void parse_ssid(const uint8_t *payload, int payload_len, uint8_t subtype, char ssid[33]);
+    void process_loop();
+    void process_frame(const FrameDescriptor &frame);
+    void process_management_frame(const FrameDescriptor &frame);
+    void process_control_frame(const FrameDescriptor &frame);
+    void process_data_frame(const FrameDescriptor &frame);
+    void addStation(const uint8_t *address, const uint8_t *bssid, const FrameDescriptor &frame);
+    void addNetwork(const char *ssid, const uint8_t *bssid, uint8_t channel, FrameKind kind, const FrameDescriptor &frame);
     static WifiScanClass* instance;
 
+    FrameQueue frameQueue;
+    CaptureStats captureStats;
+    TaskHandle_t processTaskHandle = nullptr;
+
 };
 
 extern void printHexDump(const uint8_t* data, size_t length);
@@ -52,9 +52,7 @@
 #include "Preferences.h"
 #include "WifiScan.h"
 
-#define MAX_STATIONS 255
-#define MAX_SSIDS 200
-#define MAX_BLE_DEVICES 100
+#include "ListSizes.h"
 
 #include "BLEDeviceList.h"
 #include "WifiDeviceList.h"
@@ -65,9 +63,15 @@
 #include "BLEScan.h"
 #include "AppPreferences.h"
 #include "FlashStorage.h"
+#include "HistoryStore.h"
+#include "WarmRestart.h"
 #include "BLEAdvertisingManager.h"
 #include "FirmwareInfo.h"
 #include "BLEStatusUpdater.h"
+#include "DetectionWatchlist.h"
+#include "ChannelScheduler.h"
+#include "Log.h"
+#include "Console.h"
 
 // Define the boot button pin (adjust if necessary)
 #define BOOT_BUTTON_PIN 0
@@ -115,16 +119,6 @@ const unsigned long printInterval = 30000; // 30 seconds in milliseconds
 // Base time for the last_seen field in the lists
 time_t base_time = 0;
 
-// Function to update base_time from a list
-template <typename T>
-void updateBaseTime(const std::vector<T> &list)
-{
-  for (const auto &item : list)
-  {
-    base_time = std::max(base_time, item.last_seen);
-  }
-}
-
 /**
  * @brief Prints the list of detected SSIDs and BLE devices.
  *
@@ -143,7 +137,7 @@ void printSSIDAndBLELists()
   {
     char line[150];
     snprintf(line, sizeof(line), "%-32s | %4d | %7d | %-6s | %5d | %d\n",
-             network.ssid.c_str(), network.rssi, network.channel, network.type.c_str(),
+             stringArena.get(network.ssid).c_str(), network.rssi, network.channel, frameKindName(network.type),
              network.times_seen, network.last_seen);
     listString += line;
   }
@@ -162,10 +156,10 @@ void printSSIDAndBLELists()
     char isPublicStr[6];
     snprintf(isPublicStr, sizeof(isPublicStr), "%s", device.isPublic ? "true" : "false");
     char line[150];
-    if (device.name.length())
+    if (device.name != STRING_NONE)
     {
       snprintf(line, sizeof(line), "%-32s | %-6s | %4d | %5d | %d\n",
-               device.name.substring(0, 32).c_str(), isPublicStr, device.rssi,
+               stringArena.get(device.name).c_str(), isPublicStr, device.rssi,
                device.times_seen, device.last_seen);
     }
     else
@@ -182,14 +176,14 @@ void printSSIDAndBLELists()
   listString += "Total BLE devices: " + String(bleDeviceList.size()) + "\n";
   listString += "----------------------------------------------------------------------\n";
 
-  Serial.println(listString);
+  Console.println(listString);
 }
 
 void firmwareInfo()
 {
-  Serial.println("\n\n----------------------------------------------------------------------");
-  Serial.println(getFirmwareInfoString());
-  Serial.println("----------------------------------------------------------------------\n");
+  Console.println("\n\n----------------------------------------------------------------------");
+  Console.println(getFirmwareInfoString());
+  Console.println("----------------------------------------------------------------------\n");
 }
 
 void checkAndRestartAdvertising()
@@ -199,7 +193,7 @@ void checkAndRestartAdvertising()
 
   if (millis() - lastAdvertisingRestart > advertisingRestartInterval)
   {
-    Serial.println("Restarting BLE advertising");
+    Console.println("Restarting BLE advertising");
     BLEDevice::stopAdvertising();
     delay(100);
     BLEDevice::startAdvertising();
@@ -216,22 +210,21 @@ void checkAndRestartAdvertising()
 void setup()
 {
   Serial.begin(115200);
-  Serial.setDebugOutput(true);
-
-  delay(5000);
+  Console.setDebugOutput(true);
+  logger.begin();
 
-  Serial.println("Starting serial ...");
+  Console.println("Starting serial ...");
 
   // Encuentra la partición NVS
   const esp_partition_t* nvs_partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_NVS, NULL);
 
   if (nvs_partition != NULL) {
-    Serial.print("Partición NVS encontrada. Tamaño: ");
-    Serial.print(nvs_partition->size);  // Tamaño en bytes
-    Serial.print(" bytes. Offset: ");
-    Serial.println(nvs_partition->address);  // Dirección de inicio (offset)
+    Console.print("Partición NVS encontrada. Tamaño: ");
+    Console.print(nvs_partition->size);  // Tamaño en bytes
+    Console.print(" bytes. Offset: ");
+    Console.println(nvs_partition->address);  // Dirección de inicio (offset)
   } else {
-    Serial.println("No se encontró la partición NVS.");
+    Console.println("No se encontró la partición NVS.");
   }
   
   ledManager.begin();
@@ -242,7 +235,7 @@ void setup()
 
   firmwareInfo();
 
-  Serial.println("Loading preferences");
+  Console.println("Loading preferences");
   loadAppPreferences();
 
   // Set WiFi and BLE TX power
@@ -251,36 +244,44 @@ void setup()
 
   // Set CPU frequency
   if(appPrefs.cpu_speed != getCpuFrequencyMhz()) {
-    Serial.printf("Setting CPU frequency to %u MHz\n", appPrefs.cpu_speed);
+    Console.printf("Setting CPU frequency to %u MHz\n", appPrefs.cpu_speed);
     setCpuFrequencyMhz(appPrefs.cpu_speed);
   }
 
-  try
+  // After a software reset the lists are still in RAM. Otherwise the clock
+  // stored by the last save is enough to start capturing: in scan mode the
+  // lists are loaded by the autosave task while capture runs. Detection mode
+  // needs the watchlist, so it always loads before starting.
+  bool lazyLoad = false;
+  time_t warmClock = 0;
+  if (warmRestart.restore(warmClock))
   {
-    FlashStorage::loadAll();
+    base_time = warmClock;
   }
-  catch (const std::exception &e)
+  else
   {
-    Serial.printf("Error loading from flash storage: %s\n", e.what());
-
-    // Handle the error (e.g., clear the lists, use default values, etc.)
-    stationsList.clear();
-    ssidList.clear();
-    bleDeviceList.clear();
+    time_t savedClock = FlashStorage::loadClock();
+    lazyLoad = FLASH_LAZY_LOAD && appPrefs.operation_mode == OPERATION_MODE_SCAN && savedClock > 0;
+    if (lazyLoad)
+    {
+      base_time = savedClock;
+    }
+    else
+    {
+      base_time = std::max(FlashStorage::loadAll(), savedClock);
+    }
   }
-
-  // Update base_time from all lists in one go
-  updateBaseTime(ssidList.getClonedList());
-  updateBaseTime(bleDeviceList.getClonedList());
-  updateBaseTime(stationsList.getClonedList());
   base_time++;
-  Serial.printf("Base time set to: %ld\n", base_time);
+  historyStore.begin();
+  FlashStorage::beginAutosave(lazyLoad);
+  Console.printf("Base time set to: %ld\n", base_time);
 
   // Setup BLE Core (Advertising and Service Characteristics)
   setupBLE();
 
   if (appPrefs.operation_mode == OPERATION_MODE_DETECTION)
   {
+    detectionWatchlist.rebuild();
     WifiDetector.setup();
     BLEDetector.setup();
   }
@@ -310,47 +311,44 @@ void setup()
 void scan_mode_loop()
 {
   static unsigned long lastSaved = 0;
-  static int currentChannel = 0;
-
-  currentChannel = (currentChannel % 14) + 1;
+  uint32_t dwellTime;
+  uint8_t currentChannel = channelScheduler.nextChannel(appPrefs.wifi_channel_dwell_time, dwellTime);
   esp_wifi_set_channel(currentChannel, WIFI_SECOND_CHAN_NONE);
 
-  Serial.printf(">> Time: %lu, WiFi Ch: %2d, SSIDs: %zu, Stations: %zu, BLE: %zu, Heap: %d\n",
-                millis() / 1000, currentChannel, ssidList.size(), stationsList.size(), bleDeviceList.size(), ESP.getFreeHeap());
+  FrameQueueStats queueStats = WifiScanner.getQueueStats();
+  Console.printf(">> Time: %lu, WiFi Ch: %2d (dwell %u ms, score %u), SSIDs: %zu, Stations: %zu, BLE: %zu, Heap: %d, Frames: %u, Dropped: %u, Queue HWM: %u\n",
+                millis() / 1000, currentChannel, dwellTime, channelScheduler.getStats(currentChannel).score,
+                ssidList.size(), stationsList.size(), bleDeviceList.size(), ESP.getFreeHeap(),
+                queueStats.pushed, queueStats.dropped, queueStats.high_water);
 
-  delay(appPrefs.wifi_channel_dwell_time);
+  delay(dwellTime);
 
   checkTransmissionTimeout();
 
   checkAndRestartAdvertising();
 
-  if (currentChannel == 14)
+  if (currentChannel == WIFI_CHANNEL_COUNT)
   {
     printSSIDAndBLELists();
+    Console.print(channelScheduler.getSummary());
   }
 
   // Save all data to flash storage every autosave_interval minutes
   if (millis() - lastSaved >= appPrefs.autosave_interval * 60 * 1000)
   {
-    Serial.println("Saving all data to flash storage");
-    try
-    {
-      FlashStorage::saveAll();
-      lastSaved = millis(); // Update lastSaved only if save was successful
-      Serial.println("Data saved successfully");
-    }
-    catch (const std::exception& e)
-    {
-      Serial.printf("Error saving to flash storage: %s\n", e.what());
-    }
+    // Runs in the autosave task, scanning goes on meanwhile
+    FlashStorage::requestSave();
+    lastSaved = millis();
   }
 
+  warmRestart.update();
+
   bool bootButtonPressed = digitalRead(BOOT_BUTTON_PIN) == LOW;
 
   if (!deviceConnected) {
     if(appPrefs.stealth_mode) {
       if(bootButtonPressed) {
-        Serial.println(">>> Boot button pressed, disabling stealth mode");
+        Console.println(">>> Boot button pressed, disabling stealth mode");
         BLEAdvertisingManager::configureNormalMode();
       } else {
         BLEAdvertisingManager::configureStealthMode();
@@ -376,7 +374,7 @@ void detection_mode_loop()
   if (appPrefs.passive_scan)
   {
     WifiDetector.setChannel(1);
-    Serial.println(">> Passive WiFi scan");
+    Console.println(">> Passive WiFi scan");
   }
   else
   {
@@ -388,10 +386,11 @@ void detection_mode_loop()
     const auto &currentNetwork = clonedList[currentSSIDIndex];
     // Configure ESP32 to broadcast the selected SSID
     // WifiDetector.setupAP(currentNetwork.ssid.c_str(), nullptr, 1);
-    if (&currentNetwork && currentNetwork.ssid && currentNetwork.ssid.length() > 0) {
-      WifiDetector.setupAP(currentNetwork.ssid.c_str(), nullptr, 1);
-      Serial.printf(">> Detection Mode (%02d/%02d) >> Alarm: %d, Broadcasting SSID: \"%s\", Last detection: %d\n",
-                    currentSSIDIndex + 1, clonedList.size(), WifiDetector.isSomethingDetected(), currentNetwork.ssid.c_str(),
+    String ssid = stringArena.get(currentNetwork.ssid);
+    if (ssid.length() > 0) {
+      WifiDetector.setupAP(ssid.c_str(), nullptr, 1);
+      Console.printf(">> Detection Mode (%02d/%02d) >> Alarm: %d, Broadcasting SSID: \"%s\", Last detection: %d\n",
+                    currentSSIDIndex + 1, clonedList.size(), WifiDetector.isSomethingDetected(), ssid.c_str(),
                     millis() / 1000 - WifiDetector.getLastDetectionTime());
     }
 
@@ -423,7 +422,7 @@ void loop()
   else
   {
     // ON / OFF Red LED
-    Serial.println("Operation mode == OFF");
+    Console.println("Operation mode == OFF");
     ledManager.setPixelColor(0, LedManager::COLOR_RED);
     ledManager.show();
     delay(appPrefs.wifi_channel_dwell_time);
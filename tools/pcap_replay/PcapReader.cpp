@@ -0,0 +1,154 @@
+#include "PcapReader.h"
+#include <cstring>
+
+#define PCAP_MAGIC_US 0xa1b2c3d4
+#define PCAP_MAGIC_NS 0xa1b23c4d
+#define PCAP_SWAP_US 0xd4c3b2a1
+#define PCAP_SWAP_NS 0x4d3cb2a1
+#define PCAP_MAX_SNAPLEN 262144
+
+PcapReader::PcapReader() : file(nullptr), swapped(false), nanoseconds(false), link_type(0)
+{
+}
+
+PcapReader::~PcapReader()
+{
+  if (file)
+    fclose(file);
+}
+
+uint32_t PcapReader::read32(const uint8_t *p) const
+{
+  if (swapped)
+    return (uint32_t)p[3] | ((uint32_t)p[2] << 8) | ((uint32_t)p[1] << 16) | ((uint32_t)p[0] << 24);
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+bool PcapReader::open(const char *path)
+{
+  file = fopen(path, "rb");
+  if (!file)
+    return false;
+
+  uint8_t header[24];
+  if (fread(header, 1, sizeof(header), file) != sizeof(header))
+    return false;
+
+  swapped = false;
+  uint32_t magic = read32(header);
+  switch (magic)
+  {
+  case PCAP_MAGIC_US:
+    break;
+  case PCAP_MAGIC_NS:
+    nanoseconds = true;
+    break;
+  case PCAP_SWAP_US:
+    swapped = true;
+    break;
+  case PCAP_SWAP_NS:
+    swapped = true;
+    nanoseconds = true;
+    break;
+  default:
+    return false; // pcapng or not a capture at all
+  }
+
+  link_type = read32(&header[20]) & 0x0FFFFFFF;
+  return true;
+}
+
+bool PcapReader::next(PcapRecord &record)
+{
+  uint8_t header[16];
+  if (!file || fread(header, 1, sizeof(header), file) != sizeof(header))
+    return false;
+
+  uint32_t seconds = read32(&header[0]);
+  uint32_t fraction = read32(&header[4]);
+  uint32_t incl_len = read32(&header[8]);
+  record.orig_len = read32(&header[12]);
+  record.timestamp_us = (uint64_t)seconds * 1000000 + (nanoseconds ? fraction / 1000 : fraction);
+
+  if (incl_len > PCAP_MAX_SNAPLEN)
+    return false;
+  record.data.resize(incl_len);
+  return fread(record.data.data(), 1, incl_len, file) == incl_len;
+}
+
+namespace
+{
+  // Alignment and size of the radiotap fields up to dBm antenna signal
+  const uint8_t fieldAlign[] = {8, 1, 1, 2, 2, 1};
+  const uint8_t fieldSize[] = {8, 1, 1, 4, 2, 1};
+
+  const uint8_t RADIOTAP_FLAGS = 1;
+  const uint8_t RADIOTAP_CHANNEL = 3;
+  const uint8_t RADIOTAP_DBM_ANTSIGNAL = 5;
+
+  const uint8_t FLAG_FCS = 0x10;
+  const uint8_t FLAG_BAD_FCS = 0x40;
+
+  uint8_t channelFromFrequency(uint16_t mhz)
+  {
+    if (mhz == 2484)
+      return 14;
+    if (mhz >= 2412 && mhz <= 2472)
+      return (mhz - 2407) / 5;
+    if (mhz >= 5000 && mhz <= 5900)
+      return (mhz - 5000) / 5;
+    return 0;
+  }
+}
+
+bool parseRadiotap(const uint8_t *data, size_t len, RadioInfo &info)
+{
+  if (len < 8 || data[0] != 0)
+    return false;
+
+  size_t header_len = data[2] | (data[3] << 8);
+  if (header_len > len)
+    return false;
+
+  uint32_t present = data[4] | (data[5] << 8) | (data[6] << 16) | ((uint32_t)data[7] << 24);
+
+  // Skip any extended presence bitmaps
+  size_t pos = 8;
+  uint32_t word = present;
+  while (word & 0x80000000)
+  {
+    if (pos + 4 > header_len)
+      return false;
+    word = (uint32_t)data[pos + 3] << 24;
+    pos += 4;
+  }
+
+  info.header_len = header_len;
+  info.has_fcs = false;
+  info.bad_fcs = false;
+
+  for (uint8_t field = 0; field <= RADIOTAP_DBM_ANTSIGNAL; field++)
+  {
+    if (!(present & (1u << field)))
+      continue;
+    pos = (pos + fieldAlign[field] - 1) & ~(size_t)(fieldAlign[field] - 1);
+    if (pos + fieldSize[field] > header_len)
+      return false;
+
+    switch (field)
+    {
+    case RADIOTAP_FLAGS:
+      info.has_fcs = data[pos] & FLAG_FCS;
+      info.bad_fcs = data[pos] & FLAG_BAD_FCS;
+      break;
+    case RADIOTAP_CHANNEL:
+      info.channel = channelFromFrequency(data[pos] | (data[pos + 1] << 8));
+      break;
+    case RADIOTAP_DBM_ANTSIGNAL:
+      info.rssi = (int8_t)data[pos];
+      break;
+    }
+    pos += fieldSize[field];
+  }
+  return true;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#define LINKTYPE_IEEE802_11 105
+#define LINKTYPE_IEEE802_11_RADIOTAP 127
+
+struct PcapRecord {
+  uint64_t timestamp_us;
+  uint32_t orig_len;
+  std::vector<uint8_t> data;
+};
+
+/**
+ * @brief Reader for classic libpcap files (not pcapng), either byte order,
+ * microsecond or nanosecond timestamps.
+ */
+class PcapReader {
+public:
+  PcapReader();
+  ~PcapReader();
+
+  bool open(const char *path);
+  bool next(PcapRecord &record);
+  uint32_t linkType() const { return link_type; }
+
+private:
+  uint32_t read32(const uint8_t *p) const;
+
+  FILE *file;
+  bool swapped;
+  bool nanoseconds;
+  uint32_t link_type;
+};
+
+/**
+ * @brief What the ESP32 radio would report for a captured frame.
+ */
+struct RadioInfo {
+  int8_t rssi;
+  uint8_t channel;
+  bool has_fcs;
+  bool bad_fcs;
+  size_t header_len; // Bytes before the 802.11 header
+};
+
+// Parses the radiotap header (LINKTYPE_IEEE802_11_RADIOTAP), false if malformed
+bool parseRadiotap(const uint8_t *data, size_t len, RadioInfo &info);
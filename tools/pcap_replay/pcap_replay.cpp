@@ -0,0 +1,572 @@
+/**
+ * Host-side replay of pcap captures through the real WiFi frame pipeline.
+ *
+ * Every 802.11 frame in the capture is wrapped in a wifi_promiscuous_pkt_t and
+ * handed to the promiscuous callback registered by WifiScanClass or
+ * WifiDetectClass, exactly like the WiFi driver does on the device. The
+ * processing task runs on its own thread. At the end the tool prints
+ * throughput, callback latency percentiles, queue statistics and the final
+ * list or detection contents.
+ *
+ * With --serial-pcap the replay also runs a serial pcap capture and stores
+ * everything written to the serial port in a file, then checks that the
+ * stream holds only the pcap records of the replayed frames.
+ */
+
+#include <Arduino.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "PcapReader.h"
+#include "ReplayShim.h"
+#include "AppPreferences.h"
+#include "WifiScan.h"
+#include "WifiDetect.h"
+#include "WifiDeviceList.h"
+#include "WifiNetworkList.h"
+#include "BLEDeviceList.h"
+#include "BLEStatusUpdater.h"
+#include "DetectionWatchlist.h"
+#include "Log.h"
+#include "FrameQuarantine.h"
+#include "HistoryStore.h"
+#include "PcapCapture.h"
+#include "Console.h"
+#include "ListSizes.h"
+
+#define DEFAULT_RSSI -50
+#define DEFAULT_CHANNEL 1
+#define FCS_LEN 4
+#define SIG_LEN_MAX 4095
+#define HISTORY_IMAGE_SIZE (1024 * 1024)
+
+// Globals normally defined by main.cpp and AppPreferences.cpp
+AppPreferencesData appPrefs;
+WifiDeviceList stationsList(MAX_STATIONS);
+WifiNetworkList ssidList(MAX_SSIDS);
+BLEDeviceList bleDeviceList(MAX_BLE_DEVICES);
+time_t base_time = 0;
+
+BLEStatusUpdaterClass BLEStatusUpdater;
+
+BLEStatusUpdaterClass::BLEStatusUpdaterClass() : generation(0), notifiedGeneration(0), lastNotify(0)
+{
+}
+
+void BLEStatusUpdaterClass::update()
+{
+}
+
+namespace
+{
+  struct Options {
+    bool detect = false;
+    bool sync = false;
+    bool realtime = false;
+    bool verbose = false;
+    int loops = 1;
+    const char *learn = nullptr;
+    const char *capture = nullptr;
+    const char *history = nullptr;
+    const char *historyMac = nullptr;
+    int historyInterval = 0;
+    const char *serialPcap = nullptr;
+  };
+
+  struct ReplayResult {
+    uint64_t offered = 0;  // Frames handed to the callback
+    uint64_t filtered = 0; // Frames rejected by the promiscuous filter
+    uint64_t skipped = 0;  // Records that are not usable 802.11 frames
+    double seconds = 0;
+    std::vector<uint32_t> callbackNs;
+    std::vector<uint32_t> endToEndNs;
+    std::vector<std::vector<uint8_t>> frames; // Offered frames, kept for --serial-pcap
+  };
+
+  void usage()
+  {
+    fprintf(stderr,
+            "usage: pcap_replay [options] capture.pcap\n"
+            "  --detect          replay through WifiDetect instead of WifiScan\n"
+            "  --learn FILE      scan FILE first to build the lists used by --detect\n"
+            "  --sync            wait for each frame to be processed, measures end-to-end latency\n"
+            "  --realtime        pace the frames at the capture timestamps\n"
+            "  --loops N         replay the capture N times\n"
+            "  --min-rssi N      minimal RSSI (default -100)\n"
+            "  --detect-rssi N   proximity a watched device needs to be detected (default -100)\n"
+            "  --mgmt-only       only management frames\n"
+            "  --history IMAGE   record the final lists in a history partition image (created if missing)\n"
+            "  --history-mac MAC list the sightings of MAC stored in the history image\n"
+            "  --history-interval N  also record the sightings every N frames, like the periodic save\n"
+            "  --verbose         show the firmware serial output\n"
+            "  --serial-pcap FILE capture with the serial pcap sink, store the serial output in FILE\n"
+            "                    and check that it is a valid pcap stream\n");
+  }
+
+  FrameQueueStats queueStats(bool detect)
+  {
+    return detect ? WifiDetector.getQueueStats() : WifiScanner.getQueueStats();
+  }
+
+  void waitUntilDrained(bool detect)
+  {
+    for (;;)
+    {
+      FrameQueueStats stats = queueStats(detect);
+      if (stats.processed == stats.pushed)
+        return;
+      std::this_thread::yield();
+    }
+  }
+
+  wifi_promiscuous_pkt_type_t packetType(const uint8_t *frame)
+  {
+    switch ((frame[0] & 0x0C) >> 2)
+    {
+    case 0:
+      return WIFI_PKT_MGMT;
+    case 1:
+      return WIFI_PKT_CTRL;
+    case 2:
+      return WIFI_PKT_DATA;
+    default:
+      return WIFI_PKT_MISC;
+    }
+  }
+
+  bool replay(const char *path, const Options &options, bool detect, int loops, ReplayResult &result)
+  {
+    PcapReader reader;
+    if (!reader.open(path))
+    {
+      fprintf(stderr, "%s: not a readable pcap file\n", path);
+      return false;
+    }
+    if (reader.linkType() != LINKTYPE_IEEE802_11 && reader.linkType() != LINKTYPE_IEEE802_11_RADIOTAP)
+    {
+      fprintf(stderr, "%s: unsupported link type %u\n", path, reader.linkType());
+      return false;
+    }
+
+    // Load everything first so file IO stays out of the measurements
+    std::vector<PcapRecord> records;
+    PcapRecord record;
+    while (reader.next(record))
+      records.push_back(record);
+
+    std::vector<uint8_t> packet(sizeof(wifi_promiscuous_pkt_t) + SIG_LEN_MAX);
+    wifi_promiscuous_pkt_t *pkt = reinterpret_cast<wifi_promiscuous_pkt_t *>(packet.data());
+    uint64_t firstTimestamp = records.empty() ? 0 : records[0].timestamp_us;
+    uint64_t loopOffset = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int loop = 0; loop < loops; loop++)
+    {
+      for (const PcapRecord &rec : records)
+      {
+        RadioInfo radio = {DEFAULT_RSSI, DEFAULT_CHANNEL, false, false, 0};
+        if (reader.linkType() == LINKTYPE_IEEE802_11_RADIOTAP && !parseRadiotap(rec.data.data(), rec.data.size(), radio))
+        {
+          result.skipped++;
+          continue;
+        }
+
+        const uint8_t *frame = rec.data.data() + radio.header_len;
+        size_t frameLen = rec.data.size() - radio.header_len;
+        if (radio.has_fcs && frameLen >= FCS_LEN)
+          frameLen -= FCS_LEN;
+        if (frameLen < 2 || frameLen + FCS_LEN > SIG_LEN_MAX)
+        {
+          result.skipped++;
+          continue;
+        }
+
+        wifi_promiscuous_pkt_type_t type = packetType(frame);
+        wifi_promiscuous_cb_t callback = shimRxCallback();
+        if (callback == nullptr || !shimAccepts(type))
+        {
+          result.filtered++;
+          continue;
+        }
+
+        // The driver hands over the frame with its FCS, sig_len includes it
+        memset(&pkt->rx_ctrl, 0, sizeof(pkt->rx_ctrl));
+        pkt->rx_ctrl.rssi = radio.rssi;
+        pkt->rx_ctrl.channel = radio.channel;
+        pkt->rx_ctrl.sig_len = frameLen + FCS_LEN;
+        pkt->rx_ctrl.rx_state = radio.bad_fcs ? 1 : 0;
+        memcpy(pkt->payload, frame, frameLen);
+        memset(pkt->payload + frameLen, 0, FCS_LEN);
+
+        uint64_t offset_us = loopOffset + rec.timestamp_us - firstTimestamp;
+        shimSetMillis(offset_us / 1000);
+        if (options.realtime)
+          std::this_thread::sleep_until(start + std::chrono::microseconds(offset_us));
+
+        if (options.serialPcap)
+        {
+          result.frames.emplace_back(frame, frame + frameLen);
+          // Console traffic the gate has to hold back, like the status lines of the firmware loops
+          if (result.offered % 1000 == 0)
+          {
+            Console.printf(">> Replayed %llu frames\n", (unsigned long long)result.offered);
+            LOG_INFO("Replayed %u frames", (unsigned)result.offered);
+          }
+        }
+
+        auto before = std::chrono::steady_clock::now();
+        callback(pkt, type);
+        auto after = std::chrono::steady_clock::now();
+        result.callbackNs.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(after - before).count());
+        result.offered++;
+
+        if (options.sync)
+        {
+          waitUntilDrained(detect);
+          auto processed = std::chrono::steady_clock::now();
+          result.endToEndNs.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(processed - before).count());
+        }
+        if (options.historyInterval > 0 && result.offered % options.historyInterval == 0)
+          historyStore.recordSightings();
+      }
+      if (!records.empty())
+        loopOffset += records.back().timestamp_us - firstTimestamp + 1000;
+    }
+    waitUntilDrained(detect);
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return true;
+  }
+
+  uint32_t percentile(std::vector<uint32_t> &values, double p)
+  {
+    if (values.empty())
+      return 0;
+    size_t index = std::min(values.size() - 1, static_cast<size_t>(p * values.size()));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+  }
+
+  void printLatency(const char *label, std::vector<uint32_t> &values)
+  {
+    if (values.empty())
+      return;
+    printf("%-14s p50 %6u ns  p90 %6u ns  p99 %6u ns  max %7u ns\n", label,
+           percentile(values, 0.50), percentile(values, 0.90), percentile(values, 0.99),
+           *std::max_element(values.begin(), values.end()));
+  }
+
+  void printResult(const char *path, bool detect, ReplayResult &result)
+  {
+    FrameQueueStats stats = queueStats(detect);
+    printf("== %s via %s\n", path, detect ? "WifiDetect" : "WifiScan");
+    printf("Frames offered: %llu, filtered: %llu, skipped: %llu\n",
+           (unsigned long long)result.offered, (unsigned long long)result.filtered, (unsigned long long)result.skipped);
+    printf("Queue pushed: %u, processed: %u, dropped: %u, high water: %u\n",
+           stats.pushed, stats.processed, stats.dropped, stats.high_water);
+    printf("Elapsed: %.3f s, offered %.0f frames/s, processed %.0f frames/s\n", result.seconds,
+           result.seconds > 0 ? result.offered / result.seconds : 0.0,
+           result.seconds > 0 ? stats.processed / result.seconds : 0.0);
+    printLatency("Callback:", result.callbackNs);
+    printLatency("End-to-end:", result.endToEndNs);
+    logger.flush();
+    LogStats logStats = logger.getStats();
+    printf("Log messages written: %u, dropped: %u\n", logStats.logged, logStats.dropped);
+    printf("%s\n", frameQuarantine.getSummary().c_str());
+    if (!detect)
+      printf("%s", WifiScanner.getCaptureStats().toString().c_str());
+  }
+
+  void printLists()
+  {
+    auto stations = stationsList.getClonedList();
+    printf("\nStations (%zu):\n", stations.size());
+    for (const auto &device : stations)
+    {
+      printf("  %s  bssid %s  rssi %4d  ch %2u  seen %5u  last %ld\n", device.address.toString().c_str(),
+             device.bssid.toString().c_str(), device.rssi, device.channel, device.times_seen, (long)device.last_seen);
+    }
+
+    auto networks = ssidList.getClonedList();
+    printf("\nNetworks (%zu):\n", networks.size());
+    for (const auto &network : networks)
+    {
+      printf("  %-32s  %s  %-7s rssi %4d  ch %2u  seen %5u  last %ld\n", stringArena.get(network.ssid).c_str(),
+             network.address.toString().c_str(), frameKindName(network.type), network.rssi, network.channel,
+             network.times_seen, (long)network.last_seen);
+    }
+  }
+
+  bool printSighting(const HistoryRecord &record, void *)
+  {
+    printf("  %10u  %-7s %s  rssi %4d  ch %2u  seen %5u\n", record.timestamp, historyKindName(record.kind),
+           MacAddress(record.address).toString().c_str(), record.rssi, record.channel, record.times_seen);
+    return true;
+  }
+
+  void printHistory(const char *mac)
+  {
+    historyStore.recordSightings();
+    HistoryStats stats = historyStore.getStats();
+    printf("\nHistory: %u sightings recorded, %u stored of %u, time %u-%u, erase count %u-%u, write errors %u\n",
+           stats.appended, stats.records, stats.capacity, stats.oldest, stats.newest, stats.min_erase_count,
+           stats.max_erase_count, stats.write_errors);
+    if (mac == nullptr)
+      return;
+
+    HistoryQuery query;
+    memset(&query, 0, sizeof(query));
+    query.to = UINT32_MAX;
+    unsigned int bytes[6];
+    if (sscanf(mac, "%x:%x:%x:%x:%x:%x", &bytes[0], &bytes[1], &bytes[2], &bytes[3], &bytes[4], &bytes[5]) != 6)
+    {
+      fprintf(stderr, "%s: not a MAC address\n", mac);
+      return;
+    }
+    for (int i = 0; i < 6; i++)
+      query.address[i] = bytes[i];
+    printf("Sightings of %s:\n", mac);
+    size_t matches = historyStore.query(query, printSighting, nullptr);
+    printf("  %zu sightings\n", matches);
+  }
+
+  uint32_t le32(const uint8_t *p)
+  {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+  }
+
+  /**
+   * @brief Checks the serial output of a capture against the replayed frames.
+   *
+   * Text printed before the capture started is skipped, the pcap header must
+   * follow it. Then exactly captured records must parse, each holding one of
+   * the offered frames (in order, the ring may have dropped some). Anything
+   * after the last record was printed once the capture stopped.
+   */
+  bool checkSerialPcap(const char *path, const std::vector<std::vector<uint8_t>> &frames, uint32_t captured)
+  {
+    FILE *file = fopen(path, "rb");
+    if (file == nullptr)
+    {
+      fprintf(stderr, "%s: cannot read the serial output\n", path);
+      return false;
+    }
+    std::vector<uint8_t> stream;
+    uint8_t buffer[4096];
+    size_t len;
+    while ((len = fread(buffer, 1, sizeof(buffer), file)) > 0)
+      stream.insert(stream.end(), buffer, buffer + len);
+    fclose(file);
+
+    static const uint8_t magic[4] = {0xd4, 0xc3, 0xb2, 0xa1};
+    auto start = std::search(stream.begin(), stream.end(), magic, magic + 4);
+    size_t offset = start - stream.begin();
+    if (start == stream.end() || stream.size() - offset < 24 || le32(&stream[offset + 20]) != LINKTYPE_IEEE802_11_RADIOTAP)
+    {
+      fprintf(stderr, "%s: no pcap header in the serial output\n", path);
+      return false;
+    }
+    size_t leading = offset;
+    uint32_t snaplen = le32(&stream[offset + 16]);
+    offset += 24;
+
+    size_t next = 0;
+    for (uint32_t i = 0; i < captured; i++)
+    {
+      const uint8_t *header = stream.data() + offset;
+      uint32_t inclLen = offset + 16 <= stream.size() ? le32(&header[8]) : 0;
+      RadioInfo radio;
+      if (inclLen == 0 || le32(&header[4]) >= 1000000 || inclLen > snaplen || inclLen > le32(&header[12]) ||
+          offset + 16 + inclLen > stream.size() || !parseRadiotap(&header[16], inclLen, radio))
+      {
+        fprintf(stderr, "%s: record %u at offset %zu is not valid\n", path, i, offset);
+        return false;
+      }
+      const uint8_t *frame = &header[16 + radio.header_len];
+      size_t frameLen = inclLen - radio.header_len;
+      while (next < frames.size() &&
+             (frames[next].size() < frameLen || memcmp(frames[next].data(), frame, frameLen) != 0))
+        next++;
+      if (next == frames.size())
+      {
+        fprintf(stderr, "%s: record %u at offset %zu does not hold a replayed frame\n", path, i, offset);
+        return false;
+      }
+      next++;
+      offset += 16 + inclLen;
+    }
+    printf("Serial pcap: %u records valid, %zu bytes before the header, %zu after the last record\n", captured,
+           leading, stream.size() - offset);
+    return true;
+  }
+
+  FILE *startSerialCapture(const char *path)
+  {
+    FILE *file = fopen(path, "wb");
+    if (file == nullptr)
+    {
+      fprintf(stderr, "%s: cannot create the serial output\n", path);
+      return nullptr;
+    }
+    shimSetSerialOutput(file);
+    if (!pcapCapture.start(PcapSink::Serial, PCAP_MAX_SNAPLEN))
+    {
+      shimSetSerialOutput(nullptr);
+      fclose(file);
+      return nullptr;
+    }
+    return file;
+  }
+
+  // Returns the number of records written
+  uint32_t stopSerialCapture(FILE *file)
+  {
+    pcapCapture.stop();
+    // The writer opens the console again once the last record is out
+    while (!Console.isOpen())
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    shimSetSerialOutput(nullptr);
+    fclose(file);
+    return pcapCapture.getStats().captured;
+  }
+
+  // Replays the main capture, under a serial pcap capture with --serial-pcap
+  bool replayCapture(const Options &options, bool detect, ReplayResult &result)
+  {
+    FILE *serial = nullptr;
+    if (options.serialPcap && (serial = startSerialCapture(options.serialPcap)) == nullptr)
+      return false;
+    bool ok = replay(options.capture, options, detect, options.loops, result);
+    if (serial)
+    {
+      uint32_t captured = stopSerialCapture(serial);
+      ok = ok && checkSerialPcap(options.serialPcap, result.frames, captured);
+    }
+    return ok;
+  }
+
+  void printDetections()
+  {
+    auto devices = WifiDetector.getDetectedDevices();
+    printf("\nDetected devices (%zu):\n", devices.size());
+    for (const auto &device : devices)
+    {
+      printf("  %s\n", device.toString().c_str());
+    }
+
+    auto networks = WifiDetector.getDetectedNetworks();
+    printf("\nDetected networks (%zu):\n", networks.size());
+    for (const auto &network : networks)
+    {
+      printf("  %s\n", network.c_str());
+    }
+  }
+}
+
+int main(int argc, char **argv)
+{
+  Options options;
+  memset(&appPrefs, 0, sizeof(appPrefs));
+  appPrefs.minimal_rssi = -100;
+  appPrefs.detect_rssi = -100;
+  appPrefs.only_management_frames = false;
+
+  for (int i = 1; i < argc; i++)
+  {
+    String arg(argv[i]);
+    if (arg == "--detect")
+      options.detect = true;
+    else if (arg == "--sync")
+      options.sync = true;
+    else if (arg == "--realtime")
+      options.realtime = true;
+    else if (arg == "--verbose")
+      options.verbose = true;
+    else if (arg == "--mgmt-only")
+      appPrefs.only_management_frames = true;
+    else if (arg == "--learn" && i + 1 < argc)
+      options.learn = argv[++i];
+    else if (arg == "--loops" && i + 1 < argc)
+      options.loops = std::max(1, atoi(argv[++i]));
+    else if (arg == "--history" && i + 1 < argc)
+      options.history = argv[++i];
+    else if (arg == "--history-mac" && i + 1 < argc)
+      options.historyMac = argv[++i];
+    else if (arg == "--history-interval" && i + 1 < argc)
+      options.historyInterval = std::max(1, atoi(argv[++i]));
+    else if (arg == "--serial-pcap" && i + 1 < argc)
+      options.serialPcap = argv[++i];
+    else if (arg == "--min-rssi" && i + 1 < argc)
+      appPrefs.minimal_rssi = atoi(argv[++i]);
+    else if (arg == "--detect-rssi" && i + 1 < argc)
+      appPrefs.detect_rssi = atoi(argv[++i]);
+    else if (argv[i][0] != '-' && options.capture == nullptr)
+      options.capture = argv[i];
+    else
+    {
+      usage();
+      return 2;
+    }
+  }
+  if (options.capture == nullptr || (options.learn && !options.detect) || ((options.historyMac || options.historyInterval) && !options.history))
+  {
+    usage();
+    return 2;
+  }
+
+  shimSetSerialEnabled(options.verbose);
+  logger.begin();
+
+  if (options.history)
+  {
+    if (!shimMapPartition(HISTORY_PARTITION_LABEL, HISTORY_PARTITION_SUBTYPE, options.history, HISTORY_IMAGE_SIZE) ||
+        !historyStore.begin())
+      return 1;
+    // Like a reboot: the clock continues after the newest stored sighting
+    base_time = historyStore.getStats().newest + 1;
+  }
+
+  bool ok = true;
+  if (options.detect)
+  {
+    if (options.learn)
+    {
+      ReplayResult learnResult;
+      WifiScanner.setup();
+      ok = replay(options.learn, options, false, 1, learnResult);
+      WifiScanner.stop();
+      if (ok)
+        printResult(options.learn, false, learnResult);
+    }
+    if (ok)
+    {
+      detectionWatchlist.rebuild();
+      WifiDetector.setup();
+      ReplayResult result;
+      ok = replayCapture(options, true, result);
+      if (ok)
+      {
+        printResult(options.capture, true, result);
+        printDetections();
+      }
+    }
+  }
+  else
+  {
+    ReplayResult result;
+    WifiScanner.setup();
+    ok = replayCapture(options, false, result);
+    if (ok)
+    {
+      printResult(options.capture, false, result);
+      printLists();
+      if (options.history)
+        printHistory(options.historyMac);
+    }
+  }
+
+  // The processing tasks never return, leave without running destructors under them
+  fflush(stdout);
+  std::_Exit(ok ? 0 : 1);
+}
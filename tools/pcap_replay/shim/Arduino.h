@@ -0,0 +1,79 @@
+#pragma once
+
+// Minimal Arduino core replacement for the host build of the frame pipeline.
+// Only what the replayed sources use is provided.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <cstdarg>
+#include <cctype>
+#include <ctime>
+#include <string>
+#include <type_traits>
+
+class String {
+public:
+  String() {}
+  String(const char *c) : s(c ? c : "") {}
+  String(const std::string &x) : s(x) {}
+  template <typename T, typename = typename std::enable_if<std::is_arithmetic<T>::value>::type>
+  explicit String(T v) : s(std::to_string(v)) {}
+
+  const char *c_str() const { return s.c_str(); }
+  size_t length() const { return s.size(); }
+  bool isEmpty() const { return s.empty(); }
+  bool operator==(const String &o) const { return s == o.s; }
+  bool operator!=(const String &o) const { return s != o.s; }
+  bool operator==(const char *o) const { return s == o; }
+  bool operator!=(const char *o) const { return s != o; }
+  bool operator<(const String &o) const { return s < o.s; }
+  String &operator+=(const String &o) { s += o.s; return *this; }
+  String &operator+=(const char *o) { s += o; return *this; }
+  String &operator+=(char c) { s += c; return *this; }
+  friend String operator+(const String &a, const String &b) { return String(a.s + b.s); }
+  friend String operator+(const String &a, const char *b) { return String(a.s + b); }
+  friend String operator+(const char *a, const String &b) { return String(a + b.s); }
+  char operator[](size_t i) const { return s[i]; }
+
+private:
+  std::string s;
+};
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *data, size_t len);
+  virtual void flush() {}
+  int printf(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+  size_t print(const char *x) { return write(reinterpret_cast<const uint8_t *>(x), strlen(x)); }
+  size_t print(const String &x) { return print(x.c_str()); }
+  size_t println(const char *x = "") { return print(x) + print("\n"); }
+  size_t println(const String &x) { return println(x.c_str()); }
+};
+
+class HardwareSerial : public Print {
+public:
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *data, size_t len) override;
+  void begin(unsigned long) {}
+  void setDebugOutput(bool) {}
+  void flush() override;
+};
+
+extern HardwareSerial Serial;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+uint32_t esp_random();
+
+struct EspClass {
+  uint32_t getFreeHeap() { return 0; }
+  void restart() { exit(0); }
+};
+
+extern EspClass ESP;
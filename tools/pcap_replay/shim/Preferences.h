@@ -0,0 +1,7 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Only the type is needed, nothing is persisted in the host build
+class Preferences {
+};
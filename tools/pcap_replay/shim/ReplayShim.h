@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include "esp_wifi.h"
+
+// Driver state exposed to the replay harness
+
+// Callback registered with esp_wifi_set_promiscuous_rx_cb, nullptr if none
+wifi_promiscuous_cb_t shimRxCallback();
+// True if promiscuous mode is enabled and the filter accepts the packet type
+bool shimAccepts(wifi_promiscuous_pkt_type_t type);
+
+// millis() returns this virtual clock once set, so records age with the capture timestamps
+void shimSetMillis(unsigned long ms);
+
+void shimSetSerialEnabled(bool enabled);
+// Everything written to Serial goes to file instead of stdout, even when disabled; nullptr restores stdout
+void shimSetSerialOutput(FILE *file);
+
+// Backs a data partition with an image file, created erased if it does not exist.
+// Writes go through to the file, so the image can be inspected or reused.
+bool shimMapPartition(const char *label, int subtype, const char *path, uint32_t size);
@@ -0,0 +1,352 @@
+#include <Arduino.h>
+#include <WiFi.h>
+#include <esp_wifi.h>
+#include <esp_timer.h>
+#include <esp_partition.h>
+#include "freertos/task.h"
+#include "ReplayShim.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+HardwareSerial Serial;
+EspClass ESP;
+WiFiClass WiFi;
+
+namespace
+{
+  std::atomic<bool> serialEnabled(true);
+  std::atomic<FILE *> serialOutput(nullptr);
+  std::atomic<bool> virtualClock(false);
+  std::atomic<unsigned long> virtualMillis(0);
+  const std::chrono::steady_clock::time_point bootTime = std::chrono::steady_clock::now();
+
+  std::atomic<wifi_promiscuous_cb_t> rxCallback(nullptr);
+  std::atomic<bool> promiscuous(false);
+  std::atomic<uint32_t> filterMask(WIFI_PROMIS_FILTER_MASK_ALL);
+
+  struct ShimTask {
+    std::mutex mutex;
+    std::condition_variable cv;
+    uint32_t notifications = 0;
+  };
+
+  thread_local ShimTask *currentTask = nullptr;
+
+  // Data partition backed by an image file, with NOR flash semantics
+  struct ShimPartition {
+    esp_partition_t info;
+    std::string path;
+    std::vector<uint8_t> data;
+  };
+
+  const size_t FLASH_SECTOR_SIZE = 4096;
+  std::mutex partitionMutex;
+  std::vector<std::unique_ptr<ShimPartition>> partitions;
+
+  ShimPartition *findPartition(const esp_partition_t *partition)
+  {
+    for (auto &p : partitions)
+    {
+      if (&p->info == partition)
+        return p.get();
+    }
+    return nullptr;
+  }
+
+  bool inRange(const ShimPartition *p, size_t offset, size_t size)
+  {
+    return p != nullptr && offset <= p->data.size() && size <= p->data.size() - offset;
+  }
+
+  void persist(const ShimPartition *p, size_t offset, size_t size)
+  {
+    FILE *file = fopen(p->path.c_str(), "r+b");
+    if (file == nullptr)
+      return;
+    fseek(file, offset, SEEK_SET);
+    fwrite(p->data.data() + offset, 1, size, file);
+    fclose(file);
+  }
+}
+
+size_t Print::write(const uint8_t *data, size_t len)
+{
+  size_t written = 0;
+  while (written < len && write(data[written]) == 1)
+  {
+    written++;
+  }
+  return written;
+}
+
+int Print::printf(const char *fmt, ...)
+{
+  va_list ap;
+  va_start(ap, fmt);
+  int len = vsnprintf(nullptr, 0, fmt, ap);
+  va_end(ap);
+  if (len <= 0)
+    return 0;
+  std::vector<char> text(len + 1);
+  va_start(ap, fmt);
+  vsnprintf(text.data(), text.size(), fmt, ap);
+  va_end(ap);
+  return write(reinterpret_cast<const uint8_t *>(text.data()), len);
+}
+
+size_t HardwareSerial::write(const uint8_t *data, size_t len)
+{
+  FILE *output = serialOutput.load(std::memory_order_relaxed);
+  if (output == nullptr && !serialEnabled.load(std::memory_order_relaxed))
+    return 0;
+  return fwrite(data, 1, len, output != nullptr ? output : stdout);
+}
+
+void HardwareSerial::flush()
+{
+  FILE *output = serialOutput.load(std::memory_order_relaxed);
+  fflush(output != nullptr ? output : stdout);
+}
+
+unsigned long millis()
+{
+  if (virtualClock.load(std::memory_order_relaxed))
+    return virtualMillis.load(std::memory_order_relaxed);
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - bootTime).count();
+}
+
+unsigned long micros()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - bootTime).count();
+}
+
+int64_t esp_timer_get_time()
+{
+  return micros();
+}
+
+void delay(unsigned long ms)
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+uint32_t esp_random()
+{
+  static std::mt19937 generator(std::random_device{}());
+  return generator();
+}
+
+esp_err_t esp_wifi_set_promiscuous_rx_cb(wifi_promiscuous_cb_t cb)
+{
+  rxCallback.store(cb);
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_promiscuous(bool en)
+{
+  promiscuous.store(en);
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_promiscuous_filter(const wifi_promiscuous_filter_t *filter)
+{
+  filterMask.store(filter->filter_mask);
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_channel(uint8_t, wifi_second_chan_t)
+{
+  return ESP_OK;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *, uint32_t, void *param,
+                                   UBaseType_t, TaskHandle_t *handle, BaseType_t)
+{
+  ShimTask *task = new ShimTask();
+  if (handle)
+    *handle = task;
+  std::thread([fn, param, task]()
+              {
+                currentTask = task;
+                fn(param);
+              }).detach();
+  return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t)
+{
+  // Threads cannot be killed from outside, the harness exits instead
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+  delay(ticks);
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks)
+{
+  ShimTask *task = currentTask;
+  if (task == nullptr)
+    return 0;
+  std::unique_lock<std::mutex> lock(task->mutex);
+  auto ready = [task]() { return task->notifications > 0; };
+  if (ticks == portMAX_DELAY)
+    task->cv.wait(lock, ready);
+  else
+    task->cv.wait_for(lock, std::chrono::milliseconds(ticks), ready);
+  uint32_t value = task->notifications;
+  if (value > 0)
+    task->notifications = clearOnExit ? 0 : value - 1;
+  return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t handle)
+{
+  ShimTask *task = static_cast<ShimTask *>(handle);
+  {
+    std::lock_guard<std::mutex> lock(task->mutex);
+    task->notifications++;
+  }
+  task->cv.notify_one();
+  return pdPASS;
+}
+
+void taskYIELD()
+{
+  std::this_thread::yield();
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label)
+{
+  std::lock_guard<std::mutex> lock(partitionMutex);
+  for (auto &p : partitions)
+  {
+    if (p->info.type == type && p->info.subtype == subtype && (label == nullptr || strcmp(p->info.label, label) == 0))
+      return &p->info;
+  }
+  return nullptr;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t offset, void *dst, size_t size)
+{
+  std::lock_guard<std::mutex> lock(partitionMutex);
+  ShimPartition *p = findPartition(partition);
+  if (!inRange(p, offset, size))
+    return -1;
+  memcpy(dst, p->data.data() + offset, size);
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t offset, const void *src, size_t size)
+{
+  std::lock_guard<std::mutex> lock(partitionMutex);
+  ShimPartition *p = findPartition(partition);
+  if (!inRange(p, offset, size))
+    return -1;
+  // Programming only clears bits, like the real flash
+  const uint8_t *bytes = static_cast<const uint8_t *>(src);
+  for (size_t i = 0; i < size; i++)
+    p->data[offset + i] &= bytes[i];
+  persist(p, offset, size);
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size)
+{
+  std::lock_guard<std::mutex> lock(partitionMutex);
+  ShimPartition *p = findPartition(partition);
+  if (!inRange(p, offset, size) || offset % FLASH_SECTOR_SIZE != 0 || size % FLASH_SECTOR_SIZE != 0)
+    return -1;
+  memset(p->data.data() + offset, 0xFF, size);
+  persist(p, offset, size);
+  return ESP_OK;
+}
+
+bool shimMapPartition(const char *label, int subtype, const char *path, uint32_t size)
+{
+  std::unique_ptr<ShimPartition> p(new ShimPartition());
+  memset(&p->info, 0, sizeof(p->info));
+  p->info.type = ESP_PARTITION_TYPE_DATA;
+  p->info.subtype = subtype;
+  p->info.size = size;
+  strncpy(p->info.label, label, sizeof(p->info.label) - 1);
+  p->path = path;
+  p->data.assign(size, 0xFF);
+
+  // Keep an existing image, start an erased one otherwise
+  FILE *file = fopen(path, "rb");
+  if (file != nullptr)
+  {
+    size_t read = fread(p->data.data(), 1, size, file);
+    fclose(file);
+    if (read != size)
+    {
+      fprintf(stderr, "%s: image is not %u bytes\n", path, size);
+      return false;
+    }
+  }
+  else
+  {
+    file = fopen(path, "wb");
+    if (file == nullptr || fwrite(p->data.data(), 1, size, file) != size)
+    {
+      if (file)
+        fclose(file);
+      fprintf(stderr, "%s: cannot create the image\n", path);
+      return false;
+    }
+    fclose(file);
+  }
+
+  std::lock_guard<std::mutex> lock(partitionMutex);
+  partitions.push_back(std::move(p));
+  return true;
+}
+
+wifi_promiscuous_cb_t shimRxCallback()
+{
+  return rxCallback.load();
+}
+
+bool shimAccepts(wifi_promiscuous_pkt_type_t type)
+{
+  if (!promiscuous.load())
+    return false;
+  uint32_t mask = filterMask.load();
+  switch (type)
+  {
+  case WIFI_PKT_MGMT:
+    return mask & WIFI_PROMIS_FILTER_MASK_MGMT;
+  case WIFI_PKT_CTRL:
+    return mask & WIFI_PROMIS_FILTER_MASK_CTRL;
+  case WIFI_PKT_DATA:
+    return mask & WIFI_PROMIS_FILTER_MASK_DATA;
+  default:
+    return false;
+  }
+}
+
+void shimSetMillis(unsigned long ms)
+{
+  virtualMillis.store(ms, std::memory_order_relaxed);
+  virtualClock.store(true, std::memory_order_relaxed);
+}
+
+void shimSetSerialEnabled(bool enabled)
+{
+  serialEnabled.store(enabled);
+}
+
+void shimSetSerialOutput(FILE *file)
+{
+  serialOutput.store(file);
+}
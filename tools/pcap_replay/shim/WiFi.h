@@ -0,0 +1,17 @@
+#pragma once
+
+#include <Arduino.h>
+#include "esp_wifi.h"
+
+typedef enum { WIFI_OFF, WIFI_STA, WIFI_AP, WIFI_AP_STA } wifi_mode_t;
+typedef enum { WIFI_POWER_8_5dBm = 34 } wifi_power_t;
+
+class WiFiClass {
+public:
+  bool mode(wifi_mode_t) { return true; }
+  bool setTxPower(wifi_power_t) { return true; }
+  bool softAP(const char *, const char *, int, int, int, bool) { return true; }
+  bool softAPdisconnect(bool) { return true; }
+};
+
+extern WiFiClass WiFi;
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <cstdint>
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_ERROR_CHECK(x) (void)(x)
+
+typedef void *esp_event_handler_instance_t;
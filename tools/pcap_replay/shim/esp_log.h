@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstdarg>
+
+// ESP-IDF log hook, the host build has no IDF log output to redirect
+
+typedef int (*vprintf_like_t)(const char *, va_list);
+
+inline vprintf_like_t esp_log_set_vprintf(vprintf_like_t)
+{
+  return nullptr;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "esp_wifi_types.h"
+#include "esp_event.h"
+
+esp_err_t esp_wifi_set_promiscuous_rx_cb(wifi_promiscuous_cb_t cb);
+esp_err_t esp_wifi_set_promiscuous(bool en);
+esp_err_t esp_wifi_set_promiscuous_filter(const wifi_promiscuous_filter_t *filter);
+esp_err_t esp_wifi_set_channel(uint8_t primary, wifi_second_chan_t second);